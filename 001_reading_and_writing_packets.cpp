@@ -85,9 +85,9 @@ struct TestPacketA : public protocol2::Packet
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
-        serialize_int( stream, a, -10, 10 );
-        serialize_int( stream, b, -20, 20 );
-        serialize_int( stream, c, -30, 30 );
+        serialize_int_const( stream, a, -10, 10 );
+        serialize_int_const( stream, b, -20, 20 );
+        serialize_int_const( stream, c, -30, 30 );
         return true;
     }
 
@@ -120,9 +120,9 @@ struct TestPacketB : public protocol2::Packet
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
-        serialize_int( stream, numItems, 0, MaxItems );
+        serialize_int_const( stream, numItems, 0, MaxItems );
         for ( int i = 0; i < numItems; ++i )
-            serialize_int( stream, items[i], -100, +100 );
+            serialize_int_const( stream, items[i], -100, +100 );
         return true;
     }
 
@@ -259,6 +259,9 @@ int main()
 
     TestPacketFactory packetFactory;
 
+    protocol2::PacketInfo info( ProtocolId );
+    info.packetFactory = &packetFactory;
+
     for ( int i = 0; ( i < NumIterations || NumIterations < 0 ); ++i )
     {
         const int packetType = rand() % TEST_PACKET_NUM_TYPES;
@@ -273,10 +276,6 @@ int main()
 
         bool error = false;
 
-        protocol2::PacketInfo info;
-        info.protocolId = ProtocolId;
-        info.packetFactory = &packetFactory;
-
         const int bytesWritten = protocol2::WritePacket( info, writePacket, writeBuffer, MaxPacketSize );
 
         if ( bytesWritten > 0 )
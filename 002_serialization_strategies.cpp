@@ -336,7 +336,7 @@ template <int bits> struct compressed_quaternion
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
-        serialize_bits( stream, largest, 2 );
+        serialize_bits_const( stream, largest, 2 );
         serialize_bits( stream, integer_a, bits );
         serialize_bits( stream, integer_b, bits );
         serialize_bits( stream, integer_c, bits );
@@ -642,7 +642,7 @@ template <typename Stream> bool serialize_object_index_internal( Stream & stream
     serialize_bool( stream, twoBits );
     if ( twoBits )
     {
-        serialize_int( stream, difference, 2, 5 );
+        serialize_int_const( stream, difference, 2, 5 );
         if ( Stream::IsReading )
             current = previous + difference;
         previous = current;
@@ -657,7 +657,7 @@ template <typename Stream> bool serialize_object_index_internal( Stream & stream
     serialize_bool( stream, threeBits );
     if ( threeBits )
     {
-        serialize_int( stream, difference, 6, 13 );
+        serialize_int_const( stream, difference, 6, 13 );
         if ( Stream::IsReading )
             current = previous + difference;
         previous = current;
@@ -672,7 +672,7 @@ template <typename Stream> bool serialize_object_index_internal( Stream & stream
     serialize_bool( stream, fourBits );
     if ( fourBits )
     {
-        serialize_int( stream, difference, 14, 29 );
+        serialize_int_const( stream, difference, 14, 29 );
         if ( Stream::IsReading )
             current = previous + difference;
         previous = current;
@@ -687,7 +687,7 @@ template <typename Stream> bool serialize_object_index_internal( Stream & stream
     serialize_bool( stream, fiveBits );
     if ( fiveBits )
     {
-        serialize_int( stream, difference, 30, 61 );
+        serialize_int_const( stream, difference, 30, 61 );
         if ( Stream::IsReading )
             current = previous + difference;
         previous = current;
@@ -702,7 +702,7 @@ template <typename Stream> bool serialize_object_index_internal( Stream & stream
     serialize_bool( stream, sixBits );
     if ( sixBits )
     {
-        serialize_int( stream, difference, 62, 125 );
+        serialize_int_const( stream, difference, 62, 125 );
         if ( Stream::IsReading )
             current = previous + difference;
         previous = current;
@@ -711,7 +711,7 @@ template <typename Stream> bool serialize_object_index_internal( Stream & stream
 
     // [126,MaxObjects+1] (required in case we go from -1 directly to MaxObjects, eg. no objects to send...)
 
-    serialize_int( stream, difference, 126, MaxObjects + 1 );
+    serialize_int_const( stream, difference, 126, MaxObjects + 1 );
     if ( Stream::IsReading )
     {
         current = previous + difference;
@@ -898,6 +898,9 @@ int main()
 
     TestPacketFactory packetFactory;
 
+    protocol2::PacketInfo info( ProtocolId );
+    info.packetFactory = &packetFactory;
+
     for ( int i = 0; ( i < NumIterations || NumIterations < 0 ); ++i )
     {
         const int packetType = rand() % TEST_PACKET_NUM_TYPES;
@@ -912,10 +915,6 @@ int main()
 
         bool error = false;
 
-        protocol2::PacketInfo info;
-        info.protocolId = ProtocolId;
-        info.packetFactory = &packetFactory;
-
         const int bytesWritten = protocol2::WritePacket( info, writePacket, writeBuffer, MaxPacketSize );
 
         if ( bytesWritten > 0 )
@@ -75,20 +75,20 @@ struct FragmentPacket : public protocol2::Object
     int packetType;
     uint8_t fragmentId;
     uint8_t numFragments;
-    uint8_t fragmentData[MaxFragmentSize];
+    const uint8_t *fragmentData;        // points at the fragment data to send on write. points into the packet buffer on read
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
-        serialize_bits( stream, crc32, 32 );
-        serialize_bits( stream, sequence, 16 );
+        serialize_bits_const( stream, crc32, 32 );
+        serialize_bits_const( stream, sequence, 16 );
 
         packetType = 0;
-        serialize_int( stream, packetType, 0, TEST_PACKET_NUM_TYPES - 1 );
+        serialize_int_const( stream, packetType, 0, TEST_PACKET_NUM_TYPES - 1 );
         if ( packetType != 0 )
             return true;
 
-        serialize_bits( stream, fragmentId, 8 );
-        serialize_bits( stream, numFragments, 8 );
+        serialize_bits_const( stream, fragmentId, 8 );
+        serialize_bits_const( stream, numFragments, 8 );
 
         serialize_align( stream );
 
@@ -106,7 +106,7 @@ struct FragmentPacket : public protocol2::Object
         assert( fragmentSize > 0 );
         assert( fragmentSize <= MaxFragmentSize );
 
-        serialize_bytes( stream, fragmentData, fragmentSize );
+        serialize_bytes_view( stream, fragmentData, fragmentSize );
 
         return true;
     }
@@ -308,7 +308,7 @@ struct PacketBuffer
 
         if ( fragmentPacket.packetType == 0 )
         {
-            return ProcessFragment( data + PacketFragmentHeaderBytes, fragmentPacket.fragmentSize, fragmentPacket.sequence, fragmentPacket.fragmentId, fragmentPacket.numFragments );
+            return ProcessFragment( fragmentPacket.fragmentData, fragmentPacket.fragmentSize, fragmentPacket.sequence, fragmentPacket.fragmentId, fragmentPacket.numFragments );
         }
         else
         {
@@ -419,7 +419,7 @@ bool SplitPacketIntoFragments( uint16_t sequence, const uint8_t *packetData, int
         fragmentPacket.sequence = sequence;
         fragmentPacket.fragmentId = (uint8_t) i;
         fragmentPacket.numFragments = (uint8_t) numFragments;
-        memcpy( fragmentPacket.fragmentData, src, fragmentSize );
+        fragmentPacket.fragmentData = src;
 
         if ( !fragmentPacket.SerializeInternal( stream ) )
         {
@@ -491,9 +491,9 @@ struct TestPacketA : public protocol2::Packet
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
-        serialize_int( stream, a, -10, 10 );
-        serialize_int( stream, b, -20, 20 );
-        serialize_int( stream, c, -30, 30 );
+        serialize_int_const( stream, a, -10, 10 );
+        serialize_int_const( stream, b, -20, 20 );
+        serialize_int_const( stream, c, -30, 30 );
         return true;
     }
 
@@ -526,9 +526,9 @@ struct TestPacketB : public protocol2::Packet
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
-        serialize_int( stream, numItems, 0, MaxItems );
+        serialize_int_const( stream, numItems, 0, MaxItems );
         for ( int i = 0; i < numItems; ++i )
-            serialize_int( stream, items[i], -100, +100 );
+            serialize_int_const( stream, items[i], -100, +100 );
         return true;
     }
 
@@ -625,7 +625,7 @@ struct TestPacketHeader : public protocol2::Object
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
-        serialize_bits( stream, sequence, 16 );
+        serialize_bits_const( stream, sequence, 16 );
         return true;
     }
 
@@ -692,6 +692,9 @@ int main()
 
     TestPacketFactory packetFactory;
 
+    protocol2::PacketInfo info( ProtocolId );
+    info.packetFactory = &packetFactory;
+
     uint16_t sequence = 0;
 
     for ( int i = 0; ( i < NumIterations || NumIterations == -1 ); ++i )
@@ -710,10 +713,6 @@ int main()
         TestPacketHeader writePacketHeader;
         writePacketHeader.sequence = sequence;
 
-        protocol2::PacketInfo info;
-        info.protocolId = ProtocolId;
-        info.packetFactory = &packetFactory;
-
         const int bytesWritten = protocol2::WritePacket( info, writePacket, buffer, MaxPacketSize, &writePacketHeader );
 
         printf( "===================================================\n" );
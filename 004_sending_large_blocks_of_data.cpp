@@ -62,7 +62,7 @@ struct SlicePacket : public protocol2::Packet
     int sliceId;
     int numSlices;
     int sliceBytes;
-    uint8_t data[SliceSize];
+    const uint8_t *data;                // points into the chunk on write. points into the packet buffer on read
 
     SlicePacket() : Packet( SLICE_PACKET )
     {
@@ -70,23 +70,23 @@ struct SlicePacket : public protocol2::Packet
         sliceId = 0;
         numSlices = 0;
         sliceBytes = 0;
-        memset( data, 0, sizeof( data ) );
+        data = NULL;
     }
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
-        serialize_bits( stream, chunkId, 16 );
-        serialize_int( stream, sliceId, 0, MaxSlicesPerChunk - 1 );
-        serialize_int( stream, numSlices, 1, MaxSlicesPerChunk );
+        serialize_bits_const( stream, chunkId, 16 );
+        serialize_int_const( stream, sliceId, 0, MaxSlicesPerChunk - 1 );
+        serialize_int_const( stream, numSlices, 1, MaxSlicesPerChunk );
         if ( sliceId == numSlices - 1 )
         {
-            serialize_int( stream, sliceBytes, 1, SliceSize );
+            serialize_int_const( stream, sliceBytes, 1, SliceSize );
         }
         else if ( Stream::IsReading )
         {
             sliceBytes = SliceSize;
         }
-        serialize_bytes( stream, data, sliceBytes );
+        serialize_bytes_view( stream, data, sliceBytes );
         return true;
     }
 
@@ -108,8 +108,8 @@ struct AckPacket : public protocol2::Packet
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
-        serialize_bits( stream, chunkId, 16 );
-        serialize_int( stream, numSlices, 1, MaxSlicesPerChunk );
+        serialize_bits_const( stream, chunkId, 16 );
+        serialize_int_const( stream, numSlices, 1, MaxSlicesPerChunk );
         for ( int i = 0; i < numSlices; ++i )
             serialize_bool( stream, acked[i] );
         return true;
@@ -211,7 +211,7 @@ public:
                 packet->sliceId = sliceId;
                 packet->numSlices = numSlices;
                 packet->sliceBytes = ( sliceId == numSlices - 1 ) ? ( SliceSize - ( SliceSize * numSlices - chunkSize ) ) : SliceSize;
-                memcpy( packet->data, chunkData + sliceId * SliceSize, packet->sliceBytes );
+                packet->data = chunkData + sliceId * SliceSize;
                 printf( "sent slice %d of chunk %d (%d bytes)\n", sliceId, chunkId, packet->sliceBytes );
                 break;
             }
@@ -401,6 +401,8 @@ public:
     }
 };
 
+static const protocol2::PacketInfo seededPacketInfo( ProtocolId );
+
 static network2::Simulator simulator;
 
 void SendPacket( const network2::Address & from, const network2::Address & to, protocol2::Packet *packet )
@@ -409,8 +411,7 @@ void SendPacket( const network2::Address & from, const network2::Address & to, p
 
     uint8_t *packetData = new uint8_t[MaxPacketSize];
 
-    protocol2::PacketInfo info;
-    info.protocolId = ProtocolId;
+    protocol2::PacketInfo info = seededPacketInfo;
     info.packetFactory = &packetFactory;
 
     const int packetSize = protocol2::WritePacket( info, packet, packetData, MaxPacketSize );
@@ -427,15 +428,16 @@ void SendPacket( const network2::Address & from, const network2::Address & to, p
     packetFactory.DestroyPacket( packet );
 }
 
-protocol2::Packet * ReceivePacket( network2::Address & from, network2::Address & to )
+protocol2::Packet * ReceivePacket( network2::Address & from, network2::Address & to, uint8_t * & packetData )
 {
+    // slice packets point into the packet data, so the caller frees it once the packet has been processed
+
     int packetSize;
-    uint8_t* packetData = simulator.ReceivePacket( from, to, packetSize );
+    packetData = simulator.ReceivePacket( from, to, packetSize );
     if ( !packetData )
         return NULL;
 
-    protocol2::PacketInfo info;
-    info.protocolId = ProtocolId;
+    protocol2::PacketInfo info = seededPacketInfo;
     info.packetFactory = &packetFactory;
 
     int error = 0;
@@ -443,6 +445,12 @@ protocol2::Packet * ReceivePacket( network2::Address & from, network2::Address &
     if ( error != PROTOCOL2_ERROR_NONE )
         printf( "read packet error: %s\n", protocol2::GetErrorString( error ) );
 
+    if ( !packet )
+    {
+        delete [] packetData;
+        packetData = NULL;
+    }
+
     return packet;
 }
 
@@ -512,7 +520,8 @@ int main()
         while ( true )
         {
             network2::Address from, to;
-            protocol2::Packet *packet = ReceivePacket( from, to );
+            uint8_t *packetData;
+            protocol2::Packet *packet = ReceivePacket( from, to, packetData );
             if ( !packet )
                 break;
 
@@ -540,6 +549,8 @@ int main()
             }
 
             packetFactory.DestroyPacket( packet );
+
+            delete [] packetData;
         }
 
         simulator.Update( t );
@@ -85,9 +85,9 @@ struct TestPacketA : public protocol2::Packet
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
-        serialize_int( stream, a, -10, 10 );
-        serialize_int( stream, b, -20, 20 );
-        serialize_int( stream, c, -30, 30 );
+        serialize_int_const( stream, a, -10, 10 );
+        serialize_int_const( stream, b, -20, 20 );
+        serialize_int_const( stream, c, -30, 30 );
         return true;
     }
 
@@ -120,9 +120,9 @@ struct TestPacketB : public protocol2::Packet
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
-        serialize_int( stream, numItems, 0, MaxItems );
+        serialize_int_const( stream, numItems, 0, MaxItems );
         for ( int i = 0; i < numItems; ++i )
-            serialize_int( stream, items[i], -100, +100 );
+            serialize_int_const( stream, items[i], -100, +100 );
         return true;
     }
 
@@ -258,7 +258,7 @@ struct TestPacketHeader : public protocol2::Object
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
-        serialize_bits( stream, sequence, 16 );
+        serialize_bits_const( stream, sequence, 16 );
         return true;
     }
 
@@ -271,6 +271,9 @@ int main()
 
     TestPacketFactory packetFactory;
 
+    protocol2::PacketInfo info( ProtocolId );
+    info.packetFactory = &packetFactory;
+
     uint16_t sequence = 0;
 
     TestPacketHeader *readPacketHeaders[MaxPacketsPerIteration];
@@ -322,10 +325,6 @@ int main()
 
         int numPacketsActuallyWritten = 0;
 
-        protocol2::PacketInfo info;
-        info.protocolId = ProtocolId;
-        info.packetFactory = &packetFactory;
-
         const int bytesWritten = protocol2::WriteAggregatePacket( info, 
                                                                   numWritePackets,
                                                                   writePackets, 
@@ -366,9 +365,6 @@ int main()
 
             printf( "reading aggregate packet (%d bytes)\n", bytesToRead );
 
-            info.protocolId = ProtocolId;
-            info.packetFactory = &packetFactory;
-
             ReadAggregatePacket( info, MaxPacketsPerIteration, readPackets, readBuffer, bytesWritten, numReadPackets, NULL, (protocol2::Object**) readPacketHeaders, &readError );
 
             if ( readError != PROTOCOL2_ERROR_NONE )
@@ -43,6 +43,7 @@ const uint32_t ProtocolId = 0x12311616;
 const int MaxPacketSize = 4096;
 const int MaxMessagesPerPacket = 64; 
 const int SlidingWindowSize = 1024;
+const int AckWindowSize = 256;                                      // packets acked by each packet header: 32, 64, 128 or 256
 const int MessageSendQueueSize = 1024;
 const int MessageReceiveQueueSize = 256;
 const int MessagePacketBudget = 1024;
@@ -132,15 +133,15 @@ struct ConnectionPacket : public Packet
 {
     uint16_t sequence;
     uint16_t ack;
-    uint32_t ack_bits;
+    uint64_t ack_words[(AckWindowSize+63)/64];      // storage for ack_bits, inline so creating a packet doesn't allocate
+    BitArray ack_bits;
     int numMessages;
     Message * messages[MaxMessagesPerPacket];
 
-    ConnectionPacket() : Packet( CONNECTION_PACKET )
+    ConnectionPacket() : Packet( CONNECTION_PACKET ), ack_bits( ack_words, AckWindowSize )
     {
         sequence = 0;
         ack = 0;
-        ack_bits = 0;
         numMessages = 0;
     }
 
@@ -163,11 +164,11 @@ struct ConnectionPacket : public Packet
 
         // serialize ack system
 
-        serialize_bits( stream, sequence, 16 );
+        serialize_bits_const( stream, sequence, 16 );
 
-        serialize_bits( stream, ack, 16 );
+        serialize_bits_const( stream, ack, 16 );
 
-        serialize_bits( stream, ack_bits, 32 );
+        serialize_ack_bits( stream, ack_bits );
 
         // serialize messages
 
@@ -181,7 +182,7 @@ struct ConnectionPacket : public Packet
 
             const int maxMessageType = messageFactory->GetNumTypes() - 1;
 
-            serialize_int( stream, numMessages, 1, MaxMessagesPerPacket );
+            serialize_int_const( stream, numMessages, 1, MaxMessagesPerPacket );
 
             int messageTypes[MaxMessagesPerPacket];
 
@@ -203,7 +204,7 @@ struct ConnectionPacket : public Packet
 
             for ( int i = 0; i < numMessages; ++i )
             {
-                serialize_bits( stream, messageIds[i], 16 );
+                serialize_bits_const( stream, messageIds[i], 16 );
             }
 
             for ( int i = 0; i < numMessages; ++i )
@@ -306,7 +307,7 @@ protected:
 
     void InsertAckPacketEntry( uint16_t sequence );
 
-    void ProcessAcks( uint16_t ack, uint32_t ack_bits );
+    void ProcessAcks( uint16_t ack, const BitArray & ackBits );
 
     void GetMessagesToSend( uint16_t * messageIds, int & numMessageIds );
 
@@ -330,9 +331,9 @@ private:
 
     ConnectionError m_error;                                                        // connection error level
 
-    SequenceBuffer<SentPacketData> * m_sentPackets;                                 // sequence buffer of recently sent packets
+    SequenceBuffer<SentPacketData,SlidingWindowSize> * m_sentPackets;               // sequence buffer of recently sent packets
 
-    SequenceBuffer<ReceivedPacketData> * m_receivedPackets;                         // sequence buffer of recently received packets
+    SequenceBuffer<ReceivedPacketData,SlidingWindowSize> * m_receivedPackets;       // sequence buffer of recently received packets
 
     int m_messageOverheadBits;                                                      // number of bits overhead per-serialized message
 
@@ -342,13 +343,17 @@ private:
 
     uint16_t m_oldestUnackedMessageId;                                              // id for oldest unacked message in send queue
 
-    SequenceBuffer<MessageSendQueueEntry> * m_messageSendQueue;                     // message send queue
+    SequenceBuffer<MessageSendQueueEntry,MessageSendQueueSize> * m_messageSendQueue; // message send queue
 
-    SequenceBuffer<MessageSentPacketEntry> * m_messageSentPackets;                  // messages in sent packets (for acks)
+    SequenceBuffer<MessageSentPacketEntry,SlidingWindowSize> * m_messageSentPackets; // messages in sent packets (for acks)
 
-    SequenceBuffer<MessageReceiveQueueEntry> * m_messageReceiveQueue;               // message receive queue
+    SequenceBuffer<MessageReceiveQueueEntry,MessageReceiveQueueSize> * m_messageReceiveQueue; // message receive queue
 
     uint16_t * m_sentPacketMessageIds;                                              // array of message ids, n ids per-sent packet
+
+    uint16_t m_processedAck;                                                        // most recent ack processed
+
+    BitArray * m_processedAckBits;                                                  // ack bits already processed, relative to m_processedAck
 };
 
 Connection::Connection( PacketFactory & packetFactory, MessageFactory & messageFactory )
@@ -365,18 +370,20 @@ Connection::Connection( PacketFactory & packetFactory, MessageFactory & messageF
 
     m_messageOverheadBits = CalculateMessageOverheadBits();
 
-    m_sentPackets = new SequenceBuffer<SentPacketData>( SlidingWindowSize );
+    m_sentPackets = new SequenceBuffer<SentPacketData,SlidingWindowSize>();
     
-    m_receivedPackets = new SequenceBuffer<ReceivedPacketData>( SlidingWindowSize );
+    m_receivedPackets = new SequenceBuffer<ReceivedPacketData,SlidingWindowSize>();
 
-    m_messageSendQueue = new SequenceBuffer<MessageSendQueueEntry>( MessageSendQueueSize );
+    m_messageSendQueue = new SequenceBuffer<MessageSendQueueEntry,MessageSendQueueSize>();
     
-    m_messageSentPackets = new SequenceBuffer<MessageSentPacketEntry>( SlidingWindowSize );
+    m_messageSentPackets = new SequenceBuffer<MessageSentPacketEntry,SlidingWindowSize>();
     
-    m_messageReceiveQueue = new SequenceBuffer<MessageReceiveQueueEntry>( MessageReceiveQueueSize );
+    m_messageReceiveQueue = new SequenceBuffer<MessageReceiveQueueEntry,MessageReceiveQueueSize>();
     
     m_sentPacketMessageIds = new uint16_t[ MaxMessagesPerPacket * MessageSendQueueSize ];
 
+    m_processedAckBits = new BitArray( AckWindowSize );
+
     Reset();
 }
 
@@ -390,6 +397,7 @@ Connection::~Connection()
     assert( m_messageSentPackets );
     assert( m_messageReceiveQueue );
     assert( m_sentPacketMessageIds );
+    assert( m_processedAckBits );
 
     delete m_sentPackets;
     delete m_receivedPackets;
@@ -397,6 +405,7 @@ Connection::~Connection()
     delete m_messageSentPackets;
     delete m_messageReceiveQueue;
     delete [] m_sentPacketMessageIds;
+    delete m_processedAckBits;
 
     m_sentPackets = NULL;
     m_receivedPackets = NULL;
@@ -404,6 +413,7 @@ Connection::~Connection()
     m_messageSentPackets = NULL;
     m_messageReceiveQueue = NULL;
     m_sentPacketMessageIds = NULL;
+    m_processedAckBits = NULL;
 }
 
 void Connection::Reset()
@@ -415,6 +425,9 @@ void Connection::Reset()
     m_sentPackets->Reset();
     m_receivedPackets->Reset();
 
+    m_processedAck = 0;
+    m_processedAckBits->Clear();
+
     m_sendMessageId = 0;
     m_receiveMessageId = 0;
     m_oldestUnackedMessageId = 0;
@@ -559,12 +572,6 @@ bool Connection::ReadPacket( ConnectionPacket * packet )
 void Connection::AdvanceTime( double time )
 {
     m_time = time;
-
-    m_sentPackets->RemoveOldEntries();
-
-    m_receivedPackets->RemoveOldEntries();
-
-    m_messageSentPackets->RemoveOldEntries();
 }
 
 ConnectionError Connection::GetError() const
@@ -584,13 +591,32 @@ void Connection::InsertAckPacketEntry( uint16_t sequence )
     }
 }
 
-void Connection::ProcessAcks( uint16_t ack, uint32_t ack_bits )
+void Connection::ProcessAcks( uint16_t ack, const BitArray & ackBits )
 {
-    for ( int i = 0; i < 32; ++i )
+    // only bits set for the first time need work. line up the bits processed for the last ack with this one and skip them.
+    // an ack older than the last one is processed in full (rare, and acked packets are skipped anyway)
+
+    const bool newer = !sequence_less_than( ack, m_processedAck );
+
+    if ( newer )
+        m_processedAckBits->ShiftUp( uint16_t( ack - m_processedAck ) );
+
+    for ( int i = 0; i < ackBits.GetNumWords(); ++i )
     {
-        if ( ack_bits & 1 )
-        {                    
-            const uint16_t sequence = ack - i;
+        uint64_t bits = ackBits.GetWord( i );
+
+        if ( newer )
+        {
+            const uint64_t processed = m_processedAckBits->GetWord( i );
+            m_processedAckBits->SetWord( i, processed | bits );
+            bits &= ~processed;
+        }
+
+        while ( bits )
+        {
+            const uint16_t sequence = ack - ( ( i << 6 ) + count_trailing_zeros64( bits ) );
+
+            bits &= bits - 1;
 
             SentPacketData * packetData = m_sentPackets->Find( sequence );
             
@@ -601,9 +627,10 @@ void Connection::ProcessAcks( uint16_t ack, uint32_t ack_bits )
                 packetData->acked = 1;
             }
         }
-
-        ack_bits >>= 1;
     }
+
+    if ( newer )
+        m_processedAck = ack;
 }
 
 void Connection::GetMessagesToSend( uint16_t * messageIds, int & numMessageIds )
@@ -667,29 +694,37 @@ void Connection::AddMessagePacketEntry( const uint16_t * messageIds, int & numMe
 
 void Connection::ProcessPacketMessages( const ConnectionPacket * packet )
 {
-    const uint16_t minMessageId = m_receiveMessageId;
-    const uint16_t maxMessageId = m_receiveMessageId + MessageReceiveQueueSize - 1;
+    // classify all message ids in the packet against the receive window at once
+
+    uint16_t messageIds[MaxMessagesPerPacket];
+    uint8_t messageClasses[MaxMessagesPerPacket];
 
     for ( int i = 0; i < packet->numMessages; ++i )
     {
-        Message * message = packet->messages[i];
+        assert( packet->messages[i] );
+        messageIds[i] = packet->messages[i]->GetId();
+    }
 
-        assert( message );
+    ClassifySequences( messageIds, packet->numMessages, m_receiveMessageId, MessageReceiveQueueSize, messageClasses );
 
-        const uint16_t messageId = message->GetId();
+    for ( int i = 0; i < packet->numMessages; ++i )
+    {
+        Message * message = packet->messages[i];
 
-        if ( m_messageReceiveQueue->Find( messageId ) )
-            continue;
+        const uint16_t messageId = messageIds[i];
 
-        if ( sequence_less_than( messageId, minMessageId ) )
+        if ( messageClasses[i] == PROTOCOL2_SEQUENCE_TOO_OLD )
             continue;
 
-        if ( sequence_greater_than( messageId, maxMessageId ) )
+        if ( messageClasses[i] == PROTOCOL2_SEQUENCE_TOO_NEW )
         {
             m_error = CONNECTION_ERROR_MESSAGE_DESYNC;
             return;
         }
 
+        if ( m_messageReceiveQueue->Find( messageId ) )
+            continue;
+
         MessageReceiveQueueEntry * entry = m_messageReceiveQueue->Insert( messageId );
 
         assert( entry );
@@ -804,13 +839,13 @@ struct TestMessage : public Message
 
     template <typename Stream> bool Serialize( Stream & stream )
     {        
-        serialize_bits( stream, sequence, 16 );
+        serialize_bits_const( stream, sequence, 16 );
 
         int numBits = GetNumBitsForMessage( sequence );
         int numWords = numBits / 32;
         uint32_t dummy = 0;
         for ( int i = 0; i < numWords; ++i )
-            serialize_bits( stream, dummy, 32 );
+            serialize_bits_const( stream, dummy, 32 );
         int numRemainderBits = numBits - numWords * 32;
         if ( numRemainderBits > 0 )
             serialize_bits( stream, dummy, numRemainderBits );
@@ -844,15 +879,16 @@ protected:
     }
 };
 
+static const protocol2::PacketInfo seededPacketInfo( ProtocolId );
+
 void SendPacket( Simulator & simulator, void * context, PacketFactory & packetFactory, const Address & from, const Address & to, Packet * packet )
 {
     assert( packet );
 
     uint8_t * packetData = new uint8_t[MaxPacketSize];
 
-    protocol2::PacketInfo info;
+    protocol2::PacketInfo info = seededPacketInfo;
     info.context = context;
-    info.protocolId = ProtocolId;
     info.packetFactory = &packetFactory;
 
     const int packetSize = protocol2::WritePacket( info, packet, packetData, MaxPacketSize );
@@ -879,9 +915,8 @@ Packet * ReceivePacket( Simulator & simulator, void * context, PacketFactory & p
     if ( !packetData )
         return NULL;
 
-    protocol2::PacketInfo info;
+    protocol2::PacketInfo info = seededPacketInfo;
     info.context = context;
-    info.protocolId = ProtocolId;
     info.packetFactory = &packetFactory;
 
     Packet * packet = protocol2::ReadPacket( info, packetData, packetBytes, NULL );
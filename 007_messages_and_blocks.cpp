@@ -43,6 +43,7 @@ const uint32_t ProtocolId = 0x12341241;
 const int MaxPacketSize = 4096;
 const int MaxMessagesPerPacket = 64; 
 const int SlidingWindowSize = 1024;
+const int AckWindowSize = 256;                                      // packets acked by each packet header: 32, 64, 128 or 256
 const int MessageSendQueueSize = 1024;
 const int MessageReceiveQueueSize = 1024;
 const int MessagePacketBudget = 1024;
@@ -194,23 +195,23 @@ struct ConnectionPacket : public Packet
 {
     uint16_t sequence;
     uint16_t ack;
-    uint32_t ack_bits;
+    uint64_t ack_words[(AckWindowSize+63)/64];      // storage for ack_bits, inline so creating a packet doesn't allocate
+    BitArray ack_bits;
 
     int numMessages;
     Message * messages[MaxMessagesPerPacket];
 
-    uint8_t * blockFragmentData;
+    const uint8_t * blockFragmentData;              // points into the block message on write, into the packet buffer on read
     uint64_t blockMessageId : 16;
     uint64_t blockFragmentId : 16;
     uint64_t blockFragmentSize : 16;
     uint16_t blockNumFragments : 16;
     int blockMessageType;
 
-    ConnectionPacket() : Packet( CONNECTION_PACKET )
+    ConnectionPacket() : Packet( CONNECTION_PACKET ), ack_bits( ack_words, AckWindowSize )
     {
         sequence = 0;
         ack = 0;
-        ack_bits = 0;
         numMessages = 0;
         blockFragmentData = NULL;
         blockMessageId = 0;
@@ -230,12 +231,6 @@ struct ConnectionPacket : public Packet
         }
 
         numMessages = 0;
-
-        if ( blockFragmentData )
-        {
-            delete [] blockFragmentData;
-            blockFragmentData = NULL;
-        }
     }
 
     template <typename Stream> bool Serialize( Stream & stream )
@@ -250,11 +245,11 @@ struct ConnectionPacket : public Packet
 
         // serialize ack system
 
-        serialize_bits( stream, sequence, 16 );
+        serialize_bits_const( stream, sequence, 16 );
 
-        serialize_bits( stream, ack, 16 );
+        serialize_bits_const( stream, ack, 16 );
 
-        serialize_bits( stream, ack_bits, 32 );
+        serialize_ack_bits( stream, ack_bits );
 
         // serialize messages
 
@@ -264,7 +259,7 @@ struct ConnectionPacket : public Packet
 
         if ( hasMessages )
         {
-            serialize_int( stream, numMessages, 1, MaxMessagesPerPacket );
+            serialize_int_const( stream, numMessages, 1, MaxMessagesPerPacket );
 
             int messageTypes[MaxMessagesPerPacket];
 
@@ -286,7 +281,7 @@ struct ConnectionPacket : public Packet
 
             for ( int i = 0; i < numMessages; ++i )
             {
-                serialize_bits( stream, messageIds[i], 16 );
+                serialize_bits_const( stream, messageIds[i], 16 );
             }
 
             for ( int i = 0; i < numMessages; ++i )
@@ -325,9 +320,9 @@ struct ConnectionPacket : public Packet
 
         if ( hasFragment )
         {
-            serialize_bits( stream, blockMessageId, 16 );
+            serialize_bits_const( stream, blockMessageId, 16 );
 
-            serialize_int( stream, blockNumFragments, 1, MaxFragmentsPerBlock );
+            serialize_int_const( stream, blockNumFragments, 1, MaxFragmentsPerBlock );
 
             if ( blockNumFragments > 1 )
             {
@@ -338,17 +333,9 @@ struct ConnectionPacket : public Packet
                 blockFragmentId = 0;
             }
 
-            serialize_int( stream, blockFragmentSize, 1, BlockFragmentSize );
+            serialize_int_const( stream, blockFragmentSize, 1, BlockFragmentSize );
 
-            if ( Stream::IsReading )
-            {
-                blockFragmentData = new uint8_t[blockFragmentSize];
-
-                if ( !blockFragmentData )
-                    return false;
-            }
-
-            serialize_bytes( stream, blockFragmentData, blockFragmentSize );
+            serialize_bytes_view( stream, blockFragmentData, blockFragmentSize );
 
             if ( blockFragmentId == 0 )
             {
@@ -500,7 +487,7 @@ protected:
 
     void InsertAckPacketEntry( uint16_t sequence );
 
-    void ProcessAcks( uint16_t ack, uint32_t ack_bits );
+    void ProcessAcks( uint16_t ack, const BitArray & ackBits );
 
     bool HasMessagesToSend();
 
@@ -520,9 +507,9 @@ protected:
 
     bool SendingBlockMessage();
 
-    uint8_t * GetFragmentToSend( uint16_t & messageId, uint16_t & fragmentId, int & fragmentBytes, int & numFragments, int & messageType );
+    const uint8_t * GetFragmentToSend( uint16_t & messageId, uint16_t & fragmentId, int & fragmentBytes, int & numFragments, int & messageType );
 
-    void AddFragmentToPacket( uint16_t messageId, uint16_t fragmentId, uint8_t * fragmentData, int fragmentSize, int numFragments, int messageType, ConnectionPacket * packet );
+    void AddFragmentToPacket( uint16_t messageId, uint16_t fragmentId, const uint8_t * fragmentData, int fragmentSize, int numFragments, int messageType, ConnectionPacket * packet );
 
     void AddFragmentPacketEntry( uint16_t messageId, uint16_t fragmentId, uint16_t sequence );
 
@@ -538,9 +525,9 @@ private:
 
     ConnectionError m_error;                                                        // connection error level
 
-    SequenceBuffer<SentPacketData> * m_sentPackets;                                 // sequence buffer of recently sent packets
+    SequenceBuffer<SentPacketData,SlidingWindowSize> * m_sentPackets;               // sequence buffer of recently sent packets
 
-    SequenceBuffer<ReceivedPacketData> * m_receivedPackets;                         // sequence buffer of recently received packets
+    SequenceBuffer<ReceivedPacketData,SlidingWindowSize> * m_receivedPackets;       // sequence buffer of recently received packets
 
     int m_messageOverheadBits;                                                      // number of bits overhead per-serialized message
 
@@ -550,14 +537,18 @@ private:
 
     uint16_t m_oldestUnackedMessageId;                                              // id for oldest unacked message in send queue
 
-    SequenceBuffer<MessageSendQueueEntry> * m_messageSendQueue;                     // message send queue
+    SequenceBuffer<MessageSendQueueEntry,MessageSendQueueSize> * m_messageSendQueue; // message send queue
 
-    SequenceBuffer<MessageSentPacketEntry> * m_messageSentPackets;                  // messages in sent packets (for acks)
+    SequenceBuffer<MessageSentPacketEntry,SlidingWindowSize> * m_messageSentPackets; // messages in sent packets (for acks)
 
-    SequenceBuffer<MessageReceiveQueueEntry> * m_messageReceiveQueue;               // message receive queue
+    SequenceBuffer<MessageReceiveQueueEntry,MessageReceiveQueueSize> * m_messageReceiveQueue; // message receive queue
 
     uint16_t * m_sentPacketMessageIds;                                              // array of message ids, n ids per-sent packet
 
+    uint16_t m_processedAck;                                                        // most recent ack processed
+
+    BitArray * m_processedAckBits;                                                  // ack bits already processed, relative to m_processedAck
+
     SendBlockData m_sendBlock;                                                      // data for block being sent
 
     ReceiveBlockData m_receiveBlock;                                                // data for block being received
@@ -577,18 +568,20 @@ Connection::Connection( PacketFactory & packetFactory, MessageFactory & messageF
 
     m_messageOverheadBits = CalculateMessageOverheadBits();
 
-    m_sentPackets = new SequenceBuffer<SentPacketData>( SlidingWindowSize );
+    m_sentPackets = new SequenceBuffer<SentPacketData,SlidingWindowSize>();
     
-    m_receivedPackets = new SequenceBuffer<ReceivedPacketData>( SlidingWindowSize );
+    m_receivedPackets = new SequenceBuffer<ReceivedPacketData,SlidingWindowSize>();
 
-    m_messageSendQueue = new SequenceBuffer<MessageSendQueueEntry>( MessageSendQueueSize );
+    m_messageSendQueue = new SequenceBuffer<MessageSendQueueEntry,MessageSendQueueSize>();
     
-    m_messageSentPackets = new SequenceBuffer<MessageSentPacketEntry>( SlidingWindowSize );
+    m_messageSentPackets = new SequenceBuffer<MessageSentPacketEntry,SlidingWindowSize>();
     
-    m_messageReceiveQueue = new SequenceBuffer<MessageReceiveQueueEntry>( MessageReceiveQueueSize );
+    m_messageReceiveQueue = new SequenceBuffer<MessageReceiveQueueEntry,MessageReceiveQueueSize>();
     
     m_sentPacketMessageIds = new uint16_t[ MaxMessagesPerPacket * MessageSendQueueSize ];
 
+    m_processedAckBits = new BitArray( AckWindowSize );
+
     Reset();
 }
 
@@ -602,6 +595,7 @@ Connection::~Connection()
     assert( m_messageSentPackets );
     assert( m_messageReceiveQueue );
     assert( m_sentPacketMessageIds );
+    assert( m_processedAckBits );
 
     delete m_sentPackets;
     delete m_receivedPackets;
@@ -609,6 +603,7 @@ Connection::~Connection()
     delete m_messageSentPackets;
     delete m_messageReceiveQueue;
     delete [] m_sentPacketMessageIds;
+    delete m_processedAckBits;
 
     m_sentPackets = NULL;
     m_receivedPackets = NULL;
@@ -616,6 +611,7 @@ Connection::~Connection()
     m_messageSentPackets = NULL;
     m_messageReceiveQueue = NULL;
     m_sentPacketMessageIds = NULL;
+    m_processedAckBits = NULL;
 }
 
 void Connection::Reset()
@@ -627,6 +623,9 @@ void Connection::Reset()
     m_sentPackets->Reset();
     m_receivedPackets->Reset();
 
+    m_processedAck = 0;
+    m_processedAckBits->Clear();
+
     m_sendMessageId = 0;
     m_receiveMessageId = 0;
     m_oldestUnackedMessageId = 0;
@@ -758,7 +757,7 @@ ConnectionPacket * Connection::WritePacket()
             int numFragments;
             int messageType;
 
-            uint8_t * fragmentData = GetFragmentToSend( messageId, fragmentId, fragmentBytes, numFragments, messageType );
+            const uint8_t * fragmentData = GetFragmentToSend( messageId, fragmentId, fragmentBytes, numFragments, messageType );
 
             if ( fragmentData )
             {
@@ -803,12 +802,6 @@ bool Connection::ReadPacket( ConnectionPacket * packet )
 void Connection::AdvanceTime( double time )
 {
     m_time = time;
-
-    m_sentPackets->RemoveOldEntries();
-
-    m_receivedPackets->RemoveOldEntries();
-
-    m_messageSentPackets->RemoveOldEntries();
 }
 
 ConnectionError Connection::GetError() const
@@ -828,13 +821,32 @@ void Connection::InsertAckPacketEntry( uint16_t sequence )
     }
 }
 
-void Connection::ProcessAcks( uint16_t ack, uint32_t ack_bits )
+void Connection::ProcessAcks( uint16_t ack, const BitArray & ackBits )
 {
-    for ( int i = 0; i < 32; ++i )
+    // only bits set for the first time need work. line up the bits processed for the last ack with this one and skip them.
+    // an ack older than the last one is processed in full (rare, and acked packets are skipped anyway)
+
+    const bool newer = !sequence_less_than( ack, m_processedAck );
+
+    if ( newer )
+        m_processedAckBits->ShiftUp( uint16_t( ack - m_processedAck ) );
+
+    for ( int i = 0; i < ackBits.GetNumWords(); ++i )
     {
-        if ( ack_bits & 1 )
-        {                    
-            const uint16_t sequence = ack - i;
+        uint64_t bits = ackBits.GetWord( i );
+
+        if ( newer )
+        {
+            const uint64_t processed = m_processedAckBits->GetWord( i );
+            m_processedAckBits->SetWord( i, processed | bits );
+            bits &= ~processed;
+        }
+
+        while ( bits )
+        {
+            const uint16_t sequence = ack - ( ( i << 6 ) + count_trailing_zeros64( bits ) );
+
+            bits &= bits - 1;
 
             SentPacketData * packetData = m_sentPackets->Find( sequence );
             
@@ -845,9 +857,10 @@ void Connection::ProcessAcks( uint16_t ack, uint32_t ack_bits )
                 packetData->acked = 1;
             }
         }
-
-        ack_bits >>= 1;
     }
+
+    if ( newer )
+        m_processedAck = ack;
 }
 
 bool Connection::HasMessagesToSend()
@@ -932,29 +945,37 @@ void Connection::AddMessagePacketEntry( const uint16_t * messageIds, int numMess
 
 void Connection::ProcessPacketMessages( const ConnectionPacket * packet )
 {
-    const uint16_t minMessageId = m_receiveMessageId;
-    const uint16_t maxMessageId = m_receiveMessageId + MessageReceiveQueueSize - 1;
+    // classify all message ids in the packet against the receive window at once
+
+    uint16_t messageIds[MaxMessagesPerPacket];
+    uint8_t messageClasses[MaxMessagesPerPacket];
 
     for ( int i = 0; i < packet->numMessages; ++i )
     {
-        Message * message = packet->messages[i];
+        assert( packet->messages[i] );
+        messageIds[i] = packet->messages[i]->GetId();
+    }
 
-        assert( message );
+    ClassifySequences( messageIds, packet->numMessages, m_receiveMessageId, MessageReceiveQueueSize, messageClasses );
 
-        const uint16_t messageId = message->GetId();
+    for ( int i = 0; i < packet->numMessages; ++i )
+    {
+        Message * message = packet->messages[i];
 
-        if ( m_messageReceiveQueue->Find( messageId ) )
-            continue;
+        const uint16_t messageId = messageIds[i];
 
-        if ( sequence_less_than( messageId, minMessageId ) )
+        if ( messageClasses[i] == PROTOCOL2_SEQUENCE_TOO_OLD )
             continue;
 
-        if ( sequence_greater_than( messageId, maxMessageId ) )
+        if ( messageClasses[i] == PROTOCOL2_SEQUENCE_TOO_NEW )
         {
             m_error = CONNECTION_ERROR_MESSAGE_DESYNC;
             return;
         }
 
+        if ( m_messageReceiveQueue->Find( messageId ) )
+            continue;
+
         MessageReceiveQueueEntry * entry = m_messageReceiveQueue->Insert( messageId );
 
         assert( entry );
@@ -1066,7 +1087,7 @@ bool Connection::SendingBlockMessage()
     return entry->block;
 }
 
-uint8_t * Connection::GetFragmentToSend( uint16_t & messageId, uint16_t & fragmentId, int & fragmentBytes, int & numFragments, int & messageType )
+const uint8_t * Connection::GetFragmentToSend( uint16_t & messageId, uint16_t & fragmentId, int & fragmentBytes, int & numFragments, int & messageType )
 {
     MessageSendQueueEntry * entry = m_messageSendQueue->Find( m_oldestUnackedMessageId );
 
@@ -1106,9 +1127,9 @@ uint8_t * Connection::GetFragmentToSend( uint16_t & messageId, uint16_t & fragme
 
     fragmentId = 0xFFFF;
 
-    for ( int i = 0; i < m_sendBlock.numFragments; ++i )
+    for ( int i = m_sendBlock.ackedFragment.FindFirstClear( 0 ); i >= 0 && i < m_sendBlock.numFragments; i = m_sendBlock.ackedFragment.FindFirstClear( i + 1 ) )
     {
-        if ( !m_sendBlock.ackedFragment.GetBit( i ) && m_sendBlock.fragmentSendTime[i] + FragmentResendRate < m_time )
+        if ( m_sendBlock.fragmentSendTime[i] + FragmentResendRate < m_time )
         {
             fragmentId = uint16_t( i );
             break;
@@ -1118,7 +1139,7 @@ uint8_t * Connection::GetFragmentToSend( uint16_t & messageId, uint16_t & fragme
     if ( fragmentId == 0xFFFF )
         return NULL;
 
-    // allocate and return a copy of the fragment data
+    // return a pointer to the fragment data inside the block. the packet is serialized before the block can be acked and released
 
     messageType = blockMessage->GetType();
 
@@ -1129,19 +1150,12 @@ uint8_t * Connection::GetFragmentToSend( uint16_t & messageId, uint16_t & fragme
     if ( fragmentRemainder && fragmentId == m_sendBlock.numFragments - 1 )
         fragmentBytes = fragmentRemainder;
 
-    uint8_t * fragmentData = new uint8_t[fragmentBytes];
-
-    if ( fragmentData )
-    {
-        memcpy( fragmentData, blockMessage->GetBlockData() + fragmentId * BlockFragmentSize, fragmentBytes );
-
-        m_sendBlock.fragmentSendTime[fragmentId] = m_time;
-    }
+    m_sendBlock.fragmentSendTime[fragmentId] = m_time;
 
-    return fragmentData;
+    return blockMessage->GetBlockData() + fragmentId * BlockFragmentSize;
 }
 
-void Connection::AddFragmentToPacket( uint16_t messageId, uint16_t fragmentId, uint8_t * fragmentData, int fragmentSize, int numFragments, int messageType, ConnectionPacket * packet )
+void Connection::AddFragmentToPacket( uint16_t messageId, uint16_t fragmentId, const uint8_t * fragmentData, int fragmentSize, int numFragments, int messageType, ConnectionPacket * packet )
 {
     assert( packet );
 
@@ -1330,13 +1344,13 @@ struct TestMessage : public Message
 
     template <typename Stream> bool Serialize( Stream & stream )
     {        
-        serialize_bits( stream, sequence, 16 );
+        serialize_bits_const( stream, sequence, 16 );
 
         int numBits = GetNumBitsForMessage( sequence );
         int numWords = numBits / 32;
         uint32_t dummy = 0;
         for ( int i = 0; i < numWords; ++i )
-            serialize_bits( stream, dummy, 32 );
+            serialize_bits_const( stream, dummy, 32 );
         int numRemainderBits = numBits - numWords * 32;
         if ( numRemainderBits > 0 )
             serialize_bits( stream, dummy, numRemainderBits );
@@ -1376,15 +1390,16 @@ protected:
     }
 };
 
+static const protocol2::PacketInfo seededPacketInfo( ProtocolId );
+
 void SendPacket( Simulator & simulator, void * context, PacketFactory & packetFactory, const Address & from, const Address & to, Packet * packet )
 {
     assert( packet );
 
     uint8_t * packetData = new uint8_t[MaxPacketSize];
 
-    protocol2::PacketInfo info;
+    protocol2::PacketInfo info = seededPacketInfo;
     info.context = context;
-    info.protocolId = ProtocolId;
     info.packetFactory = &packetFactory;
 
     const int packetSize = protocol2::WritePacket( info, packet, packetData, MaxPacketSize );
@@ -1402,23 +1417,28 @@ void SendPacket( Simulator & simulator, void * context, PacketFactory & packetFa
 }
 
 
-Packet * ReceivePacket( Simulator & simulator, void * context, PacketFactory & packetFactory, Address & from, Address & to )
+Packet * ReceivePacket( Simulator & simulator, void * context, PacketFactory & packetFactory, Address & from, Address & to, uint8_t * & packetData )
 {
+    // block fragments point into the packet data, so the caller frees it once the packet has been processed
+
     int packetBytes;
 
-    uint8_t * packetData = simulator.ReceivePacket( from, to, packetBytes );
+    packetData = simulator.ReceivePacket( from, to, packetBytes );
 
     if ( !packetData )
         return NULL;
 
-    protocol2::PacketInfo info;
+    protocol2::PacketInfo info = seededPacketInfo;
     info.context = context;
-    info.protocolId = ProtocolId;
     info.packetFactory = &packetFactory;
 
     Packet * packet = protocol2::ReadPacket( info, packetData, packetBytes, NULL );
 
-    delete [] packetData;
+    if ( !packet )
+    {
+        delete [] packetData;
+        packetData = NULL;
+    }
 
     return packet;
 }
@@ -1532,7 +1552,8 @@ int main()
         while ( true )
         {
 			Address to, from;
-            Packet * packet = ReceivePacket( simulator, &context, packetFactory, from, to );
+            uint8_t * packetData;
+            Packet * packet = ReceivePacket( simulator, &context, packetFactory, from, to, packetData );
             if ( !packet )
                 break;
             
@@ -1549,6 +1570,8 @@ int main()
             }        
             
             packetFactory.DestroyPacket( packet );
+
+            delete [] packetData;
         }
 
         while ( true )
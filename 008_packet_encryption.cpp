@@ -70,9 +70,9 @@ struct TestPacketA : public Packet
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
-        serialize_int( stream, a, -10, 10 );
-        serialize_int( stream, b, -20, 20 );
-        serialize_int( stream, c, -30, 30 );
+        serialize_int_const( stream, a, -10, 10 );
+        serialize_int_const( stream, b, -20, 20 );
+        serialize_int_const( stream, c, -30, 30 );
         
         return true;
     }
@@ -106,9 +106,9 @@ struct TestPacketB : public Packet
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
-        serialize_int( stream, numItems, 0, MaxItems );
+        serialize_int_const( stream, numItems, 0, MaxItems );
         for ( int i = 0; i < numItems; ++i )
-            serialize_int( stream, items[i], -100, +100 );
+            serialize_int_const( stream, items[i], -100, +100 );
 
         return true;
     }
@@ -33,6 +33,10 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <time.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
 
 using namespace protocol2;
 using namespace network2;
@@ -43,6 +47,9 @@ const int MaxClients = 32;
 const int ServerPort = 50000;
 const int ClientPort = 60000;
 const int ChallengeHashSize = 1024;
+const int PacketPoolSize = 64;
+const int PacketArenaSize = 64 * 1024;
+const int ServerReceiveBatchSize = 32;
 const float ChallengeSendRate = 0.1f;
 const float ChallengeTimeOut = 10.0f;
 const float ConnectionRequestSendRate = 0.1f;
@@ -54,13 +61,26 @@ const float ConnectionRequestTimeOut = 5.0f;
 const float ChallengeResponseTimeOut = 5.0f;
 const float KeepAliveTimeOut = 10.0f;
 const float ClientSaltTimeout = 1.0f;
+const int NumServerShards = 4;
+const int NumShardedClients = 8;
+const int ShardedServerPort = 50001;
+const int ShardedClientPort = 60001;
+const double ShardedConnectTimeOut = 5.0;
+const int ShardedWaitMilliseconds = 10;
+
+uint64_t GenerateSeed( int index )
+{
+    // seeds a per-object generator. the index keeps seeds apart if random_device is deterministic on this platform
+
+    std::random_device device;
+    return ( ( uint64_t( device() ) << 32 ) | uint64_t( device() ) ) ^ uint64_t( index );
+}
 
-uint64_t GenerateSalt()
+uint64_t GenerateSalt( std::mt19937_64 & random )
 {
-    return ( ( uint64_t( rand() ) <<  0 ) & 0x000000000000FFFFull ) | 
-           ( ( uint64_t( rand() ) << 16 ) & 0x00000000FFFF0000ull ) | 
-           ( ( uint64_t( rand() ) << 32 ) & 0x0000FFFF00000000ull ) |
-           ( ( uint64_t( rand() ) << 48 ) & 0xFFFF000000000000ull );
+    // each server and client has its own generator, so sharded servers on worker threads share no random state with anything
+
+    return random();
 }
 
 enum PacketTypes
@@ -209,29 +229,32 @@ struct ConnectionDisconnectPacket : public Packet
     PROTOCOL2_DECLARE_VIRTUAL_SERIALIZE_FUNCTIONS();
 };
 
-struct ClientServerPacketFactory : public PacketFactory
+struct ClientServerPacketFactory : public PooledPacketFactory
 {
-    ClientServerPacketFactory() : PacketFactory( CLIENT_SERVER_NUM_PACKETS ) {}
+    ClientServerPacketFactory() : PooledPacketFactory( CLIENT_SERVER_NUM_PACKETS ) 
+    {
+        InitPool<ConnectionRequestPacket>( PACKET_CONNECTION_REQUEST, PacketPoolSize );
+        InitPool<ConnectionDeniedPacket>( PACKET_CONNECTION_DENIED, PacketPoolSize );
+        InitPool<ConnectionChallengePacket>( PACKET_CONNECTION_CHALLENGE, PacketPoolSize );
+        InitPool<ConnectionResponsePacket>( PACKET_CONNECTION_RESPONSE, PacketPoolSize );
+        InitPool<ConnectionKeepAlivePacket>( PACKET_CONNECTION_KEEP_ALIVE, PacketPoolSize );
+        InitPool<ConnectionDisconnectPacket>( PACKET_CONNECTION_DISCONNECT, PacketPoolSize );
+    }
 
-    Packet* Create( int type )
+    Packet* CreatePooled( int type, PacketArena * arena )
     {
         switch ( type )
         {
-            case PACKET_CONNECTION_REQUEST:         return new ConnectionRequestPacket();
-            case PACKET_CONNECTION_DENIED:          return new ConnectionDeniedPacket();
-            case PACKET_CONNECTION_CHALLENGE:       return new ConnectionChallengePacket();
-            case PACKET_CONNECTION_RESPONSE:        return new ConnectionResponsePacket();
-            case PACKET_CONNECTION_KEEP_ALIVE:      return new ConnectionKeepAlivePacket();
-            case PACKET_CONNECTION_DISCONNECT:      return new ConnectionDisconnectPacket();
+            case PACKET_CONNECTION_REQUEST:         return CreateFromPool<ConnectionRequestPacket>( type, arena );
+            case PACKET_CONNECTION_DENIED:          return CreateFromPool<ConnectionDeniedPacket>( type, arena );
+            case PACKET_CONNECTION_CHALLENGE:       return CreateFromPool<ConnectionChallengePacket>( type, arena );
+            case PACKET_CONNECTION_RESPONSE:        return CreateFromPool<ConnectionResponsePacket>( type, arena );
+            case PACKET_CONNECTION_KEEP_ALIVE:      return CreateFromPool<ConnectionKeepAlivePacket>( type, arena );
+            case PACKET_CONNECTION_DISCONNECT:      return CreateFromPool<ConnectionDisconnectPacket>( type, arena );
             default:
                 return NULL;
         }
     }
-
-    void Destroy( Packet *packet )
-    {
-        delete packet;
-    }
 };
 
 struct ServerChallengeEntry
@@ -254,10 +277,7 @@ struct ServerChallengeHash
 
 uint64_t CalculateChallengeHashKey( const Address & address, uint64_t clientSalt, uint64_t serverSeed )
 {
-    char buffer[256];
-    const char * addressString = address.ToString( buffer, sizeof( buffer ) );
-    const int addressLength = (int) strlen( addressString );
-    return murmur_hash_64( &serverSeed, 8, murmur_hash_64( &clientSalt, 8, murmur_hash_64( addressString, addressLength, 0 ) ) );
+    return murmur_hash_64( &serverSeed, 8, murmur_hash_64( &clientSalt, 8, HashAddress( address ) ) );
 }
 
 struct ServerClientData
@@ -279,7 +299,9 @@ struct ServerClientData
     }
 };
 
-Packet * ReceivePacket( Socket * socket, PacketFactory * packetFactory, Address & address )
+static const protocol2::PacketInfo seededPacketInfo( ProtocolId );
+
+Packet * ReceivePacket( Socket * socket, PacketFactory * packetFactory, PacketArena * packetArena, Address & address )
 {
     uint8_t packetData[MaxPacketSize];
     
@@ -288,14 +310,16 @@ Packet * ReceivePacket( Socket * socket, PacketFactory * packetFactory, Address
     if ( !packetBytes )
         return NULL;
 
-    protocol2::PacketInfo info;
-    info.protocolId = ProtocolId;
+    protocol2::PacketInfo info = seededPacketInfo;
     info.packetFactory = packetFactory;
 
-    return protocol2::ReadPacket( info, packetData, packetBytes, NULL );
+    if ( packetArena )
+        return protocol2::ReadPacket( info, *packetArena, packetData, packetBytes, NULL );
+    else
+        return protocol2::ReadPacket( info, packetData, packetBytes, NULL );
 }
 
-void SendPacket( Socket * socket, PacketFactory * packetFactory, const Address & address, Packet * packet )
+void SendPacket( Socket * socket, PacketFactory * packetFactory, const ResolvedAddress & address, Packet * packet )
 {
     assert( socket );
     assert( packetFactory );
@@ -304,8 +328,7 @@ void SendPacket( Socket * socket, PacketFactory * packetFactory, const Address &
 
     uint8_t packetData[MaxPacketSize];
 
-    protocol2::PacketInfo info;
-    info.protocolId = ProtocolId;
+    protocol2::PacketInfo info = seededPacketInfo;
     info.packetFactory = packetFactory;
 
     const int packetSize = protocol2::WritePacket( info, packet, packetData, MaxPacketSize );
@@ -318,15 +341,30 @@ void SendPacket( Socket * socket, PacketFactory * packetFactory, const Address &
     packetFactory->DestroyPacket( packet );
 }
 
+void SendPacket( Socket * socket, PacketFactory * packetFactory, const Address & address, Packet * packet )
+{
+    assert( address.IsValid() );
+
+    SendPacket( socket, packetFactory, ResolvedAddress( address ), packet );
+}
+
 class Server
 {
     Socket * m_socket;                                                  // socket for sending and receiving packets.
 
     PacketFactory * m_packetFactory;                                    // packet factory for creating and destroying packets.
 
+    PacketArena m_packetArena;                                          // received packets are read into this arena and freed all at once after they are processed.
+
+    std::mt19937_64 m_random;                                           // generates salts. owned by this server so shards on different threads don't share random state.
+
     uint64_t m_serverSalt;                                              // server salt. randomizes hash keys to eliminate challenge/response hash worst case attack.
 
     int m_numConnectedClients;                                          // number of connected clients
+
+    int m_clientIndexBegin;                                             // first client slot owned by this server. servers sharded across threads each own a range of slots
+
+    int m_clientIndexEnd;                                               // one past the last client slot owned by this server
     
     bool m_clientConnected[MaxClients];                                 // true if client n is connected
     
@@ -335,21 +373,37 @@ class Server
     uint64_t m_challengeSalt[MaxClients];                               // array of challenge salt values per-client
     
     Address m_clientAddress[MaxClients];                                // array of client address values per-client
+
+    ResolvedAddress m_clientResolvedAddress[MaxClients];                // client addresses as native sockaddrs, so sends don't convert them every packet
+
+    AddressMap<int> m_clientAddressMap;                                 // client address -> client index for connected clients. one client per address
     
     ServerClientData m_clientData[MaxClients];                          // heavier weight data per-client, eg. not for fast lookup
 
     ServerChallengeHash m_challengeHash;                                // challenge hash entries. stores client challenge/response data
 
+    uint8_t m_receiveBuffer[ServerReceiveBatchSize][MaxPacketSize];     // packets are received into these buffers a batch at a time
+
+    void * m_receivePacketData[ServerReceiveBatchSize];                 // pointers to each receive buffer, for Socket::ReceivePackets
+
 public:
 
-    Server( Socket & socket, PacketFactory & packetFactory )
+    Server( Socket & socket, PacketFactory & packetFactory, int shardIndex = 0, int numShards = 1 ) : m_packetArena( PacketArenaSize ), m_random( GenerateSeed( shardIndex ) ), m_clientAddressMap( MaxClients )
     {
+        assert( numShards > 0 );
+        assert( numShards <= MaxClients );
+        assert( shardIndex >= 0 );
+        assert( shardIndex < numShards );
         m_socket = &socket;
         m_packetFactory = &packetFactory;
-        m_serverSalt = GenerateSalt();
+        m_serverSalt = GenerateSalt( m_random );
         m_numConnectedClients = 0;
+        m_clientIndexBegin = shardIndex * MaxClients / numShards;
+        m_clientIndexEnd = ( shardIndex + 1 ) * MaxClients / numShards;
         for ( int i = 0; i < MaxClients; ++i )
             ResetClientState( i );
+        for ( int i = 0; i < ServerReceiveBatchSize; ++i )
+            m_receivePacketData[i] = m_receiveBuffer[i];
     }
 
     ~Server()
@@ -362,7 +416,7 @@ public:
 
     void SendPackets( double time )
     {
-        for ( int i = 0; i < MaxClients; ++i )
+        for ( int i = m_clientIndexBegin; i < m_clientIndexEnd; ++i )
         {
             if ( !m_clientConnected[i] )
                 continue;
@@ -380,42 +434,59 @@ public:
 
     void ReceivePackets( double time )
     {
+        protocol2::PacketInfo info = seededPacketInfo;
+        info.packetFactory = m_packetFactory;
+
         while ( true )
         {
-            Address address;
-            Packet * packet = ReceivePacket( m_socket, m_packetFactory, address );
-            if ( !packet )
-                break;
-            
-            switch ( packet->GetType() )
+            // drain the socket a batch at a time. on linux this is one recvmmsg per batch instead of one recvfrom per packet
+
+            Address address[ServerReceiveBatchSize];
+            int packetBytes[ServerReceiveBatchSize];
+
+            const int numPackets = m_socket->ReceivePackets( address, m_receivePacketData, packetBytes, MaxPacketSize, ServerReceiveBatchSize );
+
+            for ( int i = 0; i < numPackets; ++i )
             {
-                case PACKET_CONNECTION_REQUEST:
-                    ProcessConnectionRequest( *(ConnectionRequestPacket*)packet, address, time );
-                    break;
+                Packet * packet = protocol2::ReadPacket( info, m_packetArena, m_receiveBuffer[i], packetBytes[i], NULL );
+                if ( !packet )
+                    continue;
 
-                case PACKET_CONNECTION_RESPONSE:
-                    ProcessConnectionResponse( *(ConnectionResponsePacket*)packet, address, time );
-                    break;
+                switch ( packet->GetType() )
+                {
+                    case PACKET_CONNECTION_REQUEST:
+                        ProcessConnectionRequest( *(ConnectionRequestPacket*)packet, address[i], time );
+                        break;
 
-                case PACKET_CONNECTION_KEEP_ALIVE:
-                    ProcessConnectionKeepAlive( *(ConnectionKeepAlivePacket*)packet, address, time );
-                    break;
+                    case PACKET_CONNECTION_RESPONSE:
+                        ProcessConnectionResponse( *(ConnectionResponsePacket*)packet, address[i], time );
+                        break;
 
-                case PACKET_CONNECTION_DISCONNECT:
-                    ProcessConnectionDisconnect( *(ConnectionDisconnectPacket*)packet, address, time );
-                    break;
+                    case PACKET_CONNECTION_KEEP_ALIVE:
+                        ProcessConnectionKeepAlive( *(ConnectionKeepAlivePacket*)packet, address[i], time );
+                        break;
 
-                default:
-                    break;
+                    case PACKET_CONNECTION_DISCONNECT:
+                        ProcessConnectionDisconnect( *(ConnectionDisconnectPacket*)packet, address[i], time );
+                        break;
+
+                    default:
+                        break;
+                }
             }
 
-            m_packetFactory->DestroyPacket( packet );
+            // packets in the arena are only referenced while their batch is processed, so reset per-batch to keep the arena small
+
+            m_packetArena.Reset();
+
+            if ( numPackets < ServerReceiveBatchSize )
+                break;
         }
     }
 
     void CheckForTimeOut( double time )
     {
-        for ( int i = 0; i < MaxClients; ++i )
+        for ( int i = m_clientIndexBegin; i < m_clientIndexEnd; ++i )
         {
             if ( !m_clientConnected[i] )
                 continue;
@@ -435,22 +506,29 @@ public:
         return m_numConnectedClients;
     }
 
+    int GetMaxClients() const
+    {
+        return m_clientIndexEnd - m_clientIndexBegin;
+    }
+
 protected:
 
     void ResetClientState( int clientIndex )
     {
         assert( clientIndex >= 0 );
         assert( clientIndex < MaxClients );
+        m_clientAddressMap.Remove( m_clientAddress[clientIndex] );
         m_clientConnected[clientIndex] = false;
         m_clientSalt[clientIndex] = 0;
         m_challengeSalt[clientIndex] = 0;
         m_clientAddress[clientIndex] = Address();
+        m_clientResolvedAddress[clientIndex].Clear();
         m_clientData[clientIndex] = ServerClientData();
     }
 
     int FindFreeClientIndex() const
     {
-        for ( int i = 0; i < MaxClients; ++i )
+        for ( int i = m_clientIndexBegin; i < m_clientIndexEnd; ++i )
         {
             if ( !m_clientConnected[i] )
                 return i;
@@ -458,20 +536,30 @@ protected:
         return -1;
     }
 
+    int FindClientIndex( const Address & address ) const
+    {
+        const int * clientIndex = m_clientAddressMap.Find( address );
+        if ( !clientIndex )
+            return -1;
+        assert( m_clientConnected[*clientIndex] );
+        assert( m_clientAddress[*clientIndex] == address );
+        return *clientIndex;
+    }
+
     int FindExistingClientIndex( const Address & address, uint64_t clientSalt, uint64_t challengeSalt ) const
     {
-        for ( int i = 0; i < MaxClients; ++i )
-        {
-            if ( m_clientConnected[i] && m_clientAddress[i] == address && m_clientSalt[i] == clientSalt && m_challengeSalt[i] == challengeSalt )
-                return i;
-        }
-        return -1;
+        const int clientIndex = FindClientIndex( address );
+        if ( clientIndex == -1 )
+            return -1;
+        if ( m_clientSalt[clientIndex] != clientSalt || m_challengeSalt[clientIndex] != challengeSalt )
+            return -1;
+        return clientIndex;
     }
 
     void ConnectClient( int clientIndex, const Address & address, uint64_t clientSalt, uint64_t challengeSalt, double time )
     {
         assert( m_numConnectedClients >= 0 );
-        assert( m_numConnectedClients < MaxClients - 1 );
+        assert( m_numConnectedClients < GetMaxClients() );
         assert( !m_clientConnected[clientIndex] );
 
         m_numConnectedClients++;
@@ -480,6 +568,11 @@ protected:
         m_clientSalt[clientIndex] = clientSalt;
         m_challengeSalt[clientIndex] = challengeSalt;
         m_clientAddress[clientIndex] = address;
+        m_clientResolvedAddress[clientIndex].Set( address );
+
+        const bool inserted = m_clientAddressMap.Insert( address, clientIndex );
+        (void) inserted;
+        assert( inserted );
 
         m_clientData[clientIndex].address = address;
         m_clientData[clientIndex].clientSalt = clientSalt;
@@ -523,14 +616,8 @@ protected:
 
     bool IsConnected( const Address & address, uint64_t clientSalt ) const
     {
-        for ( int i = 0; i < MaxClients; ++i )
-        {
-            if ( !m_clientConnected[i] )
-                continue;
-            if ( m_clientAddress[i] == address && m_clientSalt[i] == clientSalt )
-                return true;
-        }
-        return false;
+        const int clientIndex = FindClientIndex( address );
+        return clientIndex != -1 && m_clientSalt[clientIndex] == clientSalt;
     }
 
     ServerChallengeEntry * FindChallenge( const Address & address, uint64_t clientSalt, double time )
@@ -573,7 +660,7 @@ protected:
             ServerChallengeEntry * entry = &m_challengeHash.entries[index];
 
             entry->client_salt = clientSalt;
-            entry->challenge_salt = GenerateSalt();
+            entry->challenge_salt = GenerateSalt( m_random );
             entry->last_packet_send_time = time - ChallengeSendRate * 2;
             entry->create_time = time;
             entry->address = address;
@@ -602,7 +689,7 @@ protected:
         assert( clientIndex < MaxClients );
         assert( m_clientConnected[clientIndex] );
         m_clientData[clientIndex].lastPacketSendTime = time;
-        SendPacket( m_socket, m_packetFactory, m_clientAddress[clientIndex], packet );
+        SendPacket( m_socket, m_packetFactory, m_clientResolvedAddress[clientIndex], packet );
     }
 
     void ProcessConnectionRequest( const ConnectionRequestPacket & packet, const Address & address, double time )
@@ -611,7 +698,7 @@ protected:
         const char *addressString = address.ToString( buffer, sizeof( buffer ) );        
         printf( "processing connection request packet from: %s\n", addressString );
 
-        if ( m_numConnectedClients == MaxClients )
+        if ( m_numConnectedClients == GetMaxClients() )
         {
             printf( "connection denied: server is full\n" );
             ConnectionDeniedPacket * connectionDeniedPacket = (ConnectionDeniedPacket*) m_packetFactory->CreatePacket( PACKET_CONNECTION_DENIED );
@@ -687,7 +774,14 @@ protected:
             return;
         }
 
-        if ( m_numConnectedClients == MaxClients )
+        // a client connecting from the address of an existing client with different salts has restarted.
+        // the old connection is stale, so drop it and let the new one take over the address
+
+        const int staleClientIndex = FindClientIndex( address );
+        if ( staleClientIndex != -1 )
+            DisconnectClient( staleClientIndex, time );
+
+        if ( m_numConnectedClients == GetMaxClients() )
         {
             if ( entry->last_packet_send_time + ConnectionChallengeSendRate < time )
             {
@@ -758,6 +852,8 @@ class Client
 
     Address m_serverAddress;                                            // server address we are connecting or connected to.
 
+    std::mt19937_64 m_random;                                           // generates client salts.
+
     uint64_t m_clientSalt;                                              // client salt. randomly generated on each call to connect.
 
     uint64_t m_challengeSalt;                                           // challenge salt sent back from server in connection challenge.
@@ -770,7 +866,7 @@ class Client
 
 public:
 
-    Client( Socket & socket, PacketFactory & packetFactory )
+    Client( Socket & socket, PacketFactory & packetFactory ) : m_random( GenerateSeed( socket.GetPort() ) )
     {
         m_socket = &socket;
         m_packetFactory = &packetFactory;
@@ -788,7 +884,7 @@ public:
     void Connect( const Address & address, double time )
     {
         Disconnect( time );
-        m_clientSalt = GenerateSalt();
+        m_clientSalt = GenerateSalt( m_random );
         m_challengeSalt = 0;
         m_serverAddress = address;
         m_clientState = CLIENT_STATE_SENDING_CONNECTION_REQUEST;
@@ -886,7 +982,7 @@ public:
         while ( true )
         {
             Address address;
-            Packet * packet = ReceivePacket( m_socket, m_packetFactory, address );
+            Packet * packet = ReceivePacket( m_socket, m_packetFactory, NULL, address );
             if ( !packet )
                 break;
             
@@ -931,7 +1027,7 @@ public:
 
                 if ( m_clientSaltExpiryTime < time )
                 {
-                    m_clientSalt = GenerateSalt();
+                    m_clientSalt = GenerateSalt( m_random );
                     m_clientSaltExpiryTime = time + ClientSaltTimeout;
                     printf( "client salt timed out. new client salt is %" PRIx64 "\n", m_clientSalt );
                 }
@@ -1078,12 +1174,142 @@ protected:
     }
 };
 
+double GetTime()
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+}
+
+void RunServerShard( Socket * socket, int shardIndex, std::atomic<bool> * quit )
+{
+    // each shard thread owns its socket, packet factory, salt generator and a range of client slots. the only shared state
+    // is the quit flag, which is atomic, so no locks
+
+    ClientServerPacketFactory packetFactory;
+
+    Server server( *socket, packetFactory, shardIndex, NumServerShards );
+
+    while ( !quit->load() )
+    {
+        const double time = GetTime();
+
+        server.SendPackets( time );
+
+        server.ReceivePackets( time );
+
+        server.CheckForTimeOut( time );
+
+        // sleep until a packet arrives. the timeout bounds how late keep-alives, time outs and quit are noticed
+
+        socket->WaitForPackets( ShardedWaitMilliseconds );
+    }
+}
+
+void RunShardedClientServer()
+{
+    printf( "\nsharded client server (%d shards, %d clients)\n\n", NumServerShards, NumShardedClients );
+
+    // the kernel spreads clients across the sockets in the group by hashing their addresses. same port, one thread per socket
+
+    SocketGroup serverSockets( ShardedServerPort, NumServerShards );
+
+    if ( serverSockets.IsError() )
+    {
+        printf( "error: failed to initialize server socket group (%d)\n", serverSockets.GetError() );
+        return;
+    }
+
+    std::atomic<bool> quit( false );
+
+    std::thread shards[NumServerShards];
+    for ( int i = 0; i < NumServerShards; ++i )
+        shards[i] = std::thread( RunServerShard, &serverSockets.GetSocket( i ), i, &quit );
+
+    ClientServerPacketFactory clientPacketFactory;
+
+    Socket * clientSockets[NumShardedClients];
+    Client * clients[NumShardedClients];
+
+    const Address serverAddress( "::1", ShardedServerPort );
+
+    for ( int i = 0; i < NumShardedClients; ++i )
+    {
+        clientSockets[i] = new Socket( ShardedClientPort + i );
+        clients[i] = new Client( *clientSockets[i], clientPacketFactory );
+        if ( !clientSockets[i]->IsError() )
+            clients[i]->Connect( serverAddress, GetTime() );
+    }
+
+#if NETWORK2_EPOLL
+    SocketPoller poller;
+    for ( int i = 0; i < NumShardedClients; ++i )
+    {
+        if ( !clientSockets[i]->IsError() )
+            poller.AddSocket( *clientSockets[i] );
+    }
+#endif // #if NETWORK2_EPOLL
+
+    const double startTime = GetTime();
+
+    while ( GetTime() < startTime + ShardedConnectTimeOut )
+    {
+        const double time = GetTime();
+
+        int numConnected = 0;
+
+        for ( int i = 0; i < NumShardedClients; ++i )
+        {
+            clients[i]->SendPackets( time );
+            clients[i]->ReceivePackets( time );
+            clients[i]->CheckForTimeOut( time );
+            if ( clients[i]->IsConnected() )
+                numConnected++;
+        }
+
+        if ( numConnected == NumShardedClients )
+            break;
+
+        // one wait covers every client socket. wake as soon as any of them has packets
+
+#if NETWORK2_EPOLL
+        SocketPollerEvent events[NumShardedClients];
+        poller.Wait( events, NumShardedClients, ShardedWaitMilliseconds );
+#else // #if NETWORK2_EPOLL
+        std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+#endif // #if NETWORK2_EPOLL
+    }
+
+    int numConnected = 0;
+
+    for ( int i = 0; i < NumShardedClients; ++i )
+    {
+        if ( clients[i]->IsConnected() )
+            numConnected++;
+        clients[i]->Disconnect( GetTime() );
+    }
+
+    printf( "%d/%d clients connected\n", numConnected, NumShardedClients );
+
+    // give the shards a moment to process the disconnect packets before shutting them down
+
+    std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+
+    quit.store( true );
+
+    for ( int i = 0; i < NumServerShards; ++i )
+        shards[i].join();
+
+    for ( int i = 0; i < NumShardedClients; ++i )
+    {
+        delete clients[i];
+        delete clientSockets[i];
+    }
+}
+
 int main()
 {
     printf( "\nclient server\n\n" );
 
-    srand( (unsigned int) time( NULL ) );
-
     InitializeNetwork();
 
     Address clientAddress( "::1", ClientPort );
@@ -1146,6 +1372,8 @@ int main()
             break;
     }
 
+    RunShardedClientServer();
+
     ShutdownNetwork();
 
     printf( "\n" );
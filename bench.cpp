@@ -0,0 +1,1219 @@
+/*
+    Benchmarks for Protocol2 Library and Network2 Library.
+
+    Copyright © 2016, The Network Protocol Company, Inc.
+
+    Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+        1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+        2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+           in the documentation and/or other materials provided with the distribution.
+
+        3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived
+           from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+    INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+    WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+    USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define NETWORK2_IMPLEMENTATION
+#define PROTOCOL2_IMPLEMENTATION
+
+#include "network2.h"
+#include "protocol2.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
+#define NOMINMAX
+#include <windows.h>
+#else // #if NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
+#include <time.h>
+#endif // #if NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
+
+// IMPORTANT: Build this in release. Timings from a debug build are dominated by asserts.
+
+static double time_seconds()
+{
+#if NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
+    static LARGE_INTEGER frequency;
+    if ( frequency.QuadPart == 0 )
+        QueryPerformanceFrequency( &frequency );
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter( &counter );
+    return double( counter.QuadPart ) / double( frequency.QuadPart );
+#else // #if NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
+    timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif // #if NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
+}
+
+static volatile uint64_t bench_sink;                    // results are written here so the optimizer can't throw the work away
+
+const int BitpackerBufferSize = 64 * 1024;
+const int BitpackerNumFields = 8192;
+const int BitpackerIterations = 2000;
+
+static uint32_t bitpacker_values[BitpackerNumFields];
+static int bitpacker_bits[BitpackerNumFields];
+
+template <typename Writer> double bench_bitpacker_write( uint8_t * buffer )
+{
+    const double start = time_seconds();
+    for ( int i = 0; i < BitpackerIterations; ++i )
+    {
+        Writer writer( buffer, BitpackerBufferSize );
+        for ( int j = 0; j < BitpackerNumFields; ++j )
+            writer.WriteBits( bitpacker_values[j], bitpacker_bits[j] );
+        writer.FlushBits();
+        bench_sink += writer.GetBytesWritten();
+    }
+    return time_seconds() - start;
+}
+
+double bench_bitpacker_write_bulk( uint8_t * buffer )
+{
+    // pack pairs of fields into one WriteBits64 call. this is the bulk path the 64 bit writer is for
+
+    const double start = time_seconds();
+    for ( int i = 0; i < BitpackerIterations; ++i )
+    {
+        protocol2::BitWriter64 writer( buffer, BitpackerBufferSize );
+        for ( int j = 0; j < BitpackerNumFields; j += 2 )
+        {
+            const int bits0 = bitpacker_bits[j];
+            const int bits1 = bitpacker_bits[j+1];
+            const uint64_t value0 = bitpacker_values[j] & ( ( uint64_t(1) << bits0 ) - 1 );
+            const uint64_t value1 = bitpacker_values[j+1];
+            writer.WriteBits64( value0 | ( value1 << bits0 ), bits0 + bits1 );
+        }
+        writer.FlushBits();
+        bench_sink += writer.GetBytesWritten();
+    }
+    return time_seconds() - start;
+}
+
+template <typename Reader> double bench_bitpacker_read( const uint8_t * buffer, int bytes )
+{
+    const double start = time_seconds();
+    for ( int i = 0; i < BitpackerIterations; ++i )
+    {
+        Reader reader( buffer, bytes );
+        uint32_t sum = 0;
+        for ( int j = 0; j < BitpackerNumFields; ++j )
+            sum += reader.ReadBits( bitpacker_bits[j] );
+        bench_sink += sum;
+    }
+    return time_seconds() - start;
+}
+
+void bench_bitpacker()
+{
+    printf( "bench_bitpacker\n" );
+
+    int totalBits = 0;
+    for ( int i = 0; i < BitpackerNumFields; ++i )
+    {
+        bitpacker_bits[i] = 1 + rand() % 32;
+        bitpacker_values[i] = uint32_t( rand() ) * 2654435761U;
+        totalBits += bitpacker_bits[i];
+    }
+
+    assert( totalBits <= BitpackerBufferSize * 8 );
+
+    static uint8_t buffer[BitpackerBufferSize];
+
+    const int bytes = ( totalBits + 7 ) / 8;
+
+    const double fields = double( BitpackerNumFields ) * BitpackerIterations;
+
+    const double write32 = bench_bitpacker_write<protocol2::BitWriter>( buffer );
+    const double read32 = bench_bitpacker_read<protocol2::BitReader>( buffer, bytes );
+    const double write64 = bench_bitpacker_write<protocol2::BitWriter64>( buffer );
+    const double read64 = bench_bitpacker_read<protocol2::BitReader64>( buffer, bytes );
+    const double writeBulk = bench_bitpacker_write_bulk( buffer );
+
+    printf( "    write 32:      %.2f ns/field\n", write32 / fields * 1000000000.0 );
+    printf( "    write 64:      %.2f ns/field\n", write64 / fields * 1000000000.0 );
+    printf( "    write 64 bulk: %.2f ns/field\n", writeBulk / fields * 1000000000.0 );
+    printf( "    read 32:       %.2f ns/field\n", read32 / fields * 1000000000.0 );
+    printf( "    read 64:       %.2f ns/field\n", read64 / fields * 1000000000.0 );
+}
+
+// the same fields through the streams, one serialize_bits per field against one serialize_bits64 per pair of fields
+
+static uint64_t bitpacker_pair_values[BitpackerNumFields/2];
+static int bitpacker_pair_bits[BitpackerNumFields/2];
+
+struct BenchFields
+{
+    uint32_t sum;
+
+    template <typename Stream> bool Serialize( Stream & stream )
+    {
+        for ( int j = 0; j < BitpackerNumFields; ++j )
+        {
+            uint32_t value = bitpacker_values[j];
+            serialize_bits( stream, value, bitpacker_bits[j] );
+            sum += value;
+        }
+        return true;
+    }
+};
+
+struct BenchFieldPairs
+{
+    uint32_t sum;
+
+    template <typename Stream> bool Serialize( Stream & stream )
+    {
+        for ( int j = 0; j < BitpackerNumFields / 2; ++j )
+        {
+            uint64_t value = bitpacker_pair_values[j];
+            serialize_bits64( stream, value, bitpacker_pair_bits[j] );
+            sum += uint32_t( value );
+        }
+        return true;
+    }
+};
+
+template <typename Fields> void bench_serialize_bits64_fields( const char * name, uint8_t * buffer )
+{
+    const double fields = double( BitpackerNumFields ) * BitpackerIterations;
+
+    Fields object;
+    object.sum = 0;
+
+    int bytesWritten = 0;
+    double start = time_seconds();
+    for ( int i = 0; i < BitpackerIterations; ++i )
+    {
+        protocol2::WriteStream stream( buffer, BitpackerBufferSize );
+        object.Serialize( stream );
+        stream.Flush();
+        bytesWritten = stream.GetBytesProcessed();
+    }
+    const double writeTime = time_seconds() - start;
+
+    start = time_seconds();
+    for ( int i = 0; i < BitpackerIterations; ++i )
+    {
+        protocol2::ReadStream stream( buffer, bytesWritten );
+        object.Serialize( stream );
+    }
+    const double readTime = time_seconds() - start;
+
+    bench_sink += object.sum;
+
+    printf( "    %-10s write %.2f ns/field, read %.2f ns/field\n", name, writeTime / fields * 1000000000.0, readTime / fields * 1000000000.0 );
+}
+
+void bench_serialize_bits64()
+{
+    printf( "bench_serialize_bits64 (%s bitpacker)\n", PROTOCOL2_BITPACKER_64 ? "64 bit" : "32 bit" );
+
+    // reuses the fields from bench_bitpacker
+
+    for ( int j = 0; j < BitpackerNumFields; j += 2 )
+    {
+        const int bits0 = bitpacker_bits[j];
+        const uint64_t value0 = bitpacker_values[j] & ( ( uint64_t(1) << bits0 ) - 1 );
+        const uint64_t value1 = bitpacker_values[j+1] & ( ( uint64_t(1) << bitpacker_bits[j+1] ) - 1 );
+        bitpacker_pair_values[j/2] = value0 | ( value1 << bits0 );
+        bitpacker_pair_bits[j/2] = bits0 + bitpacker_bits[j+1];
+    }
+
+    static uint8_t buffer[BitpackerBufferSize];
+
+    bench_serialize_bits64_fields<BenchFields>( "bits", buffer );
+    bench_serialize_bits64_fields<BenchFieldPairs>( "bits64", buffer );
+}
+
+// TestPacketB and TestPacketC from 001_reading_and_writing_packets.cpp. the _Const versions match how 001 serializes them, the others use runtime bounds for comparison
+
+const int MaxItems = 32;
+
+struct Vector
+{
+    float x,y,z;
+};
+
+struct BenchPacketB
+{
+    int numItems;
+    int items[MaxItems];
+
+    template <typename Stream> bool Serialize( Stream & stream )
+    {
+        serialize_int( stream, numItems, 0, MaxItems );
+        for ( int i = 0; i < numItems; ++i )
+            serialize_int( stream, items[i], -100, +100 );
+        return true;
+    }
+};
+
+struct BenchPacketB_Const : public BenchPacketB
+{
+    template <typename Stream> bool Serialize( Stream & stream )
+    {
+        serialize_int_const( stream, numItems, 0, MaxItems );
+        for ( int i = 0; i < numItems; ++i )
+            serialize_int_const( stream, items[i], -100, +100 );
+        return true;
+    }
+};
+
+struct BenchPacketC
+{
+    Vector position;
+    Vector velocity;
+
+    template <typename Stream> bool Serialize( Stream & stream )
+    {
+        // serialize_float and serialize_bool have compile time widths, so spell the fields out with runtime widths
+
+        uint32_t * values = (uint32_t*) &position;
+        for ( int i = 0; i < 3; ++i )
+            serialize_bits( stream, values[i], 32 );
+        bool at_rest = Stream::IsWriting && velocity.x == 0.0f && velocity.y == 0.0f && velocity.z == 0.0f;
+        uint32_t at_rest_bits = at_rest ? 1 : 0;
+        serialize_bits( stream, at_rest_bits, 1 );
+        if ( !at_rest_bits )
+        {
+            values = (uint32_t*) &velocity;
+            for ( int i = 0; i < 3; ++i )
+                serialize_bits( stream, values[i], 32 );
+        }
+        return true;
+    }
+};
+
+struct BenchPacketC_Const : public BenchPacketC
+{
+    template <typename Stream> bool Serialize( Stream & stream )
+    {
+        serialize_float( stream, position.x );
+        serialize_float( stream, position.y );
+        serialize_float( stream, position.z );
+        bool at_rest = Stream::IsWriting && velocity.x == 0.0f && velocity.y == 0.0f && velocity.z == 0.0f;
+        serialize_bool( stream, at_rest );
+        if ( !at_rest )
+        {
+            serialize_float( stream, velocity.x );
+            serialize_float( stream, velocity.y );
+            serialize_float( stream, velocity.z );
+        }
+        return true;
+    }
+};
+
+const int SerializeNumPackets = 256;
+const int SerializeIterations = 2000;
+const int SerializeBufferSize = 256 * 1024;
+
+template <typename Packet> void bench_serialize_packet( const char * name, Packet * packets, int numFields )
+{
+    static uint8_t buffer[SerializeBufferSize];
+
+    double start = time_seconds();
+    int bytesWritten = 0;
+    for ( int i = 0; i < SerializeIterations; ++i )
+    {
+        protocol2::WriteStream stream( buffer, SerializeBufferSize );
+        for ( int j = 0; j < SerializeNumPackets; ++j )
+            packets[j].Serialize( stream );
+        stream.Flush();
+        bytesWritten = stream.GetBytesProcessed();
+    }
+    const double writeTime = time_seconds() - start;
+
+    start = time_seconds();
+    for ( int i = 0; i < SerializeIterations; ++i )
+    {
+        protocol2::ReadStream stream( buffer, bytesWritten );
+        for ( int j = 0; j < SerializeNumPackets; ++j )
+            packets[j].Serialize( stream );
+        bench_sink += stream.GetBitsProcessed();
+    }
+    const double readTime = time_seconds() - start;
+
+    // the same read through an unchecked stream, as ReadPacket does once the worst case packet size is known to fit
+
+    start = time_seconds();
+    for ( int i = 0; i < SerializeIterations; ++i )
+    {
+        protocol2::ReadStream stream( buffer, bytesWritten );
+        protocol2::UncheckedReadStream uncheckedStream( stream );
+        for ( int j = 0; j < SerializeNumPackets; ++j )
+            packets[j].Serialize( uncheckedStream );
+        bench_sink += uncheckedStream.GetBitsProcessed();
+    }
+    const double uncheckedReadTime = time_seconds() - start;
+
+    const double fields = double( numFields ) * SerializeIterations;
+
+    printf( "    %-8s write %.2f ns/field, read %.2f ns/field, unchecked read %.2f ns/field\n", name, writeTime / fields * 1000000000.0, readTime / fields * 1000000000.0, uncheckedReadTime / fields * 1000000000.0 );
+}
+
+void bench_serialize_bounds()
+{
+    printf( "bench_serialize_bounds\n" );
+
+    static BenchPacketB_Const packetsB[SerializeNumPackets];
+    static BenchPacketC_Const packetsC[SerializeNumPackets];
+
+    int numFieldsB = 0;
+    int numFieldsC = 0;
+
+    for ( int i = 0; i < SerializeNumPackets; ++i )
+    {
+        packetsB[i].numItems = rand() % ( MaxItems + 1 );
+        for ( int j = 0; j < packetsB[i].numItems; ++j )
+            packetsB[i].items[j] = -100 + rand() % 201;
+        numFieldsB += 1 + packetsB[i].numItems;
+
+        packetsC[i].position.x = float( rand() % 2000 - 1000 );
+        packetsC[i].position.y = float( rand() % 2000 - 1000 );
+        packetsC[i].position.z = float( rand() % 2000 - 1000 );
+        const bool at_rest = ( rand() % 2 ) != 0;
+        packetsC[i].velocity.x = at_rest ? 0.0f : float( rand() % 200 - 100 );
+        packetsC[i].velocity.y = at_rest ? 0.0f : float( rand() % 200 - 100 );
+        packetsC[i].velocity.z = at_rest ? 0.0f : float( rand() % 200 - 100 );
+        numFieldsC += at_rest ? 4 : 7;
+    }
+
+    bench_serialize_packet<BenchPacketB>( "B", packetsB, numFieldsB );
+    bench_serialize_packet<BenchPacketB_Const>( "B const", packetsB, numFieldsB );
+    bench_serialize_packet<BenchPacketC>( "C", packetsC, numFieldsC );
+    bench_serialize_packet<BenchPacketC_Const>( "C const", packetsC, numFieldsC );
+}
+
+typedef uint32_t (*Crc32Function)( const uint8_t *buffer, size_t length, uint32_t crc32 );
+
+static double bench_crc32_function( Crc32Function function, const uint8_t * buffer, int bytes )
+{
+    const int iterations = ( 64 * 1024 * 1024 ) / bytes;
+    uint32_t crc32 = 0;
+    const double start = time_seconds();
+    for ( int i = 0; i < iterations; ++i )
+        crc32 = function( buffer, bytes, crc32 );
+    const double time = time_seconds() - start;
+    bench_sink += crc32;
+    return ( double( bytes ) * iterations ) / time / ( 1024.0 * 1024.0 * 1024.0 );
+}
+
+void bench_crc32()
+{
+    printf( "bench_crc32 (GB/sec)\n" );
+
+    const int MaxBytes = 4096;
+
+    static uint8_t buffer[MaxBytes];
+    for ( int i = 0; i < MaxBytes; ++i )
+        buffer[i] = (uint8_t) rand();
+
+#if PROTOCOL2_CRC32_PCLMUL
+    const bool pclmul = protocol2::cpu_supports_crc32_pclmul();
+#endif // #if PROTOCOL2_CRC32_PCLMUL
+
+    const int sizes[] = { 64, 128, 256, 512, 1024, 1200, 2048, 4096 };
+
+    for ( int i = 0; i < (int) ( sizeof( sizes ) / sizeof( int ) ); ++i )
+    {
+        const int bytes = sizes[i];
+        printf( "    %4d bytes: bytewise %.2f, slicing by 8 %.2f", bytes,
+            bench_crc32_function( protocol2::calculate_crc32_bytewise, buffer, bytes ),
+            bench_crc32_function( protocol2::calculate_crc32_slicing_by_8, buffer, bytes ) );
+#if PROTOCOL2_CRC32_PCLMUL
+        if ( pclmul )
+            printf( ", pclmul %.2f", bench_crc32_function( protocol2::calculate_crc32_pclmul, buffer, bytes ) );
+#endif // #if PROTOCOL2_CRC32_PCLMUL
+        printf( "\n" );
+    }
+}
+
+enum BenchPacketTypes
+{
+    BENCH_PACKET_INPUT,
+    BENCH_PACKET_STATE,
+    BENCH_PACKET_NUM_TYPES
+};
+
+struct BenchInputPacket : public protocol2::Packet
+{
+    uint16_t sequence;
+    int buttons;
+
+    BenchInputPacket() : Packet( BENCH_PACKET_INPUT ), sequence( 0 ), buttons( 0 ) {}
+
+    template <typename Stream> bool Serialize( Stream & stream )
+    {
+        serialize_bits( stream, sequence, 16 );
+        serialize_int( stream, buttons, 0, 255 );
+        return true;
+    }
+
+    PROTOCOL2_DECLARE_VIRTUAL_SERIALIZE_FUNCTIONS();
+};
+
+struct BenchStatePacket : public protocol2::Packet
+{
+    uint8_t data[128];
+
+    BenchStatePacket() : Packet( BENCH_PACKET_STATE ) { memset( data, 0, sizeof( data ) ); }
+
+    template <typename Stream> bool Serialize( Stream & stream )
+    {
+        serialize_bytes( stream, data, sizeof( data ) );
+        return true;
+    }
+
+    PROTOCOL2_DECLARE_VIRTUAL_SERIALIZE_FUNCTIONS();
+};
+
+struct BenchHeapPacketFactory : public protocol2::PacketFactory
+{
+    BenchHeapPacketFactory() : PacketFactory( BENCH_PACKET_NUM_TYPES ) {}
+
+    protocol2::Packet* Create( int type )
+    {
+        switch ( type )
+        {
+            case BENCH_PACKET_INPUT: return new BenchInputPacket();
+            case BENCH_PACKET_STATE: return new BenchStatePacket();
+        }
+        return NULL;
+    }
+
+    void Destroy( protocol2::Packet *packet )
+    {
+        delete packet;
+    }
+};
+
+struct BenchPooledPacketFactory : public protocol2::PooledPacketFactory
+{
+    BenchPooledPacketFactory() : PooledPacketFactory( BENCH_PACKET_NUM_TYPES ) 
+    {
+        InitPool<BenchInputPacket>( BENCH_PACKET_INPUT, 256 );
+        InitPool<BenchStatePacket>( BENCH_PACKET_STATE, 256 );
+    }
+
+    protocol2::Packet* CreatePooled( int type, protocol2::PacketArena * arena )
+    {
+        switch ( type )
+        {
+            case BENCH_PACKET_INPUT: return CreateFromPool<BenchInputPacket>( type, arena );
+            case BENCH_PACKET_STATE: return CreateFromPool<BenchStatePacket>( type, arena );
+        }
+        return NULL;
+    }
+};
+
+const int PacketFactoryNumPackets = 64;
+const int PacketFactoryIterations = 20000;
+
+static double bench_packet_factory_receive( protocol2::PacketFactory & packetFactory, uint8_t buffers[][256], const int * bytes )
+{
+    // a burst of packets is read and then destroyed after dispatch, like a server receive loop
+
+    protocol2::PacketInfo info;
+    info.protocolId = 0x12345678;
+    info.packetFactory = &packetFactory;
+    info.CalculateCrc32Seed();
+
+    protocol2::Packet * packets[PacketFactoryNumPackets];
+
+    const double start = time_seconds();
+    for ( int i = 0; i < PacketFactoryIterations; ++i )
+    {
+        for ( int j = 0; j < PacketFactoryNumPackets; ++j )
+            packets[j] = protocol2::ReadPacket( info, buffers[j], bytes[j] );
+        for ( int j = 0; j < PacketFactoryNumPackets; ++j )
+        {
+            bench_sink += packets[j]->GetType();
+            packetFactory.DestroyPacket( packets[j] );
+        }
+    }
+    return ( time_seconds() - start ) / ( double( PacketFactoryIterations ) * PacketFactoryNumPackets ) * 1000000000.0;
+}
+
+static double bench_packet_factory_receive_arena( protocol2::PacketFactory & packetFactory, uint8_t buffers[][256], const int * bytes )
+{
+    // same burst, but the packets are read into an arena that is reset once they have all been dispatched
+
+    protocol2::PacketInfo info;
+    info.protocolId = 0x12345678;
+    info.packetFactory = &packetFactory;
+    info.CalculateCrc32Seed();
+
+    protocol2::PacketArena arena( PacketFactoryNumPackets * 256 );
+
+    const double start = time_seconds();
+    for ( int i = 0; i < PacketFactoryIterations; ++i )
+    {
+        for ( int j = 0; j < PacketFactoryNumPackets; ++j )
+        {
+            protocol2::Packet * packet = protocol2::ReadPacket( info, arena, buffers[j], bytes[j] );
+            bench_sink += packet->GetType();
+        }
+        arena.Reset();
+    }
+    return ( time_seconds() - start ) / ( double( PacketFactoryIterations ) * PacketFactoryNumPackets ) * 1000000000.0;
+}
+
+void bench_packet_factory()
+{
+    printf( "bench_packet_factory\n" );
+
+    BenchHeapPacketFactory heapPacketFactory;
+    BenchPooledPacketFactory pooledPacketFactory;
+
+    protocol2::PacketInfo info;
+    info.protocolId = 0x12345678;
+    info.packetFactory = &heapPacketFactory;
+
+    static uint8_t buffers[PacketFactoryNumPackets][256];
+    int bytes[PacketFactoryNumPackets];
+
+    for ( int i = 0; i < PacketFactoryNumPackets; ++i )
+    {
+        protocol2::Packet * packet = heapPacketFactory.CreatePacket( ( i % 4 ) == 0 ? BENCH_PACKET_STATE : BENCH_PACKET_INPUT );
+        bytes[i] = protocol2::WritePacket( info, packet, buffers[i], sizeof( buffers[i] ) );
+        heapPacketFactory.DestroyPacket( packet );
+    }
+
+    printf( "    read + destroy, heap:   %.1f ns/packet\n", bench_packet_factory_receive( heapPacketFactory, buffers, bytes ) );
+    printf( "    read + destroy, pooled: %.1f ns/packet\n", bench_packet_factory_receive( pooledPacketFactory, buffers, bytes ) );
+    printf( "    read into arena:        %.1f ns/packet\n", bench_packet_factory_receive_arena( pooledPacketFactory, buffers, bytes ) );
+}
+
+struct BenchAckData
+{
+    int dummy;
+};
+
+const int AckBitsNumConnections = 1024;
+const int AckBitsIterations = 256;
+
+static void bench_ack_bits_reference( const protocol2::SequenceBuffer<BenchAckData> & packets, uint16_t & ack, uint32_t & ack_bits )
+{
+    // the per-sequence Find loop GenerateAckBits used before GetAckBits
+
+    ack = packets.GetSequence() - 1;
+    ack_bits = 0;
+    for ( int i = 0; i < 32; ++i )
+    {
+        if ( packets.Find( ack - i ) )
+            ack_bits |= uint32_t(1) << i;
+    }
+}
+
+void bench_generate_ack_bits()
+{
+    printf( "bench_generate_ack_bits (ns per connection per packet)\n" );
+
+    // one received packet buffer per connection, each with ~10% loss, as a server would hold them
+
+    protocol2::SequenceBuffer<BenchAckData> ** connections = new protocol2::SequenceBuffer<BenchAckData>*[AckBitsNumConnections];
+    for ( int i = 0; i < AckBitsNumConnections; ++i )
+    {
+        connections[i] = new protocol2::SequenceBuffer<BenchAckData>( 256 );
+        uint16_t sequence = uint16_t( rand() );
+        for ( int j = 0; j < 300; ++j, ++sequence )
+        {
+            if ( rand() % 10 )
+                connections[i]->Insert( sequence );
+        }
+    }
+
+    uint16_t ack;
+    uint32_t ack_bits;
+
+    double start = time_seconds();
+    for ( int i = 0; i < AckBitsIterations; ++i )
+    {
+        for ( int j = 0; j < AckBitsNumConnections; ++j )
+        {
+            bench_ack_bits_reference( *connections[j], ack, ack_bits );
+            bench_sink += ack_bits;
+        }
+    }
+    const double reference_time = time_seconds() - start;
+
+    start = time_seconds();
+    for ( int i = 0; i < AckBitsIterations; ++i )
+    {
+        for ( int j = 0; j < AckBitsNumConnections; ++j )
+        {
+            protocol2::GenerateAckBits( *connections[j], ack, ack_bits );
+            bench_sink += ack_bits;
+        }
+    }
+    const double word_time = time_seconds() - start;
+
+    const double calls = double( AckBitsIterations ) * AckBitsNumConnections;
+    printf( "    find loop:     %.1f\n", reference_time / calls * 1000000000.0 );
+    printf( "    word parallel: %.1f\n", word_time / calls * 1000000000.0 );
+
+    for ( int i = 0; i < AckBitsNumConnections; ++i )
+        delete connections[i];
+    delete [] connections;
+}
+
+const int PacketSequenceNumPackets = 256;
+const int PacketSequenceIterations = 20000;
+
+static void bench_reference_compress_packet_sequence( uint64_t sequence, uint8_t & prefix_byte, int & num_sequence_bytes, uint8_t * sequence_bytes )
+{
+    // the bit by bit loop CompressPacketSequence used before
+
+    prefix_byte = 0;
+    num_sequence_bytes = 0;
+    for ( int i = 7; i > 0; --i )
+    {
+        const uint8_t current_sequence_byte = uint8_t( sequence >> (i*8) );
+        if ( current_sequence_byte != 0 )
+        {
+            sequence_bytes[num_sequence_bytes++] = current_sequence_byte;
+            prefix_byte |= ( 1 << (i-1) );
+        }
+    }
+    sequence_bytes[num_sequence_bytes++] = (uint8_t) ( sequence & 0xFF );
+}
+
+static uint64_t bench_reference_decompress_packet_sequence( uint8_t prefix_byte, const uint8_t * sequence_bytes )
+{
+    uint64_t sequence = 0;
+    int index = 0;
+    for ( int i = 7; i > 0; --i )
+    {
+        if ( prefix_byte & ( 1 << (i-1) ) )
+            sequence |= ( uint64_t( sequence_bytes[index++] ) << (i*8) );
+    }
+    sequence |= uint64_t( sequence_bytes[index] );
+    return sequence;
+}
+
+void bench_packet_sequence()
+{
+    printf( "bench_packet_sequence (ns per sequence, compress + decompress)\n" );
+
+    // per-connection sequences spread over the first few bytes, like a server sending to many clients
+
+    static uint64_t sequences[PacketSequenceNumPackets];
+    static uint8_t prefix_bytes[PacketSequenceNumPackets];
+    static int num_sequence_bytes[PacketSequenceNumPackets];
+    static uint8_t buffers[PacketSequenceNumPackets][8];
+    static uint64_t decoded_sequences[PacketSequenceNumPackets];
+    uint8_t * sequence_bytes[PacketSequenceNumPackets];
+    const uint8_t * const_sequence_bytes[PacketSequenceNumPackets];
+
+    for ( int i = 0; i < PacketSequenceNumPackets; ++i )
+    {
+        sequences[i] = uint64_t( rand() ) << ( rand() % 24 );
+        sequence_bytes[i] = buffers[i];
+        const_sequence_bytes[i] = buffers[i];
+    }
+
+    double start = time_seconds();
+    for ( int i = 0; i < PacketSequenceIterations; ++i )
+    {
+        for ( int j = 0; j < PacketSequenceNumPackets; ++j )
+            bench_reference_compress_packet_sequence( sequences[j] + i, prefix_bytes[j], num_sequence_bytes[j], buffers[j] );
+        for ( int j = 0; j < PacketSequenceNumPackets; ++j )
+            bench_sink += bench_reference_decompress_packet_sequence( prefix_bytes[j], buffers[j] );
+    }
+    const double reference_time = time_seconds() - start;
+
+    start = time_seconds();
+    for ( int i = 0; i < PacketSequenceIterations; ++i )
+    {
+        for ( int j = 0; j < PacketSequenceNumPackets; ++j )
+            protocol2::CompressPacketSequence( sequences[j] + i, prefix_bytes[j], num_sequence_bytes[j], buffers[j] );
+        for ( int j = 0; j < PacketSequenceNumPackets; ++j )
+            bench_sink += protocol2::DecompressPacketSequence( prefix_bytes[j], buffers[j] );
+    }
+    const double single_time = time_seconds() - start;
+
+    start = time_seconds();
+    for ( int i = 0; i < PacketSequenceIterations; ++i )
+    {
+        sequences[i % PacketSequenceNumPackets]++;
+        protocol2::CompressPacketSequences( PacketSequenceNumPackets, sequences, prefix_bytes, num_sequence_bytes, sequence_bytes );
+        protocol2::DecompressPacketSequences( PacketSequenceNumPackets, prefix_bytes, const_sequence_bytes, decoded_sequences );
+        bench_sink += decoded_sequences[i % PacketSequenceNumPackets];
+    }
+    const double batch_time = time_seconds() - start;
+
+    const double count = double( PacketSequenceIterations ) * PacketSequenceNumPackets;
+    printf( "    bit by bit: %.2f\n", reference_time / count * 1000000000.0 );
+    printf( "    table:      %.2f\n", single_time / count * 1000000000.0 );
+    printf( "    batched:    %.2f\n", batch_time / count * 1000000000.0 );
+}
+
+const int ClassifyNumSequences = 48;
+const int ClassifyIterations = 200000;
+
+void bench_classify_sequences()
+{
+    printf( "bench_classify_sequences (ns per sequence)\n" );
+
+    // a tick's worth of received message ids for one connection, mostly in the window
+
+    uint16_t sequences[ClassifyNumSequences];
+    uint8_t classes[ClassifyNumSequences];
+
+    const uint16_t window_start = 65500;
+    const int window_size = 256;
+
+    for ( int i = 0; i < ClassifyNumSequences; ++i )
+        sequences[i] = uint16_t( window_start + ( rand() % 300 ) - 20 );
+
+    double start = time_seconds();
+    for ( int i = 0; i < ClassifyIterations; ++i )
+    {
+        const uint16_t window_end = uint16_t( window_start + window_size - 1 );
+        for ( int j = 0; j < ClassifyNumSequences; ++j )
+        {
+            if ( protocol2::sequence_less_than( sequences[j], window_start ) )
+                classes[j] = PROTOCOL2_SEQUENCE_TOO_OLD;
+            else if ( protocol2::sequence_greater_than( sequences[j], window_end ) )
+                classes[j] = PROTOCOL2_SEQUENCE_TOO_NEW;
+            else
+                classes[j] = PROTOCOL2_SEQUENCE_IN_WINDOW;
+        }
+        bench_sink += classes[i % ClassifyNumSequences];
+        sequences[i % ClassifyNumSequences] ^= 1;
+    }
+    const double scalar_time = time_seconds() - start;
+
+    start = time_seconds();
+    for ( int i = 0; i < ClassifyIterations; ++i )
+    {
+        protocol2::ClassifySequences( sequences, ClassifyNumSequences, window_start, window_size, classes );
+        bench_sink += classes[i % ClassifyNumSequences];
+        sequences[i % ClassifyNumSequences] ^= 1;
+    }
+    const double batch_time = time_seconds() - start;
+
+    const double count = double( ClassifyIterations ) * ClassifyNumSequences;
+    printf( "    scalar compares: %.2f\n", scalar_time / count * 1000000000.0 );
+    printf( "    batch:           %.2f\n", batch_time / count * 1000000000.0 );
+}
+
+const int SocketBenchSendPort = 40000;
+const int SocketBenchReceivePort = 40001;
+const int SocketBenchPacketBytes = 100;
+const int SocketBenchBurst = 32;
+const int SocketBenchIterations = 4000;
+
+struct SocketBenchResult
+{
+    double time;
+    int packetsReceived;
+    int syscalls;
+};
+
+static void bench_socket_print( const char * name, const SocketBenchResult & result )
+{
+    printf( "    %s %.0f packets/sec, %.3f syscalls/packet (%d/%d packets received)\n", name,
+        result.packetsReceived / result.time, result.syscalls / double( result.packetsReceived ),
+        result.packetsReceived, SocketBenchBurst * SocketBenchIterations );
+}
+
+static void bench_socket_batch_loopback()
+{
+    network2::Socket sendSocket( SocketBenchSendPort, network2::SOCKET_TYPE_IPV4 );
+    network2::Socket receiveSocket( SocketBenchReceivePort, network2::SOCKET_TYPE_IPV4 );
+
+    if ( sendSocket.IsError() || receiveSocket.IsError() )
+    {
+        printf( "    failed to create sockets\n" );
+        return;
+    }
+
+    network2::Address to[SocketBenchBurst];
+    network2::Address from[NETWORK2_SOCKET_BATCH_SIZE];
+    static uint8_t receiveBuffer[NETWORK2_SOCKET_BATCH_SIZE][SocketBenchPacketBytes];
+    uint8_t sendBuffer[SocketBenchPacketBytes];
+    const void * sendPacketData[SocketBenchBurst];
+    void * receivePacketData[NETWORK2_SOCKET_BATCH_SIZE];
+    int sendPacketBytes[SocketBenchBurst];
+    int receivePacketBytes[NETWORK2_SOCKET_BATCH_SIZE];
+
+    memset( sendBuffer, 0x5A, sizeof( sendBuffer ) );
+
+    for ( int i = 0; i < SocketBenchBurst; ++i )
+    {
+        to[i] = network2::Address( 127, 0, 0, 1, SocketBenchReceivePort );
+        sendPacketData[i] = sendBuffer;
+        sendPacketBytes[i] = SocketBenchPacketBytes;
+    }
+
+    for ( int i = 0; i < NETWORK2_SOCKET_BATCH_SIZE; ++i )
+        receivePacketData[i] = receiveBuffer[i];
+
+    // syscalls are counted by the sockets, so fallback paths (eg. no sendmmsg or GSO) are measured, not assumed
+
+    // one syscall per packet, then one more to find the socket empty. this is how the 009 server used to drain its socket
+
+    SocketBenchResult single;
+    memset( &single, 0, sizeof( single ) );
+
+    uint64_t startSyscalls = sendSocket.GetNumSyscalls() + receiveSocket.GetNumSyscalls();
+    double start = time_seconds();
+    for ( int i = 0; i < SocketBenchIterations; ++i )
+    {
+        for ( int j = 0; j < SocketBenchBurst; ++j )
+        {
+            sendSocket.SendPacket( to[j], sendBuffer, SocketBenchPacketBytes );
+        }
+
+        while ( true )
+        {
+            const int bytes = receiveSocket.ReceivePacket( from[0], receiveBuffer[0], SocketBenchPacketBytes );
+            if ( !bytes )
+                break;
+            single.packetsReceived++;
+        }
+    }
+    single.time = time_seconds() - start;
+    single.syscalls = int( sendSocket.GetNumSyscalls() + receiveSocket.GetNumSyscalls() - startSyscalls );
+
+    // same again with the destination resolved to a sockaddr once up front, and the source left as a sockaddr
+
+    const network2::ResolvedAddress resolvedTo( to[0] );
+    network2::ResolvedAddress resolvedFrom;
+
+    SocketBenchResult resolved;
+    memset( &resolved, 0, sizeof( resolved ) );
+
+    startSyscalls = sendSocket.GetNumSyscalls() + receiveSocket.GetNumSyscalls();
+    start = time_seconds();
+    for ( int i = 0; i < SocketBenchIterations; ++i )
+    {
+        for ( int j = 0; j < SocketBenchBurst; ++j )
+        {
+            sendSocket.SendPacket( resolvedTo, sendBuffer, SocketBenchPacketBytes );
+        }
+
+        while ( true )
+        {
+            const int bytes = receiveSocket.ReceivePacket( resolvedFrom, receiveBuffer[0], SocketBenchPacketBytes );
+            if ( !bytes )
+                break;
+            resolved.packetsReceived++;
+        }
+    }
+    resolved.time = time_seconds() - start;
+    resolved.syscalls = int( sendSocket.GetNumSyscalls() + receiveSocket.GetNumSyscalls() - startSyscalls );
+
+    // batched. with recvmmsg/sendmmsg each call below is a single syscall, otherwise it falls back to one per packet
+
+    SocketBenchResult batch;
+    memset( &batch, 0, sizeof( batch ) );
+
+    startSyscalls = sendSocket.GetNumSyscalls() + receiveSocket.GetNumSyscalls();
+    start = time_seconds();
+    for ( int i = 0; i < SocketBenchIterations; ++i )
+    {
+        sendSocket.SendPackets( to, sendPacketData, sendPacketBytes, SocketBenchBurst );
+
+        while ( true )
+        {
+            const int numPackets = receiveSocket.ReceivePackets( from, receivePacketData, receivePacketBytes, SocketBenchPacketBytes, NETWORK2_SOCKET_BATCH_SIZE );
+            batch.packetsReceived += numPackets;
+            if ( numPackets < NETWORK2_SOCKET_BATCH_SIZE )
+                break;
+        }
+    }
+    batch.time = time_seconds() - start;
+    batch.syscalls = int( sendSocket.GetNumSyscalls() + receiveSocket.GetNumSyscalls() - startSyscalls );
+
+    // the whole burst as one segmented send (GSO), received in batches
+
+    static uint8_t segmentsBuffer[SocketBenchBurst * SocketBenchPacketBytes];
+    memset( segmentsBuffer, 0x5A, sizeof( segmentsBuffer ) );
+
+    SocketBenchResult segments;
+    memset( &segments, 0, sizeof( segments ) );
+
+    startSyscalls = sendSocket.GetNumSyscalls() + receiveSocket.GetNumSyscalls();
+    start = time_seconds();
+    for ( int i = 0; i < SocketBenchIterations; ++i )
+    {
+        sendSocket.SendPacketSegments( to[0], segmentsBuffer, sizeof( segmentsBuffer ), SocketBenchPacketBytes );
+
+        while ( true )
+        {
+            const int numPackets = receiveSocket.ReceivePackets( from, receivePacketData, receivePacketBytes, SocketBenchPacketBytes, NETWORK2_SOCKET_BATCH_SIZE );
+            segments.packetsReceived += numPackets;
+            if ( numPackets < NETWORK2_SOCKET_BATCH_SIZE )
+                break;
+        }
+    }
+    segments.time = time_seconds() - start;
+    segments.syscalls = int( sendSocket.GetNumSyscalls() + receiveSocket.GetNumSyscalls() - startSyscalls );
+
+    bench_sink += receivePacketBytes[0];
+
+    bench_socket_print( "single:  ", single );
+    bench_socket_print( "resolved:", resolved );
+    bench_socket_print( "batch:   ", batch );
+    bench_socket_print( "segments:", segments );
+
+#if NETWORK2_IO_URING
+
+    // io_uring: sends are queued and submitted together, packets arrive through a multishot receive.
+    // the rings count their own syscalls, since completions can be picked up without entering the kernel
+
+    network2::IoUringSocket sendRing( sendSocket, SocketBenchPacketBytes );
+    network2::IoUringSocket receiveRing( receiveSocket, SocketBenchPacketBytes );
+
+    if ( sendRing.IsError() || receiveRing.IsError() )
+    {
+        printf( "    io_uring: not available\n" );
+        return;
+    }
+
+    network2::ReceivedPacket receivedPackets[NETWORK2_SOCKET_BATCH_SIZE];
+
+    SocketBenchResult uring;
+    memset( &uring, 0, sizeof( uring ) );
+
+    startSyscalls = sendRing.GetNumSyscalls() + receiveRing.GetNumSyscalls();
+
+    start = time_seconds();
+    for ( int i = 0; i < SocketBenchIterations; ++i )
+    {
+        for ( int j = 0; j < SocketBenchBurst; ++j )
+            sendRing.SendPacket( to[j], sendBuffer, SocketBenchPacketBytes );
+
+        sendRing.Flush();
+
+        int burstReceived = 0;
+        while ( burstReceived < SocketBenchBurst )
+        {
+            const int numPackets = receiveRing.ReceivePackets( receivedPackets, NETWORK2_SOCKET_BATCH_SIZE, 1 );
+            if ( !numPackets )
+                break;
+            burstReceived += numPackets;
+            bench_sink += receivedPackets[0].packetBytes;
+        }
+
+        uring.packetsReceived += burstReceived;
+    }
+    uring.time = time_seconds() - start;
+    uring.syscalls = int( sendRing.GetNumSyscalls() + receiveRing.GetNumSyscalls() - startSyscalls );
+
+    bench_socket_print( "io_uring:", uring );
+
+#endif // #if NETWORK2_IO_URING
+}
+
+void bench_socket_batch()
+{
+    printf( "bench_socket_batch (loopback, %d byte packets in bursts of %d)\n", SocketBenchPacketBytes, SocketBenchBurst );
+
+    network2::InitializeNetwork();
+
+    bench_socket_batch_loopback();
+
+    network2::ShutdownNetwork();
+}
+
+const int AddressLookupIterations = 1000000;
+
+static network2::Address bench_address_lookup_key( int i )
+{
+    return network2::Address( 0x2001, 0xdb8, 0, uint16_t( i >> 16 ), 0, 0, uint16_t( rand() ), uint16_t( i ), uint16_t( 40000 + i % 1000 ) );
+}
+
+void bench_address_lookup()
+{
+    printf( "bench_address_lookup (ns per lookup)\n" );
+
+    const int clientCounts[] = { 64, 1024, 4096 };
+
+    for ( int c = 0; c < int( sizeof( clientCounts ) / sizeof( clientCounts[0] ) ); ++c )
+    {
+        const int numClients = clientCounts[c];
+
+        network2::Address * addresses = new network2::Address[numClients];
+        int * lookups = new int[AddressLookupIterations];
+
+        network2::AddressMap<int> map( numClients );
+
+        for ( int i = 0; i < numClients; ++i )
+        {
+            addresses[i] = bench_address_lookup_key( i );
+            map.Insert( addresses[i], i );
+        }
+
+        for ( int i = 0; i < AddressLookupIterations; ++i )
+            lookups[i] = rand() % numClients;
+
+        // linear scan, like the 009 server did per packet
+
+        double start = time_seconds();
+        for ( int i = 0; i < AddressLookupIterations; ++i )
+        {
+            const network2::Address & address = addresses[lookups[i]];
+            for ( int j = 0; j < numClients; ++j )
+            {
+                if ( addresses[j] == address )
+                {
+                    bench_sink += j;
+                    break;
+                }
+            }
+        }
+        const double linear_time = time_seconds() - start;
+
+        start = time_seconds();
+        for ( int i = 0; i < AddressLookupIterations; ++i )
+            bench_sink += *map.Find( addresses[lookups[i]] );
+        const double map_time = time_seconds() - start;
+
+        // challenge hash key: formatting the address as a string vs hashing its bytes
+
+        start = time_seconds();
+        for ( int i = 0; i < AddressLookupIterations; ++i )
+        {
+            char buffer[256];
+            const char * addressString = addresses[lookups[i]].ToString( buffer, sizeof( buffer ) );
+            bench_sink += protocol2::murmur_hash_64( addressString, (uint32_t) strlen( addressString ), 0 );
+        }
+        const double string_hash_time = time_seconds() - start;
+
+        start = time_seconds();
+        for ( int i = 0; i < AddressLookupIterations; ++i )
+            bench_sink += network2::HashAddress( addresses[lookups[i]] );
+        const double address_hash_time = time_seconds() - start;
+
+        printf( "    %4d clients: linear %.2f, map %.2f, string hash %.2f, address hash %.2f\n", numClients,
+            linear_time / AddressLookupIterations * 1000000000.0,
+            map_time / AddressLookupIterations * 1000000000.0,
+            string_hash_time / AddressLookupIterations * 1000000000.0,
+            address_hash_time / AddressLookupIterations * 1000000000.0 );
+
+        delete [] addresses;
+        delete [] lookups;
+    }
+}
+
+const int SimulatorNumEntries = 16384;
+const int SimulatorPacketsInFlight = 10000;
+const int SimulatorIterations = 10;
+const int SimulatorSteps = 100;
+const int SimulatorBatchSize = 64;
+
+static double bench_simulator_drain( bool batch )
+{
+    const network2::Address from( 127, 0, 0, 1, 40000 );
+    const network2::Address to( 127, 0, 0, 1, 40001 );
+
+    network2::Simulator simulator( SimulatorNumEntries );
+    simulator.SetLatency( 100.0f );
+    simulator.SetJitter( 50.0f );
+
+    network2::Address packetFrom[SimulatorBatchSize];
+    network2::Address packetTo[SimulatorBatchSize];
+    uint8_t * packetData[SimulatorBatchSize];
+    int packetSize[SimulatorBatchSize];
+
+    double t = 0.0;
+    int numReceived = 0;
+
+    const double start = time_seconds();
+
+    for ( int i = 0; i < SimulatorIterations; ++i )
+    {
+        for ( int j = 0; j < SimulatorPacketsInFlight; ++j )
+            simulator.SendPacket( from, to, new uint8_t[32], 32 );
+
+        // advance past the max latency + jitter in steps, draining whatever is due at each step
+
+        for ( int j = 0; j < SimulatorSteps; ++j )
+        {
+            t += 0.2 / SimulatorSteps;
+            simulator.Update( t );
+
+            if ( batch )
+            {
+                int numPackets;
+                while ( ( numPackets = simulator.ReceivePackets( packetFrom, packetTo, packetData, packetSize, SimulatorBatchSize ) ) > 0 )
+                {
+                    for ( int k = 0; k < numPackets; ++k )
+                    {
+                        bench_sink += packetSize[k];
+                        delete [] packetData[k];
+                    }
+                    numReceived += numPackets;
+                }
+            }
+            else
+            {
+                while ( uint8_t * data = simulator.ReceivePacket( packetFrom[0], packetTo[0], packetSize[0] ) )
+                {
+                    bench_sink += packetSize[0];
+                    delete [] data;
+                    numReceived++;
+                }
+            }
+        }
+    }
+
+    const double time = time_seconds() - start;
+
+    if ( numReceived != SimulatorIterations * SimulatorPacketsInFlight )
+        printf( "    error: only %d/%d packets received\n", numReceived, SimulatorIterations * SimulatorPacketsInFlight );
+
+    return time / numReceived * 1000000000.0;
+}
+
+void bench_simulator()
+{
+    printf( "bench_simulator (%d packets in flight, ns per packet sent and received)\n", SimulatorPacketsInFlight );
+
+    printf( "    single: %.2f\n", bench_simulator_drain( false ) );
+    printf( "    batch:  %.2f\n", bench_simulator_drain( true ) );
+}
+
+int main()
+{
+    srand( 0 );
+
+    bench_bitpacker();
+
+    bench_serialize_bits64();
+
+    bench_serialize_bounds();
+
+    bench_crc32();
+
+    bench_packet_factory();
+
+    bench_generate_ack_bits();
+
+    bench_packet_sequence();
+
+    bench_classify_sequences();
+
+    bench_socket_batch();
+
+    bench_address_lookup();
+
+    bench_simulator();
+
+    return 0;
+}
@@ -52,9 +52,70 @@
 #define NETWORK2_PLATFORM NETWORK2_PLATFORM_UNIX
 #endif
 
+#if NETWORK2_PLATFORM == NETWORK2_PLATFORM_UNIX && defined(__linux__)
+#define NETWORK2_MMSG 1                                 // recvmmsg/sendmmsg. requires _GNU_SOURCE, which g++ defines by default
+#else
+#define NETWORK2_MMSG 0
+#endif
+
+#define NETWORK2_SOCKET_BATCH_SIZE 64                   // max packets per recvmmsg/sendmmsg syscall. larger batches are split
+
+#if NETWORK2_PLATFORM == NETWORK2_PLATFORM_UNIX && defined(__linux__)
+#define NETWORK2_UDP_SEGMENTS 1                         // UDP_SEGMENT (GSO) send and UDP_GRO receive. linux 4.18+ and 5.0+ respectively
+#else
+#define NETWORK2_UDP_SEGMENTS 0
+#endif
+
+#if NETWORK2_PLATFORM != NETWORK2_PLATFORM_WINDOWS
+#define NETWORK2_REUSE_PORT 1                           // SO_REUSEPORT. linux load balances between sockets on the same port, mac does not
+#else
+#define NETWORK2_REUSE_PORT 0
+#endif
+
+#define NETWORK2_MAX_SEGMENTS 64                        // max segments per segmented send. matches UDP_MAX_SEGMENTS on older kernels
+#define NETWORK2_MAX_SEGMENTS_BYTES 65507               // max bytes per segmented send or receive. the largest ipv4 udp payload
+
+#ifndef NETWORK2_IO_URING
+#if NETWORK2_PLATFORM == NETWORK2_PLATFORM_UNIX && defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+#if defined(IORING_RECV_MULTISHOT)
+#define NETWORK2_IO_URING 1                             // io_uring socket backend. needs linux 6.0+ headers to build, and a 6.0+ kernel to run
+#else
+#define NETWORK2_IO_URING 0
+#endif
+#endif // #ifndef NETWORK2_IO_URING
+
+#if NETWORK2_PLATFORM == NETWORK2_PLATFORM_UNIX && defined(__linux__)
+#define NETWORK2_EPOLL 1                                // SocketPoller, built on epoll and timerfd
+#else
+#define NETWORK2_EPOLL 0
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define NETWORK2_SSE2 1                                 // AddressMap compares 16 control bytes per probe
+#else
+#define NETWORK2_SSE2 0
+#endif
+
+#if NETWORK2_SSE2
+#include <emmintrin.h>
+#endif // #if NETWORK2_SSE2
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // #ifdef _MSC_VER
+
 struct addrinfo;
 struct sockaddr_in6;
 struct sockaddr_storage;
+struct sockaddr;
+struct msghdr;
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
 
 namespace network2
 {
@@ -150,6 +211,270 @@ namespace network2
         void Parse( const char * address );
     };
 
+    uint64_t HashAddress( const Address & address, uint64_t seed = 0 );
+
+    const uint8_t AddressMapEmpty = 0x80;                // control byte for a slot that has never been used since the last rebuild
+    const uint8_t AddressMapDeleted = 0xFE;              // control byte for a removed slot. probes continue past these
+    const int AddressMapGroupSize = 16;                  // slots per probe group. one SSE2 compare covers a whole group
+
+    template <typename T> class AddressMap
+    {
+        // open addressing hash map from address to T, with a fixed capacity set at construction.
+        // each slot has a control byte holding the low 7 bits of its hash, or empty/deleted.
+        // lookups probe a group of 16 slots at a time, so a miss usually costs one compare and no key comparisons.
+
+    public:
+
+        AddressMap( int capacity )
+        {
+            assert( capacity > 0 );
+            m_capacity = capacity;
+            m_numSlots = AddressMapGroupSize;
+            while ( m_numSlots - m_numSlots / 8 < capacity )
+                m_numSlots *= 2;
+            m_groupMask = m_numSlots / AddressMapGroupSize - 1;
+            m_maxUsedSlots = m_numSlots - m_numSlots / 16;
+            m_control = new uint8_t[m_numSlots];
+            m_keys = new Address[m_numSlots];
+            m_values = new T[m_numSlots];
+            Clear();
+        }
+
+        ~AddressMap()
+        {
+            delete [] m_control;
+            delete [] m_keys;
+            delete [] m_values;
+        }
+
+        void Clear()
+        {
+            memset( m_control, AddressMapEmpty, uint32_t( m_numSlots ) );
+            m_numEntries = 0;
+            m_numDeleted = 0;
+        }
+
+        T * Find( const Address & address )
+        {
+            const int slot = FindSlot( address, HashAddress( address ) );
+            return ( slot >= 0 ) ? &m_values[slot] : NULL;
+        }
+
+        const T * Find( const Address & address ) const
+        {
+            const int slot = FindSlot( address, HashAddress( address ) );
+            return ( slot >= 0 ) ? &m_values[slot] : NULL;
+        }
+
+        bool Insert( const Address & address, const T & value )
+        {
+            // inserts or replaces the value for this address. returns false if the map is at capacity
+
+            assert( address.IsValid() );
+
+            const uint64_t hash = HashAddress( address );
+
+            int slot = FindSlot( address, hash );
+            if ( slot >= 0 )
+            {
+                m_values[slot] = value;
+                return true;
+            }
+
+            if ( m_numEntries == m_capacity )
+                return false;
+
+            if ( m_numEntries + m_numDeleted >= m_maxUsedSlots )
+                Rebuild();
+
+            slot = FindFreeSlot( hash );
+            assert( slot >= 0 );
+
+            if ( m_control[slot] == AddressMapDeleted )
+                m_numDeleted--;
+
+            m_control[slot] = uint8_t( hash & 0x7F );
+            m_keys[slot] = address;
+            m_values[slot] = value;
+            m_numEntries++;
+
+            return true;
+        }
+
+        bool Remove( const Address & address )
+        {
+            const int slot = FindSlot( address, HashAddress( address ) );
+            if ( slot < 0 )
+                return false;
+
+            // IMPORTANT: a group that still has an empty slot has never been full, so no probe has ever continued past it.
+            // that makes it safe to mark the slot empty instead of deleted, which keeps probe chains short under churn.
+
+            const uint8_t * group = m_control + ( slot & ~( AddressMapGroupSize - 1 ) );
+            if ( MatchGroup( group, AddressMapEmpty ) )
+            {
+                m_control[slot] = AddressMapEmpty;
+            }
+            else
+            {
+                m_control[slot] = AddressMapDeleted;
+                m_numDeleted++;
+            }
+
+            m_keys[slot] = Address();
+            m_values[slot] = T();
+            m_numEntries--;
+
+            return true;
+        }
+
+        int GetNumEntries() const
+        {
+            return m_numEntries;
+        }
+
+        int GetCapacity() const
+        {
+            return m_capacity;
+        }
+
+    private:
+
+        AddressMap( const AddressMap & other );
+
+        AddressMap & operator = ( const AddressMap & other );
+
+        static uint32_t MatchGroup( const uint8_t * group, uint8_t value )
+        {
+            // returns a bitmask with bit n set if control byte n in the group equals value
+#if NETWORK2_SSE2
+            const __m128i control = _mm_loadu_si128( (const __m128i*) group );
+            return (uint32_t) _mm_movemask_epi8( _mm_cmpeq_epi8( control, _mm_set1_epi8( (char) value ) ) );
+#else // #if NETWORK2_SSE2
+            uint32_t mask = 0;
+            for ( int i = 0; i < AddressMapGroupSize; ++i )
+            {
+                if ( group[i] == value )
+                    mask |= 1U << i;
+            }
+            return mask;
+#endif // #if NETWORK2_SSE2
+        }
+
+        static uint32_t MatchFree( const uint8_t * group )
+        {
+            // empty and deleted control bytes are the only ones with the high bit set
+#if NETWORK2_SSE2
+            return (uint32_t) _mm_movemask_epi8( _mm_loadu_si128( (const __m128i*) group ) );
+#else // #if NETWORK2_SSE2
+            uint32_t mask = 0;
+            for ( int i = 0; i < AddressMapGroupSize; ++i )
+            {
+                if ( group[i] & 0x80 )
+                    mask |= 1U << i;
+            }
+            return mask;
+#endif // #if NETWORK2_SSE2
+        }
+
+        static int FirstMatch( uint32_t mask )
+        {
+            assert( mask );
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward( &index, mask );
+            return (int) index;
+#else // #ifdef _MSC_VER
+            return __builtin_ctz( mask );
+#endif // #ifdef _MSC_VER
+        }
+
+        int FindSlot( const Address & address, uint64_t hash ) const
+        {
+            const uint8_t tag = uint8_t( hash & 0x7F );
+            int group = int( ( hash >> 7 ) & m_groupMask );
+            for ( int i = 0; i <= m_groupMask; ++i )
+            {
+                const int groupStart = group * AddressMapGroupSize;
+                uint32_t match = MatchGroup( m_control + groupStart, tag );
+                while ( match )
+                {
+                    const int slot = groupStart + FirstMatch( match );
+                    if ( m_keys[slot] == address )
+                        return slot;
+                    match &= match - 1;
+                }
+                if ( MatchGroup( m_control + groupStart, AddressMapEmpty ) )
+                    return -1;
+                group = ( group + 1 ) & m_groupMask;
+            }
+            return -1;
+        }
+
+        int FindFreeSlot( uint64_t hash ) const
+        {
+            int group = int( ( hash >> 7 ) & m_groupMask );
+            for ( int i = 0; i <= m_groupMask; ++i )
+            {
+                const int groupStart = group * AddressMapGroupSize;
+                const uint32_t match = MatchFree( m_control + groupStart );
+                if ( match )
+                    return groupStart + FirstMatch( match );
+                group = ( group + 1 ) & m_groupMask;
+            }
+            return -1;
+        }
+
+        void Rebuild()
+        {
+            // too many deleted slots. reinsert every entry so probes can stop at empty slots again.
+            // this allocates temporary copies of the entries, but only runs after heavy insert/remove churn
+
+            const int numEntries = m_numEntries;
+            Address * keys = new Address[numEntries > 0 ? numEntries : 1];
+            T * values = new T[numEntries > 0 ? numEntries : 1];
+
+            int count = 0;
+            for ( int i = 0; i < m_numSlots; ++i )
+            {
+                if ( m_control[i] & 0x80 )
+                    continue;
+                keys[count] = m_keys[i];
+                values[count] = m_values[i];
+                m_keys[i] = Address();
+                m_values[i] = T();
+                count++;
+            }
+            assert( count == numEntries );
+
+            Clear();
+
+            for ( int i = 0; i < count; ++i )
+            {
+                const uint64_t hash = HashAddress( keys[i] );
+                const int slot = FindFreeSlot( hash );
+                assert( slot >= 0 );
+                m_control[slot] = uint8_t( hash & 0x7F );
+                m_keys[slot] = keys[i];
+                m_values[slot] = values[i];
+            }
+            m_numEntries = count;
+
+            delete [] keys;
+            delete [] values;
+        }
+
+        int m_capacity;                                 // max entries, as passed to the constructor
+        int m_numSlots;                                 // number of slots. a power of two, at least 8/7 of capacity
+        int m_groupMask;                                // number of groups minus one
+        int m_maxUsedSlots;                             // entries plus deleted slots reaching this trigger a rebuild. 15/16 of the slots, so probes always reach an empty slot
+        int m_numEntries;                               // number of entries in the map
+        int m_numDeleted;                               // number of slots marked deleted
+        uint8_t * m_control;                            // control byte per slot: empty, deleted, or the low 7 bits of the hash
+        Address * m_keys;                               // address per slot
+        T * m_values;                                   // value per slot
+    };
+
 #if NETWORK2_SOCKETS
 
     enum SocketType
@@ -167,7 +492,8 @@ namespace network2
         SOCKET_ERROR_BIND_IPV4_FAILED,
         SOCKET_ERROR_BIND_IPV6_FAILED,
         SOCKET_ERROR_GET_SOCKNAME_IPV4_FAILED,
-        SOCKET_ERROR_GET_SOCKNAME_IPV6_FAILED    
+        SOCKET_ERROR_GET_SOCKNAME_IPV6_FAILED,
+        SOCKET_ERROR_SOCKOPT_REUSE_PORT_FAILED
     };
 
 #if NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
@@ -176,11 +502,43 @@ namespace network2
 	typedef int SocketHandle;
 #endif // #if NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
 						   
+    class ResolvedAddress
+    {
+    public:
+
+        ResolvedAddress();
+
+        explicit ResolvedAddress( const Address & address );
+
+        void Set( const Address & address );
+
+        void Clear();
+
+        bool IsValid() const;
+
+        Address GetAddress() const;
+
+        const sockaddr * GetSockaddr() const;
+
+        int GetSockaddrLength() const;
+
+        bool operator ==( const ResolvedAddress & other ) const;
+
+        bool operator !=( const ResolvedAddress & other ) const;
+
+    private:
+
+        friend class Socket;
+
+        uint64_t m_sockaddr[4];                         // sockaddr_in or sockaddr_in6, in network byte order, ready to pass to sendto
+        int m_length;                                   // size of the sockaddr in bytes. 0 if not valid
+    };
+
     class Socket
     {
     public:
 
-        Socket( uint16_t port, SocketType type = SOCKET_TYPE_IPV6 );
+        Socket( uint16_t port, SocketType type = SOCKET_TYPE_IPV6, bool reusePort = false );
 
         ~Socket();
 
@@ -188,17 +546,232 @@ namespace network2
 
         int GetError() const;
 
+        uint16_t GetPort() const;
+
+        SocketHandle GetHandle() const;
+
         bool SendPacket( const Address & address, const void * packetData, size_t packetBytes );
     
         int ReceivePacket( Address & from, void * packetData, int maxPacketSize );
 
+        bool SendPacket( const ResolvedAddress & address, const void * packetData, size_t packetBytes );
+
+        int ReceivePacket( ResolvedAddress & from, void * packetData, int maxPacketSize );
+
+        bool WaitForPackets( int timeoutMilliseconds );
+
+        int SendPackets( const Address * to, const void * const * packetData, const int * packetBytes, int numPackets );
+
+        int ReceivePackets( Address * from, void * const * packetData, int * packetBytes, int maxPacketSize, int maxPackets );
+
+        int SendPackets( const ResolvedAddress * to, const void * const * packetData, const int * packetBytes, int numPackets );
+
+        int ReceivePackets( ResolvedAddress * from, void * const * packetData, int * packetBytes, int maxPacketSize, int maxPackets );
+
+        int SendPacketSegments( const Address & address, const void * packetData, int packetBytes, int segmentSize );
+
+        bool EnableReceiveSegments();
+
+        int ReceivePacketSegments( Address & from, void * packetData, int maxPacketSize, int & segmentSize );
+
+        uint64_t GetNumSyscalls() const;
+
     private:
 
         int m_error;
         uint16_t m_port;
         SocketHandle m_socket;
+        uint64_t m_numSyscalls;                         // send and receive syscalls made, including ones that fail or find the socket empty
+    };
+
+    class SocketGroup
+    {
+    public:
+
+        SocketGroup( uint16_t port, int numSockets, SocketType type = SOCKET_TYPE_IPV6 );
+
+        ~SocketGroup();
+
+        bool IsError() const;
+
+        int GetError() const;
+
+        uint16_t GetPort() const;
+
+        int GetNumSockets() const;
+
+        Socket & GetSocket( int index );
+
+    private:
+
+        int m_error;
+        uint16_t m_port;
+        int m_numSockets;
+        Socket ** m_sockets;
+    };
+
+#if NETWORK2_IO_URING
+
+    enum IoUringError
+    {
+        IO_URING_ERROR_NONE,
+        IO_URING_ERROR_SETUP_FAILED,
+        IO_URING_ERROR_MAP_RINGS_FAILED,
+        IO_URING_ERROR_REGISTER_BUFFERS_FAILED,
+        IO_URING_ERROR_RECEIVE_FAILED
+    };
+
+    struct ReceivedPacket
+    {
+        Address from;                                   // address the packet came from
+        const uint8_t * packetData;                     // packet data. points into a receive buffer owned by the io_uring socket
+        int packetBytes;                                // size of the packet in bytes
+    };
+
+    class IoUringSocket
+    {
+    public:
+
+        IoUringSocket( Socket & socket, int maxPacketSize, int numReceiveBuffers = 256, int numSendBuffers = 64 );
+
+        ~IoUringSocket();
+
+        bool IsError() const;
+
+        int GetError() const;
+
+        bool SendPacket( const Address & address, const void * packetData, int packetBytes );
+
+        void Flush();
+
+        int ReceivePackets( ReceivedPacket * packets, int maxPackets, int timeoutMilliseconds = 0 );
+
+        uint64_t GetNumSyscalls() const;
+
+    private:
+
+        struct SendBuffer;
+
+        io_uring_sqe * GetSqe();
+
+        int Enter( int minComplete, int timeoutMilliseconds );
+
+        void ReapCompletions();
+
+        void ArmReceive();
+
+        void ReleaseBuffer( int bufferId );
+
+        void PublishBuffers();
+
+        int m_error;
+        Socket * m_socket;
+        int m_ringFd;
+        int m_maxPacketSize;
+        int m_bufferSize;                               // bytes per receive buffer: recvmsg header, source address, then the packet
+        int m_numReceiveBuffers;
+        int m_numSendBuffers;
+        uint64_t m_numSyscalls;
+        bool m_receiveArmed;                            // true while the multishot receive is queued with the kernel
+
+        void * m_sqRing;
+        void * m_cqRing;
+        size_t m_sqRingSize;
+        size_t m_cqRingSize;
+        io_uring_sqe * m_sqes;
+        size_t m_sqesSize;
+        uint32_t * m_sqHead;
+        uint32_t * m_sqTail;
+        uint32_t * m_sqFlags;
+        uint32_t m_sqMask;
+        uint32_t m_sqEntries;
+        uint32_t m_sqLocalTail;                         // sqes filled in but not yet made visible to the kernel
+        int m_numPendingSubmit;
+        uint32_t * m_cqHead;
+        uint32_t * m_cqTail;
+        uint32_t m_cqMask;
+        io_uring_cqe * m_cqes;
+
+        io_uring_buf_ring * m_bufferRing;               // provided buffer ring. the kernel picks a free receive buffer from here per packet
+        uint16_t m_bufferRingTail;
+        uint8_t * m_receiveBuffers;
+        msghdr * m_receiveMessage;
+
+        int * m_completedBufferId;                      // received packets reaped from the completion queue, not yet returned to the caller
+        int * m_completedBytes;
+        int m_completedHead;
+        int m_numCompleted;
+
+        int * m_releaseBufferId;                        // buffers handed to the caller by the last ReceivePackets. returned to the kernel on the next
+        int m_numRelease;
+
+        SendBuffer * m_sendBuffers;
+        uint8_t * m_sendData;
+        int * m_freeSendBuffers;
+        int m_numFreeSendBuffers;
+    };
+
+#endif // #if NETWORK2_IO_URING
+
+#if NETWORK2_EPOLL
+
+    enum SocketPollerEventType
+    {
+        SOCKET_POLLER_EVENT_SOCKET,
+        SOCKET_POLLER_EVENT_TIMER
+    };
+
+    struct SocketPollerEvent
+    {
+        SocketPollerEventType type;                     // socket has packets to receive, or a timer fired
+        Socket * socket;                                // the socket with packets. NULL for timer events
+        int timerId;                                    // the timer that fired. -1 for socket events
+        uint64_t timerExpirations;                      // number of timer intervals elapsed since the timer last fired
+        void * userData;                                // user data passed in when the socket or timer was added
+    };
+
+    class SocketPoller
+    {
+    public:
+
+        SocketPoller( int maxEntries = 256 );
+
+        ~SocketPoller();
+
+        bool IsError() const;
+
+        bool AddSocket( Socket & socket, void * userData = NULL );
+
+        bool RemoveSocket( Socket & socket );
+
+        int AddTimer( double intervalSeconds, void * userData = NULL );
+
+        bool RemoveTimer( int timerId );
+
+        int Wait( SocketPollerEvent * events, int maxEvents, int timeoutMilliseconds );
+
+    private:
+
+        int AllocateEntry( SocketPollerEventType type, int fd, Socket * socket, void * userData );
+
+        void FreeEntry( int index );
+
+        struct Entry
+        {
+            bool used;
+            SocketPollerEventType type;
+            int fd;
+            Socket * socket;
+            void * userData;
+        };
+
+        int m_epollFd;
+        int m_maxEntries;
+        Entry * m_entries;
     };
 
+#endif // #if NETWORK2_EPOLL
+
 #endif // #if NETWORK2_SOCKETS
 
 #if NETWORK2_SIMULATOR
@@ -218,21 +791,42 @@ namespace network2
             Entry()
             {
                 deliveryTime = 0.0;
+                sequence = 0;
                 packetData = NULL;
                 packetSize = 0;
+                heapIndex = -1;
             }
 
             Address from;                               // address this packet is from
             Address to;                                 // address this packet is sent to
             double deliveryTime;                        // delivery time for this packet
+            uint64_t sequence;                          // send order. breaks delivery time ties so equal times deliver in the order sent
             uint8_t *packetData;                        // packet data (owns pointer)
             int packetSize;                             // size of packet in bytes
+            int heapIndex;                              // index of this entry in the delivery heap, or -1 if the entry is empty
         };
 
         Entry * m_entries;                              // pointer to dynamically allocated packet entries. this is where buffered packets are stored.
 
+        int * m_heap;                                   // binary min-heap of entry indices ordered by delivery time. the root is the next packet due
+        int m_heapSize;                                 // number of packets in the heap. always equal to the number of non-empty entries
+
+        uint64_t m_sequence;                            // sequence number for the next packet sent
+
         double m_currentTime;                           // current time from last call to update. initially 0.0
 
+        void InsertEntry( const Address & from, const Address & to, uint8_t * packetData, int packetSize, double deliveryTime );
+
+        void RemoveEntry( int entryIndex );
+
+        bool HeapLess( int a, int b ) const;
+
+        void HeapSwap( int a, int b );
+
+        void HeapSiftUp( int heapIndex );
+
+        void HeapSiftDown( int heapIndex );
+
     public:
 
         Simulator( int numPackets = 1024 );
@@ -247,6 +841,10 @@ namespace network2
 
         uint8_t * ReceivePacket( Address & from, Address & to, int & packetSize );
 
+        int ReceivePackets( Address * from, Address * to, uint8_t ** packetData, int * packetSize, int maxPackets );
+
+        int GetNumPacketsInFlight() const;
+
         void Update( double t );
     };
 
@@ -283,6 +881,32 @@ namespace network2
     #include <arpa/inet.h>
     #include <unistd.h>
     #include <errno.h>
+
+    #if NETWORK2_UDP_SEGMENTS
+    #include <netinet/udp.h>
+    #ifndef SOL_UDP
+    #define SOL_UDP 17
+    #endif
+    #ifndef UDP_SEGMENT
+    #define UDP_SEGMENT 103
+    #endif
+    #ifndef UDP_GRO
+    #define UDP_GRO 104
+    #endif
+    #endif // #if NETWORK2_UDP_SEGMENTS
+
+    #include <poll.h>
+
+    #if NETWORK2_EPOLL
+    #include <sys/epoll.h>
+    #include <sys/timerfd.h>
+    #endif // #if NETWORK2_EPOLL
+
+    #if NETWORK2_IO_URING
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <linux/io_uring.h>
+    #endif // #if NETWORK2_IO_URING
     
 #else
 
@@ -600,13 +1224,51 @@ namespace network2
         return !( *this == other );
     }
 
-#if NETWORK2_SOCKETS
+    static inline uint64_t hash_address_word( uint64_t hash, uint64_t word )
+    {
+        word *= 0x87c37b91114253d5ULL;
+        word = ( word << 31 ) | ( word >> 33 );
+        word *= 0x4cf5ad432745937fULL;
+        hash ^= word;
+        hash = ( hash << 27 ) | ( hash >> 37 );
+        return hash * 5 + 0x52dce729;
+    }
 
-    Socket::Socket( uint16_t port, SocketType type )
+    uint64_t HashAddress( const Address & address, uint64_t seed )
+    {
+        // hashes the same fields operator == compares: type, port and the raw address bytes.
+        // murmur3 style mixing on 64 bit words, so it is cheap enough to call per-packet.
+
+        uint64_t hash = hash_address_word( seed, ( uint64_t( address.GetType() ) << 16 ) | address.GetPort() );
+
+        if ( address.GetType() == ADDRESS_IPV4 )
+        {
+            hash = hash_address_word( hash, address.GetAddress4() );
+        }
+        else if ( address.GetType() == ADDRESS_IPV6 )
+        {
+            uint64_t words[2];
+            memcpy( words, address.GetAddress6(), sizeof( words ) );
+            hash = hash_address_word( hash, words[0] );
+            hash = hash_address_word( hash, words[1] );
+        }
+
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb93fe53b69a7ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+#if NETWORK2_SOCKETS
+
+    Socket::Socket( uint16_t port, SocketType type, bool reusePort )
     {
         assert( IsNetworkInitialized() );
 
         m_error = SOCKET_ERROR_NONE;
+        m_numSyscalls = 0;
 
         // create socket
 
@@ -631,6 +1293,25 @@ namespace network2
             }
         }
 
+        // share the port with other sockets. must be set on every socket on the port, before bind
+
+        if ( reusePort )
+        {
+#if NETWORK2_REUSE_PORT
+            int yes = 1;
+            if ( setsockopt( m_socket, SOL_SOCKET, SO_REUSEPORT, (char*)&yes, sizeof(yes) ) != 0 )
+            {
+                printf( "failed to set reuse port sockopt\n" );
+                m_error = SOCKET_ERROR_SOCKOPT_REUSE_PORT_FAILED;
+                return;
+            }
+#else // #if NETWORK2_REUSE_PORT
+            printf( "reuse port is not supported on this platform\n" );
+            m_error = SOCKET_ERROR_SOCKOPT_REUSE_PORT_FAILED;
+            return;
+#endif // #if NETWORK2_REUSE_PORT
+        }
+
         // bind to port
 
         if ( type == SOCKET_TYPE_IPV6 )
@@ -643,7 +1324,7 @@ namespace network2
 
             if ( ::bind( m_socket, (const sockaddr*) &sock_address, sizeof(sock_address) ) < 0 )
             {
-                m_socket = SOCKET_ERROR_BIND_IPV6_FAILED;
+                m_error = SOCKET_ERROR_BIND_IPV6_FAILED;
                 return;
             }
         }
@@ -745,54 +1426,177 @@ namespace network2
         return m_error;
     }
 
-    bool Socket::SendPacket( const Address & address, const void * packetData, size_t packetBytes )
+    uint16_t Socket::GetPort() const
     {
-        assert( packetData );
-        assert( packetBytes > 0 );
-        assert( address.IsValid() );
-        assert( m_socket );
-        assert( !IsError() );
+        return m_port;
+    }
+
+    SocketHandle Socket::GetHandle() const
+    {
+        return m_socket;
+    }
 
-        bool result = false;
+    #if NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
+    typedef int socklen_t;
+    #endif
 
+    ResolvedAddress::ResolvedAddress()
+    {
+        Clear();
+    }
+
+    ResolvedAddress::ResolvedAddress( const Address & address )
+    {
+        Set( address );
+    }
+
+    void ResolvedAddress::Set( const Address & address )
+    {
         if ( address.GetType() == ADDRESS_IPV6 )
         {
-            sockaddr_in6 socket_address;
-            memset( &socket_address, 0, sizeof( socket_address ) );
-            socket_address.sin6_family = AF_INET6;
-            socket_address.sin6_port = htons( address.GetPort() );
-            memcpy( &socket_address.sin6_addr, address.GetAddress6(), sizeof( socket_address.sin6_addr ) );
-            size_t sent_bytes = sendto( m_socket, (const char*)packetData, (int) packetBytes, 0, (sockaddr*)&socket_address, sizeof( sockaddr_in6 ) );
-			result = sent_bytes == packetBytes;
+            sockaddr_in6 * socket_address = (sockaddr_in6*) m_sockaddr;
+            memset( socket_address, 0, sizeof( sockaddr_in6 ) );
+            socket_address->sin6_family = AF_INET6;
+            socket_address->sin6_port = htons( address.GetPort() );
+            memcpy( &socket_address->sin6_addr, address.GetAddress6(), sizeof( socket_address->sin6_addr ) );
+            m_length = sizeof( sockaddr_in6 );
         }
         else if ( address.GetType() == ADDRESS_IPV4 )
         {
-            sockaddr_in socket_address;
-            memset( &socket_address, 0, sizeof( socket_address ) );
-            socket_address.sin_family = AF_INET;
-            socket_address.sin_addr.s_addr = address.GetAddress4();
-            socket_address.sin_port = htons( (unsigned short) address.GetPort() );
-            size_t sent_bytes = sendto( m_socket, (const char*)packetData, (int) packetBytes, 0, (sockaddr*)&socket_address, sizeof(sockaddr_in) );
-            result = sent_bytes == packetBytes;
+            sockaddr_in * socket_address = (sockaddr_in*) m_sockaddr;
+            memset( socket_address, 0, sizeof( sockaddr_in ) );
+            socket_address->sin_family = AF_INET;
+            socket_address->sin_addr.s_addr = address.GetAddress4();
+            socket_address->sin_port = htons( (unsigned short) address.GetPort() );
+            m_length = sizeof( sockaddr_in );
         }
+        else
+        {
+            Clear();
+        }
+    }
 
-        return result;
+    void ResolvedAddress::Clear()
+    {
+        memset( m_sockaddr, 0, sizeof( m_sockaddr ) );
+        m_length = 0;
+    }
+
+    bool ResolvedAddress::IsValid() const
+    {
+        return m_length != 0;
+    }
+
+    Address ResolvedAddress::GetAddress() const
+    {
+        const sockaddr * socket_address = (const sockaddr*) m_sockaddr;
+
+        if ( m_length && socket_address->sa_family == AF_INET6 )
+        {
+            return Address( *(const sockaddr_in6*) m_sockaddr );
+        }
+        else if ( m_length && socket_address->sa_family == AF_INET )
+        {
+            const sockaddr_in * socket_address_ipv4 = (const sockaddr_in*) m_sockaddr;
+            const uint8_t * bytes = (const uint8_t*) &socket_address_ipv4->sin_addr.s_addr;
+            return Address( bytes[0], bytes[1], bytes[2], bytes[3], ntohs( socket_address_ipv4->sin_port ) );
+        }
+
+        return Address();
+    }
+
+    const sockaddr * ResolvedAddress::GetSockaddr() const
+    {
+        return (const sockaddr*) m_sockaddr;
+    }
+
+    int ResolvedAddress::GetSockaddrLength() const
+    {
+        return m_length;
+    }
+
+    bool ResolvedAddress::operator ==( const ResolvedAddress & other ) const
+    {
+        // compare only family, address and port. received addresses may carry ipv6 flow info and scope ids
+
+        if ( m_length != other.m_length )
+            return false;
+
+        if ( !m_length )
+            return true;
+
+        const sockaddr * a = (const sockaddr*) m_sockaddr;
+        const sockaddr * b = (const sockaddr*) other.m_sockaddr;
+
+        if ( a->sa_family != b->sa_family )
+            return false;
+
+        if ( a->sa_family == AF_INET6 )
+        {
+            const sockaddr_in6 * a6 = (const sockaddr_in6*) a;
+            const sockaddr_in6 * b6 = (const sockaddr_in6*) b;
+            return a6->sin6_port == b6->sin6_port && memcmp( &a6->sin6_addr, &b6->sin6_addr, sizeof( a6->sin6_addr ) ) == 0;
+        }
+        else
+        {
+            const sockaddr_in * a4 = (const sockaddr_in*) a;
+            const sockaddr_in * b4 = (const sockaddr_in*) b;
+            return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+        }
+    }
+
+    bool ResolvedAddress::operator !=( const ResolvedAddress & other ) const
+    {
+        return !( *this == other );
+    }
+
+    bool Socket::SendPacket( const Address & address, const void * packetData, size_t packetBytes )
+    {
+        assert( address.IsValid() );
+
+        return SendPacket( ResolvedAddress( address ), packetData, packetBytes );
     }
 
     int Socket::ReceivePacket( Address & from, void * packetData, int maxPacketSize )
+    {
+        ResolvedAddress resolvedFrom;
+
+        const int bytesRead = ReceivePacket( resolvedFrom, packetData, maxPacketSize );
+
+        if ( bytesRead > 0 )
+            from = resolvedFrom.GetAddress();
+
+        return bytesRead;
+    }
+
+    bool Socket::SendPacket( const ResolvedAddress & address, const void * packetData, size_t packetBytes )
+    {
+        assert( packetData );
+        assert( packetBytes > 0 );
+        assert( m_socket );
+        assert( !IsError() );
+
+        if ( !address.IsValid() )
+            return false;
+
+        m_numSyscalls++;
+
+        size_t sent_bytes = sendto( m_socket, (const char*)packetData, (int) packetBytes, 0, address.GetSockaddr(), address.GetSockaddrLength() );
+
+        return sent_bytes == packetBytes;
+    }
+
+    int Socket::ReceivePacket( ResolvedAddress & from, void * packetData, int maxPacketSize )
     {
         assert( m_socket );
         assert( packetData );
         assert( maxPacketSize > 0 );
 
-        #if NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
-        typedef int socklen_t;
-        #endif
-        
-        sockaddr_storage sockaddr_from;
-        socklen_t fromLength = sizeof( sockaddr_from );
+        socklen_t fromLength = sizeof( from.m_sockaddr );
 
-        int result = recvfrom( m_socket, (char*)packetData, maxPacketSize, 0, (sockaddr*)&sockaddr_from, &fromLength );
+        m_numSyscalls++;
+
+        int result = recvfrom( m_socket, (char*)packetData, maxPacketSize, 0, (sockaddr*) from.m_sockaddr, &fromLength );
 
 #if NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
 		if ( result == SOCKET_ERROR )
@@ -818,7 +1622,7 @@ namespace network2
         }
 #endif // #if NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
 
-        from = Address( sockaddr_from );
+        from.m_length = fromLength;
 
         assert( result >= 0 );
 
@@ -827,146 +1631,1424 @@ namespace network2
         return bytesRead;
     }
 
-#endif // #if NETWORK2_SOCKETS
+    bool Socket::WaitForPackets( int timeoutMilliseconds )
+    {
+        assert( m_socket );
 
-#if NETWORK2_SIMULATOR
+        // blocks until there is a packet to receive or the timeout expires. a negative timeout waits forever
 
-    Simulator::Simulator( int numPackets )
-    {
-        assert( numPackets > 0 );
-        m_currentTime = 0.0;
-        m_latency = 0.0f;
-        m_jitter = 0.0f;
-        m_packetLoss = 0.0f;
-        m_duplicates = 0.0f;
-        m_currentIndex = 0;
-        m_numEntries = numPackets;
-        m_entries = new Entry[numPackets];
-        memset( m_entries, 0, sizeof( Entry ) * numPackets );
+#if NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
+        WSAPOLLFD pollEntry;
+        pollEntry.fd = (SOCKET) m_socket;
+        pollEntry.events = POLLRDNORM;
+        pollEntry.revents = 0;
+        return WSAPoll( &pollEntry, 1, timeoutMilliseconds ) > 0;
+#else // #if NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
+        pollfd pollEntry;
+        pollEntry.fd = m_socket;
+        pollEntry.events = POLLIN;
+        pollEntry.revents = 0;
+        return poll( &pollEntry, 1, timeoutMilliseconds ) > 0;
+#endif // #if NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
     }
 
-    Simulator::~Simulator()
+    int Socket::SendPackets( const Address * to, const void * const * packetData, const int * packetBytes, int numPackets )
     {
-        assert( m_entries );
-        assert( m_numEntries > 0 );
-        for ( int i = 0; i < m_numEntries; ++i )
+        assert( to );
+        assert( numPackets >= 0 );
+
+        // resolve a batch worth of addresses at a time. servers sending every tick should keep resolved addresses around instead
+
+        ResolvedAddress resolved[NETWORK2_SOCKET_BATCH_SIZE];
+
+        int numSent = 0;
+
+        for ( int index = 0; index < numPackets; index += NETWORK2_SOCKET_BATCH_SIZE )
         {
-            if ( m_entries[i].packetData )
-                delete [] m_entries[i].packetData;
+            const int batchSize = ( numPackets - index < NETWORK2_SOCKET_BATCH_SIZE ) ? numPackets - index : NETWORK2_SOCKET_BATCH_SIZE;
+
+            for ( int i = 0; i < batchSize; ++i )
+            {
+                assert( to[index+i].IsValid() );
+                resolved[i].Set( to[index+i] );
+            }
+
+            numSent += SendPackets( resolved, packetData + index, packetBytes + index, batchSize );
         }
-        delete [] m_entries;
-        m_entries = NULL;
-        m_numEntries = 0;
-    }
 
-    void Simulator::SetLatency( float milliseconds )
-    {
-        m_latency = milliseconds;
+        return numSent;
     }
 
-    void Simulator::SetJitter( float milliseconds )
+    int Socket::ReceivePackets( Address * from, void * const * packetData, int * packetBytes, int maxPacketSize, int maxPackets )
     {
-        m_jitter = milliseconds;
-    }
+        assert( from );
+        assert( maxPackets >= 0 );
 
-    void Simulator::SetPacketLoss( float percent )
-    {
-        m_packetLoss = percent;
-    }
+        ResolvedAddress resolved[NETWORK2_SOCKET_BATCH_SIZE];
 
-    void Simulator::SetDuplicates( float percent )
-    {
-        m_duplicates = percent;
+        int numPackets = 0;
+
+        while ( numPackets < maxPackets )
+        {
+            const int batchSize = ( maxPackets - numPackets < NETWORK2_SOCKET_BATCH_SIZE ) ? maxPackets - numPackets : NETWORK2_SOCKET_BATCH_SIZE;
+
+            const int numReceived = ReceivePackets( resolved, packetData + numPackets, packetBytes + numPackets, maxPacketSize, batchSize );
+
+            for ( int i = 0; i < numReceived; ++i )
+                from[numPackets+i] = resolved[i].GetAddress();
+
+            numPackets += numReceived;
+
+            if ( numReceived < batchSize )
+                break;
+        }
+
+        return numPackets;
     }
 
-    void Simulator::SendPacket( const Address & from, const Address & to, uint8_t * packetData, int packetSize )
+    int Socket::SendPackets( const ResolvedAddress * to, const void * const * packetData, const int * packetBytes, int numPackets )
     {
-        assert( from.IsValid() );
-        assert( to.IsValid() );
-
+        assert( to );
         assert( packetData );
-        assert( packetSize > 0 );
+        assert( packetBytes );
+        assert( numPackets >= 0 );
+        assert( m_socket );
+        assert( !IsError() );
 
-        if ( random_float( 0.0f, 100.0f ) <= m_packetLoss )
-        {
-            delete [] packetData;
-            return;
-        }
+        int numSent = 0;
 
-        Entry & entry = m_entries[m_currentIndex];
+#if NETWORK2_MMSG
+
+        // IMPORTANT: sendmmsg stops at the first packet that fails and reports how many went out before it.
+        // the failed packet is dropped and sending resumes after it, same as a loop over SendPacket would.
 
-        if ( entry.packetData )
+        mmsghdr messages[NETWORK2_SOCKET_BATCH_SIZE];
+        iovec iov[NETWORK2_SOCKET_BATCH_SIZE];
+
+        int index = 0;
+
+        while ( index < numPackets )
         {
-            delete [] entry.packetData;
-            entry = Entry();
-        }
+            const int batchSize = ( numPackets - index < NETWORK2_SOCKET_BATCH_SIZE ) ? numPackets - index : NETWORK2_SOCKET_BATCH_SIZE;
 
-        double delay = m_latency / 1000.0;
+            memset( messages, 0, sizeof( mmsghdr ) * batchSize );
 
-        if ( m_jitter > 0 )
-            delay += random_float( -m_jitter, +m_jitter ) / 1000.0;
+            for ( int i = 0; i < batchSize; ++i )
+            {
+                assert( packetData[index+i] );
+                assert( packetBytes[index+i] > 0 );
+                assert( to[index+i].IsValid() );
+                iov[i].iov_base = (void*) packetData[index+i];
+                iov[i].iov_len = packetBytes[index+i];
+                messages[i].msg_hdr.msg_name = (void*) to[index+i].GetSockaddr();
+                messages[i].msg_hdr.msg_namelen = to[index+i].GetSockaddrLength();
+                messages[i].msg_hdr.msg_iov = &iov[i];
+                messages[i].msg_hdr.msg_iovlen = 1;
+            }
 
-        entry.from = from;
-        entry.to = to;
-        entry.packetData = packetData;
-        entry.packetSize = packetSize;
-        entry.deliveryTime = m_currentTime + delay;
+            m_numSyscalls++;
 
-        m_currentIndex = ( m_currentIndex + 1 ) % m_numEntries;
+            const int result = sendmmsg( m_socket, messages, batchSize, 0 );
 
-        if ( random_float( 0.0f, 100.0f ) <= m_duplicates )
-        {
-            uint8_t *duplicatePacketData = new uint8_t[packetSize];
+            if ( result <= 0 )
+            {
+                index++;
+                continue;
+            }
 
-            memcpy( duplicatePacketData, packetData, packetSize );
+            for ( int i = 0; i < result; ++i )
+            {
+                if ( (int) messages[i].msg_len == packetBytes[index+i] )
+                    numSent++;
+            }
 
-            Entry & nextEntry = m_entries[m_currentIndex];
+            index += result;
+        }
 
-            nextEntry.from = from;
-            nextEntry.to = to;
-            nextEntry.packetData = duplicatePacketData;
-            nextEntry.packetSize = packetSize;
-            nextEntry.deliveryTime = m_currentTime + delay + random_float( -1.0, +1.0 );
+#else // #if NETWORK2_MMSG
 
-            m_currentIndex = ( m_currentIndex + 1 ) % m_numEntries;
+        for ( int i = 0; i < numPackets; ++i )
+        {
+            if ( SendPacket( to[i], packetData[i], packetBytes[i] ) )
+                numSent++;
         }
+
+#endif // #if NETWORK2_MMSG
+
+        return numSent;
     }
 
-    uint8_t * Simulator::ReceivePacket( Address & from, Address & to, int & packetSize )
-    { 
-        int oldestEntryIndex = -1;
-        double oldestEntryTime = 0;
+    int Socket::ReceivePackets( ResolvedAddress * from, void * const * packetData, int * packetBytes, int maxPacketSize, int maxPackets )
+    {
+        assert( m_socket );
+        assert( from );
+        assert( packetData );
+        assert( packetBytes );
+        assert( maxPacketSize > 0 );
+        assert( maxPackets >= 0 );
 
-        for ( int i = 0; i < m_numEntries; ++i )
+        int numPackets = 0;
+
+#if NETWORK2_MMSG
+
+        mmsghdr messages[NETWORK2_SOCKET_BATCH_SIZE];
+        iovec iov[NETWORK2_SOCKET_BATCH_SIZE];
+
+        while ( numPackets < maxPackets )
         {
-            const Entry & entry = m_entries[i];
+            const int batchSize = ( maxPackets - numPackets < NETWORK2_SOCKET_BATCH_SIZE ) ? maxPackets - numPackets : NETWORK2_SOCKET_BATCH_SIZE;
 
-            if ( !entry.packetData )
-                continue;
+            memset( messages, 0, sizeof( mmsghdr ) * batchSize );
+
+            for ( int i = 0; i < batchSize; ++i )
+            {
+                assert( packetData[numPackets+i] );
+                iov[i].iov_base = packetData[numPackets+i];
+                iov[i].iov_len = maxPacketSize;
+                messages[i].msg_hdr.msg_name = from[numPackets+i].m_sockaddr;
+                messages[i].msg_hdr.msg_namelen = sizeof( from[numPackets+i].m_sockaddr );
+                messages[i].msg_hdr.msg_iov = &iov[i];
+                messages[i].msg_hdr.msg_iovlen = 1;
+            }
+
+            m_numSyscalls++;
+
+            const int result = recvmmsg( m_socket, messages, batchSize, 0, NULL );
+
+            if ( result <= 0 )
+            {
+                if ( errno != EAGAIN && errno != EWOULDBLOCK )
+                    printf( "recvmmsg failed: %s\n", strerror( errno ) );
 
-            if ( oldestEntryIndex == -1 || m_entries[i].deliveryTime < oldestEntryTime )
+                break;
+            }
+
+            for ( int i = 0; i < result; ++i )
             {
-                oldestEntryIndex = i;
-                oldestEntryTime = entry.deliveryTime;
+                from[numPackets].m_length = messages[i].msg_hdr.msg_namelen;
+                packetBytes[numPackets] = messages[i].msg_len;
+                numPackets++;
             }
+
+            // a short batch means the socket is drained. don't spend another syscall finding out
+
+            if ( result < batchSize )
+                break;
         }
 
-        Entry & entry = m_entries[oldestEntryIndex];
+#else // #if NETWORK2_MMSG
 
-        if ( oldestEntryIndex == -1 || entry.deliveryTime > m_currentTime )
-            return NULL;
+        while ( numPackets < maxPackets )
+        {
+            const int bytes = ReceivePacket( from[numPackets], packetData[numPackets], maxPacketSize );
+            if ( bytes <= 0 )
+                break;
+            packetBytes[numPackets++] = bytes;
+        }
 
-        assert( entry.packetData );
+#endif // #if NETWORK2_MMSG
 
-        uint8_t *packetData = entry.packetData;
+        return numPackets;
+    }
 
-		to = entry.to;
-        from = entry.from;
-        packetSize = entry.packetSize;
+    int Socket::SendPacketSegments( const Address & address, const void * packetData, int packetBytes, int segmentSize )
+    {
+        assert( packetData );
+        assert( packetBytes > 0 );
+        assert( segmentSize > 0 );
+        assert( address.IsValid() );
+        assert( m_socket );
+        assert( !IsError() );
 
-        entry = Entry();
+        // IMPORTANT: packet data is split into segmentSize byte packets, the last one holding whatever is left over.
+        // with UDP_SEGMENT the kernel does the split, so up to NETWORK2_MAX_SEGMENTS packets go out per syscall.
 
-        return packetData;
+        const uint8_t * data = (const uint8_t*) packetData;
+
+        int numSent = 0;
+
+        const ResolvedAddress resolvedAddress( address );
+        if ( !resolvedAddress.IsValid() )
+            return 0;
+
+#if NETWORK2_UDP_SEGMENTS
+
+        int maxChunkSegments = NETWORK2_MAX_SEGMENTS_BYTES / segmentSize;
+        if ( maxChunkSegments > NETWORK2_MAX_SEGMENTS )
+            maxChunkSegments = NETWORK2_MAX_SEGMENTS;
+
+        const int maxChunkBytes = maxChunkSegments * segmentSize;
+
+        while ( maxChunkSegments > 1 && packetBytes > segmentSize )
+        {
+            const int chunkBytes = ( packetBytes < maxChunkBytes ) ? packetBytes : maxChunkBytes;
+
+            iovec iov;
+            iov.iov_base = (void*) data;
+            iov.iov_len = chunkBytes;
+
+            char control[CMSG_SPACE( sizeof( uint16_t ) )];
+            memset( control, 0, sizeof( control ) );
+
+            msghdr message;
+            memset( &message, 0, sizeof( message ) );
+            message.msg_name = (void*) resolvedAddress.GetSockaddr();
+            message.msg_namelen = resolvedAddress.GetSockaddrLength();
+            message.msg_iov = &iov;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof( control );
+
+            cmsghdr * cmsg = CMSG_FIRSTHDR( &message );
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN( sizeof( uint16_t ) );
+            const uint16_t gso_size = (uint16_t) segmentSize;
+            memcpy( CMSG_DATA( cmsg ), &gso_size, sizeof( gso_size ) );
+
+            m_numSyscalls++;
+
+            if ( sendmsg( m_socket, &message, 0 ) != chunkBytes )
+            {
+                // no GSO for this route or segment size (eg. segment larger than the mtu). send what's left one packet at a time
+                break;
+            }
+
+            numSent += ( chunkBytes + segmentSize - 1 ) / segmentSize;
+            data += chunkBytes;
+            packetBytes -= chunkBytes;
+        }
+
+#endif // #if NETWORK2_UDP_SEGMENTS
+
+        while ( packetBytes > 0 )
+        {
+            const int bytes = ( packetBytes < segmentSize ) ? packetBytes : segmentSize;
+            if ( SendPacket( resolvedAddress, data, bytes ) )
+                numSent++;
+            data += bytes;
+            packetBytes -= bytes;
+        }
+
+        return numSent;
+    }
+
+    bool Socket::EnableReceiveSegments()
+    {
+        assert( m_socket );
+        assert( !IsError() );
+
+        // IMPORTANT: once enabled, the kernel may coalesce same sized packets from one sender into a single receive of up to
+        // NETWORK2_MAX_SEGMENTS_BYTES. receive with ReceivePacketSegments into a buffer that big, or packets will be truncated.
+
+#if NETWORK2_UDP_SEGMENTS
+        int yes = 1;
+        return setsockopt( m_socket, SOL_UDP, UDP_GRO, (char*)&yes, sizeof( yes ) ) == 0;
+#else // #if NETWORK2_UDP_SEGMENTS
+        return false;
+#endif // #if NETWORK2_UDP_SEGMENTS
+    }
+
+    int Socket::ReceivePacketSegments( Address & from, void * packetData, int maxPacketSize, int & segmentSize )
+    {
+        assert( m_socket );
+        assert( packetData );
+        assert( maxPacketSize > 0 );
+
+        // returns the total bytes received. the data is a run of segmentSize byte packets, the last of which may be shorter
+
+#if NETWORK2_UDP_SEGMENTS
+
+        sockaddr_storage sockaddr_from;
+
+        iovec iov;
+        iov.iov_base = packetData;
+        iov.iov_len = maxPacketSize;
+
+        char control[CMSG_SPACE( sizeof( int ) )];
+
+        msghdr message;
+        memset( &message, 0, sizeof( message ) );
+        message.msg_name = &sockaddr_from;
+        message.msg_namelen = sizeof( sockaddr_from );
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof( control );
+
+        m_numSyscalls++;
+
+        const int result = recvmsg( m_socket, &message, 0 );
+
+        if ( result <= 0 )
+        {
+            if ( errno != EAGAIN && errno != EWOULDBLOCK )
+                printf( "recvmsg failed: %s\n", strerror( errno ) );
+
+            return 0;
+        }
+
+        if ( message.msg_flags & MSG_TRUNC )
+        {
+            printf( "recvmsg truncated: packet data is larger than %d bytes\n", maxPacketSize );
+            return 0;
+        }
+
+        segmentSize = result;
+
+        for ( cmsghdr * cmsg = CMSG_FIRSTHDR( &message ); cmsg; cmsg = CMSG_NXTHDR( &message, cmsg ) )
+        {
+            if ( cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO )
+            {
+                int gso_size;
+                memcpy( &gso_size, CMSG_DATA( cmsg ), sizeof( gso_size ) );
+                segmentSize = gso_size;
+            }
+        }
+
+        from = Address( sockaddr_from );
+
+        return result;
+
+#else // #if NETWORK2_UDP_SEGMENTS
+
+        const int result = ReceivePacket( from, packetData, maxPacketSize );
+        segmentSize = result;
+        return result;
+
+#endif // #if NETWORK2_UDP_SEGMENTS
+    }
+
+    uint64_t Socket::GetNumSyscalls() const
+    {
+        return m_numSyscalls;
+    }
+
+    SocketGroup::SocketGroup( uint16_t port, int numSockets, SocketType type )
+    {
+        assert( numSockets > 0 );
+
+        // IMPORTANT: the kernel hashes each sender address to one socket in the group, so all packets from a given
+        // client arrive on the same socket. give each socket its own thread and that thread owns those clients.
+
+        m_error = SOCKET_ERROR_NONE;
+        m_port = port;
+        m_numSockets = numSockets;
+        m_sockets = new Socket*[numSockets];
+        memset( m_sockets, 0, sizeof( Socket* ) * numSockets );
+
+        for ( int i = 0; i < numSockets; ++i )
+        {
+            // if port is 0 the first socket picks one, and the rest join it
+
+            m_sockets[i] = new Socket( m_port, type, true );
+
+            if ( m_sockets[i]->IsError() )
+            {
+                m_error = m_sockets[i]->GetError();
+                return;
+            }
+
+            m_port = m_sockets[i]->GetPort();
+        }
+    }
+
+    SocketGroup::~SocketGroup()
+    {
+        assert( m_sockets );
+        for ( int i = 0; i < m_numSockets; ++i )
+            delete m_sockets[i];
+        delete [] m_sockets;
+        m_sockets = NULL;
+        m_numSockets = 0;
+    }
+
+    bool SocketGroup::IsError() const
+    {
+        return m_error != SOCKET_ERROR_NONE;
+    }
+
+    int SocketGroup::GetError() const
+    {
+        return m_error;
+    }
+
+    uint16_t SocketGroup::GetPort() const
+    {
+        return m_port;
+    }
+
+    int SocketGroup::GetNumSockets() const
+    {
+        return m_numSockets;
+    }
+
+    Socket & SocketGroup::GetSocket( int index )
+    {
+        assert( index >= 0 );
+        assert( index < m_numSockets );
+        assert( m_sockets[index] );
+        return *m_sockets[index];
+    }
+
+#if NETWORK2_IO_URING
+
+    // IMPORTANT: io_uring is driven through raw syscalls, so there is no dependency on liburing.
+    // requires linux 6.0+ for multishot recvmsg and provided buffer rings. check IsError and fall back to Socket if it fails.
+
+    static const uint64_t IoUringReceiveTag = 1ULL << 32;
+    static const uint64_t IoUringCancelTag = 2ULL << 32;
+
+    static int io_uring_setup_syscall( unsigned entries, io_uring_params * params )
+    {
+        return (int) syscall( __NR_io_uring_setup, entries, params );
+    }
+
+    static int io_uring_enter_syscall( int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void * arg, size_t argSize )
+    {
+        return (int) syscall( __NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize );
+    }
+
+    static int io_uring_register_syscall( int fd, unsigned opcode, void * arg, unsigned numArgs )
+    {
+        return (int) syscall( __NR_io_uring_register, fd, opcode, arg, numArgs );
+    }
+
+    struct IoUringSocket::SendBuffer
+    {
+        msghdr message;
+        iovec iov;
+        ResolvedAddress address;
+    };
+
+    IoUringSocket::IoUringSocket( Socket & socket, int maxPacketSize, int numReceiveBuffers, int numSendBuffers )
+    {
+        assert( !socket.IsError() );
+        assert( maxPacketSize > 0 );
+        assert( numReceiveBuffers > 0 );
+        assert( numReceiveBuffers <= 32768 );
+        assert( ( numReceiveBuffers & ( numReceiveBuffers - 1 ) ) == 0 );
+        assert( numSendBuffers > 0 );
+
+        m_error = IO_URING_ERROR_NONE;
+        m_socket = &socket;
+        m_ringFd = -1;
+        m_maxPacketSize = maxPacketSize;
+        m_bufferSize = ( int( sizeof( io_uring_recvmsg_out ) + sizeof( sockaddr_storage ) ) + maxPacketSize + 15 ) & ~15;
+        m_numReceiveBuffers = numReceiveBuffers;
+        m_numSendBuffers = numSendBuffers;
+        m_numSyscalls = 0;
+        m_receiveArmed = false;
+        m_sqRing = NULL;
+        m_cqRing = NULL;
+        m_sqRingSize = 0;
+        m_cqRingSize = 0;
+        m_sqes = NULL;
+        m_sqesSize = 0;
+        m_sqLocalTail = 0;
+        m_numPendingSubmit = 0;
+        m_bufferRing = NULL;
+        m_bufferRingTail = 0;
+        m_completedHead = 0;
+        m_numCompleted = 0;
+        m_numRelease = 0;
+
+        m_receiveBuffers = new uint8_t[numReceiveBuffers * m_bufferSize];
+        m_receiveMessage = new msghdr;
+        m_completedBufferId = new int[numReceiveBuffers];
+        m_completedBytes = new int[numReceiveBuffers];
+        m_releaseBufferId = new int[numReceiveBuffers];
+        m_sendBuffers = new SendBuffer[numSendBuffers];
+        m_sendData = new uint8_t[numSendBuffers * maxPacketSize];
+        m_freeSendBuffers = new int[numSendBuffers];
+        m_numFreeSendBuffers = numSendBuffers;
+        for ( int i = 0; i < numSendBuffers; ++i )
+            m_freeSendBuffers[i] = numSendBuffers - 1 - i;
+
+        // create the ring. room in the submission queue for every send buffer plus the receive and a cancel.
+        // the completion queue is sized so a burst of received packets doesn't overflow it
+
+        io_uring_params params;
+        memset( &params, 0, sizeof( params ) );
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = ( numReceiveBuffers + numSendBuffers ) * 2;
+
+        m_ringFd = io_uring_setup_syscall( numSendBuffers + 2, &params );
+        if ( m_ringFd < 0 )
+        {
+            printf( "io_uring setup failed: %s\n", strerror( errno ) );
+            m_error = IO_URING_ERROR_SETUP_FAILED;
+            return;
+        }
+
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof( uint32_t );
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+        m_sqesSize = params.sq_entries * sizeof( io_uring_sqe );
+
+        if ( params.features & IORING_FEAT_SINGLE_MMAP )
+        {
+            if ( m_cqRingSize > m_sqRingSize )
+                m_sqRingSize = m_cqRingSize;
+            m_cqRingSize = 0;
+        }
+
+        m_sqRing = mmap( NULL, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING );
+        if ( m_sqRing == MAP_FAILED )
+            m_sqRing = NULL;
+
+        if ( m_cqRingSize )
+        {
+            m_cqRing = mmap( NULL, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING );
+            if ( m_cqRing == MAP_FAILED )
+                m_cqRing = NULL;
+        }
+        else
+        {
+            m_cqRing = m_sqRing;
+        }
+
+        m_sqes = (io_uring_sqe*) mmap( NULL, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES );
+        if ( m_sqes == MAP_FAILED )
+            m_sqes = NULL;
+
+        if ( !m_sqRing || !m_cqRing || !m_sqes )
+        {
+            printf( "io_uring mmap failed: %s\n", strerror( errno ) );
+            m_error = IO_URING_ERROR_MAP_RINGS_FAILED;
+            return;
+        }
+
+        uint8_t * sqRing = (uint8_t*) m_sqRing;
+        m_sqHead = (uint32_t*) ( sqRing + params.sq_off.head );
+        m_sqTail = (uint32_t*) ( sqRing + params.sq_off.tail );
+        m_sqFlags = (uint32_t*) ( sqRing + params.sq_off.flags );
+        m_sqMask = *(uint32_t*) ( sqRing + params.sq_off.ring_mask );
+        m_sqEntries = params.sq_entries;
+        m_sqLocalTail = *m_sqTail;
+
+        // sqe n always sits in submission queue slot n
+
+        uint32_t * sqArray = (uint32_t*) ( sqRing + params.sq_off.array );
+        for ( uint32_t i = 0; i < params.sq_entries; ++i )
+            sqArray[i] = i;
+
+        uint8_t * cqRing = (uint8_t*) m_cqRing;
+        m_cqHead = (uint32_t*) ( cqRing + params.cq_off.head );
+        m_cqTail = (uint32_t*) ( cqRing + params.cq_off.tail );
+        m_cqMask = *(uint32_t*) ( cqRing + params.cq_off.ring_mask );
+        m_cqes = (io_uring_cqe*) ( cqRing + params.cq_off.cqes );
+
+        // register the provided buffer ring and fill it with every receive buffer
+
+        void * bufferRing = NULL;
+        if ( posix_memalign( &bufferRing, 4096, numReceiveBuffers * sizeof( io_uring_buf ) ) != 0 )
+        {
+            m_error = IO_URING_ERROR_REGISTER_BUFFERS_FAILED;
+            return;
+        }
+
+        m_bufferRing = (io_uring_buf_ring*) bufferRing;
+        memset( m_bufferRing, 0, numReceiveBuffers * sizeof( io_uring_buf ) );
+
+        io_uring_buf_reg bufferRegister;
+        memset( &bufferRegister, 0, sizeof( bufferRegister ) );
+        bufferRegister.ring_addr = (uint64_t) (uintptr_t) m_bufferRing;
+        bufferRegister.ring_entries = numReceiveBuffers;
+        bufferRegister.bgid = 0;
+
+        if ( io_uring_register_syscall( m_ringFd, IORING_REGISTER_PBUF_RING, &bufferRegister, 1 ) != 0 )
+        {
+            printf( "io_uring register buffer ring failed: %s\n", strerror( errno ) );
+            m_error = IO_URING_ERROR_REGISTER_BUFFERS_FAILED;
+            return;
+        }
+
+        for ( int i = 0; i < numReceiveBuffers; ++i )
+            ReleaseBuffer( i );
+
+        PublishBuffers();
+
+        memset( m_receiveMessage, 0, sizeof( msghdr ) );
+        m_receiveMessage->msg_namelen = sizeof( sockaddr_storage );
+
+        ArmReceive();
+
+        Flush();
+    }
+
+    IoUringSocket::~IoUringSocket()
+    {
+        if ( m_ringFd >= 0 )
+        {
+            // IMPORTANT: the kernel writes receive buffers and reads send buffers until their requests complete.
+            // cancel the receive and wait for everything in flight before any of that memory is freed.
+
+            if ( m_sqes && m_cqRing )
+            {
+                if ( m_receiveArmed )
+                {
+                    io_uring_sqe * sqe = GetSqe();
+                    if ( !sqe )
+                    {
+                        Flush();
+                        sqe = GetSqe();
+                    }
+                    if ( sqe )
+                    {
+                        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                        sqe->fd = -1;
+                        sqe->addr = IoUringReceiveTag;
+                        sqe->user_data = IoUringCancelTag;
+                    }
+                }
+
+                for ( int i = 0; i < 100 && ( m_receiveArmed || m_numFreeSendBuffers < m_numSendBuffers ); ++i )
+                {
+                    Enter( 1, 10 );
+                    ReapCompletions();
+                }
+            }
+
+            close( m_ringFd );
+            m_ringFd = -1;
+        }
+
+        if ( m_sqes )
+            munmap( m_sqes, m_sqesSize );
+        if ( m_cqRing && m_cqRing != m_sqRing )
+            munmap( m_cqRing, m_cqRingSize );
+        if ( m_sqRing )
+            munmap( m_sqRing, m_sqRingSize );
+
+        free( m_bufferRing );
+
+        delete [] m_receiveBuffers;
+        delete m_receiveMessage;
+        delete [] m_completedBufferId;
+        delete [] m_completedBytes;
+        delete [] m_releaseBufferId;
+        delete [] m_sendBuffers;
+        delete [] m_sendData;
+        delete [] m_freeSendBuffers;
+
+        m_socket = NULL;
+    }
+
+    bool IoUringSocket::IsError() const
+    {
+        return m_error != IO_URING_ERROR_NONE;
+    }
+
+    int IoUringSocket::GetError() const
+    {
+        return m_error;
+    }
+
+    uint64_t IoUringSocket::GetNumSyscalls() const
+    {
+        return m_numSyscalls;
+    }
+
+    bool IoUringSocket::SendPacket( const Address & address, const void * packetData, int packetBytes )
+    {
+        assert( packetData );
+        assert( packetBytes > 0 );
+        assert( packetBytes <= m_maxPacketSize );
+        assert( address.IsValid() );
+
+        if ( IsError() )
+            return false;
+
+        // sends are only queued here. they go to the kernel together on the next Flush or ReceivePackets
+
+        if ( m_numFreeSendBuffers == 0 )
+        {
+            Flush();
+            ReapCompletions();
+            if ( m_numFreeSendBuffers == 0 )
+                return false;
+        }
+
+        io_uring_sqe * sqe = GetSqe();
+        if ( !sqe )
+        {
+            Flush();
+            sqe = GetSqe();
+            if ( !sqe )
+                return false;
+        }
+
+        const int index = m_freeSendBuffers[--m_numFreeSendBuffers];
+
+        SendBuffer & sendBuffer = m_sendBuffers[index];
+        uint8_t * data = m_sendData + index * m_maxPacketSize;
+        memcpy( data, packetData, packetBytes );
+
+        sendBuffer.iov.iov_base = data;
+        sendBuffer.iov.iov_len = packetBytes;
+        memset( &sendBuffer.message, 0, sizeof( sendBuffer.message ) );
+        sendBuffer.address.Set( address );
+        sendBuffer.message.msg_name = (void*) sendBuffer.address.GetSockaddr();
+        sendBuffer.message.msg_namelen = sendBuffer.address.GetSockaddrLength();
+        sendBuffer.message.msg_iov = &sendBuffer.iov;
+        sendBuffer.message.msg_iovlen = 1;
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = m_socket->GetHandle();
+        sqe->addr = (uint64_t) (uintptr_t) &sendBuffer.message;
+        sqe->len = 1;
+        sqe->user_data = index;
+
+        return true;
+    }
+
+    void IoUringSocket::Flush()
+    {
+        if ( m_numPendingSubmit > 0 )
+            Enter( 0, 0 );
+    }
+
+    int IoUringSocket::ReceivePackets( ReceivedPacket * packets, int maxPackets, int timeoutMilliseconds )
+    {
+        assert( packets );
+        assert( maxPackets >= 0 );
+
+        if ( IsError() )
+            return 0;
+
+        // packets returned by the last call are done with. hand their buffers back to the kernel
+
+        for ( int i = 0; i < m_numRelease; ++i )
+            ReleaseBuffer( m_releaseBufferId[i] );
+
+        if ( m_numRelease )
+            PublishBuffers();
+
+        m_numRelease = 0;
+
+        // the multishot receive stops when it runs out of buffers or hits an error. rearm it
+
+        if ( !m_receiveArmed )
+            ArmReceive();
+
+        ReapCompletions();
+
+        // one syscall submits queued sends and, if nothing has arrived yet, sleeps until something does or the timeout expires
+
+        const bool wait = m_numCompleted == 0 && timeoutMilliseconds != 0;
+
+        if ( m_numPendingSubmit > 0 || wait || ( __atomic_load_n( m_sqFlags, __ATOMIC_ACQUIRE ) & IORING_SQ_CQ_OVERFLOW ) )
+        {
+            Enter( wait ? 1 : 0, timeoutMilliseconds );
+            ReapCompletions();
+        }
+
+        int numPackets = 0;
+
+        while ( numPackets < maxPackets && m_numCompleted > 0 )
+        {
+            const int bufferId = m_completedBufferId[m_completedHead];
+            const int bytes = m_completedBytes[m_completedHead];
+            m_completedHead = ( m_completedHead + 1 ) % m_numReceiveBuffers;
+            m_numCompleted--;
+
+            m_releaseBufferId[m_numRelease++] = bufferId;
+
+            uint8_t * buffer = m_receiveBuffers + bufferId * m_bufferSize;
+
+            const io_uring_recvmsg_out * header = (const io_uring_recvmsg_out*) buffer;
+
+            if ( ( header->flags & MSG_TRUNC ) || header->namelen > sizeof( sockaddr_storage ) )
+                continue;
+
+            const int headerBytes = int( sizeof( io_uring_recvmsg_out ) + sizeof( sockaddr_storage ) );
+
+            assert( headerBytes + (int) header->payloadlen <= bytes );
+            (void) bytes;
+
+            packets[numPackets].from = Address( *(const sockaddr_storage*) ( buffer + sizeof( io_uring_recvmsg_out ) ) );
+            packets[numPackets].packetData = buffer + headerBytes;
+            packets[numPackets].packetBytes = header->payloadlen;
+            numPackets++;
+        }
+
+        return numPackets;
+    }
+
+    io_uring_sqe * IoUringSocket::GetSqe()
+    {
+        const uint32_t head = __atomic_load_n( m_sqHead, __ATOMIC_ACQUIRE );
+
+        if ( m_sqLocalTail - head >= m_sqEntries )
+            return NULL;
+
+        io_uring_sqe * sqe = &m_sqes[m_sqLocalTail & m_sqMask];
+        memset( sqe, 0, sizeof( io_uring_sqe ) );
+
+        m_sqLocalTail++;
+        m_numPendingSubmit++;
+
+        return sqe;
+    }
+
+    int IoUringSocket::Enter( int minComplete, int timeoutMilliseconds )
+    {
+        __atomic_store_n( m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE );
+
+        unsigned flags = 0;
+
+        if ( minComplete > 0 || ( __atomic_load_n( m_sqFlags, __ATOMIC_ACQUIRE ) & IORING_SQ_CQ_OVERFLOW ) )
+            flags |= IORING_ENTER_GETEVENTS;
+
+        io_uring_getevents_arg eventsArg;
+        __kernel_timespec timeout;
+        void * arg = NULL;
+        size_t argSize = 0;
+
+        if ( minComplete > 0 && timeoutMilliseconds > 0 )
+        {
+            timeout.tv_sec = timeoutMilliseconds / 1000;
+            timeout.tv_nsec = ( timeoutMilliseconds % 1000 ) * 1000000LL;
+            memset( &eventsArg, 0, sizeof( eventsArg ) );
+            eventsArg.ts = (uint64_t) (uintptr_t) &timeout;
+            flags |= IORING_ENTER_EXT_ARG;
+            arg = &eventsArg;
+            argSize = sizeof( eventsArg );
+        }
+
+        m_numSyscalls++;
+
+        const int result = io_uring_enter_syscall( m_ringFd, m_numPendingSubmit, minComplete, flags, arg, argSize );
+
+        if ( result > 0 )
+            m_numPendingSubmit -= result;
+
+        return result;
+    }
+
+    void IoUringSocket::ReapCompletions()
+    {
+        uint32_t head = *m_cqHead;
+        const uint32_t tail = __atomic_load_n( m_cqTail, __ATOMIC_ACQUIRE );
+
+        while ( head != tail )
+        {
+            const io_uring_cqe & cqe = m_cqes[head & m_cqMask];
+
+            if ( cqe.user_data == IoUringReceiveTag )
+            {
+                if ( !( cqe.flags & IORING_CQE_F_MORE ) )
+                    m_receiveArmed = false;
+
+                if ( cqe.res >= 0 && ( cqe.flags & IORING_CQE_F_BUFFER ) )
+                {
+                    assert( m_numCompleted < m_numReceiveBuffers );
+                    const int index = ( m_completedHead + m_numCompleted ) % m_numReceiveBuffers;
+                    m_completedBufferId[index] = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                    m_completedBytes[index] = cqe.res;
+                    m_numCompleted++;
+                }
+                else if ( cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP )
+                {
+                    // kernel is too old for multishot recvmsg. transient errors like ENOBUFS or ECONNREFUSED just rearm
+
+                    printf( "io_uring receive failed: %s\n", strerror( -cqe.res ) );
+                    m_error = IO_URING_ERROR_RECEIVE_FAILED;
+                }
+            }
+            else if ( cqe.user_data < (uint64_t) m_numSendBuffers )
+            {
+                assert( m_numFreeSendBuffers < m_numSendBuffers );
+                m_freeSendBuffers[m_numFreeSendBuffers++] = (int) cqe.user_data;
+            }
+
+            head++;
+        }
+
+        __atomic_store_n( m_cqHead, head, __ATOMIC_RELEASE );
+    }
+
+    void IoUringSocket::ArmReceive()
+    {
+        io_uring_sqe * sqe = GetSqe();
+        if ( !sqe )
+            return;
+
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = m_socket->GetHandle();
+        sqe->addr = (uint64_t) (uintptr_t) m_receiveMessage;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = 0;
+        sqe->user_data = IoUringReceiveTag;
+
+        m_receiveArmed = true;
+    }
+
+    void IoUringSocket::ReleaseBuffer( int bufferId )
+    {
+        assert( bufferId >= 0 );
+        assert( bufferId < m_numReceiveBuffers );
+        // IMPORTANT: don't use m_bufferRing->bufs. in C++ the kernel header's flexible array member lands at offset 8, not 0
+
+        io_uring_buf & buffer = ( (io_uring_buf*) m_bufferRing )[m_bufferRingTail & ( m_numReceiveBuffers - 1 )];
+        buffer.addr = (uint64_t) (uintptr_t) ( m_receiveBuffers + bufferId * m_bufferSize );
+        buffer.len = m_bufferSize;
+        buffer.bid = (uint16_t) bufferId;
+        m_bufferRingTail++;
+    }
+
+    void IoUringSocket::PublishBuffers()
+    {
+        __atomic_store_n( &m_bufferRing->tail, m_bufferRingTail, __ATOMIC_RELEASE );
+    }
+
+#endif // #if NETWORK2_IO_URING
+
+#if NETWORK2_EPOLL
+
+    SocketPoller::SocketPoller( int maxEntries )
+    {
+        assert( maxEntries > 0 );
+        m_maxEntries = maxEntries;
+        m_entries = new Entry[maxEntries];
+        memset( m_entries, 0, sizeof( Entry ) * maxEntries );
+        m_epollFd = epoll_create1( EPOLL_CLOEXEC );
+        if ( m_epollFd < 0 )
+            printf( "epoll create failed: %s\n", strerror( errno ) );
+    }
+
+    SocketPoller::~SocketPoller()
+    {
+        for ( int i = 0; i < m_maxEntries; ++i )
+        {
+            if ( m_entries[i].used && m_entries[i].type == SOCKET_POLLER_EVENT_TIMER )
+                close( m_entries[i].fd );
+        }
+        if ( m_epollFd >= 0 )
+            close( m_epollFd );
+        delete [] m_entries;
+        m_entries = NULL;
+    }
+
+    bool SocketPoller::IsError() const
+    {
+        return m_epollFd < 0;
+    }
+
+    bool SocketPoller::AddSocket( Socket & socket, void * userData )
+    {
+        assert( !socket.IsError() );
+
+        if ( IsError() )
+            return false;
+
+        return AllocateEntry( SOCKET_POLLER_EVENT_SOCKET, socket.GetHandle(), &socket, userData ) >= 0;
+    }
+
+    bool SocketPoller::RemoveSocket( Socket & socket )
+    {
+        for ( int i = 0; i < m_maxEntries; ++i )
+        {
+            if ( m_entries[i].used && m_entries[i].socket == &socket )
+            {
+                FreeEntry( i );
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int SocketPoller::AddTimer( double intervalSeconds, void * userData )
+    {
+        assert( intervalSeconds > 0.0 );
+
+        if ( IsError() )
+            return -1;
+
+        // periodic timer with nanosecond resolution. Wait reports how many intervals passed since it last fired
+
+        const int fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+        if ( fd < 0 )
+            return -1;
+
+        const int64_t nanoseconds = (int64_t) ( intervalSeconds * 1000000000.0 );
+
+        itimerspec interval;
+        interval.it_interval.tv_sec = nanoseconds / 1000000000;
+        interval.it_interval.tv_nsec = nanoseconds % 1000000000;
+        interval.it_value = interval.it_interval;
+
+        if ( timerfd_settime( fd, 0, &interval, NULL ) != 0 )
+        {
+            close( fd );
+            return -1;
+        }
+
+        const int index = AllocateEntry( SOCKET_POLLER_EVENT_TIMER, fd, NULL, userData );
+        if ( index < 0 )
+            close( fd );
+
+        return index;
+    }
+
+    bool SocketPoller::RemoveTimer( int timerId )
+    {
+        if ( timerId < 0 || timerId >= m_maxEntries || !m_entries[timerId].used || m_entries[timerId].type != SOCKET_POLLER_EVENT_TIMER )
+            return false;
+
+        const int fd = m_entries[timerId].fd;
+        FreeEntry( timerId );
+        close( fd );
+        return true;
+    }
+
+    int SocketPoller::Wait( SocketPollerEvent * events, int maxEvents, int timeoutMilliseconds )
+    {
+        assert( events );
+        assert( maxEvents > 0 );
+
+        if ( IsError() )
+            return 0;
+
+        // level triggered: a socket keeps reporting until it has been drained, so a caller may receive in batches across waits
+
+        const int MaxEpollEvents = 64;
+        epoll_event epollEvents[MaxEpollEvents];
+
+        const int result = epoll_wait( m_epollFd, epollEvents, ( maxEvents < MaxEpollEvents ) ? maxEvents : MaxEpollEvents, timeoutMilliseconds );
+
+        if ( result < 0 )
+        {
+            if ( errno != EINTR )
+                printf( "epoll wait failed: %s\n", strerror( errno ) );
+            return 0;
+        }
+
+        int numEvents = 0;
+
+        for ( int i = 0; i < result; ++i )
+        {
+            const int index = (int) epollEvents[i].data.u32;
+
+            assert( index >= 0 );
+            assert( index < m_maxEntries );
+
+            const Entry & entry = m_entries[index];
+
+            if ( !entry.used )
+                continue;
+
+            SocketPollerEvent & event = events[numEvents];
+            event.type = entry.type;
+            event.userData = entry.userData;
+
+            if ( entry.type == SOCKET_POLLER_EVENT_TIMER )
+            {
+                uint64_t expirations = 0;
+                if ( read( entry.fd, &expirations, sizeof( expirations ) ) != sizeof( expirations ) )
+                    continue;
+                event.socket = NULL;
+                event.timerId = index;
+                event.timerExpirations = expirations;
+            }
+            else
+            {
+                event.socket = entry.socket;
+                event.timerId = -1;
+                event.timerExpirations = 0;
+            }
+
+            numEvents++;
+        }
+
+        return numEvents;
+    }
+
+    int SocketPoller::AllocateEntry( SocketPollerEventType type, int fd, Socket * socket, void * userData )
+    {
+        for ( int i = 0; i < m_maxEntries; ++i )
+        {
+            if ( m_entries[i].used )
+                continue;
+
+            epoll_event event;
+            memset( &event, 0, sizeof( event ) );
+            event.events = EPOLLIN;
+            event.data.u32 = (uint32_t) i;
+
+            if ( epoll_ctl( m_epollFd, EPOLL_CTL_ADD, fd, &event ) != 0 )
+            {
+                printf( "epoll add failed: %s\n", strerror( errno ) );
+                return -1;
+            }
+
+            m_entries[i].used = true;
+            m_entries[i].type = type;
+            m_entries[i].fd = fd;
+            m_entries[i].socket = socket;
+            m_entries[i].userData = userData;
+
+            return i;
+        }
+
+        return -1;
+    }
+
+    void SocketPoller::FreeEntry( int index )
+    {
+        assert( index >= 0 );
+        assert( index < m_maxEntries );
+        assert( m_entries[index].used );
+        epoll_ctl( m_epollFd, EPOLL_CTL_DEL, m_entries[index].fd, NULL );
+        memset( &m_entries[index], 0, sizeof( Entry ) );
+    }
+
+#endif // #if NETWORK2_EPOLL
+
+#endif // #if NETWORK2_SOCKETS
+
+#if NETWORK2_SIMULATOR
+
+    Simulator::Simulator( int numPackets )
+    {
+        assert( numPackets > 0 );
+        m_currentTime = 0.0;
+        m_latency = 0.0f;
+        m_jitter = 0.0f;
+        m_packetLoss = 0.0f;
+        m_duplicates = 0.0f;
+        m_currentIndex = 0;
+        m_numEntries = numPackets;
+        m_entries = new Entry[numPackets];
+        m_heap = new int[numPackets];
+        m_heapSize = 0;
+        m_sequence = 0;
+    }
+
+    Simulator::~Simulator()
+    {
+        assert( m_entries );
+        assert( m_heap );
+        assert( m_numEntries > 0 );
+        for ( int i = 0; i < m_numEntries; ++i )
+        {
+            if ( m_entries[i].packetData )
+                delete [] m_entries[i].packetData;
+        }
+        delete [] m_entries;
+        delete [] m_heap;
+        m_entries = NULL;
+        m_heap = NULL;
+        m_numEntries = 0;
+        m_heapSize = 0;
+    }
+
+    void Simulator::SetLatency( float milliseconds )
+    {
+        m_latency = milliseconds;
+    }
+
+    void Simulator::SetJitter( float milliseconds )
+    {
+        m_jitter = milliseconds;
+    }
+
+    void Simulator::SetPacketLoss( float percent )
+    {
+        m_packetLoss = percent;
+    }
+
+    void Simulator::SetDuplicates( float percent )
+    {
+        m_duplicates = percent;
+    }
+
+    void Simulator::SendPacket( const Address & from, const Address & to, uint8_t * packetData, int packetSize )
+    {
+        assert( from.IsValid() );
+        assert( to.IsValid() );
+
+        assert( packetData );
+        assert( packetSize > 0 );
+
+        if ( random_float( 0.0f, 100.0f ) <= m_packetLoss )
+        {
+            delete [] packetData;
+            return;
+        }
+
+        double delay = m_latency / 1000.0;
+
+        if ( m_jitter > 0 )
+            delay += random_float( -m_jitter, +m_jitter ) / 1000.0;
+
+        InsertEntry( from, to, packetData, packetSize, m_currentTime + delay );
+
+        if ( random_float( 0.0f, 100.0f ) <= m_duplicates )
+        {
+            uint8_t *duplicatePacketData = new uint8_t[packetSize];
+
+            memcpy( duplicatePacketData, packetData, packetSize );
+
+            InsertEntry( from, to, duplicatePacketData, packetSize, m_currentTime + delay + random_float( -1.0, +1.0 ) );
+        }
+    }
+
+    uint8_t * Simulator::ReceivePacket( Address & from, Address & to, int & packetSize )
+    { 
+        if ( m_heapSize == 0 )
+            return NULL;
+
+        const int entryIndex = m_heap[0];
+
+        Entry & entry = m_entries[entryIndex];
+
+        if ( entry.deliveryTime > m_currentTime )
+            return NULL;
+
+        assert( entry.packetData );
+
+        uint8_t *packetData = entry.packetData;
+
+        to = entry.to;
+        from = entry.from;
+        packetSize = entry.packetSize;
+
+        entry.packetData = NULL;
+
+        RemoveEntry( entryIndex );
+
+        return packetData;
+    }
+
+    int Simulator::ReceivePackets( Address * from, Address * to, uint8_t ** packetData, int * packetSize, int maxPackets )
+    {
+        // returns packets due by the current time in delivery order. the caller owns the packet data and must delete [] it
+
+        assert( from );
+        assert( to );
+        assert( packetData );
+        assert( packetSize );
+        assert( maxPackets >= 0 );
+
+        int numPackets = 0;
+
+        while ( numPackets < maxPackets )
+        {
+            packetData[numPackets] = ReceivePacket( from[numPackets], to[numPackets], packetSize[numPackets] );
+            if ( !packetData[numPackets] )
+                break;
+            numPackets++;
+        }
+
+        return numPackets;
+    }
+
+    int Simulator::GetNumPacketsInFlight() const
+    {
+        return m_heapSize;
+    }
+
+    void Simulator::InsertEntry( const Address & from, const Address & to, uint8_t * packetData, int packetSize, double deliveryTime )
+    {
+        // IMPORTANT: entries are reused in the order packets are sent, so when the simulator is full the oldest packet sent is dropped
+
+        if ( m_entries[m_currentIndex].packetData )
+        {
+            delete [] m_entries[m_currentIndex].packetData;
+            m_entries[m_currentIndex].packetData = NULL;
+            RemoveEntry( m_currentIndex );
+        }
+
+        Entry & entry = m_entries[m_currentIndex];
+
+        entry.from = from;
+        entry.to = to;
+        entry.packetData = packetData;
+        entry.packetSize = packetSize;
+        entry.deliveryTime = deliveryTime;
+        entry.sequence = m_sequence++;
+        entry.heapIndex = m_heapSize;
+
+        m_heap[m_heapSize++] = m_currentIndex;
+        HeapSiftUp( entry.heapIndex );
+
+        m_currentIndex = ( m_currentIndex + 1 ) % m_numEntries;
+    }
+
+    void Simulator::RemoveEntry( int entryIndex )
+    {
+        // removes the entry from the heap and clears it. the caller has already taken or freed the packet data
+
+        assert( entryIndex >= 0 );
+        assert( entryIndex < m_numEntries );
+        assert( !m_entries[entryIndex].packetData );
+
+        const int heapIndex = m_entries[entryIndex].heapIndex;
+
+        assert( heapIndex >= 0 );
+        assert( heapIndex < m_heapSize );
+        assert( m_heap[heapIndex] == entryIndex );
+
+        m_heapSize--;
+
+        if ( heapIndex != m_heapSize )
+        {
+            HeapSwap( heapIndex, m_heapSize );
+            HeapSiftUp( heapIndex );
+            HeapSiftDown( heapIndex );
+        }
+
+        m_entries[entryIndex] = Entry();
+    }
+
+    bool Simulator::HeapLess( int a, int b ) const
+    {
+        const Entry & entryA = m_entries[m_heap[a]];
+        const Entry & entryB = m_entries[m_heap[b]];
+        if ( entryA.deliveryTime != entryB.deliveryTime )
+            return entryA.deliveryTime < entryB.deliveryTime;
+        return entryA.sequence < entryB.sequence;
+    }
+
+    void Simulator::HeapSwap( int a, int b )
+    {
+        const int entryIndex = m_heap[a];
+        m_heap[a] = m_heap[b];
+        m_heap[b] = entryIndex;
+        m_entries[m_heap[a]].heapIndex = a;
+        m_entries[m_heap[b]].heapIndex = b;
+    }
+
+    void Simulator::HeapSiftUp( int heapIndex )
+    {
+        while ( heapIndex > 0 )
+        {
+            const int parent = ( heapIndex - 1 ) / 2;
+            if ( !HeapLess( heapIndex, parent ) )
+                break;
+            HeapSwap( heapIndex, parent );
+            heapIndex = parent;
+        }
+    }
+
+    void Simulator::HeapSiftDown( int heapIndex )
+    {
+        while ( true )
+        {
+            const int left = heapIndex * 2 + 1;
+            const int right = left + 1;
+            int smallest = heapIndex;
+            if ( left < m_heapSize && HeapLess( left, smallest ) )
+                smallest = left;
+            if ( right < m_heapSize && HeapLess( right, smallest ) )
+                smallest = right;
+            if ( smallest == heapIndex )
+                break;
+            HeapSwap( heapIndex, smallest );
+            heapIndex = smallest;
+        }
     }
 
     void Simulator::Update( double t )
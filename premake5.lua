@@ -32,6 +32,11 @@ project "test"
     configuration "Release"
         links { release_libs }
 
+project "bench"
+    language "C++"
+    kind "ConsoleApp"
+    files { "bench.cpp", "protocol2.h", "network2.h" }
+
 project "001_reading_and_writing_packets"
     language "C++"
     kind "ConsoleApp"
@@ -84,6 +89,8 @@ project "009_client_server"
         links { debug_libs }
     configuration "Release"
         links { release_libs }
+    configuration "not windows"
+        links { "pthread" }
 
 project "010_connect_tokens"
     language "C++"
@@ -121,6 +128,17 @@ if not os.is "windows" then
         end
     }
 
+    newaction
+    {
+        trigger     = "bench",
+        description = "Build and run benchmarks",
+        execute = function ()
+            if os.execute "make -j32 bench config=release_x64" == 0 then
+                os.execute "./bin/bench"
+            end
+        end
+    }
+
     newaction
     {
         trigger     = "001",
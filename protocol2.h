@@ -34,10 +34,15 @@
 #include <assert.h>
 #include <math.h>
 #include <string.h>
+#include <new>
 
 #define PROTOCOL2_SERIALIZE_CHECKS              1
 #define PROTOCOL2_DEBUG_PACKET_LEAKS            0
 #define PROTOCOL2_PACKET_AGGREGATION            1
+#ifndef PROTOCOL2_BITPACKER_64
+#define PROTOCOL2_BITPACKER_64                  0
+#endif // #ifndef PROTOCOL2_BITPACKER_64
+#define PROTOCOL2_SEQUENCE_BUFFER_TAGS          0
 
 #if PROTOCOL2_DEBUG_PACKET_LEAKS
 #include <stdio.h>
@@ -58,6 +63,42 @@
   #define PROTOCOL2_BIG_ENDIAN 1
 #endif
 
+#if defined(__x86_64__) || defined(_M_X64)
+  #define PROTOCOL2_CRC32_PCLMUL 1
+#else
+  #define PROTOCOL2_CRC32_PCLMUL 0
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+  #define PROTOCOL2_SSE2 1
+#else
+  #define PROTOCOL2_SSE2 0
+#endif
+
+#if defined(__AVX2__)
+  #define PROTOCOL2_AVX2 1
+#else
+  #define PROTOCOL2_AVX2 0
+#endif
+
+#if PROTOCOL2_SSE2
+#include <emmintrin.h>
+#endif // #if PROTOCOL2_SSE2
+
+#if PROTOCOL2_AVX2
+#include <immintrin.h>
+#endif // #if PROTOCOL2_AVX2
+
+#if defined(__BMI2__) && PROTOCOL2_LITTLE_ENDIAN
+  #define PROTOCOL2_BMI2 1
+#else
+  #define PROTOCOL2_BMI2 0
+#endif
+
+#if PROTOCOL2_BMI2
+#include <immintrin.h>
+#endif // #if PROTOCOL2_BMI2
+
 #ifdef _MSC_VER
 #pragma warning( disable : 4127 )
 #pragma warning( disable : 4244 )
@@ -148,6 +189,25 @@ namespace protocol2
 #endif // #ifdef __GNUC__
     }
 
+    inline int popcount64( uint64_t x )
+    {
+#ifdef __GNUC__
+        return __builtin_popcountll( x );
+#else // #ifdef __GNUC__
+        return popcount( uint32_t( x ) ) + popcount( uint32_t( x >> 32 ) );
+#endif // #ifdef __GNUC__
+    }
+
+    inline int count_trailing_zeros64( uint64_t x )
+    {
+        assert( x );
+#ifdef __GNUC__
+        return __builtin_ctzll( x );
+#else // #ifdef __GNUC__
+        return popcount64( ( x & ( ~x + 1 ) ) - 1 );
+#endif // #ifdef __GNUC__
+    }
+
 #ifdef __GNUC__
 
     inline int bits_required( uint32_t min, uint32_t max )
@@ -189,6 +249,15 @@ namespace protocol2
         return ( value & 0x00ff ) << 8 | ( value & 0xff00 ) >> 8;
     }
 
+    inline uint64_t bswap( uint64_t value )
+    {
+#ifdef __GNUC__
+        return __builtin_bswap64( value );
+#else // #ifdef __GNUC__
+        return ( uint64_t( bswap( uint32_t( value & 0xFFFFFFFF ) ) ) << 32 ) | bswap( uint32_t( value >> 32 ) );
+#endif // #ifdef __GNUC__
+    }
+
     // IMPORTANT: These functions consider network order to be little endian because most modern processors are little endian. Least amount of work!
 
     inline uint32_t host_to_network( uint32_t value )
@@ -227,6 +296,24 @@ namespace protocol2
 #endif // #if PROTOCOL2_BIG_ENDIAN
     }
 
+    inline uint64_t host_to_network( uint64_t value )
+    {
+#if PROTOCOL2_BIG_ENDIAN
+        return bswap( value );
+#else // #if PROTOCOL2_BIG_ENDIAN
+        return value;
+#endif // #if PROTOCOL2_BIG_ENDIAN
+    }
+
+    inline uint64_t network_to_host( uint64_t value )
+    {
+#if PROTOCOL2_BIG_ENDIAN
+        return bswap( value );
+#else // #if PROTOCOL2_BIG_ENDIAN
+        return value;
+#endif // #if PROTOCOL2_BIG_ENDIAN
+    }
+
     inline bool sequence_greater_than( uint16_t s1, uint16_t s2 )
     {
         return ( ( s1 > s2 ) && ( s1 - s2 <= 32768 ) ) || 
@@ -262,7 +349,19 @@ namespace protocol2
         return ( n >> 1 ) ^ ( -int32_t( n & 1 ) );
     }
 
-    uint32_t calculate_crc32( const uint8_t *buffer, size_t length, uint32_t crc32 = 0 );
+    uint32_t calculate_crc32( const uint8_t *buffer, size_t length, uint32_t crc32 = 0 );             // picks the fastest implementation below for this cpu
+
+    uint32_t calculate_crc32_bytewise( const uint8_t *buffer, size_t length, uint32_t crc32 = 0 );
+
+    uint32_t calculate_crc32_slicing_by_8( const uint8_t *buffer, size_t length, uint32_t crc32 = 0 );
+
+#if PROTOCOL2_CRC32_PCLMUL
+
+    bool cpu_supports_crc32_pclmul();
+
+    uint32_t calculate_crc32_pclmul( const uint8_t *buffer, size_t length, uint32_t crc32 = 0 );        // only call this if cpu_supports_crc32_pclmul returns true
+
+#endif // #if PROTOCOL2_CRC32_PCLMUL
 
     uint32_t hash_data( const uint8_t * data, uint32_t length, uint32_t hash );
 
@@ -270,6 +369,14 @@ namespace protocol2
 
     uint64_t murmur_hash_64( const void * key, uint32_t length, uint64_t seed );
 
+    struct WriteCheckpoint
+    {
+        uint64_t scratch;
+        int bitsWritten;
+        int wordIndex;
+        int scratchBits;
+    };
+
     class BitWriter
     {
     public:
@@ -290,7 +397,6 @@ namespace protocol2
         {
             assert( bits > 0 );
             assert( bits <= 32 );
-            assert( m_bitsWritten + bits <= m_numBits );
 
             value &= ( uint64_t(1) << bits ) - 1;
 
@@ -300,8 +406,10 @@ namespace protocol2
 
             if ( m_scratchBits >= 32 )
             {
-                assert( m_wordIndex < m_numWords );
-                m_data[m_wordIndex] = host_to_network( uint32_t( m_scratch & 0xFFFFFFFF ) );
+                // writes past the end of the buffer are dropped. the writer is left in overflow until rolled back
+
+                if ( m_wordIndex < m_numWords )
+                    m_data[m_wordIndex] = host_to_network( uint32_t( m_scratch & 0xFFFFFFFF ) );
                 m_scratch >>= 32;
                 m_scratchBits -= 32;
                 m_wordIndex++;
@@ -310,6 +418,21 @@ namespace protocol2
             m_bitsWritten += bits;
         }
 
+        void WriteBits64( uint64_t value, int bits )
+        {
+            // low 32 bits first, so the bitstream matches BitWriter64::WriteBits64
+
+            assert( bits > 0 );
+            assert( bits <= 64 );
+            if ( bits <= 32 )
+            {
+                WriteBits( uint32_t( value ), bits );
+                return;
+            }
+            WriteBits( uint32_t( value ), 32 );
+            WriteBits( uint32_t( value >> 32 ), bits - 32 );
+        }
+
         void WriteAlign()
         {
             const int remainderBits = m_bitsWritten % 8;
@@ -324,9 +447,15 @@ namespace protocol2
         void WriteBytes( const uint8_t* data, int bytes )
         {
             assert( GetAlignBits() == 0 );
-            assert( m_bitsWritten + bytes * 8 <= m_numBits );
             assert( ( m_bitsWritten % 32 ) == 0 || ( m_bitsWritten % 32 ) == 8 || ( m_bitsWritten % 32 ) == 16 || ( m_bitsWritten % 32 ) == 24 );
 
+            if ( m_bitsWritten + bytes * 8 > m_numBits )
+            {
+                for ( int i = 0; i < bytes; ++i )
+                    WriteBits( data[i], 8 );
+                return;
+            }
+
             int headBytes = ( 4 - ( m_bitsWritten % 32 ) / 8 ) % 4;
             if ( headBytes > bytes )
                 headBytes = bytes;
@@ -366,14 +495,42 @@ namespace protocol2
         {
             if ( m_scratchBits != 0 )
             {
-                assert( m_wordIndex < m_numWords );
-                m_data[m_wordIndex] = host_to_network( uint32_t( m_scratch & 0xFFFFFFFF ) );
+                if ( m_wordIndex < m_numWords )
+                    m_data[m_wordIndex] = host_to_network( uint32_t( m_scratch & 0xFFFFFFFF ) );
                 m_scratch >>= 32;
                 m_scratchBits -= 32;
                 m_wordIndex++;                
             }
         }
 
+        WriteCheckpoint Checkpoint() const
+        {
+            WriteCheckpoint checkpoint;
+            checkpoint.scratch = m_scratch;
+            checkpoint.bitsWritten = m_bitsWritten;
+            checkpoint.wordIndex = m_wordIndex;
+            checkpoint.scratchBits = m_scratchBits;
+            return checkpoint;
+        }
+
+        void Rollback( const WriteCheckpoint & checkpoint )
+        {
+            // the partial word at the checkpoint is restored from the saved scratch and rewritten on the next flush
+
+            assert( checkpoint.bitsWritten <= m_bitsWritten );
+            assert( checkpoint.bitsWritten <= m_numBits );
+
+            m_scratch = checkpoint.scratch;
+            m_bitsWritten = checkpoint.bitsWritten;
+            m_wordIndex = checkpoint.wordIndex;
+            m_scratchBits = checkpoint.scratchBits;
+        }
+
+        bool IsOverflow() const
+        {
+            return m_bitsWritten > m_numBits;
+        }
+
         int GetAlignBits() const
         {
             return ( 8 - ( m_bitsWritten % 8 ) ) % 8;
@@ -468,6 +625,17 @@ namespace protocol2
             return output;
         }
 
+        uint64_t ReadBits64( int bits )
+        {
+            assert( bits > 0 );
+            assert( bits <= 64 );
+            if ( bits <= 32 )
+                return ReadBits( bits );
+            const uint64_t low = ReadBits( 32 );
+            const uint64_t high = ReadBits( bits - 32 );
+            return low | ( high << 32 );
+        }
+
         bool ReadAlign()
         {
             const int remainderBits = m_bitsRead % 8;
@@ -520,6 +688,36 @@ namespace protocol2
             assert( headBytes + numWords * 4 + tailBytes == bytes );
         }
 
+        const uint8_t* ReadBytesView( int bytes )
+        {
+            // same walk as ReadBytes, but the bytes are left in place and a pointer to them is returned
+
+            assert( GetAlignBits() == 0 );
+            assert( m_bitsRead + bytes * 8 <= m_numBits );
+
+            const uint8_t* data = ( (const uint8_t*) m_data ) + m_bitsRead / 8;
+
+            int headBytes = ( 4 - ( m_bitsRead % 32 ) / 8 ) % 4;
+            if ( headBytes > bytes )
+                headBytes = bytes;
+            for ( int i = 0; i < headBytes; ++i )
+                ReadBits( 8 );
+            if ( headBytes == bytes )
+                return data;
+
+            assert( m_scratchBits == 0 );
+
+            const int numWords = ( bytes - headBytes ) / 4;
+            m_bitsRead += numWords * 32;
+            m_wordIndex += numWords;
+
+            const int tailBytes = bytes - headBytes - numWords * 4;
+            for ( int i = 0; i < tailBytes; ++i )
+                ReadBits( 8 );
+
+            return data;
+        }
+
         int GetAlignBits() const
         {
             return ( 8 - m_bitsRead % 8 ) % 8;
@@ -569,119 +767,758 @@ namespace protocol2
         int m_wordIndex;
     };
 
-    #define PROTOCOL2_ERROR_NONE                        0
-    #define PROTOCOL2_ERROR_CRC32_MISMATCH              1
-    #define PROTOCOL2_ERROR_INVALID_PACKET_TYPE         2
-    #define PROTOCOL2_ERROR_PACKET_TYPE_NOT_ALLOWED     3
-    #define PROTOCOL2_ERROR_CREATE_PACKET_FAILED        4
-    #define PROTOCOL2_ERROR_SERIALIZE_HEADER_FAILED     5
-    #define PROTOCOL2_ERROR_SERIALIZE_PACKET_FAILED     6
-    #define PROTOCOL2_ERROR_SERIALIZE_CHECK_FAILED      7
-    #define PROTOCOL2_ERROR_STREAM_OVERFLOW             8
-    #define PROTOCOL2_ERROR_STREAM_ABORTED              9
-
-    class WriteStream
+    class BitWriter64
     {
     public:
 
-        enum { IsWriting = 1 };
-        enum { IsReading = 0 };
-
-        WriteStream( uint8_t* buffer, int bytes ) : m_error( PROTOCOL2_ERROR_NONE ), m_context( NULL ), m_writer( buffer, bytes ) {}
+        // IMPORTANT: Same bitstream layout as BitWriter, but bits are flushed to the buffer 64 bits at a time.
+        // 64 bits are two little endian dwords back to back, so packets written with either writer can be read by either reader.
 
-        bool SerializeInteger( int32_t value, int32_t min, int32_t max )
+        BitWriter64( void* data, int bytes ) 
+            : m_data( (uint32_t*)data ), m_numWords( bytes / 4 )
         {
-            assert( min < max );
-            assert( value >= min );
-            assert( value <= max );
-            const int bits = bits_required( min, max );
-            uint32_t unsigned_value = value - min;
-            m_writer.WriteBits( unsigned_value, bits );
-            return true;
+            assert( data );
+            assert( ( bytes % 4 ) == 0 );           // buffer size must be a multiple of four
+            m_numBits = m_numWords * 32;
+            m_bitsWritten = 0;
+            m_wordIndex = 0;
+            m_scratch = 0;
+            m_scratchBits = 0;
         }
 
-        bool SerializeBits( uint32_t value, int bits )
+        void WriteBits( uint32_t value, int bits )
         {
             assert( bits > 0 );
             assert( bits <= 32 );
-            m_writer.WriteBits( value, bits );
-            return true;
+            WriteBits64( value, bits );
         }
 
-        bool SerializeBytes( const uint8_t* data, int bytes )
+        void WriteBits64( uint64_t value, int bits )
         {
-            assert( data );
-            assert( bytes >= 0 );
-            if ( !SerializeAlign() )
-                return false;
-            m_writer.WriteBytes( data, bytes );
-            return true;
-        }
+            assert( bits > 0 );
+            assert( bits <= 64 );
+            assert( m_scratchBits >= 0 && m_scratchBits < 64 );
 
-        bool SerializeAlign()
-        {
-            m_writer.WriteAlign();
-            return true;
+            value &= ~uint64_t(0) >> ( 64 - bits );
+
+            m_scratch |= value << m_scratchBits;
+
+            m_scratchBits += bits;
+
+            if ( m_scratchBits >= 64 )
+            {
+                // writes past the end of the buffer are dropped. the writer is left in overflow until rolled back
+
+                const uint64_t word = host_to_network( m_scratch );
+                if ( m_wordIndex + 2 <= m_numWords )
+                    memcpy( &m_data[m_wordIndex], &word, 8 );
+                m_wordIndex += 2;
+                m_scratchBits -= 64;
+                m_scratch = ( value >> 1 ) >> ( bits - m_scratchBits - 1 );        // split shift so a full 64 bit shift is never needed
+            }
+
+            m_bitsWritten += bits;
         }
 
-        int GetAlignBits() const
+        void WriteAlign()
         {
-            return m_writer.GetAlignBits();
+            const int remainderBits = m_bitsWritten % 8;
+            if ( remainderBits != 0 )
+            {
+                uint32_t zero = 0;
+                WriteBits( zero, 8 - remainderBits );
+                assert( ( m_bitsWritten % 8 ) == 0 );
+            }
         }
 
-        bool SerializeCheck( const char * string )
+        void WriteBytes( const uint8_t* data, int bytes )
         {
-#if PROTOCOL2_SERIALIZE_CHECKS
-            SerializeAlign();
-            const uint32_t magic = hash_string( string, 0 );
-            SerializeBits( magic, 32 );
-#endif // #if PROTOCOL2_SERIALIZE_CHECKS
-            return true;
+            assert( GetAlignBits() == 0 );
+            assert( ( m_bitsWritten % 32 ) == 0 || ( m_bitsWritten % 32 ) == 8 || ( m_bitsWritten % 32 ) == 16 || ( m_bitsWritten % 32 ) == 24 );
+
+            if ( m_bitsWritten + bytes * 8 > m_numBits )
+            {
+                for ( int i = 0; i < bytes; ++i )
+                    WriteBits( data[i], 8 );
+                return;
+            }
+
+            int headBytes = ( 4 - ( m_bitsWritten % 32 ) / 8 ) % 4;
+            if ( headBytes > bytes )
+                headBytes = bytes;
+            for ( int i = 0; i < headBytes; ++i )
+                WriteBits( data[i], 8 );
+            if ( headBytes == bytes )
+                return;
+
+            FlushBits();
+
+            assert( GetAlignBits() == 0 );
+
+            int numWords = ( bytes - headBytes ) / 4;
+            if ( numWords > 0 )
+            {
+                assert( ( m_bitsWritten % 32 ) == 0 );
+                memcpy( &m_data[m_wordIndex], data + headBytes, numWords * 4 );
+                m_bitsWritten += numWords * 32;
+                m_wordIndex += numWords;
+                m_scratch = 0;
+            }
+
+            assert( GetAlignBits() == 0 );
+
+            int tailStart = headBytes + numWords * 4;
+            int tailBytes = bytes - tailStart;
+            assert( tailBytes >= 0 && tailBytes < 4 );
+            for ( int i = 0; i < tailBytes; ++i )
+                WriteBits( data[tailStart+i], 8 );
+
+            assert( GetAlignBits() == 0 );
+
+            assert( headBytes + numWords * 4 + tailBytes == bytes );
         }
 
-        void Flush()
+        void FlushBits()
         {
-            m_writer.FlushBits();
+            // flush a dword at a time so a buffer that is only a multiple of four bytes is never overrun
+
+            while ( m_scratchBits > 0 )
+            {
+                if ( m_wordIndex < m_numWords )
+                    m_data[m_wordIndex] = host_to_network( uint32_t( m_scratch & 0xFFFFFFFF ) );
+                m_scratch >>= 32;
+                m_scratchBits = ( m_scratchBits > 32 ) ? m_scratchBits - 32 : 0;
+                m_wordIndex++;
+            }
         }
 
-        const uint8_t* GetData() const
+        WriteCheckpoint Checkpoint() const
         {
-            return m_writer.GetData();
+            WriteCheckpoint checkpoint;
+            checkpoint.scratch = m_scratch;
+            checkpoint.bitsWritten = m_bitsWritten;
+            checkpoint.wordIndex = m_wordIndex;
+            checkpoint.scratchBits = m_scratchBits;
+            return checkpoint;
         }
 
-        int GetBytesProcessed() const
+        void Rollback( const WriteCheckpoint & checkpoint )
         {
-            return m_writer.GetBytesWritten();
+            // the partial word at the checkpoint is restored from the saved scratch and rewritten on the next flush
+
+            assert( checkpoint.bitsWritten <= m_bitsWritten );
+            assert( checkpoint.bitsWritten <= m_numBits );
+
+            m_scratch = checkpoint.scratch;
+            m_bitsWritten = checkpoint.bitsWritten;
+            m_wordIndex = checkpoint.wordIndex;
+            m_scratchBits = checkpoint.scratchBits;
         }
 
-        int GetBitsProcessed() const
+        bool IsOverflow() const
         {
-            return m_writer.GetBitsWritten();
+            return m_bitsWritten > m_numBits;
         }
 
-        int GetBitsRemaining() const
+        int GetAlignBits() const
         {
-            return GetTotalBits() - GetBitsProcessed();
+            return ( 8 - ( m_bitsWritten % 8 ) ) % 8;
         }
 
-        int GetTotalBits() const
+        int GetBitsWritten() const
         {
-            return m_writer.GetTotalBytes() * 8;
+            return m_bitsWritten;
         }
 
-        int GetTotalBytes() const
+        int GetBitsAvailable() const
         {
-            return m_writer.GetTotalBytes();
+            return m_numBits - m_bitsWritten;
         }
 
-        void SetContext( void *context )
+        const uint8_t* GetData() const
         {
-            m_context = context;
+            return (uint8_t*) m_data;
         }
 
-        void* GetContext() const
+        int GetBytesWritten() const
         {
-            return m_context;
+            return ( m_bitsWritten + 7 ) / 8;
+        }
+
+        int GetTotalBytes() const
+        {
+            return m_numWords * 4;
+        }
+
+    private:
+
+        uint32_t* m_data;
+        uint64_t m_scratch;
+        int m_numBits;
+        int m_numWords;
+        int m_bitsWritten;
+        int m_wordIndex;
+        int m_scratchBits;
+    };
+
+    class BitReader64
+    {
+    public:
+
+        BitReader64( const void* data, int bytes ) : m_data( (const uint32_t*)data ), m_numBytes( bytes ), m_numWords( ( bytes + 3 ) / 4 )
+        {
+            // IMPORTANT: Just like BitReader the buffer underneath must round up to a multiple of 4 bytes. 
+            // Refills read a qword at a time, falling back to a single dword for the last word in the buffer.
+            assert( data );
+            m_numBits = m_numBytes * 8;
+            m_bitsRead = 0;
+            m_scratch = 0;
+            m_scratchBits = 0;
+            m_wordIndex = 0;
+        }
+
+        bool WouldOverflow( int bits ) const
+        {
+            return m_bitsRead + bits > m_numBits;
+        }
+
+        uint32_t ReadBits( int bits )
+        {
+            assert( bits > 0 );
+            assert( bits <= 32 );
+            return uint32_t( ReadBits64( bits ) );
+        }
+
+        uint64_t ReadBits64( int bits )
+        {
+            assert( bits > 0 );
+            assert( bits <= 64 );
+            assert( m_bitsRead + bits <= m_numBits );
+            assert( m_scratchBits >= 0 && m_scratchBits <= 64 );
+
+            m_bitsRead += bits;
+
+            const uint64_t mask = ( bits < 64 ) ? ( uint64_t(1) << bits ) - 1 : ~uint64_t(0);
+
+            if ( m_scratchBits >= bits )
+            {
+                const uint64_t output = m_scratch & mask;
+                m_scratch = ( bits < 64 ) ? ( m_scratch >> bits ) : 0;
+                m_scratchBits -= bits;
+                return output;
+            }
+
+            // the scratch and the refill word together act as a 128 bit scratch. take what we need and keep the rest
+
+            uint64_t word;
+            int wordBits;
+            if ( m_wordIndex + 2 <= m_numWords )
+            {
+                memcpy( &word, &m_data[m_wordIndex], 8 );
+                word = network_to_host( word );
+                wordBits = 64;
+                m_wordIndex += 2;
+            }
+            else
+            {
+                assert( m_wordIndex < m_numWords );
+                word = network_to_host( m_data[m_wordIndex] );
+                wordBits = 32;
+                m_wordIndex++;
+            }
+
+            const uint64_t output = ( m_scratch | ( word << m_scratchBits ) ) & mask;
+
+            const int usedBits = bits - m_scratchBits;
+
+            assert( usedBits > 0 && usedBits <= wordBits );
+
+            m_scratch = ( usedBits < 64 ) ? ( word >> usedBits ) : 0;
+            m_scratchBits = wordBits - usedBits;
+
+            return output;
+        }
+
+        bool ReadAlign()
+        {
+            const int remainderBits = m_bitsRead % 8;
+            if ( remainderBits != 0 )
+            {
+                uint32_t value = ReadBits( 8 - remainderBits );
+                assert( m_bitsRead % 8 == 0 );
+                if ( value != 0 )
+                    return false;
+            }
+            return true;
+        }
+
+        void ReadBytes( uint8_t* data, int bytes )
+        {
+            assert( GetAlignBits() == 0 );
+            assert( m_bitsRead + bytes * 8 <= m_numBits );
+            assert( ( m_bitsRead % 32 ) == 0 || ( m_bitsRead % 32 ) == 8 || ( m_bitsRead % 32 ) == 16 || ( m_bitsRead % 32 ) == 24 );
+
+            int headBytes = ( 4 - ( m_bitsRead % 32 ) / 8 ) % 4;
+            if ( headBytes > bytes )
+                headBytes = bytes;
+            for ( int i = 0; i < headBytes; ++i )
+                data[i] = (uint8_t) ReadBits( 8 );
+            if ( headBytes == bytes )
+                return;
+
+            assert( GetAlignBits() == 0 );
+
+            // dword aligned here, so the scratch holds whole dwords that are still in the buffer. rewind over them.
+
+            assert( ( m_scratchBits % 32 ) == 0 );
+            m_wordIndex -= m_scratchBits / 32;
+            m_scratch = 0;
+            m_scratchBits = 0;
+
+            int numWords = ( bytes - headBytes ) / 4;
+            if ( numWords > 0 )
+            {
+                assert( ( m_bitsRead % 32 ) == 0 );
+                memcpy( data + headBytes, &m_data[m_wordIndex], numWords * 4 );
+                m_bitsRead += numWords * 32;
+                m_wordIndex += numWords;
+            }
+
+            assert( GetAlignBits() == 0 );
+
+            int tailStart = headBytes + numWords * 4;
+            int tailBytes = bytes - tailStart;
+            assert( tailBytes >= 0 && tailBytes < 4 );
+            for ( int i = 0; i < tailBytes; ++i )
+                data[tailStart+i] = (uint8_t) ReadBits( 8 );
+
+            assert( GetAlignBits() == 0 );
+
+            assert( headBytes + numWords * 4 + tailBytes == bytes );
+        }
+
+        const uint8_t* ReadBytesView( int bytes )
+        {
+            // same walk as ReadBytes, but the bytes are left in place and a pointer to them is returned
+
+            assert( GetAlignBits() == 0 );
+            assert( m_bitsRead + bytes * 8 <= m_numBits );
+
+            const uint8_t* data = ( (const uint8_t*) m_data ) + m_bitsRead / 8;
+
+            int headBytes = ( 4 - ( m_bitsRead % 32 ) / 8 ) % 4;
+            if ( headBytes > bytes )
+                headBytes = bytes;
+            for ( int i = 0; i < headBytes; ++i )
+                ReadBits( 8 );
+            if ( headBytes == bytes )
+                return data;
+
+            assert( ( m_scratchBits % 32 ) == 0 );
+            m_wordIndex -= m_scratchBits / 32;
+            m_scratch = 0;
+            m_scratchBits = 0;
+
+            const int numWords = ( bytes - headBytes ) / 4;
+            m_bitsRead += numWords * 32;
+            m_wordIndex += numWords;
+
+            const int tailBytes = bytes - headBytes - numWords * 4;
+            for ( int i = 0; i < tailBytes; ++i )
+                ReadBits( 8 );
+
+            return data;
+        }
+
+        int GetAlignBits() const
+        {
+            return ( 8 - m_bitsRead % 8 ) % 8;
+        }
+
+        int GetBitsRead() const
+        {
+            return m_bitsRead;
+        }
+
+        int GetBytesRead() const
+        {
+            return m_wordIndex * 4;
+        }
+
+        int GetBitsRemaining() const
+        {
+            return m_numBits - m_bitsRead;
+        }
+
+        int GetBytesRemaining() const
+        {
+            return GetBitsRemaining() / 8;
+        }
+
+        int GetTotalBits() const 
+        {
+            return m_numBits;
+        }
+
+        int GetTotalBytes() const
+        {
+            return m_numBits / 8;
+        }
+
+    private:
+
+        const uint32_t* m_data;
+        uint64_t m_scratch;
+        int m_numBits;
+        int m_numBytes;
+        int m_numWords;
+        int m_bitsRead;
+        int m_scratchBits;
+        int m_wordIndex;
+    };
+
+#if PROTOCOL2_BITPACKER_64
+    typedef BitWriter64 StreamBitWriter;
+    typedef BitReader64 StreamBitReader;
+#else // #if PROTOCOL2_BITPACKER_64
+    typedef BitWriter StreamBitWriter;
+    typedef BitReader StreamBitReader;
+#endif // #if PROTOCOL2_BITPACKER_64
+
+    #define PROTOCOL2_ERROR_NONE                        0
+    #define PROTOCOL2_ERROR_CRC32_MISMATCH              1
+    #define PROTOCOL2_ERROR_INVALID_PACKET_TYPE         2
+    #define PROTOCOL2_ERROR_PACKET_TYPE_NOT_ALLOWED     3
+    #define PROTOCOL2_ERROR_CREATE_PACKET_FAILED        4
+    #define PROTOCOL2_ERROR_SERIALIZE_HEADER_FAILED     5
+    #define PROTOCOL2_ERROR_SERIALIZE_PACKET_FAILED     6
+    #define PROTOCOL2_ERROR_SERIALIZE_CHECK_FAILED      7
+    #define PROTOCOL2_ERROR_STREAM_OVERFLOW             8
+    #define PROTOCOL2_ERROR_STREAM_ABORTED              9
+
+    class WriteStream
+    {
+    public:
+
+        enum { IsWriting = 1 };
+        enum { IsReading = 0 };
+
+        WriteStream( uint8_t* buffer, int bytes ) : m_error( PROTOCOL2_ERROR_NONE ), m_context( NULL ), m_writer( buffer, bytes ) {}
+
+        bool SerializeInteger( int32_t value, int32_t min, int32_t max )
+        {
+            assert( min < max );
+            assert( value >= min );
+            assert( value <= max );
+            const int bits = bits_required( min, max );
+            uint32_t unsigned_value = value - min;
+            m_writer.WriteBits( unsigned_value, bits );
+            return true;
+        }
+
+        bool SerializeBits( uint32_t value, int bits )
+        {
+            assert( bits > 0 );
+            assert( bits <= 32 );
+            m_writer.WriteBits( value, bits );
+            return true;
+        }
+
+        template <int32_t min, int32_t max> bool SerializeInteger( int32_t value )
+        {
+            assert( min < max );
+            assert( value >= min );
+            assert( value <= max );
+            const int bits = BitsRequired<min,max>::result;
+            uint32_t unsigned_value = value - min;
+            m_writer.WriteBits( unsigned_value, bits );
+            return true;
+        }
+
+        template <int bits> bool SerializeBits( uint32_t value )
+        {
+            assert( bits > 0 );
+            assert( bits <= 32 );
+            m_writer.WriteBits( value, bits );
+            return true;
+        }
+
+        bool SerializeBits64( uint64_t value, int bits )
+        {
+            assert( bits > 0 );
+            assert( bits <= 64 );
+            m_writer.WriteBits64( value, bits );
+            return true;
+        }
+
+        bool SerializeBytes( const uint8_t* data, int bytes )
+        {
+            assert( data );
+            assert( bytes >= 0 );
+            if ( !SerializeAlign() )
+                return false;
+            m_writer.WriteBytes( data, bytes );
+            return true;
+        }
+
+        bool SerializeBytesView( const uint8_t* & data, int bytes )
+        {
+            return SerializeBytes( data, bytes );
+        }
+
+        bool SerializeAlign()
+        {
+            m_writer.WriteAlign();
+            return true;
+        }
+
+        int GetAlignBits() const
+        {
+            return m_writer.GetAlignBits();
+        }
+
+        bool SerializeCheck( const char * string )
+        {
+#if PROTOCOL2_SERIALIZE_CHECKS
+            SerializeAlign();
+            const uint32_t magic = hash_string( string, 0 );
+            SerializeBits<32>( magic );
+#endif // #if PROTOCOL2_SERIALIZE_CHECKS
+            return true;
+        }
+
+        void Flush()
+        {
+            m_writer.FlushBits();
+        }
+
+        WriteCheckpoint Checkpoint() const
+        {
+            return m_writer.Checkpoint();
+        }
+
+        void Rollback( const WriteCheckpoint & checkpoint )
+        {
+            // discard everything written since the checkpoint, including any overflow past the end of the buffer
+            m_writer.Rollback( checkpoint );
+        }
+
+        const uint8_t* GetData() const
+        {
+            return m_writer.GetData();
+        }
+
+        int GetBytesProcessed() const
+        {
+            return m_writer.GetBytesWritten();
+        }
+
+        int GetBitsProcessed() const
+        {
+            return m_writer.GetBitsWritten();
+        }
+
+        int GetBitsRemaining() const
+        {
+            return GetTotalBits() - GetBitsProcessed();
+        }
+
+        int GetTotalBits() const
+        {
+            return m_writer.GetTotalBytes() * 8;
+        }
+
+        int GetTotalBytes() const
+        {
+            return m_writer.GetTotalBytes();
+        }
+
+        void SetContext( void *context )
+        {
+            m_context = context;
+        }
+
+        void* GetContext() const
+        {
+            return m_context;
+        }
+
+        int GetError() const
+        {
+            if ( m_error == PROTOCOL2_ERROR_NONE && m_writer.IsOverflow() )
+                return PROTOCOL2_ERROR_STREAM_OVERFLOW;
+            return m_error;
+        }
+
+    private:
+
+        int m_error;
+        void *m_context;
+        StreamBitWriter m_writer;
+    };
+
+    class ReadStream
+    {
+    public:
+
+        enum { IsWriting = 0 };
+        enum { IsReading = 1 };
+
+        ReadStream( const uint8_t* buffer, int bytes ) : m_context( NULL ), m_error( PROTOCOL2_ERROR_NONE ), m_reader( buffer, bytes ) {}
+
+        bool SerializeInteger( int32_t & value, int32_t min, int32_t max )
+        {
+            assert( min < max );
+            const int bits = bits_required( min, max );
+            if ( m_reader.WouldOverflow( bits ) )
+            {
+                m_error = PROTOCOL2_ERROR_STREAM_OVERFLOW;
+                return false;
+            }
+            uint32_t unsigned_value = m_reader.ReadBits( bits );
+            value = (int32_t) unsigned_value + min;
+            return true;
+        }
+
+        bool SerializeBits( uint32_t & value, int bits )
+        {
+            assert( bits > 0 );
+            assert( bits <= 32 );
+            if ( m_reader.WouldOverflow( bits ) )
+            {
+                m_error = PROTOCOL2_ERROR_STREAM_OVERFLOW;
+                return false;
+            }
+            uint32_t read_value = m_reader.ReadBits( bits );
+            value = read_value;
+            return true;
+        }
+
+        template <int32_t min, int32_t max> bool SerializeInteger( int32_t & value )
+        {
+            assert( min < max );
+            const int bits = BitsRequired<min,max>::result;
+            if ( m_reader.WouldOverflow( bits ) )
+            {
+                m_error = PROTOCOL2_ERROR_STREAM_OVERFLOW;
+                return false;
+            }
+            uint32_t unsigned_value = m_reader.ReadBits( bits );
+            value = (int32_t) unsigned_value + min;
+            return true;
+        }
+
+        template <int bits> bool SerializeBits( uint32_t & value )
+        {
+            assert( bits > 0 );
+            assert( bits <= 32 );
+            if ( m_reader.WouldOverflow( bits ) )
+            {
+                m_error = PROTOCOL2_ERROR_STREAM_OVERFLOW;
+                return false;
+            }
+            value = m_reader.ReadBits( bits );
+            return true;
+        }
+
+        bool SerializeBits64( uint64_t & value, int bits )
+        {
+            assert( bits > 0 );
+            assert( bits <= 64 );
+            if ( m_reader.WouldOverflow( bits ) )
+            {
+                m_error = PROTOCOL2_ERROR_STREAM_OVERFLOW;
+                return false;
+            }
+            value = m_reader.ReadBits64( bits );
+            return true;
+        }
+
+        bool SerializeBytes( uint8_t* data, int bytes )
+        {
+            if ( !SerializeAlign() )
+                return false;
+            if ( m_reader.WouldOverflow( bytes * 8 ) )
+            {
+                m_error = PROTOCOL2_ERROR_STREAM_OVERFLOW;
+                return false;
+            }
+            m_reader.ReadBytes( data, bytes );
+            return true;
+        }
+
+        bool SerializeBytesView( const uint8_t* & data, int bytes )
+        {
+            if ( !SerializeAlign() )
+                return false;
+            if ( m_reader.WouldOverflow( bytes * 8 ) )
+            {
+                m_error = PROTOCOL2_ERROR_STREAM_OVERFLOW;
+                return false;
+            }
+            data = m_reader.ReadBytesView( bytes );
+            return true;
+        }
+
+        bool SerializeAlign()
+        {
+            const int alignBits = m_reader.GetAlignBits();
+            if ( m_reader.WouldOverflow( alignBits ) )
+            {
+                m_error = PROTOCOL2_ERROR_STREAM_OVERFLOW;
+                return false;
+            }
+            if ( !m_reader.ReadAlign() )
+                return false;
+            return true;
+        }
+
+        int GetAlignBits() const
+        {
+            return m_reader.GetAlignBits();
+        }
+
+        bool SerializeCheck( const char * string )
+        {
+#if PROTOCOL2_SERIALIZE_CHECKS            
+            SerializeAlign();
+            uint32_t value = 0;
+            SerializeAlign();
+            SerializeBits<32>( value );
+            const uint32_t magic = hash_string( string, 0 );
+            if ( magic != value )
+            {
+                printf( "serialize check failed: '%s'. expected %x, got %x\n", string, magic, value );
+            }
+            return value == magic;
+#else // #if PROTOCOL2_SERIALIZE_CHECKS
+            return true;
+#endif // #if PROTOCOL2_SERIALIZE_CHECKS
+        }
+
+        int GetBitsProcessed() const
+        {
+            return m_reader.GetBitsRead();
+        }
+
+        int GetBitsRemaining() const
+        {
+            return m_reader.GetBitsRemaining();
+        }
+
+        int GetBytesProcessed() const
+        {
+            return ( m_reader.GetBitsRead() + 7 ) / 8;
+        }
+
+        void SetContext( void* context )
+        {
+            m_context = context;
+        }
+
+        void* GetContext() const
+        {
+            return m_context;
         }
 
         int GetError() const
@@ -689,34 +1526,43 @@ namespace protocol2
             return m_error;
         }
 
+        int GetBytesRead() const
+        {
+            return m_reader.GetBytesRead();
+        }
+
     private:
 
+        friend class UncheckedReadStream;
+
+        void* m_context;
         int m_error;
-        void *m_context;
-        BitWriter m_writer;
+        StreamBitReader m_reader;
     };
 
-    class ReadStream
+    class UncheckedReadStream
     {
+        // reads from a read stream without checking each integer and bits field for overflow.
+
+        // IMPORTANT: Only use this once you have verified the buffer covers the true worst case bits still to be read,
+        // over every value the fields can take, not just the bits of one particular packet. Integer and bits reads past 
+        // the end of the buffer are only caught by asserts in debug builds. Bytes and align still check for overflow, 
+        // since length prefixed data is where an underestimated worst case usually comes from.
+
     public:
 
         enum { IsWriting = 0 };
         enum { IsReading = 1 };
 
-        ReadStream( const uint8_t* buffer, int bytes ) : m_context( NULL ), m_error( PROTOCOL2_ERROR_NONE ), m_bitsRead(0), m_reader( buffer, bytes ) {}
+        UncheckedReadStream( ReadStream & stream ) : m_stream( stream ), m_reader( stream.m_reader ) {}
 
         bool SerializeInteger( int32_t & value, int32_t min, int32_t max )
         {
             assert( min < max );
             const int bits = bits_required( min, max );
-            if ( m_reader.WouldOverflow( bits ) )
-            {
-                m_error = PROTOCOL2_ERROR_STREAM_OVERFLOW;
-                return false;
-            }
+            assert( !m_reader.WouldOverflow( bits ) );
             uint32_t unsigned_value = m_reader.ReadBits( bits );
             value = (int32_t) unsigned_value + min;
-            m_bitsRead += bits;
             return true;
         }
 
@@ -724,43 +1570,73 @@ namespace protocol2
         {
             assert( bits > 0 );
             assert( bits <= 32 );
-            if ( m_reader.WouldOverflow( bits ) )
+            assert( !m_reader.WouldOverflow( bits ) );
+            value = m_reader.ReadBits( bits );
+            return true;
+        }
+
+        template <int32_t min, int32_t max> bool SerializeInteger( int32_t & value )
+        {
+            assert( min < max );
+            const int bits = BitsRequired<min,max>::result;
+            assert( !m_reader.WouldOverflow( bits ) );
+            uint32_t unsigned_value = m_reader.ReadBits( bits );
+            value = (int32_t) unsigned_value + min;
+            return true;
+        }
+
+        template <int bits> bool SerializeBits( uint32_t & value )
+        {
+            assert( bits > 0 );
+            assert( bits <= 32 );
+            assert( !m_reader.WouldOverflow( bits ) );
+            value = m_reader.ReadBits( bits );
+            return true;
+        }
+
+        bool SerializeBits64( uint64_t & value, int bits )
+        {
+            assert( bits > 0 );
+            assert( bits <= 64 );
+            assert( !m_reader.WouldOverflow( bits ) );
+            value = m_reader.ReadBits64( bits );
+            return true;
+        }
+
+        bool SerializeBytes( uint8_t* data, int bytes )
+        {
+            if ( !SerializeAlign() )
+                return false;
+            if ( m_reader.WouldOverflow( bytes * 8 ) )
             {
-                m_error = PROTOCOL2_ERROR_STREAM_OVERFLOW;
+                m_stream.m_error = PROTOCOL2_ERROR_STREAM_OVERFLOW;
                 return false;
             }
-            uint32_t read_value = m_reader.ReadBits( bits );
-            value = read_value;
-            m_bitsRead += bits;
+            m_reader.ReadBytes( data, bytes );
             return true;
         }
 
-        bool SerializeBytes( uint8_t* data, int bytes )
+        bool SerializeBytesView( const uint8_t* & data, int bytes )
         {
             if ( !SerializeAlign() )
                 return false;
             if ( m_reader.WouldOverflow( bytes * 8 ) )
             {
-                m_error = PROTOCOL2_ERROR_STREAM_OVERFLOW;
+                m_stream.m_error = PROTOCOL2_ERROR_STREAM_OVERFLOW;
                 return false;
             }
-            m_reader.ReadBytes( data, bytes );
-            m_bitsRead += bytes * 8;
+            data = m_reader.ReadBytesView( bytes );
             return true;
         }
 
         bool SerializeAlign()
         {
-            const int alignBits = m_reader.GetAlignBits();
-            if ( m_reader.WouldOverflow( alignBits ) )
+            if ( m_reader.WouldOverflow( m_reader.GetAlignBits() ) )
             {
-                m_error = PROTOCOL2_ERROR_STREAM_OVERFLOW;
+                m_stream.m_error = PROTOCOL2_ERROR_STREAM_OVERFLOW;
                 return false;
             }
-            if ( !m_reader.ReadAlign() )
-                return false;
-            m_bitsRead += alignBits;
-            return true;
+            return m_reader.ReadAlign();
         }
 
         int GetAlignBits() const
@@ -770,25 +1646,12 @@ namespace protocol2
 
         bool SerializeCheck( const char * string )
         {
-#if PROTOCOL2_SERIALIZE_CHECKS            
-            SerializeAlign();
-            uint32_t value = 0;
-            SerializeAlign();
-            SerializeBits( value, 32 );
-            const uint32_t magic = hash_string( string, 0 );
-            if ( magic != value )
-            {
-                printf( "serialize check failed: '%s'. expected %x, got %x\n", string, magic, value );
-            }
-            return value == magic;
-#else // #if PROTOCOL2_SERIALIZE_CHECKS
-            return true;
-#endif // #if PROTOCOL2_SERIALIZE_CHECKS
+            return m_stream.SerializeCheck( string );
         }
 
         int GetBitsProcessed() const
         {
-            return m_bitsRead;
+            return m_reader.GetBitsRead();
         }
 
         int GetBitsRemaining() const
@@ -798,22 +1661,22 @@ namespace protocol2
 
         int GetBytesProcessed() const
         {
-            return ( m_bitsRead + 7 ) / 8;
+            return ( m_reader.GetBitsRead() + 7 ) / 8;
         }
 
         void SetContext( void* context )
         {
-            m_context = context;
+            m_stream.SetContext( context );
         }
 
         void* GetContext() const
         {
-            return m_context;
+            return m_stream.GetContext();
         }
 
         int GetError() const
         {
-            return m_error;
+            return m_stream.GetError();
         }
 
         int GetBytesRead() const
@@ -821,12 +1684,24 @@ namespace protocol2
             return m_reader.GetBytesRead();
         }
 
+        ReadStream & GetCheckedStream()
+        {
+            // for hand written serialize functions that only take a read stream. reads through it are checked as usual
+
+            return m_stream;
+        }
+
+        operator ReadStream & ()
+        {
+            // so an unchecked stream can be passed straight to hand written functions that take a read stream
+
+            return m_stream;
+        }
+
     private:
 
-        void* m_context;
-        int m_error;
-        int m_bitsRead;
-        BitReader m_reader;
+        ReadStream & m_stream;
+        StreamBitReader & m_reader;
     };
 
     class MeasureStream
@@ -860,6 +1735,35 @@ namespace protocol2
             return true;
         }
 
+#ifdef DEBUG
+        template <int32_t min, int32_t max> bool SerializeInteger( int32_t value )
+#else // #ifdef DEBUG
+        template <int32_t min, int32_t max> bool SerializeInteger( int32_t /*value*/ )
+#endif // #ifdef DEBUG
+        {
+            assert( min < max );
+            assert( value >= min );
+            assert( value <= max );
+            m_bitsWritten += BitsRequired<min,max>::result;
+            return true;
+        }
+
+        template <int bits> bool SerializeBits( uint32_t /*value*/ )
+        {
+            assert( bits > 0 );
+            assert( bits <= 32 );
+            m_bitsWritten += bits;
+            return true;
+        }
+
+        bool SerializeBits64( uint64_t /*value*/, int bits )
+        {
+            assert( bits > 0 );
+            assert( bits <= 64 );
+            m_bitsWritten += bits;
+            return true;
+        }
+
         bool SerializeBytes( const uint8_t* /*data*/, int bytes )
         {
             SerializeAlign();
@@ -867,6 +1771,11 @@ namespace protocol2
             return true;
         }
 
+        bool SerializeBytesView( const uint8_t* & data, int bytes )
+        {
+            return SerializeBytes( data, bytes );
+        }
+
         bool SerializeAlign()
         {
             const int alignBits = GetAlignBits();
@@ -971,13 +1880,50 @@ namespace protocol2
                 value = uint32_value;                                   \
         } while (0)
 
+    // serialize_int_const and serialize_bits_const take compile time constant bounds, so bits required and masks are folded at compile time
+
+    #define serialize_int_const( stream, value, min, max )                                  \
+        do                                                                                  \
+        {                                                                                   \
+            assert( min < max );                                                            \
+            int32_t int32_value;                                                            \
+            if ( Stream::IsWriting )                                                        \
+            {                                                                               \
+                assert( int64_t(value) >= int64_t(min) );                                   \
+                assert( int64_t(value) <= int64_t(max) );                                   \
+                int32_value = (int32_t) value;                                              \
+            }                                                                               \
+            if ( !stream.template SerializeInteger<min,max>( int32_value ) )                \
+                return false;                                                               \
+            if ( Stream::IsReading )                                                        \
+            {                                                                               \
+                value = int32_value;                                                        \
+                if ( value < min || value > max )                                           \
+                    return false;                                                           \
+            }                                                                               \
+        } while (0)
+
+    #define serialize_bits_const( stream, value, bits )                                     \
+        do                                                                                  \
+        {                                                                                   \
+            assert( bits > 0 );                                                             \
+            assert( bits <= 32 );                                                           \
+            uint32_t uint32_value;                                                          \
+            if ( Stream::IsWriting )                                                        \
+                uint32_value = (uint32_t) value;                                            \
+            if ( !stream.template SerializeBits<bits>( uint32_value ) )                     \
+                return false;                                                               \
+            if ( Stream::IsReading )                                                        \
+                value = uint32_value;                                                       \
+        } while (0)
+
 	#define serialize_bool( stream, value )								\
 		do																\
 		{																\
             uint32_t uint32_bool_value;									\
 			if ( Stream::IsWriting )									\
 				uint32_bool_value = value ? 1 : 0; 						\
-			serialize_bits( stream, uint32_bool_value, 1 );				\
+			serialize_bits_const( stream, uint32_bool_value, 1 );		\
 			if ( Stream::IsReading )									\
 				value = uint32_bool_value ? true : false;				\
 		} while (0)
@@ -1000,9 +1946,9 @@ namespace protocol2
         if ( Stream::IsWriting )
             memcpy( &int_value, &value, 4 );
 
-        bool result = stream.SerializeBits( int_value, 32 );
+        bool result = stream.template SerializeBits<32>( int_value );
 
-        if ( Stream::IsReading )
+        if ( Stream::IsReading && result )
             memcpy( &value, &int_value, 4 );
 
         return result;
@@ -1016,20 +1962,28 @@ namespace protocol2
         } while (0)
 
     #define serialize_uint32( stream, value )                                       \
-        serialize_bits( stream, value, 32 );
+        serialize_bits_const( stream, value, 32 );
+
+    // serialize_bits64 serializes up to 64 bits in one call. with PROTOCOL2_BITPACKER_64 this is a single WriteBits64/ReadBits64 
+    // on the 64 bit bitpacker, otherwise it is split into two 32 bit fields. the bitstream is the same either way
+
+    #define serialize_bits64( stream, value, bits )                                 \
+        do                                                                          \
+        {                                                                           \
+            assert( bits > 0 );                                                     \
+            assert( bits <= 64 );                                                   \
+            uint64_t uint64_value;                                                  \
+            if ( Stream::IsWriting )                                                \
+                uint64_value = (uint64_t) value;                                    \
+            if ( !stream.SerializeBits64( uint64_value, bits ) )                    \
+                return false;                                                       \
+            if ( Stream::IsReading )                                                \
+                value = uint64_value;                                               \
+        } while (0)
 
     template <typename Stream> bool serialize_uint64_internal( Stream & stream, uint64_t & value )
     {
-        uint32_t hi,lo;
-        if ( Stream::IsWriting )
-        {
-            lo = value & 0xFFFFFFFF;
-            hi = value >> 32;
-        }
-        serialize_bits( stream, lo, 32 );
-        serialize_bits( stream, hi, 32 );
-        if ( Stream::IsReading )
-            value = ( uint64_t(hi) << 32 ) | lo;
+        serialize_bits64( stream, value, 64 );
         return true;
     }
 
@@ -1079,6 +2033,20 @@ namespace protocol2
                 return false;                                                       \
         } while (0)
 
+    template <typename Stream> bool serialize_bytes_view_internal( Stream & stream, const uint8_t* & data, int bytes )
+    {
+        return stream.SerializeBytesView( data, bytes );
+    }
+
+    // on read, data points into the stream buffer instead of being copied out. the buffer must outlive any use of it
+
+    #define serialize_bytes_view( stream, data, bytes )                             \
+        do                                                                          \
+        {                                                                           \
+            if ( !protocol2::serialize_bytes_view_internal( stream, data, bytes ) ) \
+                return false;                                                       \
+        } while (0)
+
     template <typename Stream> bool serialize_string_internal( Stream & stream, char* string, int buffer_size )
     {
         int length;
@@ -1153,6 +2121,7 @@ namespace protocol2
     #define read_uint64    serialize_uint64
     #define read_double    serialize_double
     #define read_bytes     serialize_bytes
+    #define read_bytes_view serialize_bytes_view
     #define read_string    serialize_string
     #define read_align     serialize_align
     #define read_check     serialize_check
@@ -1184,6 +2153,7 @@ namespace protocol2
     #define write_uint64   serialize_uint64
     #define write_double   serialize_double
     #define write_bytes    serialize_bytes
+    #define write_bytes_view serialize_bytes_view
     #define write_string   serialize_string
     #define write_align    serialize_align
     #define write_check    serialize_check
@@ -1197,6 +2167,13 @@ namespace protocol2
 
         virtual bool SerializeInternal( class ReadStream & stream ) = 0;
 
+        virtual bool SerializeInternal( class UncheckedReadStream & stream )
+        {
+            // objects that don't declare an unchecked serialize are read through the checked stream
+
+            return SerializeInternal( stream.GetCheckedStream() );
+        }
+
         virtual bool SerializeInternal( class WriteStream & stream ) = 0;
 
         virtual bool SerializeInternal( class MeasureStream & stream ) = 0;
@@ -1204,6 +2181,7 @@ namespace protocol2
 
     #define PROTOCOL2_DECLARE_VIRTUAL_SERIALIZE_FUNCTIONS()                                                     \
         bool SerializeInternal( class protocol2::ReadStream & stream ) { return Serialize( stream ); };         \
+        bool SerializeInternal( class protocol2::UncheckedReadStream & stream ) { return Serialize( stream ); }; \
         bool SerializeInternal( class protocol2::WriteStream & stream ) { return Serialize( stream ); };        \
         bool SerializeInternal( class protocol2::MeasureStream & stream ) { return Serialize( stream ); };      \
 
@@ -1225,6 +2203,64 @@ namespace protocol2
         Packet & operator = ( const Packet & other );
     };
 
+    class PacketArena
+    {
+    public:
+
+        // IMPORTANT: Packets created in an arena are never destroyed individually. Reset frees every packet in the arena
+        // at once without running destructors, so only use it for packets whose destructors don't need to run.
+
+        PacketArena( int bytes )
+        {
+            assert( bytes > 0 );
+            m_data = new uint8_t[bytes];
+            m_capacity = bytes;
+            m_bytesAllocated = 0;
+        }
+
+        ~PacketArena()
+        {
+            assert( m_data );
+            delete [] m_data;
+            m_data = NULL;
+        }
+
+        void * Allocate( int bytes )
+        {
+            assert( bytes > 0 );
+            const int alignment = 16;
+            const int offset = ( m_bytesAllocated + alignment - 1 ) & ~( alignment - 1 );
+            if ( offset + bytes > m_capacity )
+                return NULL;
+            m_bytesAllocated = offset + bytes;
+            return m_data + offset;
+        }
+
+        void Reset()
+        {
+            m_bytesAllocated = 0;
+        }
+
+        int GetBytesAllocated() const
+        {
+            return m_bytesAllocated;
+        }
+
+        int GetCapacity() const
+        {
+            return m_capacity;
+        }
+
+    private:
+
+        uint8_t * m_data;
+        int m_capacity;
+        int m_bytesAllocated;
+
+        PacketArena( const PacketArena & other );
+        PacketArena & operator = ( const PacketArena & other );
+    };
+
     class PacketFactory
     {        
         int m_numPacketTypes;
@@ -1237,18 +2273,86 @@ namespace protocol2
 
         PacketFactory( int numTypes );
 
-        ~PacketFactory();
+        virtual ~PacketFactory();
 
         Packet* CreatePacket( int type );
 
+        Packet* CreatePacket( int type, PacketArena & arena );
+
         void DestroyPacket( Packet *packet );
 
-        int GetNumPacketTypes() const;
+        int GetNumPacketTypes() const;
+
+    protected:
+
+        virtual Packet * Create( int type ) = 0;
+        virtual void Destroy( Packet *packet ) = 0;
+
+        virtual Packet * CreateInArena( int /*type*/, PacketArena & /*arena*/ ) { return NULL; }
+    };
+
+    class PooledPacketFactory : public PacketFactory
+    {
+    public:
+
+        // IMPORTANT: Packets are constructed in fixed size slots preallocated per-packet type. Create and destroy are O(1) 
+        // pops and pushes on a per-type free list, so no memory is allocated once the pools are set up. Call InitPool for 
+        // each packet type in your constructor and implement CreatePooled with CreateFromPool, passing the arena through. 
+        // The arena is NULL for regular creates. Otherwise the packet is being created in that PacketArena, and 
+        // CreateFromPool takes the memory from the arena instead of the pool.
+
+        PooledPacketFactory( int numTypes );
+
+        ~PooledPacketFactory();
+
+        int GetPoolCapacity( int type ) const;
+
+        int GetPoolNumAllocated( int type ) const;
+
+        int GetPoolMaxAllocated( int type ) const;
+
+        int GetPoolNumFailed( int type ) const;
+
+    protected:
+
+        template <typename T> void InitPool( int type, int capacity )
+        {
+            InitPool( type, (int) sizeof( T ), capacity );
+        }
+
+        template <typename T> T * CreateFromPool( int type, PacketArena * arena )
+        {
+            assert( (int) sizeof( T ) <= m_pools[type].packetBytes );
+            void * memory = AllocateFromPool( type, arena );
+            return memory ? new ( memory ) T() : NULL;
+        }
+
+        virtual Packet * CreatePooled( int type, PacketArena * arena ) = 0;
+
+        void InitPool( int type, int packetBytes, int capacity );
+
+        void * AllocateFromPool( int type, PacketArena * arena );
+
+        Packet * Create( int type );
+
+        void Destroy( Packet *packet );
+
+        Packet * CreateInArena( int type, PacketArena & arena );
+
+    private:
 
-    protected:
+        struct Pool
+        {
+            uint8_t * memory;                       // capacity * packetBytes bytes of packet slots
+            void * freeList;                        // first free slot. each free slot stores a pointer to the next free slot
+            int packetBytes;                        // size of each slot, rounded up to keep packets aligned
+            int capacity;                           // number of slots
+            int numAllocated;                       // number of slots in use
+            int maxAllocated;                       // high water mark for slots in use
+            int numFailed;                          // number of creates that found the pool empty
+        };
 
-        virtual Packet * Create( int type ) = 0;
-        virtual void Destroy( Packet *packet ) = 0;
+        Pool * m_pools;
     };
 
     struct PacketInfo
@@ -1258,16 +2362,43 @@ namespace protocol2
         uint32_t protocolId;                        // protocol id that distinguishes your protocol from other packets sent over UDP.
         PacketFactory * packetFactory;              // create packets and determine information about packet types. required.
         const uint8_t * allowedPacketTypes;         // array of allowed packet types. if a packet type is not allowed the serialize read or write will fail.
+        const int * maxPacketBits;                  // optional array of true worst case bits per-packet type. if the buffer covers it, the packet is read without per-field overflow checks. see ReadPacket.
         void * context;                             // context for the packet serialization (optional, pass in NULL)
+        uint32_t crc32Seed;                         // crc32 of the protocol id followed by the zeroed crc32 field. set by CalculateCrc32Seed.
+        uint32_t crc32SeedProtocolId;               // protocol id the seed was calculated for. if it doesn't match protocolId the seed is recalculated per-packet.
+        bool crc32SeedValid;                        // true once CalculateCrc32Seed has been called. until then the seed is recalculated per-packet.
 
         PacketInfo()
+        {
+            Initialize( 0 );
+        }
+
+        explicit PacketInfo( uint32_t id )
+        {
+            // sets the protocol id and calculates its crc32 seed. copies of this packet info reuse the seed
+
+            Initialize( id );
+            CalculateCrc32Seed();
+        }
+
+        void CalculateCrc32Seed();                  // call after setting protocolId so each packet only runs crc32 over its own bytes
+
+        uint32_t GetCrc32Seed() const;              // the seed packets are checksummed with. recalculated if CalculateCrc32Seed wasn't called for this protocolId
+
+    private:
+
+        void Initialize( uint32_t id )
         {
             rawFormat = false;
             prefixBytes = 0;
-            protocolId = 0;
+            protocolId = id;
             packetFactory = NULL;
             allowedPacketTypes = NULL;
+            maxPacketBits = NULL;
             context = NULL;
+            crc32Seed = 0;
+            crc32SeedProtocolId = 0;
+            crc32SeedValid = false;
         }
     };
 
@@ -1277,7 +2408,20 @@ namespace protocol2
                      int bufferSize, 
                      Object *header = NULL );
 
+    // IMPORTANT: PacketInfo::maxPacketBits must be an upper bound over every packet of that type a sender could construct, 
+    // including hostile ones, not the size of one typical packet. MeasureStream only measures the instance you pass it, 
+    // so measure an instance with every variable count and length at its maximum, eg. a packet with MaxItems items 
+    // rather than a default constructed one. If you can't bound a packet type, set its entry to INT_MAX so it is 
+    // always read with overflow checks.
+
+    Packet * ReadPacket( const PacketInfo & info, 
+                         const uint8_t *buffer, 
+                         int bufferSize, 
+                         Object *header = NULL, 
+                         int *errorCode = NULL );
+
     Packet * ReadPacket( const PacketInfo & info, 
+                         PacketArena & arena,
                          const uint8_t *buffer, 
                          int bufferSize, 
                          Object *header = NULL, 
@@ -1320,13 +2464,28 @@ namespace protocol2
             assert( m_bytes > 0 );
             assert( ( m_bytes % 8 ) == 0 );
             m_data = new uint64_t[ m_bytes / 8 ];
+            m_ownsData = true;
+            Clear();
+        }
+
+        BitArray( uint64_t * data, int size )
+        {
+            // uses caller provided storage of at least ( size + 63 ) / 64 words, eg. an array inline in a packet, so nothing is allocated
+
+            assert( data );
+            assert( size > 0 );
+            m_size = size;
+            m_bytes = 8 * ( ( size / 64 ) + ( ( size % 64 ) ? 1 : 0 ) );
+            m_data = data;
+            m_ownsData = false;
             Clear();
         }
 
         ~BitArray()
         {
             assert( m_data );
-            delete [] m_data;
+            if ( m_ownsData )
+                delete [] m_data;
             m_data = NULL;
         }
 
@@ -1356,6 +2515,118 @@ namespace protocol2
             m_data[data_index] &= ~( uint64_t(1) << bit_index );
         }
 
+        void SetRange( int begin, int end )
+        {
+            // sets bits [begin,end) a word at a time
+
+            assert( begin >= 0 );
+            assert( begin <= end );
+            assert( end <= m_size );
+            if ( begin == end )
+                return;
+            const int first_word = begin >> 6;
+            const int last_word = ( end - 1 ) >> 6;
+            const uint64_t first_mask = ~uint64_t(0) << ( begin & 63 );
+            const uint64_t last_mask = ~uint64_t(0) >> ( 63 - ( ( end - 1 ) & 63 ) );
+            if ( first_word == last_word )
+            {
+                m_data[first_word] |= first_mask & last_mask;
+                return;
+            }
+            m_data[first_word] |= first_mask;
+            for ( int i = first_word + 1; i < last_word; ++i )
+                m_data[i] = ~uint64_t(0);
+            m_data[last_word] |= last_mask;
+        }
+
+        void ClearRange( int begin, int end )
+        {
+            // clears bits [begin,end) a word at a time
+
+            assert( begin >= 0 );
+            assert( begin <= end );
+            assert( end <= m_size );
+            if ( begin == end )
+                return;
+            const int first_word = begin >> 6;
+            const int last_word = ( end - 1 ) >> 6;
+            const uint64_t first_mask = ~uint64_t(0) << ( begin & 63 );
+            const uint64_t last_mask = ~uint64_t(0) >> ( 63 - ( ( end - 1 ) & 63 ) );
+            if ( first_word == last_word )
+            {
+                m_data[first_word] &= ~( first_mask & last_mask );
+                return;
+            }
+            m_data[first_word] &= ~first_mask;
+            for ( int i = first_word + 1; i < last_word; ++i )
+                m_data[i] = 0;
+            m_data[last_word] &= ~last_mask;
+        }
+
+        int CountSet() const
+        {
+            // bits past m_size are never set, so whole words can be counted
+
+            const int num_words = m_bytes / 8;
+            int count = 0;
+            for ( int i = 0; i < num_words; ++i )
+                count += popcount64( m_data[i] );
+            return count;
+        }
+
+        int FindFirstClear( int from ) const
+        {
+            // returns the index of the first clear bit at or after from, or -1 if there is none
+
+            assert( from >= 0 );
+            if ( from >= m_size )
+                return -1;
+            const int num_words = m_bytes / 8;
+            int word_index = from >> 6;
+            uint64_t word = ~m_data[word_index] & ( ~uint64_t(0) << ( from & 63 ) );
+            while ( !word )
+            {
+                if ( ++word_index >= num_words )
+                    return -1;
+#if PROTOCOL2_SSE2
+                const __m128i ones = _mm_set1_epi8( -1 );
+                while ( word_index + 2 <= num_words && _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*) &m_data[word_index] ), ones ) ) == 0xFFFF )
+                    word_index += 2;
+                if ( word_index >= num_words )
+                    return -1;
+#endif // #if PROTOCOL2_SSE2
+                word = ~m_data[word_index];
+            }
+            const int index = ( word_index << 6 ) + count_trailing_zeros64( word );
+            return ( index < m_size ) ? index : -1;
+        }
+
+        int FindNextSet( int from ) const
+        {
+            // returns the index of the first set bit at or after from, or -1 if there is none
+
+            assert( from >= 0 );
+            if ( from >= m_size )
+                return -1;
+            const int num_words = m_bytes / 8;
+            int word_index = from >> 6;
+            uint64_t word = m_data[word_index] & ( ~uint64_t(0) << ( from & 63 ) );
+            while ( !word )
+            {
+                if ( ++word_index >= num_words )
+                    return -1;
+#if PROTOCOL2_SSE2
+                const __m128i zero = _mm_setzero_si128();
+                while ( word_index + 2 <= num_words && _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*) &m_data[word_index] ), zero ) ) == 0xFFFF )
+                    word_index += 2;
+                if ( word_index >= num_words )
+                    return -1;
+#endif // #if PROTOCOL2_SSE2
+                word = m_data[word_index];
+            }
+            return ( word_index << 6 ) + count_trailing_zeros64( word );
+        }
+
         uint64_t GetBit( int index ) const
         {
             assert( index >= 0 );
@@ -1367,52 +2638,372 @@ namespace protocol2
             return ( m_data[data_index] >> bit_index ) & 1;
         }
 
-        int GetSize() const
-        {
-            return m_size;
-        }
+        void ShiftUp( int count )
+        {
+            // moves bit n to bit n + count. bits shifted past the end are lost and the low bits are cleared
+
+            assert( count >= 0 );
+            if ( count >= m_size )
+            {
+                Clear();
+                return;
+            }
+            const int num_words = m_bytes / 8;
+            const int word_shift = count >> 6;
+            const int bit_shift = count & 63;
+            for ( int i = num_words - 1; i >= 0; --i )
+            {
+                const int source = i - word_shift;
+                uint64_t word = 0;
+                if ( source >= 0 )
+                {
+                    word = m_data[source] << bit_shift;
+                    if ( bit_shift && source > 0 )
+                        word |= m_data[source-1] >> ( 64 - bit_shift );
+                }
+                m_data[i] = word;
+            }
+            if ( m_size & 63 )
+                m_data[num_words-1] &= ~uint64_t(0) >> ( 64 - ( m_size & 63 ) );
+        }
+
+        uint64_t GetWord( int index ) const
+        {
+            assert( index >= 0 );
+            assert( index < m_bytes / 8 );
+            return m_data[index];
+        }
+
+        void SetWord( int index, uint64_t value )
+        {
+            assert( index >= 0 );
+            assert( index < m_bytes / 8 );
+            assert( index < m_size / 64 || ( value >> ( m_size & 63 ) ) == 0 );
+            m_data[index] = value;
+        }
+
+        int GetNumWords() const
+        {
+            return m_bytes / 8;
+        }
+
+        int GetSize() const
+        {
+            return m_size;
+        }
+
+    private:
+
+        int m_size;
+        int m_bytes;
+        uint64_t * m_data;
+        bool m_ownsData;
+
+        BitArray( const BitArray & other );
+        BitArray & operator = ( const BitArray & other );
+    };
+
+    inline uint32_t reverse_bits( uint32_t x )
+    {
+        x = ( ( x >> 1 ) & 0x55555555 ) | ( ( x & 0x55555555 ) << 1 );
+        x = ( ( x >> 2 ) & 0x33333333 ) | ( ( x & 0x33333333 ) << 2 );
+        x = ( ( x >> 4 ) & 0x0F0F0F0F ) | ( ( x & 0x0F0F0F0F ) << 4 );
+        x = ( ( x >> 8 ) & 0x00FF00FF ) | ( ( x & 0x00FF00FF ) << 8 );
+        return ( x >> 16 ) | ( x << 16 );
+    }
+
+    inline uint32_t sequence_match_mask( const uint16_t * sequences, uint16_t first_sequence )
+    {
+        // bit n is set if sequences[n] == first_sequence + n, for n in [0,32)
+
+#if PROTOCOL2_SSE2
+        const __m128i eight = _mm_set1_epi16( 8 );
+        __m128i expected = _mm_add_epi16( _mm_set1_epi16( (short) first_sequence ), _mm_setr_epi16( 0, 1, 2, 3, 4, 5, 6, 7 ) );
+        uint32_t mask = 0;
+        for ( int i = 0; i < 32; i += 16 )
+        {
+            const __m128i a = _mm_cmpeq_epi16( _mm_loadu_si128( (const __m128i*) ( sequences + i ) ), expected );
+            expected = _mm_add_epi16( expected, eight );
+            const __m128i b = _mm_cmpeq_epi16( _mm_loadu_si128( (const __m128i*) ( sequences + i + 8 ) ), expected );
+            expected = _mm_add_epi16( expected, eight );
+            mask |= uint32_t( _mm_movemask_epi8( _mm_packs_epi16( a, b ) ) ) << i;
+        }
+        return mask;
+#else // #if PROTOCOL2_SSE2
+        uint32_t mask = 0;
+        for ( int i = 0; i < 32; ++i )
+            mask |= uint32_t( sequences[i] == uint16_t( first_sequence + i ) ) << i;
+        return mask;
+#endif // #if PROTOCOL2_SSE2
+    }
+
+    inline uint32_t tag_match_mask( const uint32_t * tags, uint16_t first_sequence )
+    {
+        // bit n is set if tags[n] == 0x10000 | uint16_t( first_sequence + n ), for n in [0,32)
+
+#if PROTOCOL2_SSE2
+        const __m128i four = _mm_set1_epi32( 4 );
+        const __m128i low = _mm_set1_epi32( 0xFFFF );
+        const __m128i exists = _mm_set1_epi32( 0x10000 );
+        __m128i sequence = _mm_add_epi32( _mm_set1_epi32( first_sequence ), _mm_setr_epi32( 0, 1, 2, 3 ) );
+        uint32_t mask = 0;
+        for ( int i = 0; i < 32; i += 16 )
+        {
+            __m128i match[4];
+            for ( int j = 0; j < 4; ++j )
+            {
+                const __m128i expected = _mm_or_si128( _mm_and_si128( sequence, low ), exists );
+                match[j] = _mm_cmpeq_epi32( _mm_loadu_si128( (const __m128i*) ( tags + i + j * 4 ) ), expected );
+                sequence = _mm_add_epi32( sequence, four );
+            }
+            const __m128i a = _mm_packs_epi32( match[0], match[1] );
+            const __m128i b = _mm_packs_epi32( match[2], match[3] );
+            mask |= uint32_t( _mm_movemask_epi8( _mm_packs_epi16( a, b ) ) ) << i;
+        }
+        return mask;
+#else // #if PROTOCOL2_SSE2
+        uint32_t mask = 0;
+        for ( int i = 0; i < 32; ++i )
+            mask |= uint32_t( tags[i] == ( 0x10000 | uint16_t( first_sequence + i ) ) ) << i;
+        return mask;
+#endif // #if PROTOCOL2_SSE2
+    }
+
+    template <typename T, int N = 0> class SequenceBuffer;
+
+    template <typename T> class SequenceBuffer<T, 0>
+    {
+    public:
+
+        SequenceBuffer( int size ) : m_exists( size )
+        {
+            assert( size > 0 );
+            m_size = size;
+            m_first_entry = true;
+            m_sequence = 0;
+            m_entry_sequence = new uint16_t[size];
+            m_entry_data = new T[size];
+            Reset();
+        }
+
+        ~SequenceBuffer()
+        {
+            assert( m_entry_data );
+            assert( m_entry_sequence );
+            delete [] m_entry_data;
+            delete [] m_entry_sequence;
+            m_entry_data = NULL;
+            m_entry_sequence = NULL;
+        }
+
+        void Reset()
+        {
+            m_first_entry = true;
+            m_sequence = 0;
+            m_exists.Clear();
+            memset( m_entry_sequence, 0, sizeof(uint16_t) * m_size );
+        }
+
+        T * Insert( uint16_t sequence )
+        {
+            if ( m_first_entry )
+            {
+                m_sequence = sequence + 1;
+                m_first_entry = false;
+            }
+            else if ( sequence_less_than( sequence, m_sequence - m_size ) )
+            {
+                return NULL;
+            }
+            else if ( sequence_greater_than( sequence + 1, m_sequence ) )
+            {
+                RemoveEntries( m_sequence, sequence );
+                m_sequence = sequence + 1;
+            }
+
+            const int index = sequence % m_size;
+
+            m_exists.SetBit( index );
+
+            m_entry_sequence[index] = sequence;
+
+            return &m_entry_data[index];
+        }
+
+        void Remove( uint16_t sequence )
+        {
+            m_exists.ClearBit( sequence % m_size );
+        }
+
+        void RemoveOldEntries()
+        {
+            // nothing to do: insert removes entries as they fall out of the window
+        }
+
+        bool IsAvailable( uint16_t sequence ) const
+        {
+            return !m_exists.GetBit( sequence % m_size );
+        }
+
+        int GetIndex( uint16_t sequence ) const
+        {
+            return sequence % m_size;
+        }
+
+        const T * Find( uint16_t sequence ) const
+        {
+            const int index = sequence % m_size;
+            if ( m_exists.GetBit( index ) && m_entry_sequence[index] == sequence )
+                return &m_entry_data[index];
+            else
+                return NULL;
+        }
+
+        T * Find( uint16_t sequence )
+        {
+            const int index = sequence % m_size;
+            if ( m_exists.GetBit( index ) && m_entry_sequence[index] == sequence )
+                return &m_entry_data[index];
+            else
+                return NULL;
+        }
+
+        T * GetAtIndex( int index )
+        {
+            assert( index >= 0 );
+            assert( index < m_size );
+            return m_exists.GetBit( index ) ? &m_entry_data[index] : NULL;
+        }
+
+        uint32_t GetAckBits( uint16_t ack ) const
+        {
+            // bit n is set if sequence ack - n is in the buffer
+
+            if ( m_size < 64 || ( m_size & ( m_size - 1 ) ) != 0 )
+            {
+                uint32_t ack_bits = 0;
+                for ( int i = 0; i < 32; ++i )
+                {
+                    if ( Find( ack - i ) )
+                        ack_bits |= uint32_t(1) << i;
+                }
+                return ack_bits;
+            }
+
+            // with a power of two size, sequences ack - 31 through ack are at consecutive indices that wrap at most once. 
+            // take their exists bits straight from the bit array words, then check their sequences 8 at a time
+
+            const uint16_t first_sequence = ack - 31;
+            const int first_index = first_sequence & ( m_size - 1 );
+            const int word_index = first_index >> 6;
+            const int bit_index = first_index & 63;
+
+            uint64_t window = m_exists.GetWord( word_index ) >> bit_index;
+            if ( bit_index > 32 )
+                window |= m_exists.GetWord( ( word_index + 1 ) & ( ( m_size >> 6 ) - 1 ) ) << ( 64 - bit_index );
+
+            const uint32_t exists = uint32_t( window );
+            if ( !exists )
+                return 0;
+
+            uint16_t sequences[32];
+            const int head = ( m_size - first_index < 32 ) ? m_size - first_index : 32;
+            memcpy( sequences, &m_entry_sequence[first_index], head * sizeof( uint16_t ) );
+            if ( head < 32 )
+                memcpy( sequences + head, m_entry_sequence, ( 32 - head ) * sizeof( uint16_t ) );
+
+            return reverse_bits( exists & sequence_match_mask( sequences, first_sequence ) );
+        }
+
+        uint16_t GetSequence() const 
+        {
+            return m_sequence;
+        }
+
+        int GetSize() const
+        {
+            return m_size;
+        }
+
+    private:
+
+        void RemoveEntries( uint16_t start_sequence, uint16_t finish_sequence )
+        {
+            // the slots for sequences [start,finish] hold entries that are now older than the window. clear them before the sequence advances
+
+            const int count = uint16_t( finish_sequence - start_sequence ) + 1;
+            if ( count >= m_size )
+            {
+                m_exists.Clear();
+                return;
+            }
+
+            if ( ( 65536 % m_size ) != 0 && ( start_sequence < m_size || finish_sequence < start_sequence ) )
+            {
+                // when the size doesn't divide 65536, slot indices jump where the sequence wraps, so around the wrap check every entry
+
+                const uint16_t oldest_sequence = finish_sequence + 1 - m_size;
+                for ( int i = 0; i < m_size; ++i )
+                {
+                    if ( m_exists.GetBit( i ) && sequence_less_than( m_entry_sequence[i], oldest_sequence ) )
+                        m_exists.ClearBit( i );
+                }
+                return;
+            }
 
-    private:
+            const int start_index = start_sequence % m_size;
+            const int finish_index = finish_sequence % m_size;
+            if ( start_index <= finish_index )
+            {
+                m_exists.ClearRange( start_index, finish_index + 1 );
+            }
+            else
+            {
+                m_exists.ClearRange( start_index, m_size );
+                m_exists.ClearRange( 0, finish_index + 1 );
+            }
+        }
 
+        T * m_entry_data;
+        uint16_t * m_entry_sequence;
         int m_size;
-        int m_bytes;
-        uint64_t * m_data;
+        uint16_t m_sequence;
+        bool m_first_entry;
+        BitArray m_exists;
 
-        BitArray( const BitArray & other );
-        BitArray & operator = ( const BitArray & other );
+        SequenceBuffer( const SequenceBuffer<T> & other );
+        SequenceBuffer<T> & operator = ( const SequenceBuffer<T> & other );
     };
 
-    template <typename T> class SequenceBuffer
+    /*
+        IMPORTANT: SequenceBuffer<T,N> is the compile time sized variant. N must be a power of two, so indexing is a mask instead of a modulo,
+        and the entries, sequences and exists bits are stored inline, so the whole buffer is a single allocation with no pointers to chase.
+
+        Define PROTOCOL2_SEQUENCE_BUFFER_TAGS to 1 to store the sequence and exists flag together in one 32 bit tag per entry,
+        so a lookup touches one cache line for both instead of the bit array and the sequence array.
+    */
+
+    template <typename T, int N> class SequenceBuffer
     {
+        typedef char size_must_be_a_power_of_two[ ( N > 0 && ( N & ( N - 1 ) ) == 0 && N <= 65536 ) ? 1 : -1 ];
+
     public:
 
-        SequenceBuffer( int size ) : m_exists( size )
+        SequenceBuffer()
         {
-            assert( size > 0 );
-            m_size = size;
-            m_first_entry = true;
-            m_sequence = 0;
-            m_entry_sequence = new uint16_t[size];
-            m_entry_data = new T[size];
             Reset();
         }
 
-        ~SequenceBuffer()
-        {
-            assert( m_entry_data );
-            assert( m_entry_sequence );
-            delete [] m_entry_data;
-            delete [] m_entry_sequence;
-            m_entry_data = NULL;
-            m_entry_sequence = NULL;
-        }
-
         void Reset()
         {
             m_first_entry = true;
             m_sequence = 0;
-            m_exists.Clear();
-            memset( m_entry_sequence, 0, sizeof(uint16_t) * m_size );
+#if PROTOCOL2_SEQUENCE_BUFFER_TAGS
+            memset( m_entry_tag, 0, sizeof( m_entry_tag ) );
+#else // #if PROTOCOL2_SEQUENCE_BUFFER_TAGS
+            memset( m_exists, 0, sizeof( m_exists ) );
+            memset( m_entry_sequence, 0, sizeof( m_entry_sequence ) );
+#endif // #if PROTOCOL2_SEQUENCE_BUFFER_TAGS
         }
 
         T * Insert( uint16_t sequence )
@@ -1422,72 +3013,116 @@ namespace protocol2
                 m_sequence = sequence + 1;
                 m_first_entry = false;
             }
-            else if ( sequence_less_than( sequence, m_sequence - m_size ) )
+            else if ( sequence_less_than( sequence, uint16_t( m_sequence - N ) ) )
             {
                 return NULL;
             }
             else if ( sequence_greater_than( sequence + 1, m_sequence ) )
             {
+                RemoveEntries( m_sequence, sequence );
                 m_sequence = sequence + 1;
             }
 
-            const int index = sequence % m_size;
-
-            m_exists.SetBit( index );
+            const int index = sequence & ( N - 1 );
 
+#if PROTOCOL2_SEQUENCE_BUFFER_TAGS
+            m_entry_tag[index] = 0x10000 | sequence;
+#else // #if PROTOCOL2_SEQUENCE_BUFFER_TAGS
+            m_exists[index>>6] |= uint64_t(1) << ( index & 63 );
             m_entry_sequence[index] = sequence;
+#endif // #if PROTOCOL2_SEQUENCE_BUFFER_TAGS
 
             return &m_entry_data[index];
         }
 
         void Remove( uint16_t sequence )
         {
-            m_exists.ClearBit( sequence % m_size );
+            ClearExists( sequence & ( N - 1 ) );
         }
 
         void RemoveOldEntries()
         {
-            const uint16_t oldest_sequence = m_sequence - m_size;
-            for ( int i = 0; i < m_size; ++i )
-            {
-                if ( m_exists.GetBit( i ) && sequence_less_than( m_entry_sequence[i], oldest_sequence ) )
-                    m_exists.ClearBit( i );
-            }
+            // nothing to do: insert removes entries as they fall out of the window
         }
 
         bool IsAvailable( uint16_t sequence ) const
         {
-            return !m_exists.GetBit( sequence % m_size );
+            return !Exists( sequence & ( N - 1 ) );
         }
 
         int GetIndex( uint16_t sequence ) const
         {
-            return sequence % m_size;
+            return sequence & ( N - 1 );
         }
 
         const T * Find( uint16_t sequence ) const
         {
-            const int index = sequence % m_size;
-            if ( m_exists.GetBit( index ) && m_entry_sequence[index] == sequence )
-                return &m_entry_data[index];
-            else
-                return NULL;
+            const int index = sequence & ( N - 1 );
+            return Matches( index, sequence ) ? &m_entry_data[index] : NULL;
         }
 
         T * Find( uint16_t sequence )
         {
-            const int index = sequence % m_size;
-            if ( m_exists.GetBit( index ) && m_entry_sequence[index] == sequence )
-                return &m_entry_data[index];
-            else
-                return NULL;
+            const int index = sequence & ( N - 1 );
+            return Matches( index, sequence ) ? &m_entry_data[index] : NULL;
         }
 
         T * GetAtIndex( int index )
         {
             assert( index >= 0 );
-            assert( index < m_size );
-            return m_exists.GetBit( index ) ? &m_entry_data[index] : NULL;
+            assert( index < N );
+            return Exists( index ) ? &m_entry_data[index] : NULL;
+        }
+
+        uint32_t GetAckBits( uint16_t ack ) const
+        {
+            // bit n is set if sequence ack - n is in the buffer
+
+            if ( N < 64 )
+            {
+                uint32_t ack_bits = 0;
+                for ( int i = 0; i < 32; ++i )
+                {
+                    if ( Find( ack - i ) )
+                        ack_bits |= uint32_t(1) << i;
+                }
+                return ack_bits;
+            }
+
+            const uint16_t first_sequence = ack - 31;
+            const int first_index = first_sequence & ( N - 1 );
+            const int head = ( N - first_index < 32 ) ? N - first_index : 32;
+
+#if PROTOCOL2_SEQUENCE_BUFFER_TAGS
+
+            uint32_t tags[32];
+            memcpy( tags, &m_entry_tag[first_index], head * sizeof( uint32_t ) );
+            if ( head < 32 )
+                memcpy( tags + head, m_entry_tag, ( 32 - head ) * sizeof( uint32_t ) );
+
+            return reverse_bits( tag_match_mask( tags, first_sequence ) );
+
+#else // #if PROTOCOL2_SEQUENCE_BUFFER_TAGS
+
+            const int word_index = first_index >> 6;
+            const int bit_index = first_index & 63;
+
+            uint64_t window = m_exists[word_index] >> bit_index;
+            if ( bit_index > 32 )
+                window |= m_exists[( word_index + 1 ) & ( NumWords - 1 )] << ( 64 - bit_index );
+
+            const uint32_t exists = uint32_t( window );
+            if ( !exists )
+                return 0;
+
+            uint16_t sequences[32];
+            memcpy( sequences, &m_entry_sequence[first_index], head * sizeof( uint16_t ) );
+            if ( head < 32 )
+                memcpy( sequences + head, m_entry_sequence, ( 32 - head ) * sizeof( uint16_t ) );
+
+            return reverse_bits( exists & sequence_match_mask( sequences, first_sequence ) );
+
+#endif // #if PROTOCOL2_SEQUENCE_BUFFER_TAGS
         }
 
         uint16_t GetSequence() const 
@@ -1497,100 +3132,461 @@ namespace protocol2
 
         int GetSize() const
         {
-            return m_size;
+            return N;
         }
 
     private:
 
-        T * m_entry_data;
-        uint16_t * m_entry_sequence;
-        int m_size;
+        enum { NumWords = ( N + 63 ) / 64 };
+
+        void RemoveEntries( uint16_t start_sequence, uint16_t finish_sequence )
+        {
+            // the slots for sequences [start,finish] hold entries that are now older than the window. clear them before the sequence advances
+
+            const int count = uint16_t( finish_sequence - start_sequence ) + 1;
+            if ( count >= N )
+            {
+                ClearExists( 0, N );
+                return;
+            }
+
+            const int start_index = start_sequence & ( N - 1 );
+            const int finish_index = finish_sequence & ( N - 1 );
+            if ( start_index <= finish_index )
+            {
+                ClearExists( start_index, finish_index + 1 );
+            }
+            else
+            {
+                ClearExists( start_index, N );
+                ClearExists( 0, finish_index + 1 );
+            }
+        }
+
+#if PROTOCOL2_SEQUENCE_BUFFER_TAGS
+
+        bool Exists( int index ) const
+        {
+            return ( m_entry_tag[index] & 0x10000 ) != 0;
+        }
+
+        void ClearExists( int index )
+        {
+            m_entry_tag[index] &= 0xFFFF;
+        }
+
+        void ClearExists( int begin, int end )
+        {
+            for ( int i = begin; i < end; ++i )
+                m_entry_tag[i] &= 0xFFFF;
+        }
+
+        bool Matches( int index, uint16_t sequence ) const
+        {
+            return m_entry_tag[index] == ( 0x10000 | uint32_t( sequence ) );
+        }
+
+        uint32_t m_entry_tag[N];                            // bit 16 is set if the entry exists. the low 16 bits are its sequence
+
+#else // #if PROTOCOL2_SEQUENCE_BUFFER_TAGS
+
+        bool Exists( int index ) const
+        {
+            return ( m_exists[index>>6] >> ( index & 63 ) ) & 1;
+        }
+
+        void ClearExists( int index )
+        {
+            m_exists[index>>6] &= ~( uint64_t(1) << ( index & 63 ) );
+        }
+
+        void ClearExists( int begin, int end )
+        {
+            const int first_word = begin >> 6;
+            const int last_word = ( end - 1 ) >> 6;
+            const uint64_t first_mask = ~uint64_t(0) << ( begin & 63 );
+            const uint64_t last_mask = ~uint64_t(0) >> ( 63 - ( ( end - 1 ) & 63 ) );
+            if ( first_word == last_word )
+            {
+                m_exists[first_word] &= ~( first_mask & last_mask );
+                return;
+            }
+            m_exists[first_word] &= ~first_mask;
+            for ( int i = first_word + 1; i < last_word; ++i )
+                m_exists[i] = 0;
+            m_exists[last_word] &= ~last_mask;
+        }
+
+        bool Matches( int index, uint16_t sequence ) const
+        {
+            return Exists( index ) && m_entry_sequence[index] == sequence;
+        }
+
+        uint64_t m_exists[NumWords];
+        uint16_t m_entry_sequence[N];
+
+#endif // #if PROTOCOL2_SEQUENCE_BUFFER_TAGS
+
         uint16_t m_sequence;
         bool m_first_entry;
-        BitArray m_exists;
+        T m_entry_data[N];
 
-        SequenceBuffer( const SequenceBuffer<T> & other );
-        SequenceBuffer<T> & operator = ( const SequenceBuffer<T> & other );
+        SequenceBuffer( const SequenceBuffer<T,N> & other );
+        SequenceBuffer<T,N> & operator = ( const SequenceBuffer<T,N> & other );
     };
 
-    template <typename T> void GenerateAckBits( const SequenceBuffer<T> & packets, uint16_t & ack, uint32_t & ack_bits )
+    template <typename T, int N> void GenerateAckBits( const SequenceBuffer<T,N> & packets, uint16_t & ack, uint32_t & ack_bits )
     {
         ack = packets.GetSequence() - 1;
-        ack_bits = 0;
-        for ( int i = 0; i < 32; ++i )
+        ack_bits = packets.GetAckBits( ack );
+    }
+
+    template <typename T, int N> void GenerateAckBits( const SequenceBuffer<T,N> & packets, uint16_t & ack, BitArray & ack_bits )
+    {
+        // extended ack window: bit n is set if sequence ack - n was received, for as many bits as the array holds (a multiple of 32)
+
+        const int size = ack_bits.GetSize();
+        assert( ( size % 32 ) == 0 );
+        assert( size <= packets.GetSize() );
+        ack = packets.GetSequence() - 1;
+        for ( int i = 0; i < size; i += 64 )
         {
-            uint16_t sequence = ack - i;
-            if ( packets.Find( sequence ) )
-                ack_bits |= ( 1 << i );
+            uint64_t word = packets.GetAckBits( ack - i );
+            if ( i + 32 < size )
+                word |= uint64_t( packets.GetAckBits( ack - i - 32 ) ) << 32;
+            ack_bits.SetWord( i >> 6, word );
         }
     }
 
-    inline void CompressPacketSequence( uint64_t sequence, uint8_t & prefix_byte, int & num_sequence_bytes, uint8_t * sequence_bytes )
+    template <typename Stream> bool serialize_ack_bits_internal( Stream & stream, BitArray & ack_bits )
     {
-        // algorithm: encode a mask of 7 bits. each bit is set if byte n in the sequence is non-zero
+        // when most packets get through, the missing ones are sent as a list of runs (offset from the end of the previous run, length) 
+        // which is much smaller than the raw bits. with heavy loss the raw bits are cheaper, so the writer picks whichever is smaller
 
-        assert( sequence_bytes );
+        const int size = ack_bits.GetSize();
+        assert( size >= 32 );
+        assert( ( size % 32 ) == 0 );
 
-        prefix_byte = 0;
-        
-        num_sequence_bytes = 0;
+        const int index_bits = bits_required( 0, size - 1 );
+        const int max_runs = ( size - index_bits ) / ( 2 * index_bits );
+
+        int num_runs = 0;
+        if ( Stream::IsWriting )
+        {
+            for ( int i = ack_bits.FindFirstClear( 0 ); i >= 0 && num_runs <= max_runs; )
+            {
+                num_runs++;
+                const int end = ack_bits.FindNextSet( i );
+                i = ( end >= 0 ) ? ack_bits.FindFirstClear( end ) : -1;
+            }
+        }
+
+        bool runs = num_runs <= max_runs;
+
+        serialize_bool( stream, runs );
+
+        if ( !runs )
+        {
+            for ( int i = 0; i < size / 32; ++i )
+            {
+                uint32_t bits = 0;
+                if ( Stream::IsWriting )
+                    bits = uint32_t( ack_bits.GetWord( i >> 1 ) >> ( ( i & 1 ) * 32 ) );
+                serialize_bits( stream, bits, 32 );
+                if ( Stream::IsReading )
+                {
+                    const uint64_t word = ( i & 1 ) ? ( ack_bits.GetWord( i >> 1 ) | ( uint64_t( bits ) << 32 ) ) : bits;
+                    ack_bits.SetWord( i >> 1, word );
+                }
+            }
+            return true;
+        }
+
+        serialize_int( stream, num_runs, 0, max_runs );
+
+        if ( Stream::IsReading )
+            ack_bits.SetRange( 0, size );
+
+        int previous = 0;
+        int start = Stream::IsWriting ? ack_bits.FindFirstClear( 0 ) : 0;
+        for ( int i = 0; i < num_runs; ++i )
+        {
+            uint32_t offset = 0;
+            uint32_t length = 0;
+            if ( Stream::IsWriting )
+            {
+                const int end = ack_bits.FindNextSet( start );
+                offset = uint32_t( start - previous );
+                length = uint32_t( ( ( end >= 0 ) ? end : size ) - start - 1 );
+            }
+            serialize_bits( stream, offset, index_bits );
+            serialize_bits( stream, length, index_bits );
+            if ( Stream::IsReading )
+            {
+                start = previous + int( offset );
+                if ( start + int( length ) + 1 > size )
+                    return false;
+                ack_bits.ClearRange( start, start + int( length ) + 1 );
+            }
+            previous = start + int( length ) + 1;
+            if ( Stream::IsWriting && i + 1 < num_runs )
+                start = ack_bits.FindFirstClear( previous );
+        }
+
+        return true;
+    }
+
+    #define serialize_ack_bits( stream, ack_bits )                                          \
+        do                                                                                  \
+        {                                                                                   \
+            if ( !protocol2::serialize_ack_bits_internal( stream, ack_bits ) )              \
+                return false;                                                               \
+        } while (0)
+
+    #define PROTOCOL2_SEQUENCE_IN_WINDOW                0
+    #define PROTOCOL2_SEQUENCE_DUPLICATE                1
+    #define PROTOCOL2_SEQUENCE_TOO_OLD                  2
+    #define PROTOCOL2_SEQUENCE_TOO_NEW                  3
+
+    inline void ClassifySequences( const uint16_t * sequences, int num_sequences, uint16_t window_start, int window_size, uint8_t * classes )
+    {
+        /*
+            Classify a batch of received sequences against the window [window_start, window_start + window_size - 1].
+
+            Same rules as sequence_less_than( sequence, window_start ) for too old and sequence_greater_than( sequence, window_end ) for too new,
+            computed from the offset of each sequence from the window start: in window if offset < window_size, too old if offset > 32768.
+            An offset of exactly 32768 is too old only if window_start >= 32768, matching the tie break in sequence_greater_than.
+        */
+
+        assert( sequences );
+        assert( classes );
+        assert( num_sequences >= 0 );
+        assert( window_size >= 1 );
+        assert( window_size <= 32768 );
 
-        uint64_t byte_mask = 0xFF00000000000000ULL;
+        const uint16_t last_offset = uint16_t( window_size - 1 );
+
+        const bool half_is_old = window_start >= 32768;
+
+        int i = 0;
+
+#if PROTOCOL2_AVX2
 
-        for ( int i = 7; i > 0; --i )
         {
-            const uint8_t current_sequence_byte = uint8_t( ( sequence & byte_mask ) >> (i*8) );
+            const __m256i start = _mm256_set1_epi16( (short) window_start );
+            const __m256i last = _mm256_set1_epi16( (short) last_offset );
+            const __m256i too_new = _mm256_set1_epi16( PROTOCOL2_SEQUENCE_TOO_NEW );
+            const __m256i too_old = _mm256_set1_epi16( PROTOCOL2_SEQUENCE_TOO_OLD );
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i half = _mm256_set1_epi16( (short) 0x8000 );
+            const __m256i half_is_new = _mm256_set1_epi16( half_is_old ? 0 : -1 );
+            for ( ; i + 16 <= num_sequences; i += 16 )
+            {
+                const __m256i offset = _mm256_sub_epi16( _mm256_loadu_si256( (const __m256i*) ( sequences + i ) ), start );
+                const __m256i in_window = _mm256_cmpeq_epi16( _mm256_subs_epu16( offset, last ), zero );
+                const __m256i tie = _mm256_and_si256( _mm256_cmpeq_epi16( offset, half ), half_is_new );
+                const __m256i old = _mm256_andnot_si256( tie, _mm256_srai_epi16( offset, 15 ) );
+                __m256i result = _mm256_blendv_epi8( too_new, too_old, old );
+                result = _mm256_andnot_si256( in_window, result );
+                const __m128i bytes = _mm_packus_epi16( _mm256_castsi256_si128( result ), _mm256_extracti128_si256( result, 1 ) );
+                _mm_storeu_si128( (__m128i*) ( classes + i ), bytes );
+            }
+        }
+
+#endif // #if PROTOCOL2_AVX2
+
+#if PROTOCOL2_SSE2
 
-            if ( current_sequence_byte != 0 )
+        {
+            const __m128i start = _mm_set1_epi16( (short) window_start );
+            const __m128i last = _mm_set1_epi16( (short) last_offset );
+            const __m128i too_new = _mm_set1_epi16( PROTOCOL2_SEQUENCE_TOO_NEW );
+            const __m128i too_old = _mm_set1_epi16( PROTOCOL2_SEQUENCE_TOO_OLD );
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i half = _mm_set1_epi16( (short) 0x8000 );
+            const __m128i half_is_new = _mm_set1_epi16( half_is_old ? 0 : -1 );
+            for ( ; i + 8 <= num_sequences; i += 8 )
             {
-                sequence_bytes[num_sequence_bytes++] = current_sequence_byte;
-                prefix_byte |= ( 1 << (i-1) );
+                const __m128i offset = _mm_sub_epi16( _mm_loadu_si128( (const __m128i*) ( sequences + i ) ), start );
+                const __m128i in_window = _mm_cmpeq_epi16( _mm_subs_epu16( offset, last ), zero );
+                const __m128i tie = _mm_and_si128( _mm_cmpeq_epi16( offset, half ), half_is_new );
+                const __m128i old = _mm_andnot_si128( tie, _mm_srai_epi16( offset, 15 ) );
+                __m128i result = _mm_or_si128( _mm_and_si128( old, too_old ), _mm_andnot_si128( old, too_new ) );
+                result = _mm_andnot_si128( in_window, result );
+                _mm_storel_epi64( (__m128i*) ( classes + i ), _mm_packus_epi16( result, result ) );
             }
+        }
+
+#endif // #if PROTOCOL2_SSE2
+
+        for ( ; i < num_sequences; ++i )
+        {
+            const uint16_t offset = sequences[i] - window_start;
+            if ( offset <= last_offset )
+                classes[i] = PROTOCOL2_SEQUENCE_IN_WINDOW;
+            else if ( offset > 32768 || ( offset == 32768 && half_is_old ) )
+                classes[i] = PROTOCOL2_SEQUENCE_TOO_OLD;
+            else
+                classes[i] = PROTOCOL2_SEQUENCE_TOO_NEW;
+        }
+    }
+
+    template <typename T, int N> void ClassifySequences( const SequenceBuffer<T,N> & buffer, const uint16_t * sequences, int num_sequences, uint16_t window_start, int window_size, uint8_t * classes )
+    {
+        // as above, and sequences in the window that are already in the buffer are duplicates
+
+        ClassifySequences( sequences, num_sequences, window_start, window_size, classes );
+
+        for ( int i = 0; i < num_sequences; ++i )
+        {
+            if ( classes[i] == PROTOCOL2_SEQUENCE_IN_WINDOW && buffer.Find( sequences[i] ) )
+                classes[i] = PROTOCOL2_SEQUENCE_DUPLICATE;
+        }
+    }
+
+    inline const uint8_t * get_packet_sequence_shifts( uint8_t prefix_byte )
+    {
+        // for each prefix, the shifts of the non-zero sequence bytes in the order they are sent (most significant first)
+
+        static const uint8_t shifts[128][7] =
+        {
+            {  0,  0,  0,  0,  0,  0,  0 }, {  8,  0,  0,  0,  0,  0,  0 }, { 16,  0,  0,  0,  0,  0,  0 }, { 16,  8,  0,  0,  0,  0,  0 },
+            { 24,  0,  0,  0,  0,  0,  0 }, { 24,  8,  0,  0,  0,  0,  0 }, { 24, 16,  0,  0,  0,  0,  0 }, { 24, 16,  8,  0,  0,  0,  0 },
+            { 32,  0,  0,  0,  0,  0,  0 }, { 32,  8,  0,  0,  0,  0,  0 }, { 32, 16,  0,  0,  0,  0,  0 }, { 32, 16,  8,  0,  0,  0,  0 },
+            { 32, 24,  0,  0,  0,  0,  0 }, { 32, 24,  8,  0,  0,  0,  0 }, { 32, 24, 16,  0,  0,  0,  0 }, { 32, 24, 16,  8,  0,  0,  0 },
+            { 40,  0,  0,  0,  0,  0,  0 }, { 40,  8,  0,  0,  0,  0,  0 }, { 40, 16,  0,  0,  0,  0,  0 }, { 40, 16,  8,  0,  0,  0,  0 },
+            { 40, 24,  0,  0,  0,  0,  0 }, { 40, 24,  8,  0,  0,  0,  0 }, { 40, 24, 16,  0,  0,  0,  0 }, { 40, 24, 16,  8,  0,  0,  0 },
+            { 40, 32,  0,  0,  0,  0,  0 }, { 40, 32,  8,  0,  0,  0,  0 }, { 40, 32, 16,  0,  0,  0,  0 }, { 40, 32, 16,  8,  0,  0,  0 },
+            { 40, 32, 24,  0,  0,  0,  0 }, { 40, 32, 24,  8,  0,  0,  0 }, { 40, 32, 24, 16,  0,  0,  0 }, { 40, 32, 24, 16,  8,  0,  0 },
+            { 48,  0,  0,  0,  0,  0,  0 }, { 48,  8,  0,  0,  0,  0,  0 }, { 48, 16,  0,  0,  0,  0,  0 }, { 48, 16,  8,  0,  0,  0,  0 },
+            { 48, 24,  0,  0,  0,  0,  0 }, { 48, 24,  8,  0,  0,  0,  0 }, { 48, 24, 16,  0,  0,  0,  0 }, { 48, 24, 16,  8,  0,  0,  0 },
+            { 48, 32,  0,  0,  0,  0,  0 }, { 48, 32,  8,  0,  0,  0,  0 }, { 48, 32, 16,  0,  0,  0,  0 }, { 48, 32, 16,  8,  0,  0,  0 },
+            { 48, 32, 24,  0,  0,  0,  0 }, { 48, 32, 24,  8,  0,  0,  0 }, { 48, 32, 24, 16,  0,  0,  0 }, { 48, 32, 24, 16,  8,  0,  0 },
+            { 48, 40,  0,  0,  0,  0,  0 }, { 48, 40,  8,  0,  0,  0,  0 }, { 48, 40, 16,  0,  0,  0,  0 }, { 48, 40, 16,  8,  0,  0,  0 },
+            { 48, 40, 24,  0,  0,  0,  0 }, { 48, 40, 24,  8,  0,  0,  0 }, { 48, 40, 24, 16,  0,  0,  0 }, { 48, 40, 24, 16,  8,  0,  0 },
+            { 48, 40, 32,  0,  0,  0,  0 }, { 48, 40, 32,  8,  0,  0,  0 }, { 48, 40, 32, 16,  0,  0,  0 }, { 48, 40, 32, 16,  8,  0,  0 },
+            { 48, 40, 32, 24,  0,  0,  0 }, { 48, 40, 32, 24,  8,  0,  0 }, { 48, 40, 32, 24, 16,  0,  0 }, { 48, 40, 32, 24, 16,  8,  0 },
+            { 56,  0,  0,  0,  0,  0,  0 }, { 56,  8,  0,  0,  0,  0,  0 }, { 56, 16,  0,  0,  0,  0,  0 }, { 56, 16,  8,  0,  0,  0,  0 },
+            { 56, 24,  0,  0,  0,  0,  0 }, { 56, 24,  8,  0,  0,  0,  0 }, { 56, 24, 16,  0,  0,  0,  0 }, { 56, 24, 16,  8,  0,  0,  0 },
+            { 56, 32,  0,  0,  0,  0,  0 }, { 56, 32,  8,  0,  0,  0,  0 }, { 56, 32, 16,  0,  0,  0,  0 }, { 56, 32, 16,  8,  0,  0,  0 },
+            { 56, 32, 24,  0,  0,  0,  0 }, { 56, 32, 24,  8,  0,  0,  0 }, { 56, 32, 24, 16,  0,  0,  0 }, { 56, 32, 24, 16,  8,  0,  0 },
+            { 56, 40,  0,  0,  0,  0,  0 }, { 56, 40,  8,  0,  0,  0,  0 }, { 56, 40, 16,  0,  0,  0,  0 }, { 56, 40, 16,  8,  0,  0,  0 },
+            { 56, 40, 24,  0,  0,  0,  0 }, { 56, 40, 24,  8,  0,  0,  0 }, { 56, 40, 24, 16,  0,  0,  0 }, { 56, 40, 24, 16,  8,  0,  0 },
+            { 56, 40, 32,  0,  0,  0,  0 }, { 56, 40, 32,  8,  0,  0,  0 }, { 56, 40, 32, 16,  0,  0,  0 }, { 56, 40, 32, 16,  8,  0,  0 },
+            { 56, 40, 32, 24,  0,  0,  0 }, { 56, 40, 32, 24,  8,  0,  0 }, { 56, 40, 32, 24, 16,  0,  0 }, { 56, 40, 32, 24, 16,  8,  0 },
+            { 56, 48,  0,  0,  0,  0,  0 }, { 56, 48,  8,  0,  0,  0,  0 }, { 56, 48, 16,  0,  0,  0,  0 }, { 56, 48, 16,  8,  0,  0,  0 },
+            { 56, 48, 24,  0,  0,  0,  0 }, { 56, 48, 24,  8,  0,  0,  0 }, { 56, 48, 24, 16,  0,  0,  0 }, { 56, 48, 24, 16,  8,  0,  0 },
+            { 56, 48, 32,  0,  0,  0,  0 }, { 56, 48, 32,  8,  0,  0,  0 }, { 56, 48, 32, 16,  0,  0,  0 }, { 56, 48, 32, 16,  8,  0,  0 },
+            { 56, 48, 32, 24,  0,  0,  0 }, { 56, 48, 32, 24,  8,  0,  0 }, { 56, 48, 32, 24, 16,  0,  0 }, { 56, 48, 32, 24, 16,  8,  0 },
+            { 56, 48, 40,  0,  0,  0,  0 }, { 56, 48, 40,  8,  0,  0,  0 }, { 56, 48, 40, 16,  0,  0,  0 }, { 56, 48, 40, 16,  8,  0,  0 },
+            { 56, 48, 40, 24,  0,  0,  0 }, { 56, 48, 40, 24,  8,  0,  0 }, { 56, 48, 40, 24, 16,  0,  0 }, { 56, 48, 40, 24, 16,  8,  0 },
+            { 56, 48, 40, 32,  0,  0,  0 }, { 56, 48, 40, 32,  8,  0,  0 }, { 56, 48, 40, 32, 16,  0,  0 }, { 56, 48, 40, 32, 16,  8,  0 },
+            { 56, 48, 40, 32, 24,  0,  0 }, { 56, 48, 40, 32, 24,  8,  0 }, { 56, 48, 40, 32, 24, 16,  0 }, { 56, 48, 40, 32, 24, 16,  8 }
+        };
+
+        assert( prefix_byte < 128 );
+
+        return shifts[prefix_byte];
+    }
+
+    inline void CompressPacketSequence( uint64_t sequence, uint8_t & prefix_byte, int & num_sequence_bytes, uint8_t * sequence_bytes )
+    {
+        // algorithm: encode a mask of 7 bits. each bit is set if byte n in the sequence is non-zero.
+        // the non-zero bytes follow, most significant first, then the low byte which is always sent.
+
+        // IMPORTANT: sequence_bytes must have room for 8 bytes. all 8 may be written, even when fewer are used
+
+        assert( sequence_bytes );
+
+        // the high bit of each byte of nonzero is set if that byte of the sequence is non-zero (byte 0 excluded: it is always sent)
+
+        const uint64_t nonzero = ( ( ( sequence & 0x7F7F7F7F7F7F7F7FULL ) + 0x7F7F7F7F7F7F7F7FULL ) | sequence ) & 0x8080808080808000ULL;
+
+#if PROTOCOL2_BMI2
+
+        prefix_byte = uint8_t( _pext_u64( nonzero, 0x8080808080808000ULL ) );
+
+        const int num_high_bytes = popcount( prefix_byte );
+
+        const uint64_t bytes = ( _pext_u64( sequence, ( nonzero >> 7 ) * 0xFF ) << 8 ) | ( sequence & 0xFF );
+
+        const uint64_t big_endian_bytes = bswap( bytes << ( 8 * ( 7 - num_high_bytes ) ) );
+
+        memcpy( sequence_bytes, &big_endian_bytes, 8 );
+
+#else // #if PROTOCOL2_BMI2
+
+        // gather the flag bits into the prefix with a multiply: each flag lands in its own bit of the top byte
+
+        prefix_byte = uint8_t( ( ( nonzero >> 15 ) * 0x0102040810204000ULL ) >> 56 ) & 0x7F;
+
+        const int num_high_bytes = popcount( prefix_byte );
+
+        const uint8_t * shifts = get_packet_sequence_shifts( prefix_byte );
+
+        for ( int i = 0; i < num_high_bytes; ++i )
+            sequence_bytes[i] = uint8_t( sequence >> shifts[i] );
+
+        sequence_bytes[num_high_bytes] = uint8_t( sequence );
+
+#endif // #if PROTOCOL2_BMI2
+
+        num_sequence_bytes = num_high_bytes + 1;
+
+        assert( num_sequence_bytes <= 8 );
+        assert( ( prefix_byte & (1<<7) ) == 0 );
+    }
+
+    inline int GetPacketSequenceBytes( uint8_t prefix_byte )
+    {
+        return popcount( uint32_t( prefix_byte & 0x7F ) ) + 1;
+    }
+
+    inline uint64_t DecompressPacketSequence( uint8_t prefix_byte, const uint8_t * sequence_bytes )
+    {
+        // only the sequence bytes are read, so this is safe at the end of a packet
 
-            byte_mask >>= 8;
-        }
+        assert( sequence_bytes );
 
-        assert( num_sequence_bytes <= 7 );
-        assert( ( prefix_byte & (1<<7) ) == 0 );
+        prefix_byte &= 0x7F;
 
-        sequence_bytes[num_sequence_bytes++] = (uint8_t) ( sequence & 0xFF );
-    }
+        const int num_high_bytes = popcount( prefix_byte );
 
-    inline int GetPacketSequenceBytes( uint8_t prefix_byte )
-    {
-        int num_sequence_bytes = 0;
+        const uint8_t * shifts = get_packet_sequence_shifts( prefix_byte );
 
-        for ( int i = 7; i > 0; --i )
-        {
-            if ( prefix_byte & ( 1 << (i-1) ) )
-                num_sequence_bytes++;
-        }
+        uint64_t sequence = 0;
 
-        num_sequence_bytes++;
+        for ( int i = 0; i < num_high_bytes; ++i )
+            sequence |= uint64_t( sequence_bytes[i] ) << shifts[i];
 
-        return num_sequence_bytes;
+        return sequence | sequence_bytes[num_high_bytes];
     }
 
-    inline uint64_t DecompressPacketSequence( uint8_t prefix_byte, const uint8_t * sequence_bytes )
+    inline void CompressPacketSequences( int num_packets, const uint64_t * sequences, uint8_t * prefix_bytes, int * num_sequence_bytes, uint8_t * const * sequence_bytes )
     {
-        assert( sequence_bytes );
+        // compress the sequences for a batch of packets. sequence_bytes[i] points to 8 bytes of room for packet i
 
-        uint64_t sequence = 0;
+        assert( num_packets >= 0 );
+        assert( sequences );
+        assert( prefix_bytes );
+        assert( num_sequence_bytes );
+        assert( sequence_bytes );
 
-        int index = 0;
+        for ( int i = 0; i < num_packets; ++i )
+            CompressPacketSequence( sequences[i], prefix_bytes[i], num_sequence_bytes[i], sequence_bytes[i] );
+    }
 
-        for ( int i = 7; i > 0; --i )
-        {
-            if ( prefix_byte & ( 1 << (i-1) ) )
-            {
-                sequence |= ( uint64_t( sequence_bytes[index] ) << (i*8) );
-                ++index;
-            }
-        }
+    inline void DecompressPacketSequences( int num_packets, const uint8_t * prefix_bytes, const uint8_t * const * sequence_bytes, uint64_t * sequences )
+    {
+        // decompress the sequences for a batch of received packets. sequence_bytes[i] points to the sequence bytes of packet i
 
-        sequence |= uint64_t( sequence_bytes[index] );
+        assert( num_packets >= 0 );
+        assert( prefix_bytes );
+        assert( sequence_bytes );
+        assert( sequences );
 
-        return sequence;
+        for ( int i = 0; i < num_packets; ++i )
+            sequences[i] = DecompressPacketSequence( prefix_bytes[i], sequence_bytes[i] );
     }
 }
 
@@ -1598,11 +3594,14 @@ namespace protocol2
 
 #ifdef PROTOCOL2_IMPLEMENTATION
 
+#if PROTOCOL2_CRC32_PCLMUL
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
 #ifdef _MSC_VER
-#include <malloc.h>
-#else
-#include <alloca.h>
-#endif
+#include <intrin.h>
+#endif // #ifdef _MSC_VER
+#endif // #if PROTOCOL2_CRC32_PCLMUL
 
 namespace protocol2
 {
@@ -1642,7 +3641,7 @@ namespace protocol2
         0xB3667A2E,0xC4614AB8,0x5D681B02,0x2A6F2B94,0xB40BBE37,0xC30C8EA1,0x5A05DF1B,0x2D02EF8D 
     };
 
-    uint32_t calculate_crc32( const uint8_t *buffer, size_t length, uint32_t crc32 )
+    uint32_t calculate_crc32_bytewise( const uint8_t *buffer, size_t length, uint32_t crc32 )
     {
         crc32 ^= 0xFFFFFFFF;
         for ( size_t i = 0; i < length; ++i ) 
@@ -1650,6 +3649,201 @@ namespace protocol2
         return crc32 ^ 0xFFFFFFFF;
     }
 
+    struct Crc32SlicingTables
+    {
+        uint32_t table[8][256];
+
+        Crc32SlicingTables()
+        {
+            // table[n][i] is the crc of byte i followed by n zero bytes, so 8 bytes can be looked up at once
+
+            for ( int i = 0; i < 256; ++i )
+                table[0][i] = crc32_table[i];
+
+            for ( int n = 1; n < 8; ++n )
+            {
+                for ( int i = 0; i < 256; ++i )
+                    table[n][i] = ( table[n-1][i] >> 8 ) ^ crc32_table[ table[n-1][i] & 0xFF ];
+            }
+        }
+    };
+
+    static const Crc32SlicingTables crc32_slicing_tables;
+
+    static uint32_t crc32_slicing_by_8_update( uint32_t crc32, const uint8_t *buffer, size_t length )
+    {
+        const uint32_t (*table)[256] = crc32_slicing_tables.table;
+
+        while ( length >= 8 )
+        {
+            uint32_t a, b;
+            memcpy( &a, buffer, 4 );
+            memcpy( &b, buffer + 4, 4 );
+            a = network_to_host( a ) ^ crc32;
+            b = network_to_host( b );
+            crc32 = table[7][   a         & 0xFF ] ^ 
+                    table[6][ ( a >> 8  ) & 0xFF ] ^ 
+                    table[5][ ( a >> 16 ) & 0xFF ] ^ 
+                    table[4][   a >> 24          ] ^ 
+                    table[3][   b         & 0xFF ] ^ 
+                    table[2][ ( b >> 8  ) & 0xFF ] ^ 
+                    table[1][ ( b >> 16 ) & 0xFF ] ^ 
+                    table[0][   b >> 24          ];
+            buffer += 8;
+            length -= 8;
+        }
+
+        for ( size_t i = 0; i < length; ++i ) 
+            crc32 = ( crc32 >> 8 ) ^ crc32_table[ ( crc32 ^ buffer[i] ) & 0xFF ];
+
+        return crc32;
+    }
+
+    uint32_t calculate_crc32_slicing_by_8( const uint8_t *buffer, size_t length, uint32_t crc32 )
+    {
+        return crc32_slicing_by_8_update( crc32 ^ 0xFFFFFFFF, buffer, length ) ^ 0xFFFFFFFF;
+    }
+
+#if PROTOCOL2_CRC32_PCLMUL
+
+    bool cpu_supports_crc32_pclmul()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid( info, 1 );
+        return ( info[2] & ( 1 << 1 ) ) && ( info[2] & ( 1 << 19 ) );          // pclmulqdq and sse4.1
+#else // #ifdef _MSC_VER
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "pclmul" ) && __builtin_cpu_supports( "sse4.1" );
+#endif // #ifdef _MSC_VER
+    }
+
+    // Folds 64 bytes at a time with carry-less multiplies, then barrett reduces down to 32 bits.
+    // See "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction", Intel 2009.
+    // The constants are for the reflected crc32 polynomial 0xEDB88320, the same one the tables use.
+    // Length must be at least 64 and a multiple of 16.
+
+#ifndef _MSC_VER
+    __attribute__((target("pclmul,sse4.1")))
+#endif // #ifndef _MSC_VER
+    static uint32_t crc32_pclmul_fold( uint32_t crc32, const uint8_t *buffer, size_t length )
+    {
+        assert( length >= 64 );
+        assert( ( length % 16 ) == 0 );
+
+        const __m128i k1k2 = _mm_set_epi64x( 0x01c6e41596LL, 0x0154442bd4LL );
+        const __m128i k3k4 = _mm_set_epi64x( 0x00ccaa009eLL, 0x01751997d0LL );
+        const __m128i k5k0 = _mm_set_epi64x( 0x0000000000LL, 0x0163cd6124LL );
+        const __m128i poly = _mm_set_epi64x( 0x01f7011641LL, 0x01db710641LL );
+
+        __m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+        x1 = _mm_loadu_si128( (const __m128i*) ( buffer + 0x00 ) );
+        x2 = _mm_loadu_si128( (const __m128i*) ( buffer + 0x10 ) );
+        x3 = _mm_loadu_si128( (const __m128i*) ( buffer + 0x20 ) );
+        x4 = _mm_loadu_si128( (const __m128i*) ( buffer + 0x30 ) );
+
+        x1 = _mm_xor_si128( x1, _mm_cvtsi32_si128( (int) crc32 ) );
+
+        buffer += 64;
+        length -= 64;
+
+        // fold 4 x 128 bits at a time
+
+        while ( length >= 64 )
+        {
+            x5 = _mm_clmulepi64_si128( x1, k1k2, 0x00 );
+            x6 = _mm_clmulepi64_si128( x2, k1k2, 0x00 );
+            x7 = _mm_clmulepi64_si128( x3, k1k2, 0x00 );
+            x8 = _mm_clmulepi64_si128( x4, k1k2, 0x00 );
+
+            x1 = _mm_clmulepi64_si128( x1, k1k2, 0x11 );
+            x2 = _mm_clmulepi64_si128( x2, k1k2, 0x11 );
+            x3 = _mm_clmulepi64_si128( x3, k1k2, 0x11 );
+            x4 = _mm_clmulepi64_si128( x4, k1k2, 0x11 );
+
+            x1 = _mm_xor_si128( _mm_xor_si128( x1, x5 ), _mm_loadu_si128( (const __m128i*) ( buffer + 0x00 ) ) );
+            x2 = _mm_xor_si128( _mm_xor_si128( x2, x6 ), _mm_loadu_si128( (const __m128i*) ( buffer + 0x10 ) ) );
+            x3 = _mm_xor_si128( _mm_xor_si128( x3, x7 ), _mm_loadu_si128( (const __m128i*) ( buffer + 0x20 ) ) );
+            x4 = _mm_xor_si128( _mm_xor_si128( x4, x8 ), _mm_loadu_si128( (const __m128i*) ( buffer + 0x30 ) ) );
+
+            buffer += 64;
+            length -= 64;
+        }
+
+        // fold down to 128 bits
+
+        x5 = _mm_clmulepi64_si128( x1, k3k4, 0x00 );
+        x1 = _mm_clmulepi64_si128( x1, k3k4, 0x11 );
+        x1 = _mm_xor_si128( _mm_xor_si128( x1, x2 ), x5 );
+
+        x5 = _mm_clmulepi64_si128( x1, k3k4, 0x00 );
+        x1 = _mm_clmulepi64_si128( x1, k3k4, 0x11 );
+        x1 = _mm_xor_si128( _mm_xor_si128( x1, x3 ), x5 );
+
+        x5 = _mm_clmulepi64_si128( x1, k3k4, 0x00 );
+        x1 = _mm_clmulepi64_si128( x1, k3k4, 0x11 );
+        x1 = _mm_xor_si128( _mm_xor_si128( x1, x4 ), x5 );
+
+        // fold in the remaining 128 bit blocks one at a time
+
+        while ( length >= 16 )
+        {
+            x5 = _mm_clmulepi64_si128( x1, k3k4, 0x00 );
+            x1 = _mm_clmulepi64_si128( x1, k3k4, 0x11 );
+            x1 = _mm_xor_si128( _mm_xor_si128( x1, _mm_loadu_si128( (const __m128i*) buffer ) ), x5 );
+            buffer += 16;
+            length -= 16;
+        }
+
+        // fold 128 bits down to 64 bits
+
+        const __m128i mask32 = _mm_setr_epi32( ~0, 0, ~0, 0 );
+
+        x2 = _mm_clmulepi64_si128( x1, k3k4, 0x10 );
+        x1 = _mm_xor_si128( _mm_srli_si128( x1, 8 ), x2 );
+
+        x2 = _mm_srli_si128( x1, 4 );
+        x1 = _mm_and_si128( x1, mask32 );
+        x1 = _mm_clmulepi64_si128( x1, k5k0, 0x00 );
+        x1 = _mm_xor_si128( x1, x2 );
+
+        // barrett reduce to 32 bits
+
+        x2 = _mm_and_si128( x1, mask32 );
+        x2 = _mm_clmulepi64_si128( x2, poly, 0x10 );
+        x2 = _mm_and_si128( x2, mask32 );
+        x2 = _mm_clmulepi64_si128( x2, poly, 0x00 );
+        x1 = _mm_xor_si128( x1, x2 );
+
+        return (uint32_t) _mm_extract_epi32( x1, 1 );
+    }
+
+    uint32_t calculate_crc32_pclmul( const uint8_t *buffer, size_t length, uint32_t crc32 )
+    {
+        crc32 ^= 0xFFFFFFFF;
+        if ( length >= 64 )
+        {
+            const size_t foldBytes = length & ~size_t(15);
+            crc32 = crc32_pclmul_fold( crc32, buffer, foldBytes );
+            buffer += foldBytes;
+            length -= foldBytes;
+        }
+        return crc32_slicing_by_8_update( crc32, buffer, length ) ^ 0xFFFFFFFF;
+    }
+
+#endif // #if PROTOCOL2_CRC32_PCLMUL
+
+    uint32_t calculate_crc32( const uint8_t *buffer, size_t length, uint32_t crc32 )
+    {
+#if PROTOCOL2_CRC32_PCLMUL
+        static const bool pclmul = cpu_supports_crc32_pclmul();
+        if ( pclmul )
+            return calculate_crc32_pclmul( buffer, length, crc32 );
+#endif // #if PROTOCOL2_CRC32_PCLMUL
+        return calculate_crc32_slicing_by_8( buffer, length, crc32 );
+    }
+
     uint32_t hash_data( const uint8_t * data, uint32_t length, uint32_t hash )
     {
         assert( data );
@@ -1730,6 +3924,28 @@ namespace protocol2
         return h;
     }
 
+    static uint32_t calculate_packet_crc32_seed( uint32_t protocolId )
+    {
+        uint32_t prefix[2];
+        prefix[0] = host_to_network( protocolId );
+        prefix[1] = 0;
+        return calculate_crc32( (const uint8_t*) prefix, sizeof( prefix ) );
+    }
+
+    uint32_t PacketInfo::GetCrc32Seed() const
+    {
+        if ( crc32SeedValid && crc32SeedProtocolId == protocolId )
+            return crc32Seed;
+        return calculate_packet_crc32_seed( protocolId );
+    }
+
+    void PacketInfo::CalculateCrc32Seed()
+    {
+        crc32Seed = calculate_packet_crc32_seed( protocolId );
+        crc32SeedProtocolId = protocolId;
+        crc32SeedValid = true;
+    }
+
     int WritePacket( const PacketInfo & info, 
                      Packet *packet,
                      uint8_t *buffer, 
@@ -1781,25 +3997,24 @@ namespace protocol2
 
         stream.Flush();
 
+        if ( stream.GetError() )
+            return 0;
+
         if ( !info.rawFormat )
         {
-            uint32_t network_protocolId = host_to_network( info.protocolId );
-            crc32 = calculate_crc32( (uint8_t*) &network_protocolId, 4 );
-            crc32 = calculate_crc32( buffer + info.prefixBytes, stream.GetBytesProcessed() - info.prefixBytes, crc32 );
+            crc32 = calculate_crc32( buffer + info.prefixBytes + 4, stream.GetBytesProcessed() - info.prefixBytes - 4, info.GetCrc32Seed() );
             *((uint32_t*)(buffer+info.prefixBytes)) = host_to_network( crc32 );
         }
 
-        if ( stream.GetError() )
-            return 0;
-
         return stream.GetBytesProcessed();
     }
 
-    Packet * ReadPacket( const PacketInfo & info, 
-                         const uint8_t * buffer, 
-                         int bufferSize, 
-                         Object * header, 
-                         int * errorCode )
+    static Packet * read_packet_internal( const PacketInfo & info, 
+                                          PacketArena * arena,
+                                          const uint8_t * buffer, 
+                                          int bufferSize, 
+                                          Object * header, 
+                                          int * errorCode )
     {
         assert( buffer );
         assert( bufferSize > 0 );
@@ -1824,11 +4039,7 @@ namespace protocol2
         {
             stream.SerializeBits( read_crc32, 32 );
 
-            uint32_t network_protocolId = host_to_network( info.protocolId );
-            uint32_t crc32 = calculate_crc32( (const uint8_t*) &network_protocolId, 4 );
-            uint32_t zero = 0;
-            crc32 = calculate_crc32( (const uint8_t*) &zero, 4, crc32 );
-            crc32 = calculate_crc32( buffer + info.prefixBytes + 4, bufferSize - 4 - info.prefixBytes, crc32 );
+            uint32_t crc32 = calculate_crc32( buffer + info.prefixBytes + 4, bufferSize - 4 - info.prefixBytes, info.GetCrc32Seed() );
 
             if ( crc32 != read_crc32 )
             {
@@ -1876,7 +4087,7 @@ namespace protocol2
             }
         }
 
-        protocol2::Packet *packet = info.packetFactory->CreatePacket( packetType );
+        protocol2::Packet *packet = arena ? info.packetFactory->CreatePacket( packetType, *arena ) : info.packetFactory->CreatePacket( packetType );
         if ( !packet )
         {
             if ( errorCode )
@@ -1884,7 +4095,19 @@ namespace protocol2
             return NULL;
         }
 
-        if ( !packet->SerializeInternal( stream ) )
+        // check once up front that the packet body fits, then read it with an unchecked stream instead of checking every field for overflow
+
+        if ( info.maxPacketBits && info.maxPacketBits[packetType] <= stream.GetBitsRemaining() )
+        {
+            UncheckedReadStream uncheckedStream( stream );
+            if ( !packet->SerializeInternal( uncheckedStream ) )
+            {
+                if ( errorCode )
+                    *errorCode = PROTOCOL2_ERROR_SERIALIZE_PACKET_FAILED;
+                goto cleanup;
+            }
+        }
+        else if ( !packet->SerializeInternal( stream ) )
         {
             if ( errorCode )
                 *errorCode = PROTOCOL2_ERROR_SERIALIZE_PACKET_FAILED;
@@ -1910,10 +4133,31 @@ namespace protocol2
         return packet;
 
 cleanup:
-        info.packetFactory->DestroyPacket( packet );
+        if ( !arena )
+            info.packetFactory->DestroyPacket( packet );
         return NULL;
     }
 
+    Packet * ReadPacket( const PacketInfo & info, 
+                         const uint8_t * buffer, 
+                         int bufferSize, 
+                         Object * header, 
+                         int * errorCode )
+    {
+        return read_packet_internal( info, NULL, buffer, bufferSize, header, errorCode );
+    }
+
+    Packet * ReadPacket( const PacketInfo & info, 
+                         PacketArena & arena,
+                         const uint8_t * buffer, 
+                         int bufferSize, 
+                         Object * header, 
+                         int * errorCode )
+    {
+        // the packet lives in the arena until it is reset. don't pass it to DestroyPacket
+        return read_packet_internal( info, &arena, buffer, bufferSize, header, errorCode );
+    }
+
 #if PROTOCOL2_PACKET_AGGREGATION
 
     int WriteAggregatePacket( const PacketInfo & info, 
@@ -1941,33 +4185,29 @@ cleanup:
 
         numPacketsWritten = 0;
 
-        int aggregatePacketBytes = 0;
+        // packets are serialized straight into the output buffer. a packet that doesn't fit is rolled back and the aggregate ends there
+
+        WriteStream stream( buffer, bufferSize );
+
+        stream.SetContext( info.context );
 
-        if ( info.prefixBytes > 0 )
+        for ( int i = 0; i < info.prefixBytes; ++i )
         {
-            memset( buffer, 0, info.prefixBytes );
-            aggregatePacketBytes += info.prefixBytes;
+            uint8_t zero = 0;
+            stream.SerializeBits( zero, 8 );
         }
 
         if ( !info.rawFormat )
         {
             // reserve space for crc32
-            memset( buffer + aggregatePacketBytes, 0, 4 );
-            aggregatePacketBytes += 4;
+            uint32_t zero = 0;
+            stream.SerializeBits( zero, 32 );
         }
 
         // write the optional aggregate packet header
 
         if ( aggregatePacketHeader )
         {
-			uint8_t *scratch = (uint8_t*) alloca( bufferSize );
-
-            typedef WriteStream Stream;
-
-            Stream stream( scratch, bufferSize );
-
-            stream.SetContext( info.context );
-
             if ( !aggregatePacketHeader->SerializeInternal( stream ) )
                 return 0;
 
@@ -1975,34 +4215,22 @@ cleanup:
 
             stream.SerializeAlign();
 
-            stream.Flush();
-
             if ( stream.GetError() )
                 return 0;
-
-            int packetSize = stream.GetBytesProcessed();
-
-            memcpy( buffer + aggregatePacketBytes, scratch, packetSize );
-
-            aggregatePacketBytes += packetSize;
         }
 
         // write packet type, packet header (optional) and packet data for each packet passed in
 
+        const int maxPacketBits = ( bufferSize - packetTypeBytes ) * 8;
+
         for ( int i = 0; i < numPackets; ++i )
         {
-			uint8_t *scratch = (uint8_t*) alloca( bufferSize );
-
-            typedef WriteStream Stream;
-
-            Stream stream( scratch, bufferSize );
+            const WriteCheckpoint checkpoint = stream.Checkpoint();
 
             Packet *packet = packets[i];
 
             int packetTypePlusOne = packet->GetType() + 1;
 
-            assert( numPacketTypes > 0 );
-
             assert( stream.GetAlignBits() == 0 );       // must be byte aligned at this point
 
             stream.SerializeInteger( packetTypePlusOne, 0, numPacketTypes );
@@ -2022,28 +4250,29 @@ cleanup:
 
             stream.SerializeAlign();
 
-            stream.Flush();
-
-            if ( stream.GetError() )
-                return 0;
-
-            int packetSize = stream.GetBytesProcessed();
-
-            if ( aggregatePacketBytes + packetSize >= bufferSize + packetTypeBytes )
+            if ( stream.GetBitsProcessed() > maxPacketBits )
+            {
+                stream.Rollback( checkpoint );
                 break;
-
-            memcpy( buffer + aggregatePacketBytes, scratch, packetSize );
-
-            aggregatePacketBytes += packetSize;
+            }
 
             numPacketsWritten++;
         }
 
         // write END marker packet type (0)
 
-        memset( buffer + aggregatePacketBytes, 0, packetTypeBytes );
+        int endPacketType = 0;
 
-        aggregatePacketBytes += packetTypeBytes;
+        stream.SerializeInteger( endPacketType, 0, numPacketTypes );
+
+        stream.SerializeAlign();
+
+        stream.Flush();
+
+        if ( stream.GetError() )
+            return 0;
+
+        const int aggregatePacketBytes = stream.GetBytesProcessed();
 
         assert( aggregatePacketBytes > 0 );
         assert( aggregatePacketBytes <= bufferSize );
@@ -2052,9 +4281,8 @@ cleanup:
         {
             // calculate header crc32 for aggregate packet as a whole
 
-            uint32_t network_protocolId = host_to_network( info.protocolId );
-            uint32_t crc32 = calculate_crc32( (uint8_t*) &network_protocolId, 4 );
-            crc32 = calculate_crc32( buffer, aggregatePacketBytes, crc32 );
+            const int crc32Offset = info.prefixBytes + 4;
+            uint32_t crc32 = calculate_crc32( buffer + crc32Offset, aggregatePacketBytes - crc32Offset, info.GetCrc32Seed() );
 
             *((uint32_t*)(buffer+info.prefixBytes)) = host_to_network( crc32 );
         }
@@ -2099,11 +4327,7 @@ cleanup:
             uint32_t read_crc32 = 0;
             stream.SerializeBits( read_crc32, 32 );
 
-            uint32_t network_protocolId = host_to_network( info.protocolId );
-            uint32_t crc32 = calculate_crc32( (const uint8_t*) &network_protocolId, 4 );
-            uint32_t zero = 0;
-            crc32 = calculate_crc32( (const uint8_t*) &zero, 4, crc32 );
-            crc32 = calculate_crc32( buffer + 4, bufferSize - 4, crc32 );
+            uint32_t crc32 = calculate_crc32( buffer + info.prefixBytes + 4, bufferSize - 4 - info.prefixBytes, info.GetCrc32Seed() );
 
             if ( crc32 != read_crc32 )
             {
@@ -2263,6 +4487,16 @@ cleanup:
         return packet;
     }
 
+    Packet* PacketFactory::CreatePacket( int type, PacketArena & arena )
+    {
+        // arena packets skip the allocation counters and leak tracking. the arena frees them all at once when it is reset
+
+        assert( type >= 0 );
+        assert( type < m_numPacketTypes );
+
+        return CreateInArena( type, arena );
+    }
+
     void PacketFactory::DestroyPacket( Packet* packet )
     {
         if ( !packet )
@@ -2287,6 +4521,145 @@ cleanup:
         return m_numPacketTypes;
     }
 
+    PooledPacketFactory::PooledPacketFactory( int numTypes ) : PacketFactory( numTypes )
+    {
+        m_pools = new Pool[numTypes];
+        memset( m_pools, 0, sizeof( Pool ) * numTypes );
+    }
+
+    PooledPacketFactory::~PooledPacketFactory()
+    {
+        for ( int i = 0; i < GetNumPacketTypes(); ++i )
+        {
+            assert( m_pools[i].numAllocated == 0 );
+            delete [] m_pools[i].memory;
+        }
+
+        delete [] m_pools;
+        m_pools = NULL;
+    }
+
+    void PooledPacketFactory::InitPool( int type, int packetBytes, int capacity )
+    {
+        assert( type >= 0 );
+        assert( type < GetNumPacketTypes() );
+        assert( packetBytes > 0 );
+        assert( capacity > 0 );
+
+        Pool & pool = m_pools[type];
+
+        assert( pool.memory == NULL );
+
+        const int alignment = 16;
+
+        if ( packetBytes < (int) sizeof( void* ) )
+            packetBytes = (int) sizeof( void* );
+
+        pool.packetBytes = ( packetBytes + alignment - 1 ) & ~( alignment - 1 );
+        pool.capacity = capacity;
+        pool.memory = new uint8_t[pool.packetBytes * capacity];
+
+        // thread the free list through the slots in order, so the first packets created are adjacent in memory
+
+        for ( int i = 0; i < capacity; ++i )
+        {
+            void * next = ( i < capacity - 1 ) ? pool.memory + ( i + 1 ) * pool.packetBytes : NULL;
+            memcpy( pool.memory + i * pool.packetBytes, &next, sizeof( void* ) );
+        }
+
+        pool.freeList = pool.memory;
+    }
+
+    void * PooledPacketFactory::AllocateFromPool( int type, PacketArena * arena )
+    {
+        assert( type >= 0 );
+        assert( type < GetNumPacketTypes() );
+
+        Pool & pool = m_pools[type];
+
+        if ( arena )
+            return arena->Allocate( pool.packetBytes );
+
+        void * memory = pool.freeList;
+
+        if ( !memory )
+        {
+            pool.numFailed++;
+            return NULL;
+        }
+
+        memcpy( &pool.freeList, memory, sizeof( void* ) );
+
+        pool.numAllocated++;
+
+        if ( pool.numAllocated > pool.maxAllocated )
+            pool.maxAllocated = pool.numAllocated;
+
+        return memory;
+    }
+
+    void PooledPacketFactory::Destroy( Packet *packet )
+    {
+        assert( packet );
+
+        const int type = packet->GetType();
+
+        assert( type >= 0 );
+        assert( type < GetNumPacketTypes() );
+
+        Pool & pool = m_pools[type];
+
+        assert( (uint8_t*) packet >= pool.memory );
+        assert( (uint8_t*) packet < pool.memory + pool.capacity * pool.packetBytes );
+        assert( pool.numAllocated > 0 );
+
+        packet->~Packet();
+
+        memcpy( (void*) packet, &pool.freeList, sizeof( void* ) );
+
+        pool.freeList = packet;
+
+        pool.numAllocated--;
+    }
+
+    Packet * PooledPacketFactory::Create( int type )
+    {
+        return CreatePooled( type, NULL );
+    }
+
+    Packet * PooledPacketFactory::CreateInArena( int type, PacketArena & arena )
+    {
+        return CreatePooled( type, &arena );
+    }
+
+    int PooledPacketFactory::GetPoolCapacity( int type ) const
+    {
+        assert( type >= 0 );
+        assert( type < GetNumPacketTypes() );
+        return m_pools[type].capacity;
+    }
+
+    int PooledPacketFactory::GetPoolNumAllocated( int type ) const
+    {
+        assert( type >= 0 );
+        assert( type < GetNumPacketTypes() );
+        return m_pools[type].numAllocated;
+    }
+
+    int PooledPacketFactory::GetPoolMaxAllocated( int type ) const
+    {
+        assert( type >= 0 );
+        assert( type < GetNumPacketTypes() );
+        return m_pools[type].maxAllocated;
+    }
+
+    int PooledPacketFactory::GetPoolNumFailed( int type ) const
+    {
+        assert( type >= 0 );
+        assert( type < GetNumPacketTypes() );
+        return m_pools[type].numFailed;
+    }
+
     const char* GetErrorString( int error )
     {
         switch ( error )
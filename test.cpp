@@ -119,6 +119,270 @@ void test_bitpacker()
     check( reader.GetBitsRemaining() == bytesWritten * 8 - bitsWritten );
 }
 
+void test_bitpacker64()
+{
+    printf( "test_bitpacker64\n" );
+
+    const int BufferSize = 256;
+
+    uint8_t buffer[BufferSize];
+
+    protocol2::BitWriter64 writer( buffer, BufferSize );
+
+    check( writer.GetData() == buffer );
+    check( writer.GetTotalBytes() == BufferSize );
+    check( writer.GetBitsWritten() == 0 );
+    check( writer.GetBytesWritten() == 0 );
+    check( writer.GetBitsAvailable() == BufferSize * 8 );
+
+    writer.WriteBits( 0, 1 );
+    writer.WriteBits( 1, 1 );
+    writer.WriteBits( 10, 8 );
+    writer.WriteBits( 255, 8 );
+    writer.WriteBits( 1000, 10 );
+    writer.WriteBits( 50000, 16 );
+    writer.WriteBits( 9999999, 32 );
+    writer.WriteBits64( 0x123456789ABCDEFULL, 57 );
+    writer.WriteBits64( 0xFEDCBA9876543210ULL, 64 );
+    writer.WriteBits64( 5, 3 );
+    writer.FlushBits();
+
+    const int bitsWritten = 1 + 1 + 8 + 8 + 10 + 16 + 32 + 57 + 64 + 3;
+
+    check( writer.GetBytesWritten() == 25 );
+    check( writer.GetBitsWritten() == bitsWritten );
+    check( writer.GetBitsAvailable() == BufferSize * 8 - bitsWritten );
+
+    const int bytesWritten = writer.GetBytesWritten();
+
+    memset( buffer + bytesWritten, 0, BufferSize - bytesWritten );
+
+    protocol2::BitReader64 reader( buffer, bytesWritten );
+
+    check( reader.GetBitsRead() == 0 );
+    check( reader.GetBitsRemaining() == bytesWritten * 8 );
+
+    check( reader.ReadBits( 1 ) == 0 );
+    check( reader.ReadBits( 1 ) == 1 );
+    check( reader.ReadBits( 8 ) == 10 );
+    check( reader.ReadBits( 8 ) == 255 );
+    check( reader.ReadBits( 10 ) == 1000 );
+    check( reader.ReadBits( 16 ) == 50000 );
+    check( reader.ReadBits( 32 ) == 9999999 );
+    check( reader.ReadBits64( 57 ) == 0x123456789ABCDEFULL );
+    check( reader.ReadBits64( 64 ) == 0xFEDCBA9876543210ULL );
+    check( reader.ReadBits64( 3 ) == 5 );
+
+    check( reader.GetBitsRead() == bitsWritten );
+    check( reader.GetBitsRemaining() == bytesWritten * 8 - bitsWritten );
+
+    // the 32 bit and 64 bit bitpackers must produce identical bitstreams
+
+    uint8_t buffer32[BufferSize];
+    uint8_t buffer64[BufferSize];
+
+    memset( buffer32, 0, BufferSize );
+    memset( buffer64, 0, BufferSize );
+
+    protocol2::BitWriter writer32( buffer32, BufferSize );
+    protocol2::BitWriter64 writer64( buffer64, BufferSize );
+
+    uint8_t bytes[19];
+    for ( int i = 0; i < (int) sizeof( bytes ); ++i )
+        bytes[i] = (uint8_t) ( i * 7 + 1 );
+
+    for ( int i = 0; i < 20; ++i )
+    {
+        const int bits = 1 + ( i * 13 ) % 32;
+        const uint32_t value = uint32_t( i * 0x9E3779B9 );
+        writer32.WriteBits( value, bits );
+        writer64.WriteBits( value, bits );
+        if ( i == 10 )
+        {
+            writer32.WriteAlign();
+            writer64.WriteAlign();
+            writer32.WriteBytes( bytes, sizeof( bytes ) );
+            writer64.WriteBytes( bytes, sizeof( bytes ) );
+        }
+    }
+
+    writer32.FlushBits();
+    writer64.FlushBits();
+
+    check( writer32.GetBitsWritten() == writer64.GetBitsWritten() );
+    check( memcmp( buffer32, buffer64, BufferSize ) == 0 );
+
+    protocol2::BitReader reader32( buffer64, writer64.GetBytesWritten() );
+    protocol2::BitReader64 reader64( buffer32, writer32.GetBytesWritten() );
+
+    for ( int i = 0; i < 20; ++i )
+    {
+        const int bits = 1 + ( i * 13 ) % 32;
+        const uint32_t value = uint32_t( i * 0x9E3779B9 ) & uint32_t( ( uint64_t(1) << bits ) - 1 );
+        check( reader32.ReadBits( bits ) == value );
+        check( reader64.ReadBits( bits ) == value );
+        if ( i == 10 )
+        {
+            uint8_t readBytes32[sizeof(bytes)];
+            uint8_t readBytes64[sizeof(bytes)];
+            check( reader32.ReadAlign() );
+            check( reader64.ReadAlign() );
+            reader32.ReadBytes( readBytes32, sizeof( bytes ) );
+            reader64.ReadBytes( readBytes64, sizeof( bytes ) );
+            check( memcmp( readBytes32, bytes, sizeof( bytes ) ) == 0 );
+            check( memcmp( readBytes64, bytes, sizeof( bytes ) ) == 0 );
+        }
+    }
+
+    check( reader32.GetBitsRead() == reader64.GetBitsRead() );
+}
+
+template <typename Writer> static void test_bitpacker_rollback_writer()
+{
+    const int BufferSize = 16;
+    const int GuardSize = 8;
+
+    uint8_t buffer[BufferSize+GuardSize];
+
+    memset( buffer, 0xCD, sizeof( buffer ) );
+
+    Writer writer( buffer, BufferSize );
+
+    for ( int i = 0; i < 5; ++i )
+        writer.WriteBits( 0x1000 + i, 13 );
+
+    const protocol2::WriteCheckpoint checkpoint = writer.Checkpoint();
+    const int checkpointBits = writer.GetBitsWritten();
+
+    // rollback of bits that are still in the scratch
+
+    writer.WriteBits( 0x7, 3 );
+    writer.Rollback( checkpoint );
+    check( writer.GetBitsWritten() == checkpointBits );
+
+    // rollback of bits that were flushed, including writes past the end of the buffer
+
+    for ( int i = 0; i < 10; ++i )
+        writer.WriteBits( 0xFFFFFFFF, 32 );
+
+    check( writer.IsOverflow() );
+
+    for ( int i = 0; i < GuardSize; ++i )
+        check( buffer[BufferSize+i] == 0xCD );
+
+    writer.Rollback( checkpoint );
+
+    check( !writer.IsOverflow() );
+    check( writer.GetBitsWritten() == checkpointBits );
+
+    writer.WriteBits( 12345, 20 );
+    writer.WriteBits( 0xABCDEF, 24 );
+    writer.FlushBits();
+
+    check( !writer.IsOverflow() );
+
+    protocol2::BitReader reader( buffer, writer.GetBytesWritten() );
+
+    for ( int i = 0; i < 5; ++i )
+        check( reader.ReadBits( 13 ) == uint32_t( 0x1000 + i ) );
+
+    check( reader.ReadBits( 20 ) == 12345 );
+    check( reader.ReadBits( 24 ) == 0xABCDEF );
+}
+
+void test_bitpacker_rollback()
+{
+    printf( "test_bitpacker_rollback\n" );
+
+    test_bitpacker_rollback_writer<protocol2::BitWriter>();
+    test_bitpacker_rollback_writer<protocol2::BitWriter64>();
+}
+
+template <typename Reader> static void test_bitpacker_bytes_view_reader( const uint8_t * buffer, int bytes, const uint8_t * data, int dataBytes )
+{
+    Reader reader( buffer, bytes );
+
+    check( reader.ReadBits( 3 ) == 5 );
+    check( reader.ReadAlign() );
+
+    const uint8_t * view = reader.ReadBytesView( dataBytes );
+
+    check( view == buffer + 1 );
+    check( memcmp( view, data, dataBytes ) == 0 );
+
+    check( reader.ReadBits( 17 ) == 100000 );
+    check( reader.ReadBits( 32 ) == 0xDEADBEEF );
+}
+
+void test_bitpacker_bytes_view()
+{
+    printf( "test_bitpacker_bytes_view\n" );
+
+    const int BufferSize = 64;
+
+    uint8_t data[13];
+    for ( int i = 0; i < (int) sizeof( data ); ++i )
+        data[i] = (uint8_t) ( 200 - i );
+
+    uint8_t buffer[BufferSize];
+
+    memset( buffer, 0, BufferSize );
+
+    protocol2::BitWriter writer( buffer, BufferSize );
+
+    writer.WriteBits( 5, 3 );
+    writer.WriteAlign();
+    writer.WriteBytes( data, sizeof( data ) );
+    writer.WriteBits( 100000, 17 );
+    writer.WriteBits( 0xDEADBEEF, 32 );
+    writer.FlushBits();
+
+    test_bitpacker_bytes_view_reader<protocol2::BitReader>( buffer, writer.GetBytesWritten(), data, sizeof( data ) );
+    test_bitpacker_bytes_view_reader<protocol2::BitReader64>( buffer, writer.GetBytesWritten(), data, sizeof( data ) );
+}
+
+void test_crc32()
+{
+    printf( "test_crc32\n" );
+
+    const uint8_t check_string[] = "123456789";
+
+    check( protocol2::calculate_crc32_bytewise( check_string, 9 ) == 0xCBF43926 );
+    check( protocol2::calculate_crc32_slicing_by_8( check_string, 9 ) == 0xCBF43926 );
+    check( protocol2::calculate_crc32( check_string, 9 ) == 0xCBF43926 );
+
+    const int BufferSize = 4200;
+
+    uint8_t buffer[BufferSize];
+    for ( int i = 0; i < BufferSize; ++i )
+        buffer[i] = (uint8_t) rand();
+
+#if PROTOCOL2_CRC32_PCLMUL
+    const bool pclmul = protocol2::cpu_supports_crc32_pclmul();
+#endif // #if PROTOCOL2_CRC32_PCLMUL
+
+    for ( int length = 0; length <= BufferSize; length += ( length < 300 ) ? 1 : 37 )
+    {
+        for ( int offset = 0; offset < 4; ++offset )
+        {
+            if ( offset + length > BufferSize )
+                break;
+
+            const uint32_t seed = (uint32_t) rand();
+
+            const uint32_t expected = protocol2::calculate_crc32_bytewise( buffer + offset, length, seed );
+
+            check( protocol2::calculate_crc32_slicing_by_8( buffer + offset, length, seed ) == expected );
+            check( protocol2::calculate_crc32( buffer + offset, length, seed ) == expected );
+
+#if PROTOCOL2_CRC32_PCLMUL
+            if ( pclmul )
+                check( protocol2::calculate_crc32_pclmul( buffer + offset, length, seed ) == expected );
+#endif // #if PROTOCOL2_CRC32_PCLMUL
+        }
+    }
+}
+
 const int MaxItems = 11;
 
 struct TestData
@@ -128,6 +392,8 @@ struct TestData
     uint32_t e : 8;
     uint32_t f : 8;
     bool g;
+    int h;
+    uint32_t i : 8;
     int numItems;
     int items[MaxItems];
     float float_value;
@@ -161,6 +427,8 @@ struct TestObject : public protocol2::Object
         data.e = 255;
         data.f = 127;
         data.g = true;
+        data.h = -50;
+        data.i = 17;
 
         data.numItems = MaxItems / 2;
         for ( int i = 0; i < data.numItems; ++i )
@@ -193,6 +461,10 @@ struct TestObject : public protocol2::Object
 
         serialize_bool( stream, data.g );
 
+        serialize_int_const( stream, data.h, -100, 100 );
+
+        serialize_bits_const( stream, data.i, 5 );
+
         serialize_check( stream, "test object serialize check" );
 
         serialize_int( stream, data.numItems, 0, MaxItems - 1 );
@@ -259,6 +531,95 @@ void test_stream()
     check( readObject == writeObject );
 }
 
+const int TestBits64NumValues = 8;
+
+static const int test_bits64_widths[TestBits64NumValues] = { 1, 17, 31, 32, 33, 40, 63, 64 };
+
+struct TestBits64Object
+{
+    uint64_t values[TestBits64NumValues];
+
+    template <typename Stream> bool Serialize( Stream & stream )
+    {
+        for ( int i = 0; i < TestBits64NumValues; ++i )
+            serialize_bits64( stream, values[i], test_bits64_widths[i] );
+        return true;
+    }
+};
+
+void test_serialize_bits64()
+{
+    printf( "test_serialize_bits64\n" );
+
+    const int BufferSize = 256;
+
+    TestBits64Object writeObject;
+    int totalBits = 0;
+    for ( int i = 0; i < TestBits64NumValues; ++i )
+    {
+        const int bits = test_bits64_widths[i];
+        const uint64_t value = ( uint64_t( rand() ) << 48 ) ^ ( uint64_t( rand() ) << 24 ) ^ uint64_t( rand() );
+        writeObject.values[i] = ( bits < 64 ) ? ( value & ( ( uint64_t(1) << bits ) - 1 ) ) : value;
+        totalBits += bits;
+    }
+
+    protocol2::MeasureStream measureStream( BufferSize );
+    check( writeObject.Serialize( measureStream ) );
+    check( measureStream.GetBitsProcessed() == totalBits );
+
+    uint8_t buffer[BufferSize];
+    memset( buffer, 0, sizeof( buffer ) );
+
+    protocol2::WriteStream writeStream( buffer, BufferSize );
+    check( writeObject.Serialize( writeStream ) );
+    writeStream.Flush();
+    check( writeStream.GetBitsProcessed() == totalBits );
+
+    const int bytesWritten = writeStream.GetBytesProcessed();
+
+    TestBits64Object readObject;
+    memset( &readObject, 0, sizeof( readObject ) );
+    protocol2::ReadStream readStream( buffer, bytesWritten );
+    check( readObject.Serialize( readStream ) );
+    for ( int i = 0; i < TestBits64NumValues; ++i )
+        check( readObject.values[i] == writeObject.values[i] );
+
+    // both bitpackers lay out 64 bit writes the same, whichever one the streams are built with
+
+    uint8_t buffer32[BufferSize];
+    uint8_t buffer64[BufferSize];
+    memset( buffer32, 0, sizeof( buffer32 ) );
+    memset( buffer64, 0, sizeof( buffer64 ) );
+
+    protocol2::BitWriter writer32( buffer32, BufferSize );
+    protocol2::BitWriter64 writer64( buffer64, BufferSize );
+    for ( int i = 0; i < TestBits64NumValues; ++i )
+    {
+        writer32.WriteBits64( writeObject.values[i], test_bits64_widths[i] );
+        writer64.WriteBits64( writeObject.values[i], test_bits64_widths[i] );
+    }
+    writer32.FlushBits();
+    writer64.FlushBits();
+
+    check( memcmp( buffer32, buffer, bytesWritten ) == 0 );
+    check( memcmp( buffer64, buffer, bytesWritten ) == 0 );
+
+    protocol2::BitReader reader32( buffer, bytesWritten );
+    protocol2::BitReader64 reader64( buffer, bytesWritten );
+    for ( int i = 0; i < TestBits64NumValues; ++i )
+    {
+        check( reader32.ReadBits64( test_bits64_widths[i] ) == writeObject.values[i] );
+        check( reader64.ReadBits64( test_bits64_widths[i] ) == writeObject.values[i] );
+    }
+
+    // a 64 bit field that runs past the end of the buffer fails cleanly
+
+    protocol2::ReadStream truncatedStream( buffer, 4 );
+    uint64_t value = 0;
+    check( !truncatedStream.SerializeBits64( value, 40 ) );
+    check( truncatedStream.GetError() == PROTOCOL2_ERROR_STREAM_OVERFLOW );
+}
+
 enum TestPacketTypes
 {
     TEST_PACKET_A,
@@ -267,6 +628,15 @@ enum TestPacketTypes
     TEST_PACKET_NUM_TYPES
 };
 
+static int num_unchecked_reads;
+
+template <typename Stream> void count_unchecked_read( Stream & /*stream*/ ) {}
+
+void count_unchecked_read( protocol2::UncheckedReadStream & /*stream*/ )
+{
+    num_unchecked_reads++;
+}
+
 struct TestPacketA : public protocol2::Packet
 {
     int a,b,c;
@@ -280,6 +650,7 @@ struct TestPacketA : public protocol2::Packet
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
+        count_unchecked_read( stream );
         serialize_int( stream, a, -10, 10 );
         serialize_int( stream, b, -20, 20 );
         serialize_int( stream, c, -30, 30 );
@@ -301,6 +672,7 @@ struct TestPacketB : public protocol2::Packet
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
+        count_unchecked_read( stream );
         serialize_int( stream, x, -5, +5 );
         serialize_int( stream, y, -5, +5 );
         return true;
@@ -321,6 +693,7 @@ struct TestPacketC : public protocol2::Packet
 
     template <typename Stream> bool Serialize( Stream & stream )
     {
+        count_unchecked_read( stream );
         for ( int i = 0; i < (int) sizeof( data ); ++i )
             serialize_int( stream, data[i], 0, 255 );
         return true;
@@ -350,6 +723,27 @@ struct TestPacketFactory : public protocol2::PacketFactory
     }
 };
 
+struct TestPooledPacketFactory : public protocol2::PooledPacketFactory
+{
+    TestPooledPacketFactory( int capacity ) : PooledPacketFactory( TEST_PACKET_NUM_TYPES ) 
+    {
+        InitPool<TestPacketA>( TEST_PACKET_A, capacity );
+        InitPool<TestPacketB>( TEST_PACKET_B, capacity );
+        InitPool<TestPacketC>( TEST_PACKET_C, capacity );
+    }
+
+    protocol2::Packet* CreatePooled( int type, protocol2::PacketArena * arena )
+    {
+        switch ( type )
+        {
+            case TEST_PACKET_A: return CreateFromPool<TestPacketA>( type, arena );
+            case TEST_PACKET_B: return CreateFromPool<TestPacketB>( type, arena );
+            case TEST_PACKET_C: return CreateFromPool<TestPacketC>( type, arena );
+        }
+        return NULL;
+    }
+};
+
 void test_packets()
 {
     printf( "test packets\n" );
@@ -373,214 +767,1522 @@ void test_packets()
     packetFactory.DestroyPacket( c );
 }
 
-void test_address_ipv4()
+void test_pooled_packet_factory()
 {
-    printf( "test_address_ipv4\n" );
+    printf( "test_pooled_packet_factory\n" );
 
-    char buffer[256];
+    const int PoolSize = 2;
 
-    {
-        network2::Address address( 127, 0, 0, 1 );
-        check( address.IsValid() );
-        check( address.GetType() == network2::ADDRESS_IPV4 );
-        check( address.GetPort() == 0 );
-        check( address.GetAddress4() == 0x100007f );
-        check( strcmp( address.ToString( buffer, 256 ), "127.0.0.1" ) == 0 );
-    }
+    TestPooledPacketFactory packetFactory( PoolSize );
 
+    for ( int i = 0; i < TEST_PACKET_NUM_TYPES; ++i )
     {
-        network2::Address address( 127, 0, 0, 1, 1000 );
-        check( address.IsValid() );
-        check( address.GetType() == network2::ADDRESS_IPV4 );
-        check( address.GetPort() == 1000 );
-        check( address.GetAddress4() == 0x100007f );
-        check( strcmp( address.ToString( buffer, 256 ), "127.0.0.1:1000" ) == 0 );
+        check( packetFactory.GetPoolCapacity( i ) == PoolSize );
+        check( packetFactory.GetPoolNumAllocated( i ) == 0 );
     }
 
-    {
-        network2::Address address( "127.0.0.1" );
-        check( address.IsValid() );
-        check( address.GetType() == network2::ADDRESS_IPV4 );
-        check( address.GetPort() == 0 );
-        check( address.GetAddress4() == 0x100007f );
-        check( strcmp( address.ToString( buffer, 256 ), "127.0.0.1" ) == 0 );
-    }
+    TestPacketA *a1 = (TestPacketA*) packetFactory.CreatePacket( TEST_PACKET_A );
+    TestPacketA *a2 = (TestPacketA*) packetFactory.CreatePacket( TEST_PACKET_A );
 
-    {
-        network2::Address address( "127.0.0.1:65535" );
-        check( address.IsValid() );
-        check( address.GetType() == network2::ADDRESS_IPV4 );
-        check( address.GetPort() == 65535 );
-        check( address.GetAddress4() == 0x100007f );
-        check( strcmp( address.ToString( buffer, 256 ), "127.0.0.1:65535" ) == 0 );
-    }
+    check( a1 );
+    check( a2 );
+    check( a1 != a2 );
+    check( a1->GetType() == TEST_PACKET_A );
+    check( a1->a == 1 && a1->b == 2 && a1->c == 3 );
+    check( packetFactory.GetPoolNumAllocated( TEST_PACKET_A ) == 2 );
 
-    {
-        network2::Address address( "10.24.168.192:3000" );
-        check( address.IsValid() );
-        check( address.GetType() == network2::ADDRESS_IPV4 );
-        check( address.GetPort() == 3000 );
-        check( address.GetAddress4() == 0xc0a8180a );
-        check( strcmp( address.ToString( buffer, 256 ), "10.24.168.192:3000" ) == 0 );
-    }
+    // an empty pool fails the create without touching the other pools
 
-    {
-        network2::Address address( "255.255.255.255:65535" );
-        check( address.IsValid() );
-        check( address.GetType() == network2::ADDRESS_IPV4 );
-        check( address.GetPort() == 65535 );
-        check( address.GetAddress4() == 0xffffffff );
-        check( strcmp( address.ToString( buffer, 256 ), "255.255.255.255:65535" ) == 0 );
-    }
-}
+    check( packetFactory.CreatePacket( TEST_PACKET_A ) == NULL );
+    check( packetFactory.GetPoolNumFailed( TEST_PACKET_A ) == 1 );
 
-#if NETWORK2_PLATFORM == NETWORK2_PLATFORM_UNIX
-#include <arpa/inet.h>
-#include <netinet/in.h>
-#elif NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
-#define NOMINMAX
-#define _WINSOCK_DEPRECATED_NO_WARNINGS
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#include <ws2ipdef.h>
-#endif // #if NETWORK2_PLATFORM == NETWORK2_PLATFORM_UNIX
+    TestPacketC *c = (TestPacketC*) packetFactory.CreatePacket( TEST_PACKET_C );
+    check( c );
+    check( c->data[5] == 5 );
+    check( packetFactory.GetPoolNumAllocated( TEST_PACKET_C ) == 1 );
 
-void test_address_ipv6()
-{
-    printf( "test_address_ipv6\n" );
+    // a destroyed packet's slot is the next one handed out
 
-    char buffer[256];
+    packetFactory.DestroyPacket( a1 );
+    check( packetFactory.GetPoolNumAllocated( TEST_PACKET_A ) == 1 );
 
-    // without port numbers
+    TestPacketA *a3 = (TestPacketA*) packetFactory.CreatePacket( TEST_PACKET_A );
+    check( a3 == a1 );
+    check( a3->a == 1 && a3->b == 2 && a3->c == 3 );
 
-    {
-        const uint16_t address6[] = { 0xFE80, 0x0000, 0x0000, 0x0000, 0x0202, 0xB3FF, 0xFE1E, 0x8329 };
+    packetFactory.DestroyPacket( a2 );
+    packetFactory.DestroyPacket( a3 );
+    packetFactory.DestroyPacket( c );
 
-        network2::Address address( address6[0], address6[1], address6[2], address6[2],
-                                   address6[4], address6[5], address6[6], address6[7] );
+    check( packetFactory.GetPoolNumAllocated( TEST_PACKET_A ) == 0 );
+    check( packetFactory.GetPoolNumAllocated( TEST_PACKET_C ) == 0 );
+    check( packetFactory.GetPoolMaxAllocated( TEST_PACKET_A ) == 2 );
+    check( packetFactory.GetPoolMaxAllocated( TEST_PACKET_B ) == 0 );
 
-        check( address.IsValid() );
-        check( address.GetType() == network2::ADDRESS_IPV6 );
-        check( address.GetPort() == 0 );
+    // packets read from a buffer come from the pool too
 
-        for ( int i = 0; i < 8; ++i )
+    protocol2::PacketInfo info;
+    info.protocolId = 0x12345678;
+    info.packetFactory = &packetFactory;
+
+    TestPacketB writePacket;
+    writePacket.x = -3;
+    writePacket.y = 4;
+
+    uint8_t buffer[256];
+
+    const int bytesWritten = protocol2::WritePacket( info, &writePacket, buffer, sizeof( buffer ) );
+    check( bytesWritten > 0 );
+
+    TestPacketB *readPacket = (TestPacketB*) protocol2::ReadPacket( info, buffer, bytesWritten );
+    check( readPacket );
+    check( readPacket->GetType() == TEST_PACKET_B );
+    check( readPacket->x == -3 && readPacket->y == 4 );
+    check( packetFactory.GetPoolNumAllocated( TEST_PACKET_B ) == 1 );
+
+    packetFactory.DestroyPacket( readPacket );
+
+    check( packetFactory.GetPoolNumAllocated( TEST_PACKET_B ) == 0 );
+}
+
+void test_read_packet_arena()
+{
+    printf( "test_read_packet_arena\n" );
+
+    TestPooledPacketFactory packetFactory( 1 );
+
+    protocol2::PacketInfo info;
+    info.protocolId = 0x12345678;
+    info.packetFactory = &packetFactory;
+
+    TestPacketA writePacket;
+    writePacket.a = 5;
+    writePacket.b = -6;
+    writePacket.c = 7;
+
+    uint8_t buffer[256];
+
+    const int bytesWritten = protocol2::WritePacket( info, &writePacket, buffer, sizeof( buffer ) );
+    check( bytesWritten > 0 );
+
+    const int NumPackets = 4;
+
+    const int PacketBytes = ( sizeof( TestPacketA ) + 15 ) & ~15;
+
+    protocol2::PacketArena arena( PacketBytes * NumPackets );
+
+    // more packets than the pool holds can be read into the arena, and none of them touch the pool
+
+    TestPacketA *packets[NumPackets];
+
+    for ( int i = 0; i < NumPackets; ++i )
+    {
+        int error = PROTOCOL2_ERROR_NONE;
+        packets[i] = (TestPacketA*) protocol2::ReadPacket( info, arena, buffer, bytesWritten, NULL, &error );
+        check( packets[i] );
+        check( error == PROTOCOL2_ERROR_NONE );
+        check( packets[i]->GetType() == TEST_PACKET_A );
+        check( packets[i]->a == 5 && packets[i]->b == -6 && packets[i]->c == 7 );
+        check( ( uintptr_t( packets[i] ) % 16 ) == 0 );
+        if ( i > 0 )
+            check( packets[i] > packets[i-1] );
+    }
+
+    check( packetFactory.GetPoolNumAllocated( TEST_PACKET_A ) == 0 );
+    check( arena.GetBytesAllocated() == arena.GetCapacity() );
+
+    // a full arena fails the create
+
+    int error = PROTOCOL2_ERROR_NONE;
+    check( protocol2::ReadPacket( info, arena, buffer, bytesWritten, NULL, &error ) == NULL );
+    check( error == PROTOCOL2_ERROR_CREATE_PACKET_FAILED );
+
+    // reset frees every packet in the arena at once
+
+    arena.Reset();
+
+    check( arena.GetBytesAllocated() == 0 );
+
+    protocol2::Packet *packet = protocol2::ReadPacket( info, arena, buffer, bytesWritten );
+    check( packet == packets[0] );
+
+    // a factory that doesn't support arenas fails the create
+
+    TestPacketFactory heapPacketFactory;
+    info.packetFactory = &heapPacketFactory;
+    check( protocol2::ReadPacket( info, arena, buffer, bytesWritten, NULL, &error ) == NULL );
+    check( error == PROTOCOL2_ERROR_CREATE_PACKET_FAILED );
+}
+
+void test_read_packet_max_bits()
+{
+    printf( "test_read_packet_max_bits\n" );
+
+    TestPacketFactory packetFactory;
+
+    int maxPacketBits[TEST_PACKET_NUM_TYPES];
+    int oversizedMaxPacketBits[TEST_PACKET_NUM_TYPES];
+
+    for ( int i = 0; i < TEST_PACKET_NUM_TYPES; ++i )
+    {
+        protocol2::Packet *packet = packetFactory.CreatePacket( i );
+        protocol2::MeasureStream measureStream( 1024 );
+        packet->SerializeInternal( measureStream );
+        maxPacketBits[i] = measureStream.GetBitsProcessed();
+        oversizedMaxPacketBits[i] = maxPacketBits[i] + 1024;
+        packetFactory.DestroyPacket( packet );
+    }
+
+    protocol2::PacketInfo info;
+    info.protocolId = 0x12345678;
+    info.rawFormat = true;
+    info.packetFactory = &packetFactory;
+    info.maxPacketBits = maxPacketBits;
+
+    for ( int i = 0; i < TEST_PACKET_NUM_TYPES; ++i )
+    {
+        protocol2::Packet *writePacket = packetFactory.CreatePacket( i );
+
+        if ( i == TEST_PACKET_A )
+        {
+            TestPacketA *a = (TestPacketA*) writePacket;
+            a->a = -10;
+            a->b = 20;
+            a->c = -7;
+        }
+
+        uint8_t buffer[256];
+        memset( buffer, 0, sizeof( buffer ) );
+
+        const int bytesWritten = protocol2::WritePacket( info, writePacket, buffer, sizeof( buffer ) );
+
+        check( bytesWritten > 0 );
+
+        // the whole buffer covers the worst case, so the packet body is read with the unchecked stream
+
+        num_unchecked_reads = 0;
+
+        int error = 0;
+        protocol2::Packet *readPacket = protocol2::ReadPacket( info, buffer, bytesWritten, NULL, &error );
+
+        check( readPacket );
+        check( error == PROTOCOL2_ERROR_NONE );
+        check( readPacket->GetType() == i );
+        check( num_unchecked_reads == 1 );
+
+        if ( i == TEST_PACKET_A )
+        {
+            TestPacketA *a = (TestPacketA*) readPacket;
+            check( a->a == -10 );
+            check( a->b == 20 );
+            check( a->c == -7 );
+        }
+
+        packetFactory.DestroyPacket( readPacket );
+
+        // without max packet bits, or with a worst case larger than the buffer, the packet body is read with overflow checks
+
+        protocol2::PacketInfo checkedInfo = info;
+
+        checkedInfo.maxPacketBits = NULL;
+        readPacket = protocol2::ReadPacket( checkedInfo, buffer, bytesWritten, NULL, &error );
+        check( readPacket );
+        check( error == PROTOCOL2_ERROR_NONE );
+        packetFactory.DestroyPacket( readPacket );
+
+        checkedInfo.maxPacketBits = oversizedMaxPacketBits;
+        readPacket = protocol2::ReadPacket( checkedInfo, buffer, bytesWritten, NULL, &error );
+        check( readPacket );
+        check( error == PROTOCOL2_ERROR_NONE );
+        packetFactory.DestroyPacket( readPacket );
+
+        // a truncated buffer doesn't cover the worst case, so it must be read with overflow checks and fail cleanly
+
+        readPacket = protocol2::ReadPacket( info, buffer, 1, NULL, &error );
+
+        check( readPacket == NULL );
+        check( num_unchecked_reads == 1 );
+
+        packetFactory.DestroyPacket( writePacket );
+    }
+}
+
+const int TestVariableMaxBytes = 256;
+
+struct TestVariablePacket : public protocol2::Packet
+{
+    int numBytes;
+    uint8_t data[TestVariableMaxBytes];
+
+    TestVariablePacket( int type ) : Packet( type )
+    {
+        numBytes = 4;
+        memset( data, 0, sizeof( data ) );
+    }
+
+    template <typename Stream> bool Serialize( Stream & stream )
+    {
+        count_unchecked_read( stream );
+        serialize_int( stream, numBytes, 0, TestVariableMaxBytes );
+        serialize_bytes( stream, data, numBytes );
+        return true;
+    }
+
+    PROTOCOL2_DECLARE_VIRTUAL_SERIALIZE_FUNCTIONS();
+};
+
+struct TestVariablePacketFactory : public protocol2::PacketFactory
+{
+    TestVariablePacketFactory() : PacketFactory( 2 ) {}
+
+    protocol2::Packet* Create( int type )
+    {
+        return new TestVariablePacket( type );
+    }
+
+    void Destroy( protocol2::Packet *packet )
+    {
+        delete packet;
+    }
+};
+
+void test_read_packet_max_bits_underestimated()
+{
+    printf( "test_read_packet_max_bits_underestimated\n" );
+
+    TestVariablePacketFactory packetFactory;
+
+    // measuring a default packet underestimates the worst case, since longer packets are valid too
+
+    int maxPacketBits[2];
+    {
+        protocol2::Packet *packet = packetFactory.CreatePacket( 0 );
+        protocol2::MeasureStream measureStream( 1024 );
+        packet->SerializeInternal( measureStream );
+        maxPacketBits[0] = measureStream.GetBitsProcessed();
+        maxPacketBits[1] = maxPacketBits[0];
+        packetFactory.DestroyPacket( packet );
+    }
+
+    protocol2::PacketInfo info( 0x12345678 );
+    info.rawFormat = true;
+    info.packetFactory = &packetFactory;
+    info.maxPacketBits = maxPacketBits;
+
+    TestVariablePacket *writePacket = (TestVariablePacket*) packetFactory.CreatePacket( 0 );
+    writePacket->numBytes = 200;
+    for ( int i = 0; i < writePacket->numBytes; ++i )
+        writePacket->data[i] = (uint8_t) i;
+
+    uint8_t buffer[512];
+    memset( buffer, 0, sizeof( buffer ) );
+
+    const int bytesWritten = protocol2::WritePacket( info, writePacket, buffer, sizeof( buffer ) );
+
+    check( bytesWritten > writePacket->numBytes );
+
+    // the whole packet still reads fine through the unchecked stream
+
+    num_unchecked_reads = 0;
+
+    int error = 0;
+    TestVariablePacket *readPacket = (TestVariablePacket*) protocol2::ReadPacket( info, buffer, bytesWritten, NULL, &error );
+
+    check( readPacket );
+    check( error == PROTOCOL2_ERROR_NONE );
+    check( num_unchecked_reads == 1 );
+    check( readPacket->numBytes == writePacket->numBytes );
+    check( memcmp( readPacket->data, writePacket->data, writePacket->numBytes ) == 0 );
+
+    packetFactory.DestroyPacket( readPacket );
+
+    // a truncated packet covers the underestimated worst case, so it is read unchecked. the length prefixed bytes run 
+    // past the end of the buffer, which must fail the read instead of reading past it
+
+    const int truncatedBytes = bytesWritten - 100;
+
+    check( maxPacketBits[0] <= truncatedBytes * 8 - 32 );
+
+    uint8_t * truncatedBuffer = new uint8_t[truncatedBytes];
+    memcpy( truncatedBuffer, buffer, truncatedBytes );
+
+    readPacket = (TestVariablePacket*) protocol2::ReadPacket( info, truncatedBuffer, truncatedBytes, NULL, &error );
+
+    check( readPacket == NULL );
+    check( error == PROTOCOL2_ERROR_SERIALIZE_PACKET_FAILED );
+    check( num_unchecked_reads == 2 );
+
+    // measuring a packet with the maximum number of bytes gives the true worst case, so the truncated packet is read checked
+
+    TestVariablePacket *maxPacket = (TestVariablePacket*) packetFactory.CreatePacket( 0 );
+    maxPacket->numBytes = TestVariableMaxBytes;
+    protocol2::MeasureStream measureStream( 4096 );
+    maxPacket->SerializeInternal( measureStream );
+    maxPacketBits[0] = measureStream.GetBitsProcessed();
+    packetFactory.DestroyPacket( maxPacket );
+
+    readPacket = (TestVariablePacket*) protocol2::ReadPacket( info, truncatedBuffer, truncatedBytes, NULL, &error );
+
+    check( readPacket == NULL );
+    check( error == PROTOCOL2_ERROR_SERIALIZE_PACKET_FAILED );
+    check( num_unchecked_reads == 2 );
+
+    delete [] truncatedBuffer;
+
+    packetFactory.DestroyPacket( writePacket );
+}
+
+void test_packet_crc32_seed()
+{
+    printf( "test_packet_crc32_seed\n" );
+
+    TestPacketFactory packetFactory;
+
+    protocol2::PacketInfo info;
+    info.protocolId = 0x12345678;
+    info.packetFactory = &packetFactory;
+
+    protocol2::PacketInfo seededInfo = info;
+    seededInfo.CalculateCrc32Seed();
+
+    check( seededInfo.crc32SeedProtocolId == info.protocolId );
+
+    TestPacketC *packet = (TestPacketC*) packetFactory.CreatePacket( TEST_PACKET_C );
+
+    uint8_t buffer[256];
+    uint8_t seededBuffer[256];
+
+    const int bytesWritten = protocol2::WritePacket( info, packet, buffer, sizeof( buffer ) );
+    const int seededBytesWritten = protocol2::WritePacket( seededInfo, packet, seededBuffer, sizeof( seededBuffer ) );
+
+    check( bytesWritten > 0 );
+    check( bytesWritten == seededBytesWritten );
+    check( memcmp( buffer, seededBuffer, bytesWritten ) == 0 );
+
+    // the crc32 must be over the protocol id followed by the packet with a zeroed crc32 field
+
+    uint32_t writtenCrc32;
+    memcpy( &writtenCrc32, buffer, 4 );
+    memset( buffer, 0, 4 );
+    uint32_t network_protocolId = protocol2::host_to_network( info.protocolId );
+    uint32_t crc32 = protocol2::calculate_crc32( (const uint8_t*) &network_protocolId, 4 );
+    crc32 = protocol2::calculate_crc32( buffer, bytesWritten, crc32 );
+    check( protocol2::network_to_host( writtenCrc32 ) == crc32 );
+
+    protocol2::Packet *readPacket = protocol2::ReadPacket( seededInfo, seededBuffer, seededBytesWritten );
+    check( readPacket );
+    check( readPacket->GetType() == TEST_PACKET_C );
+    packetFactory.DestroyPacket( readPacket );
+
+    // a stale seed must not be used once the protocol id changes
+
+    seededInfo.protocolId = 0x87654321;
+    readPacket = protocol2::ReadPacket( seededInfo, seededBuffer, seededBytesWritten );
+    check( readPacket == NULL );
+
+    // a default protocol id of 0 without CalculateCrc32Seed must still seed with the crc32 of the zero protocol id and crc32 field
+
+    const uint8_t zeroPrefix[8] = { 0 };
+    check( protocol2::calculate_crc32( zeroPrefix, sizeof( zeroPrefix ) ) == 0x6522df69 );
+
+    protocol2::PacketInfo zeroInfo;
+    check( zeroInfo.protocolId == 0 );
+    check( !zeroInfo.crc32SeedValid );
+    check( zeroInfo.GetCrc32Seed() == 0x6522df69 );
+
+    zeroInfo.CalculateCrc32Seed();
+    check( zeroInfo.crc32SeedValid );
+    check( zeroInfo.crc32Seed == 0x6522df69 );
+    check( zeroInfo.GetCrc32Seed() == 0x6522df69 );
+
+    // a seed calculated for one protocol id is not used for another
+
+    zeroInfo.protocolId = info.protocolId;
+    check( zeroInfo.GetCrc32Seed() == seededInfo.crc32Seed );
+
+    // constructing a packet info with a protocol id calculates the seed once, and copies keep it
+
+    const protocol2::PacketInfo constructedInfo( info.protocolId );
+    check( constructedInfo.protocolId == info.protocolId );
+    check( constructedInfo.crc32SeedValid );
+    check( constructedInfo.crc32Seed == seededInfo.crc32Seed );
+
+    protocol2::PacketInfo copiedInfo = constructedInfo;
+    copiedInfo.packetFactory = &packetFactory;
+    check( copiedInfo.crc32SeedValid );
+    check( copiedInfo.GetCrc32Seed() == seededInfo.crc32Seed );
+
+    packetFactory.DestroyPacket( packet );
+}
+
+void test_write_stream_checkpoint()
+{
+    printf( "test_write_stream_checkpoint\n" );
+
+    // write packets speculatively until one doesn't fit, then roll back the partial packet
+
+    const int BufferSize = 64;
+
+    uint8_t buffer[BufferSize];
+
+    protocol2::WriteStream writeStream( buffer, BufferSize );
+
+    TestPacketC writePacket;
+
+    int numPacketsWritten = 0;
+
+    while ( true )
+    {
+        const protocol2::WriteCheckpoint checkpoint = writeStream.Checkpoint();
+
+        writePacket.data[0] = (uint8_t) numPacketsWritten;
+
+        check( writePacket.SerializeInternal( writeStream ) );
+
+        if ( writeStream.GetError() == PROTOCOL2_ERROR_STREAM_OVERFLOW )
+        {
+            writeStream.Rollback( checkpoint );
+            break;
+        }
+
+        numPacketsWritten++;
+    }
+
+    check( writeStream.GetError() == PROTOCOL2_ERROR_NONE );
+    check( numPacketsWritten == BufferSize / (int) sizeof( writePacket.data ) );
+
+    writeStream.Flush();
+
+    protocol2::ReadStream readStream( buffer, writeStream.GetBytesProcessed() );
+
+    for ( int i = 0; i < numPacketsWritten; ++i )
+    {
+        TestPacketC readPacket;
+        check( readPacket.SerializeInternal( readStream ) );
+        check( readPacket.data[0] == i );
+        for ( int j = 1; j < (int) sizeof( readPacket.data ); ++j )
+            check( readPacket.data[j] == writePacket.data[j] );
+    }
+}
+
+void test_aggregate_packet()
+{
+    printf( "test_aggregate_packet\n" );
+
+    TestPacketFactory packetFactory;
+
+    protocol2::PacketInfo info;
+    info.protocolId = 0x12345678;
+    info.packetFactory = &packetFactory;
+
+    const int NumPackets = 16;
+
+    protocol2::Packet *writePackets[NumPackets];
+
+    for ( int i = 0; i < NumPackets; ++i )
+    {
+        writePackets[i] = packetFactory.CreatePacket( i % TEST_PACKET_NUM_TYPES );
+        if ( writePackets[i]->GetType() == TEST_PACKET_A )
+            ( (TestPacketA*) writePackets[i] )->b = -i;
+    }
+
+    // a buffer that can't hold every packet must stop at the last packet that fits, without writing past the end of the buffer
+
+    const int BufferSize = 64;
+    const int GuardSize = 64;
+
+    uint8_t buffer[BufferSize+GuardSize];
+
+    memset( buffer, 0xCD, sizeof( buffer ) );
+
+    int numPacketsWritten = 0;
+
+    const int bytesWritten = protocol2::WriteAggregatePacket( info, NumPackets, writePackets, buffer, BufferSize, numPacketsWritten );
+
+    check( bytesWritten > 0 );
+    check( bytesWritten <= BufferSize );
+    check( numPacketsWritten > 0 );
+    check( numPacketsWritten < NumPackets );
+
+    for ( int i = 0; i < GuardSize; ++i )
+        check( buffer[BufferSize+i] == 0xCD );
+
+    protocol2::Packet *readPackets[NumPackets];
+
+    int numPacketsRead = 0;
+    int error = PROTOCOL2_ERROR_NONE;
+
+    protocol2::ReadAggregatePacket( info, NumPackets, readPackets, buffer, bytesWritten, numPacketsRead, NULL, NULL, &error );
+
+    check( error == PROTOCOL2_ERROR_NONE );
+    check( numPacketsRead == numPacketsWritten );
+
+    for ( int i = 0; i < numPacketsRead; ++i )
+    {
+        check( readPackets[i] );
+        check( readPackets[i]->GetType() == writePackets[i]->GetType() );
+        if ( readPackets[i]->GetType() == TEST_PACKET_A )
+            check( ( (TestPacketA*) readPackets[i] )->b == -i );
+        packetFactory.DestroyPacket( readPackets[i] );
+    }
+
+    // a buffer with room for every packet must hold them all
+
+    uint8_t largeBuffer[1024];
+
+    const int largeBytesWritten = protocol2::WriteAggregatePacket( info, NumPackets, writePackets, largeBuffer, sizeof( largeBuffer ), numPacketsWritten );
+
+    check( largeBytesWritten > bytesWritten );
+    check( numPacketsWritten == NumPackets );
+
+    protocol2::ReadAggregatePacket( info, NumPackets, readPackets, largeBuffer, largeBytesWritten, numPacketsRead, NULL, NULL, &error );
+
+    check( error == PROTOCOL2_ERROR_NONE );
+    check( numPacketsRead == NumPackets );
+
+    for ( int i = 0; i < numPacketsRead; ++i )
+    {
+        check( readPackets[i] );
+        check( readPackets[i]->GetType() == writePackets[i]->GetType() );
+        packetFactory.DestroyPacket( readPackets[i] );
+    }
+
+    for ( int i = 0; i < NumPackets; ++i )
+        packetFactory.DestroyPacket( writePackets[i] );
+}
+
+void test_address_ipv4()
+{
+    printf( "test_address_ipv4\n" );
+
+    char buffer[256];
+
+    {
+        network2::Address address( 127, 0, 0, 1 );
+        check( address.IsValid() );
+        check( address.GetType() == network2::ADDRESS_IPV4 );
+        check( address.GetPort() == 0 );
+        check( address.GetAddress4() == 0x100007f );
+        check( strcmp( address.ToString( buffer, 256 ), "127.0.0.1" ) == 0 );
+    }
+
+    {
+        network2::Address address( 127, 0, 0, 1, 1000 );
+        check( address.IsValid() );
+        check( address.GetType() == network2::ADDRESS_IPV4 );
+        check( address.GetPort() == 1000 );
+        check( address.GetAddress4() == 0x100007f );
+        check( strcmp( address.ToString( buffer, 256 ), "127.0.0.1:1000" ) == 0 );
+    }
+
+    {
+        network2::Address address( "127.0.0.1" );
+        check( address.IsValid() );
+        check( address.GetType() == network2::ADDRESS_IPV4 );
+        check( address.GetPort() == 0 );
+        check( address.GetAddress4() == 0x100007f );
+        check( strcmp( address.ToString( buffer, 256 ), "127.0.0.1" ) == 0 );
+    }
+
+    {
+        network2::Address address( "127.0.0.1:65535" );
+        check( address.IsValid() );
+        check( address.GetType() == network2::ADDRESS_IPV4 );
+        check( address.GetPort() == 65535 );
+        check( address.GetAddress4() == 0x100007f );
+        check( strcmp( address.ToString( buffer, 256 ), "127.0.0.1:65535" ) == 0 );
+    }
+
+    {
+        network2::Address address( "10.24.168.192:3000" );
+        check( address.IsValid() );
+        check( address.GetType() == network2::ADDRESS_IPV4 );
+        check( address.GetPort() == 3000 );
+        check( address.GetAddress4() == 0xc0a8180a );
+        check( strcmp( address.ToString( buffer, 256 ), "10.24.168.192:3000" ) == 0 );
+    }
+
+    {
+        network2::Address address( "255.255.255.255:65535" );
+        check( address.IsValid() );
+        check( address.GetType() == network2::ADDRESS_IPV4 );
+        check( address.GetPort() == 65535 );
+        check( address.GetAddress4() == 0xffffffff );
+        check( strcmp( address.ToString( buffer, 256 ), "255.255.255.255:65535" ) == 0 );
+    }
+}
+
+#if NETWORK2_PLATFORM == NETWORK2_PLATFORM_UNIX
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#elif NETWORK2_PLATFORM == NETWORK2_PLATFORM_WINDOWS
+#define NOMINMAX
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <ws2ipdef.h>
+#endif // #if NETWORK2_PLATFORM == NETWORK2_PLATFORM_UNIX
+
+void test_address_ipv6()
+{
+    printf( "test_address_ipv6\n" );
+
+    char buffer[256];
+
+    // without port numbers
+
+    {
+        const uint16_t address6[] = { 0xFE80, 0x0000, 0x0000, 0x0000, 0x0202, 0xB3FF, 0xFE1E, 0x8329 };
+
+        network2::Address address( address6[0], address6[1], address6[2], address6[2],
+                                   address6[4], address6[5], address6[6], address6[7] );
+
+        check( address.IsValid() );
+        check( address.GetType() == network2::ADDRESS_IPV6 );
+        check( address.GetPort() == 0 );
+
+        for ( int i = 0; i < 8; ++i )
+            check( htons( address6[i] ) == address.GetAddress6()[i] );
+
+        check( strcmp( address.ToString( buffer, 256 ), "fe80::202:b3ff:fe1e:8329" ) == 0 );
+    }
+
+    {
+        const uint16_t address6[] = { 0xFE80, 0x0000, 0x0000, 0x0000, 0x0202, 0xB3FF, 0xFE1E, 0x8329 };
+
+        network2::Address address( address6 );
+
+        check( address.IsValid() );
+        check( address.GetType() == network2::ADDRESS_IPV6 );
+        check( address.GetPort() == 0 );
+
+        for ( int i = 0; i < 8; ++i )
+            check( htons( address6[i] ) == address.GetAddress6()[i] );
+
+        check( strcmp( address.ToString( buffer, 256 ), "fe80::202:b3ff:fe1e:8329" ) == 0 );
+    }
+
+    {
+        const uint16_t address6[] = { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0001 };
+
+        network2::Address address( address6 );
+
+        check( address.IsValid() );
+        check( address.GetType() == network2::ADDRESS_IPV6 );
+        check( address.GetPort() == 0 );
+
+        for ( int i = 0; i < 8; ++i )
+            check( htons( address6[i] ) == address.GetAddress6()[i] );
+
+        check( strcmp( address.ToString( buffer, 256 ), "::1" ) == 0 );
+    }
+
+    // same addresses but with port numbers
+
+    {
+        const uint16_t address6[] = { 0xFE80, 0x0000, 0x0000, 0x0000, 0x0202, 0xB3FF, 0xFE1E, 0x8329 };
+
+        network2::Address address( address6[0], address6[1], address6[2], address6[2],
+                                  address6[4], address6[5], address6[6], address6[7], 65535 );
+
+        check( address.IsValid() );
+        check( address.GetType() == network2::ADDRESS_IPV6 );
+        check( address.GetPort() == 65535 );
+
+        for ( int i = 0; i < 8; ++i )
+            check( htons( address6[i] ) == address.GetAddress6()[i] );
+
+        check( strcmp( address.ToString( buffer, 256 ), "[fe80::202:b3ff:fe1e:8329]:65535" ) == 0 );
+    }
+
+    {
+        const uint16_t address6[] = { 0xFE80, 0x0000, 0x0000, 0x0000, 0x0202, 0xB3FF, 0xFE1E, 0x8329 };
+
+        network2::Address address( address6, 65535 );
+
+        check( address.IsValid() );
+        check( address.GetType() == network2::ADDRESS_IPV6 );
+        check( address.GetPort() == 65535 );
+
+        for ( int i = 0; i < 8; ++i )
+            check( htons( address6[i] ) == address.GetAddress6()[i] );
+
+        check( strcmp( address.ToString( buffer, 256 ), "[fe80::202:b3ff:fe1e:8329]:65535" ) == 0 );
+    }
+
+    {
+        const uint16_t address6[] = { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0001 };
+
+        network2::Address address( address6, 65535 );
+
+        check( address.IsValid() );
+        check( address.GetType() == network2::ADDRESS_IPV6 );
+        check( address.GetPort() == 65535 );
+
+        for ( int i = 0; i < 8; ++i )
             check( htons( address6[i] ) == address.GetAddress6()[i] );
 
+        check( strcmp( address.ToString( buffer, 256 ), "[::1]:65535" ) == 0 );
+    }
+
+    // parse addresses from strings (no ports)
+
+    {
+        network2::Address address( "fe80::202:b3ff:fe1e:8329" );
+        check( address.IsValid() );
+        check( address.GetType() == network2::ADDRESS_IPV6 );
+        check( address.GetPort() == 0 );
         check( strcmp( address.ToString( buffer, 256 ), "fe80::202:b3ff:fe1e:8329" ) == 0 );
     }
 
     {
-        const uint16_t address6[] = { 0xFE80, 0x0000, 0x0000, 0x0000, 0x0202, 0xB3FF, 0xFE1E, 0x8329 };
+        network2::Address address( "::1" );
+        check( address.IsValid() );
+        check( address.GetType() == network2::ADDRESS_IPV6 );
+        check( address.GetPort() == 0 );
+        check( strcmp( address.ToString( buffer, 256 ), "::1" ) == 0 );
+    }
 
-        network2::Address address( address6 );
+    // parse addresses from strings (with ports)
 
+    {
+        network2::Address address( "[fe80::202:b3ff:fe1e:8329]:65535" );
         check( address.IsValid() );
         check( address.GetType() == network2::ADDRESS_IPV6 );
-        check( address.GetPort() == 0 );
+        check( address.GetPort() == 65535 );
+        check( strcmp( address.ToString( buffer, 256 ), "[fe80::202:b3ff:fe1e:8329]:65535" ) == 0 );
+    }
 
-        for ( int i = 0; i < 8; ++i )
-            check( htons( address6[i] ) == address.GetAddress6()[i] );
+    {
+        network2::Address address( "[::1]:65535" );
+        check( address.IsValid() );
+        check( address.GetType() == network2::ADDRESS_IPV6 );
+        check( address.GetPort() == 65535 );
+        check( strcmp( address.ToString( buffer, 256 ), "[::1]:65535" ) == 0 );
+    }
+}
+
+const int TestSocketSendPort = 50010;
+const int TestSocketReceivePort = 50011;
+const int TestSocketNumPackets = 100;
+const int TestSocketMaxPacketSize = 256;
+
+void test_socket_batch()
+{
+    printf( "test_socket_batch\n" );
+
+    network2::InitializeNetwork();
+
+    {
+        network2::Socket sendSocket( TestSocketSendPort );
+        network2::Socket receiveSocket( TestSocketReceivePort );
+
+        check( !sendSocket.IsError() );
+        check( !receiveSocket.IsError() );
+
+        // more packets than NETWORK2_SOCKET_BATCH_SIZE so the batch is split across syscalls
+
+        static uint8_t sendBuffer[TestSocketNumPackets][TestSocketMaxPacketSize];
+        static uint8_t receiveBuffer[TestSocketNumPackets][TestSocketMaxPacketSize];
+
+        network2::Address to[TestSocketNumPackets];
+        network2::Address from[TestSocketNumPackets];
+        const void * sendPacketData[TestSocketNumPackets];
+        void * receivePacketData[TestSocketNumPackets];
+        int sendPacketBytes[TestSocketNumPackets];
+        int receivePacketBytes[TestSocketNumPackets];
+
+        for ( int i = 0; i < TestSocketNumPackets; ++i )
+        {
+            to[i] = network2::Address( "::1", TestSocketReceivePort );
+            sendPacketBytes[i] = 1 + ( i * 7 ) % TestSocketMaxPacketSize;
+            memset( sendBuffer[i], i, sendPacketBytes[i] );
+            sendPacketData[i] = sendBuffer[i];
+            receivePacketData[i] = receiveBuffer[i];
+        }
+
+        check( sendSocket.GetNumSyscalls() == 0 );
+
+        check( sendSocket.SendPackets( to, sendPacketData, sendPacketBytes, TestSocketNumPackets ) == TestSocketNumPackets );
+
+        const int expectedSendSyscalls = NETWORK2_MMSG ? ( TestSocketNumPackets + NETWORK2_SOCKET_BATCH_SIZE - 1 ) / NETWORK2_SOCKET_BATCH_SIZE : TestSocketNumPackets;
+
+        check( sendSocket.GetNumSyscalls() == uint64_t( expectedSendSyscalls ) );
+
+        // loopback delivers synchronously, so every packet is already waiting on the receive socket
+
+        const int numPackets = receiveSocket.ReceivePackets( from, receivePacketData, receivePacketBytes, TestSocketMaxPacketSize, TestSocketNumPackets );
+
+        check( numPackets == TestSocketNumPackets );
+
+        for ( int i = 0; i < numPackets; ++i )
+        {
+            check( from[i] == network2::Address( "::1", TestSocketSendPort ) );
+            check( receivePacketBytes[i] == sendPacketBytes[i] );
+            check( memcmp( receiveBuffer[i], sendBuffer[i], sendPacketBytes[i] ) == 0 );
+        }
+
+        const uint64_t receiveSyscalls = receiveSocket.GetNumSyscalls();
+
+        check( receiveSyscalls > 0 );
+
+        check( receiveSocket.ReceivePackets( from, receivePacketData, receivePacketBytes, TestSocketMaxPacketSize, TestSocketNumPackets ) == 0 );
+
+        check( receiveSocket.GetNumSyscalls() == receiveSyscalls + 1 );
+    }
+
+    network2::ShutdownNetwork();
+}
+
+const int TestSegmentSize = 200;
+const int TestSegmentsBytes = 100 * TestSegmentSize + 50;
+
+void test_socket_segments()
+{
+    printf( "test_socket_segments\n" );
+
+    network2::InitializeNetwork();
+
+    {
+        network2::Socket sendSocket( TestSocketSendPort );
+        network2::Socket receiveSocket( TestSocketReceivePort );
+        network2::Socket receiveSegmentsSocket( TestSocketReceivePort + 1 );
+
+        check( !sendSocket.IsError() );
+        check( !receiveSocket.IsError() );
+        check( !receiveSegmentsSocket.IsError() );
+
+        // 101 packets: more than NETWORK2_MAX_SEGMENTS so the send is split, with a short packet at the end
+
+        static uint8_t sendBuffer[TestSegmentsBytes];
+        for ( int i = 0; i < TestSegmentsBytes; ++i )
+            sendBuffer[i] = uint8_t( i / TestSegmentSize + i );
+
+        const int numSegments = ( TestSegmentsBytes + TestSegmentSize - 1 ) / TestSegmentSize;
+
+        // a plain receiver sees each segment as its own packet
+
+        const network2::Address receiveAddress( "::1", TestSocketReceivePort );
+
+        check( sendSocket.SendPacketSegments( receiveAddress, sendBuffer, TestSegmentsBytes, TestSegmentSize ) == numSegments );
+
+        static uint8_t receiveBuffer[128][TestSegmentSize];
+        network2::Address from[128];
+        void * receivePacketData[128];
+        int receivePacketBytes[128];
+        for ( int i = 0; i < 128; ++i )
+            receivePacketData[i] = receiveBuffer[i];
+
+        check( receiveSocket.ReceivePackets( from, receivePacketData, receivePacketBytes, TestSegmentSize, 128 ) == numSegments );
+
+        for ( int i = 0; i < numSegments; ++i )
+        {
+            const int expectedBytes = ( i < numSegments - 1 ) ? TestSegmentSize : TestSegmentsBytes - i * TestSegmentSize;
+            check( from[i] == network2::Address( "::1", TestSocketSendPort ) );
+            check( receivePacketBytes[i] == expectedBytes );
+            check( memcmp( receiveBuffer[i], sendBuffer + i * TestSegmentSize, expectedBytes ) == 0 );
+        }
+
+        // a receiver with segments enabled may get them coalesced. either way the data and packet boundaries must survive
+
+        if ( receiveSegmentsSocket.EnableReceiveSegments() )
+        {
+            check( sendSocket.SendPacketSegments( network2::Address( "::1", TestSocketReceivePort + 1 ), sendBuffer, TestSegmentsBytes, TestSegmentSize ) == numSegments );
+
+            static uint8_t segmentsBuffer[NETWORK2_MAX_SEGMENTS_BYTES];
+
+            int receivedBytes = 0;
+
+            while ( true )
+            {
+                network2::Address address;
+                int segmentSize = 0;
+                const int bytes = receiveSegmentsSocket.ReceivePacketSegments( address, segmentsBuffer, NETWORK2_MAX_SEGMENTS_BYTES, segmentSize );
+                if ( !bytes )
+                    break;
+
+                check( address == network2::Address( "::1", TestSocketSendPort ) );
+                check( segmentSize == TestSegmentSize || segmentSize == bytes );
+                check( receivedBytes % TestSegmentSize == 0 );
+                check( receivedBytes + bytes <= TestSegmentsBytes );
+                check( memcmp( segmentsBuffer, sendBuffer + receivedBytes, bytes ) == 0 );
+
+                receivedBytes += bytes;
+            }
+
+            check( receivedBytes == TestSegmentsBytes );
+        }
+    }
+
+    network2::ShutdownNetwork();
+}
+
+const int TestSocketGroupSize = 4;
+const int TestSocketGroupSenders = 16;
+
+void test_socket_group()
+{
+    printf( "test_socket_group\n" );
+
+#if NETWORK2_REUSE_PORT
+
+    network2::InitializeNetwork();
+
+    {
+        // port 0 picks a free port for the first socket, and the rest of the group joins it
+
+        network2::SocketGroup group( 0, TestSocketGroupSize );
+
+        check( !group.IsError() );
+        check( group.GetPort() != 0 );
+        check( group.GetNumSockets() == TestSocketGroupSize );
+
+        for ( int i = 0; i < TestSocketGroupSize; ++i )
+            check( group.GetSocket( i ).GetPort() == group.GetPort() );
+
+        // every packet from a sender must land on the same socket in the group
+
+        network2::Socket * senders[TestSocketGroupSenders];
+        for ( int i = 0; i < TestSocketGroupSenders; ++i )
+        {
+            senders[i] = new network2::Socket( 0 );
+            check( !senders[i]->IsError() );
+        }
+
+        const network2::Address groupAddress( "::1", group.GetPort() );
+
+        for ( int j = 0; j < 4; ++j )
+        {
+            for ( int i = 0; i < TestSocketGroupSenders; ++i )
+            {
+                uint8_t packet = uint8_t( i );
+                check( senders[i]->SendPacket( groupAddress, &packet, 1 ) );
+            }
+        }
+
+        int senderSocket[TestSocketGroupSenders];
+        int senderPackets[TestSocketGroupSenders];
+        for ( int i = 0; i < TestSocketGroupSenders; ++i )
+        {
+            senderSocket[i] = -1;
+            senderPackets[i] = 0;
+        }
+
+        for ( int i = 0; i < TestSocketGroupSize; ++i )
+        {
+            while ( true )
+            {
+                network2::Address from;
+                uint8_t packet = 0;
+                if ( !group.GetSocket( i ).ReceivePacket( from, &packet, 1 ) )
+                    break;
+                check( packet < TestSocketGroupSenders );
+                check( from.GetPort() == senders[packet]->GetPort() );
+                check( senderSocket[packet] == -1 || senderSocket[packet] == i );
+                senderSocket[packet] = i;
+                senderPackets[packet]++;
+            }
+        }
+
+        for ( int i = 0; i < TestSocketGroupSenders; ++i )
+        {
+            check( senderPackets[i] == 4 );
+            delete senders[i];
+        }
+    }
+
+    network2::ShutdownNetwork();
+
+#endif // #if NETWORK2_REUSE_PORT
+}
+
+const int TestIoUringPackets = 200;
+
+void test_io_uring_socket()
+{
+    printf( "test_io_uring_socket\n" );
+
+#if NETWORK2_IO_URING
+
+    network2::InitializeNetwork();
+
+    {
+        network2::Socket sendSocket( TestSocketSendPort );
+        network2::Socket receiveSocket( TestSocketReceivePort );
+
+        check( !sendSocket.IsError() );
+        check( !receiveSocket.IsError() );
+
+        // small buffer counts so sends have to wait for free buffers and the receive runs dry and gets rearmed
+
+        network2::IoUringSocket sender( sendSocket, TestSocketMaxPacketSize, 64, 16 );
+        network2::IoUringSocket receiver( receiveSocket, TestSocketMaxPacketSize, 64, 16 );
+
+        if ( sender.IsError() || receiver.IsError() )
+        {
+            printf( "    io_uring not available on this kernel. skipped\n" );
+        }
+        else
+        {
+            // nothing to receive: this must wait for the timeout and come back empty
+
+            network2::ReceivedPacket packets[32];
+            check( receiver.ReceivePackets( packets, 32, 1 ) == 0 );
+
+            const network2::Address receiveAddress( "::1", TestSocketReceivePort );
+            const network2::Address sendAddress( "::1", TestSocketSendPort );
+
+            int numSent = 0;
+            int numReceived = 0;
+
+            for ( int iteration = 0; iteration < 1000 && numReceived < TestIoUringPackets; ++iteration )
+            {
+                while ( numSent < TestIoUringPackets && numSent - numReceived < 48 )
+                {
+                    uint8_t packet[TestSocketMaxPacketSize];
+                    const int packetBytes = 1 + ( numSent * 13 ) % TestSocketMaxPacketSize;
+                    memset( packet, numSent, packetBytes );
+                    if ( !sender.SendPacket( receiveAddress, packet, packetBytes ) )
+                        break;
+                    numSent++;
+                }
+
+                sender.Flush();
+
+                const int numPackets = receiver.ReceivePackets( packets, 32, 10 );
+
+                for ( int i = 0; i < numPackets; ++i )
+                {
+                    // one socket, one sender: packets arrive in order
+
+                    const int expectedBytes = 1 + ( numReceived * 13 ) % TestSocketMaxPacketSize;
+                    check( packets[i].from == sendAddress );
+                    check( packets[i].packetBytes == expectedBytes );
+                    for ( int j = 0; j < expectedBytes; ++j )
+                        check( packets[i].packetData[j] == uint8_t( numReceived ) );
+                    numReceived++;
+                }
+            }
+
+            check( numSent == TestIoUringPackets );
+            check( numReceived == TestIoUringPackets );
+        }
+    }
+
+    network2::ShutdownNetwork();
+
+#endif // #if NETWORK2_IO_URING
+}
+
+void test_socket_poller()
+{
+    printf( "test_socket_poller\n" );
+
+    network2::InitializeNetwork();
+
+    {
+        network2::Socket sendSocket( TestSocketSendPort );
+        network2::Socket receiveSocketA( TestSocketReceivePort );
+        network2::Socket receiveSocketB( TestSocketReceivePort + 1 );
+
+        check( !sendSocket.IsError() );
+        check( !receiveSocketA.IsError() );
+        check( !receiveSocketB.IsError() );
+
+        // wait on a single socket
+
+        check( !receiveSocketA.WaitForPackets( 0 ) );
+
+        uint8_t packet[8];
+        memset( packet, 0, sizeof( packet ) );
+        check( sendSocket.SendPacket( network2::Address( "::1", TestSocketReceivePort ), packet, sizeof( packet ) ) );
+
+        check( receiveSocketA.WaitForPackets( 1000 ) );
+
+#if NETWORK2_EPOLL
+
+        int userDataA = 0;
+        int userDataB = 0;
+        int userDataTimer = 0;
+
+        network2::SocketPoller poller;
+
+        check( !poller.IsError() );
+        check( poller.AddSocket( receiveSocketA, &userDataA ) );
+        check( poller.AddSocket( receiveSocketB, &userDataB ) );
+
+        // socket A still has its packet: level triggered, it keeps reporting until drained
+
+        network2::SocketPollerEvent events[4];
+
+        int numEvents = poller.Wait( events, 4, 0 );
+        check( numEvents == 1 );
+        check( events[0].type == network2::SOCKET_POLLER_EVENT_SOCKET );
+        check( events[0].socket == &receiveSocketA );
+        check( events[0].userData == &userDataA );
+
+        network2::Address from;
+        check( receiveSocketA.ReceivePacket( from, packet, sizeof( packet ) ) == sizeof( packet ) );
+        check( poller.Wait( events, 4, 0 ) == 0 );
+
+        check( sendSocket.SendPacket( network2::Address( "::1", TestSocketReceivePort + 1 ), packet, sizeof( packet ) ) );
+
+        numEvents = poller.Wait( events, 4, 1000 );
+        check( numEvents == 1 );
+        check( events[0].socket == &receiveSocketB );
+        check( events[0].userData == &userDataB );
+
+        // a removed socket no longer reports, even with a packet waiting
+
+        check( poller.RemoveSocket( receiveSocketB ) );
+        check( !poller.RemoveSocket( receiveSocketB ) );
+        check( poller.Wait( events, 4, 0 ) == 0 );
+
+        // timers wake the poller with nothing on the sockets
+
+        const int timerId = poller.AddTimer( 0.001, &userDataTimer );
+        check( timerId >= 0 );
+
+        numEvents = poller.Wait( events, 4, 1000 );
+        check( numEvents == 1 );
+        check( events[0].type == network2::SOCKET_POLLER_EVENT_TIMER );
+        check( events[0].timerId == timerId );
+        check( events[0].timerExpirations >= 1 );
+        check( events[0].userData == &userDataTimer );
+
+        check( poller.RemoveTimer( timerId ) );
+        check( !poller.RemoveTimer( timerId ) );
+        check( poller.Wait( events, 4, 5 ) == 0 );
+
+#endif // #if NETWORK2_EPOLL
+    }
+
+    network2::ShutdownNetwork();
+}
+
+void test_resolved_address()
+{
+    printf( "test_resolved_address\n" );
+
+    // round trip through the native sockaddr
+
+    {
+        const network2::Address address( 107, 77, 207, 77, 50000 );
+        const network2::ResolvedAddress resolved( address );
+        check( resolved.IsValid() );
+        check( resolved.GetSockaddrLength() == sizeof( sockaddr_in ) );
+        check( resolved.GetAddress() == address );
+    }
+
+    {
+        const network2::Address address( "[fe80::202:b3ff:fe1e:8329]:65535" );
+        const network2::ResolvedAddress resolved( address );
+        check( resolved.IsValid() );
+        check( resolved.GetSockaddrLength() == sizeof( sockaddr_in6 ) );
+        check( resolved.GetAddress() == address );
+    }
+
+    {
+        network2::ResolvedAddress resolved;
+        check( !resolved.IsValid() );
+        check( !resolved.GetAddress().IsValid() );
+        resolved.Set( network2::Address( "::1", 40000 ) );
+        check( resolved.IsValid() );
+        resolved.Set( network2::Address() );
+        check( !resolved.IsValid() );
+    }
+
+    // equality compares family, address and port
+
+    {
+        const network2::ResolvedAddress a( network2::Address( 127, 0, 0, 1, 40000 ) );
+        const network2::ResolvedAddress b( network2::Address( 127, 0, 0, 1, 40000 ) );
+        const network2::ResolvedAddress c( network2::Address( 127, 0, 0, 1, 40001 ) );
+        const network2::ResolvedAddress d( network2::Address( "::1", 40000 ) );
+        check( a == b );
+        check( a != c );
+        check( a != d );
+        check( network2::ResolvedAddress() == network2::ResolvedAddress() );
+    }
+
+    // send to a resolved address and receive the sender as one
+
+    network2::InitializeNetwork();
+
+    {
+        network2::Socket sendSocket( TestSocketSendPort );
+        network2::Socket receiveSocket( TestSocketReceivePort );
+
+        check( !sendSocket.IsError() );
+        check( !receiveSocket.IsError() );
+
+        const network2::ResolvedAddress to( network2::Address( "::1", TestSocketReceivePort ) );
+
+        uint8_t packet[32];
+        memset( packet, 0xAB, sizeof( packet ) );
+        check( sendSocket.SendPacket( to, packet, sizeof( packet ) ) );
+
+        network2::ResolvedAddress from;
+        uint8_t receiveBuffer[32];
+        check( receiveSocket.ReceivePacket( from, receiveBuffer, sizeof( receiveBuffer ) ) == sizeof( packet ) );
+        check( from == network2::ResolvedAddress( network2::Address( "::1", TestSocketSendPort ) ) );
+        check( from.GetAddress() == network2::Address( "::1", TestSocketSendPort ) );
+        check( memcmp( packet, receiveBuffer, sizeof( packet ) ) == 0 );
+    }
+
+    network2::ShutdownNetwork();
+}
+
+static network2::Address test_address_map_key( int i )
+{
+    if ( i & 1 )
+        return network2::Address( 10, uint8_t( i >> 16 ), uint8_t( i >> 8 ), uint8_t( i ), uint16_t( 1000 + ( i & 7 ) ) );
+    else
+        return network2::Address( 0xfe80, 0, 0, 0, 0x202, 0xb3ff, uint16_t( i >> 16 ), uint16_t( i ), uint16_t( 2000 + ( i & 7 ) ) );
+}
+
+static void test_address_map_churn( network2::AddressMap<int> & map, int numIterations )
+{
+    // random inserts and removes, checked against a plain array
+
+    const int Capacity = map.GetCapacity();
+    const int NumKeys = Capacity * 4;
+
+    bool * present = new bool[NumKeys];
+    memset( present, 0, NumKeys );
+
+    int numPresent = map.GetNumEntries();
+    check( numPresent == 0 );
+
+    for ( int i = 0; i < numIterations; ++i )
+    {
+        const int key = rand() % NumKeys;
+
+        if ( present[key] )
+        {
+            check( map.Remove( test_address_map_key( key ) ) );
+            check( !map.Remove( test_address_map_key( key ) ) );
+            present[key] = false;
+            numPresent--;
+        }
+        else if ( numPresent < Capacity )
+        {
+            check( map.Insert( test_address_map_key( key ), key ) );
+            present[key] = true;
+            numPresent++;
+        }
+        check( map.GetNumEntries() == numPresent );
+    }
+
+    for ( int i = 0; i < NumKeys; ++i )
+    {
+        const int * value = map.Find( test_address_map_key( i ) );
+        check( present[i] == ( value != NULL ) );
+        if ( value )
+            check( *value == i );
+    }
+
+    delete [] present;
+}
+
+void test_address_map()
+{
+    printf( "test_address_map\n" );
+
+    // hash covers type, address and port
+
+    {
+        const network2::Address a( 127, 0, 0, 1, 40000 );
+        const network2::Address b( "127.0.0.1:40000" );
+        check( network2::HashAddress( a ) == network2::HashAddress( b ) );
+        check( network2::HashAddress( a ) != network2::HashAddress( network2::Address( 127, 0, 0, 1, 40001 ) ) );
+        check( network2::HashAddress( a ) != network2::HashAddress( network2::Address( 127, 0, 0, 2, 40000 ) ) );
+        check( network2::HashAddress( a ) != network2::HashAddress( network2::Address( "::1", 40000 ) ) );
+        check( network2::HashAddress( a, 1 ) != network2::HashAddress( a, 2 ) );
+        check( network2::HashAddress( network2::Address( "::1", 40000 ) ) == network2::HashAddress( network2::Address( "[::1]:40000" ) ) );
+    }
+
+    // fill to capacity
+
+    const int Capacity = 1000;
+
+    network2::AddressMap<int> map( Capacity );
+
+    check( map.GetCapacity() == Capacity );
+    check( map.GetNumEntries() == 0 );
+
+    for ( int i = 0; i < Capacity; ++i )
+        check( map.Insert( test_address_map_key( i ), i ) );
+
+    check( map.GetNumEntries() == Capacity );
+    check( !map.Insert( test_address_map_key( Capacity ), Capacity ) );
+
+    for ( int i = 0; i < Capacity; ++i )
+    {
+        const int * value = map.Find( test_address_map_key( i ) );
+        check( value && *value == i );
+    }
+
+    check( map.Find( test_address_map_key( Capacity ) ) == NULL );
+
+    // replacing an existing entry works when full
+
+    check( map.Insert( test_address_map_key( 5 ), -5 ) );
+    check( *map.Find( test_address_map_key( 5 ) ) == -5 );
+    check( map.GetNumEntries() == Capacity );
+
+    map.Clear();
+    check( map.GetNumEntries() == 0 );
+    check( map.Find( test_address_map_key( 0 ) ) == NULL );
+
+    // churn at low load, and at the 7/8 load limit where groups fill up, leave deleted slots and force rebuilds
+
+    test_address_map_churn( map, 100000 );
+
+    network2::AddressMap<int> fullMap( 2048 - 2048 / 8 );
+    test_address_map_churn( fullMap, 100000 );
+}
+
+static uint8_t * test_simulator_packet( int index )
+{
+    uint8_t * packetData = new uint8_t[4];
+    memcpy( packetData, &index, 4 );
+    return packetData;
+}
+
+static int test_simulator_packet_index( uint8_t * packetData )
+{
+    int index;
+    memcpy( &index, packetData, 4 );
+    delete [] packetData;
+    return index;
+}
 
-        check( strcmp( address.ToString( buffer, 256 ), "fe80::202:b3ff:fe1e:8329" ) == 0 );
-    }
+void test_simulator()
+{
+    printf( "test_simulator\n" );
 
-    {
-        const uint16_t address6[] = { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0001 };
+    const network2::Address from( 127, 0, 0, 1, 40000 );
+    const network2::Address to( 127, 0, 0, 1, 40001 );
 
-        network2::Address address( address6 );
+    network2::Address packetFrom[64];
+    network2::Address packetTo[64];
+    uint8_t * packetData[64];
+    int packetSize[64];
 
-        check( address.IsValid() );
-        check( address.GetType() == network2::ADDRESS_IPV6 );
-        check( address.GetPort() == 0 );
+    // packets are held until their delivery time, then delivered in the order sent
 
-        for ( int i = 0; i < 8; ++i )
-            check( htons( address6[i] ) == address.GetAddress6()[i] );
+    {
+        network2::Simulator simulator( 64 );
+        simulator.SetLatency( 100.0f );
 
-        check( strcmp( address.ToString( buffer, 256 ), "::1" ) == 0 );
-    }
+        for ( int i = 0; i < 10; ++i )
+            simulator.SendPacket( from, to, test_simulator_packet( i ), 4 );
 
-    // same addresses but with port numbers
+        check( simulator.GetNumPacketsInFlight() == 10 );
 
-    {
-        const uint16_t address6[] = { 0xFE80, 0x0000, 0x0000, 0x0000, 0x0202, 0xB3FF, 0xFE1E, 0x8329 };
+        simulator.Update( 0.05 );
+        check( simulator.ReceivePacket( packetFrom[0], packetTo[0], packetSize[0] ) == NULL );
+        check( simulator.ReceivePackets( packetFrom, packetTo, packetData, packetSize, 64 ) == 0 );
 
-        network2::Address address( address6[0], address6[1], address6[2], address6[2],
-                                  address6[4], address6[5], address6[6], address6[7], 65535 );
+        simulator.Update( 0.1 );
 
-        check( address.IsValid() );
-        check( address.GetType() == network2::ADDRESS_IPV6 );
-        check( address.GetPort() == 65535 );
+        uint8_t * first = simulator.ReceivePacket( packetFrom[0], packetTo[0], packetSize[0] );
+        check( first );
+        check( packetFrom[0] == from );
+        check( packetTo[0] == to );
+        check( packetSize[0] == 4 );
+        check( test_simulator_packet_index( first ) == 0 );
 
-        for ( int i = 0; i < 8; ++i )
-            check( htons( address6[i] ) == address.GetAddress6()[i] );
+        check( simulator.ReceivePackets( packetFrom, packetTo, packetData, packetSize, 4 ) == 4 );
+        check( simulator.ReceivePackets( packetFrom + 4, packetTo + 4, packetData + 4, packetSize + 4, 64 ) == 5 );
+        for ( int i = 0; i < 9; ++i )
+        {
+            check( packetFrom[i] == from );
+            check( packetTo[i] == to );
+            check( packetSize[i] == 4 );
+            check( test_simulator_packet_index( packetData[i] ) == i + 1 );
+        }
 
-        check( strcmp( address.ToString( buffer, 256 ), "[fe80::202:b3ff:fe1e:8329]:65535" ) == 0 );
+        check( simulator.GetNumPacketsInFlight() == 0 );
+        check( simulator.ReceivePackets( packetFrom, packetTo, packetData, packetSize, 64 ) == 0 );
     }
 
+    // with jitter, nothing arrives before the earliest delivery time and every packet arrives by the latest
+
     {
-        const uint16_t address6[] = { 0xFE80, 0x0000, 0x0000, 0x0000, 0x0202, 0xB3FF, 0xFE1E, 0x8329 };
+        const int NumPackets = 1000;
 
-        network2::Address address( address6, 65535 );
+        network2::Simulator simulator( NumPackets );
+        simulator.SetLatency( 100.0f );
+        simulator.SetJitter( 50.0f );
 
-        check( address.IsValid() );
-        check( address.GetType() == network2::ADDRESS_IPV6 );
-        check( address.GetPort() == 65535 );
+        for ( int i = 0; i < NumPackets; ++i )
+            simulator.SendPacket( from, to, test_simulator_packet( i ), 4 );
 
-        for ( int i = 0; i < 8; ++i )
-            check( htons( address6[i] ) == address.GetAddress6()[i] );
+        simulator.Update( 0.049 );
+        check( simulator.ReceivePackets( packetFrom, packetTo, packetData, packetSize, 64 ) == 0 );
 
-        check( strcmp( address.ToString( buffer, 256 ), "[fe80::202:b3ff:fe1e:8329]:65535" ) == 0 );
+        int numReceived = 0;
+        for ( int step = 0; step <= 100; ++step )
+        {
+            simulator.Update( 0.05 + step * 0.001 );
+            int numPackets;
+            while ( ( numPackets = simulator.ReceivePackets( packetFrom, packetTo, packetData, packetSize, 64 ) ) > 0 )
+            {
+                for ( int i = 0; i < numPackets; ++i )
+                    test_simulator_packet_index( packetData[i] );
+                numReceived += numPackets;
+            }
+            check( simulator.GetNumPacketsInFlight() == NumPackets - numReceived );
+        }
+
+        check( numReceived == NumPackets );
     }
 
-    {
-        const uint16_t address6[] = { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0001 };
+    // when full, the oldest packet sent is dropped to make room
 
-        network2::Address address( address6, 65535 );
+    {
+        network2::Simulator simulator( 16 );
 
-        check( address.IsValid() );
-        check( address.GetType() == network2::ADDRESS_IPV6 );
-        check( address.GetPort() == 65535 );
+        for ( int i = 0; i < 20; ++i )
+            simulator.SendPacket( from, to, test_simulator_packet( i ), 4 );
 
-        for ( int i = 0; i < 8; ++i )
-            check( htons( address6[i] ) == address.GetAddress6()[i] );
+        check( simulator.GetNumPacketsInFlight() == 16 );
 
-        check( strcmp( address.ToString( buffer, 256 ), "[::1]:65535" ) == 0 );
+        check( simulator.ReceivePackets( packetFrom, packetTo, packetData, packetSize, 64 ) == 16 );
+        for ( int i = 0; i < 16; ++i )
+            check( test_simulator_packet_index( packetData[i] ) == i + 4 );
     }
 
-    // parse addresses from strings (no ports)
+    // duplicates and packet loss
 
     {
-        network2::Address address( "fe80::202:b3ff:fe1e:8329" );
-        check( address.IsValid() );
-        check( address.GetType() == network2::ADDRESS_IPV6 );
-        check( address.GetPort() == 0 );
-        check( strcmp( address.ToString( buffer, 256 ), "fe80::202:b3ff:fe1e:8329" ) == 0 );
-    }
+        network2::Simulator simulator( 64 );
+        simulator.SetDuplicates( 100.0f );
 
-    {
-        network2::Address address( "::1" );
-        check( address.IsValid() );
-        check( address.GetType() == network2::ADDRESS_IPV6 );
-        check( address.GetPort() == 0 );
-        check( strcmp( address.ToString( buffer, 256 ), "::1" ) == 0 );
-    }
+        for ( int i = 0; i < 10; ++i )
+            simulator.SendPacket( from, to, test_simulator_packet( i ), 4 );
 
-    // parse addresses from strings (with ports)
+        check( simulator.GetNumPacketsInFlight() == 20 );
 
-    {
-        network2::Address address( "[fe80::202:b3ff:fe1e:8329]:65535" );
-        check( address.IsValid() );
-        check( address.GetType() == network2::ADDRESS_IPV6 );
-        check( address.GetPort() == 65535 );
-        check( strcmp( address.ToString( buffer, 256 ), "[fe80::202:b3ff:fe1e:8329]:65535" ) == 0 );
-    }
+        simulator.Update( 1.0 );
 
-    {
-        network2::Address address( "[::1]:65535" );
-        check( address.IsValid() );
-        check( address.GetType() == network2::ADDRESS_IPV6 );
-        check( address.GetPort() == 65535 );
-        check( strcmp( address.ToString( buffer, 256 ), "[::1]:65535" ) == 0 );
+        check( simulator.ReceivePackets( packetFrom, packetTo, packetData, packetSize, 64 ) == 20 );
+        int count[10];
+        memset( count, 0, sizeof( count ) );
+        for ( int i = 0; i < 20; ++i )
+            count[test_simulator_packet_index( packetData[i] )]++;
+        for ( int i = 0; i < 10; ++i )
+            check( count[i] == 2 );
+
+        simulator.SetDuplicates( 0.0f );
+        simulator.SetPacketLoss( 100.0f );
+
+        for ( int i = 0; i < 10; ++i )
+            simulator.SendPacket( from, to, test_simulator_packet( i ), 4 );
+
+        check( simulator.GetNumPacketsInFlight() == 0 );
     }
 }
 
@@ -595,6 +2297,99 @@ struct TestPacketData
     uint32_t sequence : 16;                 // packet sequence #
 };
 
+void test_bit_array()
+{
+    printf( "test_bit_array\n" );
+
+    const int sizes[] = { 1, 63, 64, 65, 200, 256, 1000 };
+
+    for ( int i = 0; i < (int) ( sizeof( sizes ) / sizeof( int ) ); ++i )
+    {
+        const int size = sizes[i];
+
+        protocol2::BitArray bit_array( size );
+
+        bool * reference = new bool[size];
+        memset( reference, 0, size );
+
+        check( bit_array.CountSet() == 0 );
+        check( bit_array.FindFirstClear( 0 ) == 0 );
+        check( bit_array.FindNextSet( 0 ) == -1 );
+
+        bit_array.SetRange( 0, size );
+        check( bit_array.CountSet() == size );
+        check( bit_array.FindFirstClear( 0 ) == -1 );
+        bit_array.ClearRange( 0, size );
+        check( bit_array.CountSet() == 0 );
+
+        for ( int j = 0; j < 256; ++j )
+        {
+            int begin = rand() % ( size + 1 );
+            int end = rand() % ( size + 1 );
+            if ( begin > end )
+                protocol2::swap( begin, end );
+
+            const bool set = ( rand() % 2 ) != 0;
+            if ( set )
+                bit_array.SetRange( begin, end );
+            else
+                bit_array.ClearRange( begin, end );
+            for ( int k = begin; k < end; ++k )
+                reference[k] = set;
+
+            int count = 0;
+            for ( int k = 0; k < size; ++k )
+            {
+                check( ( bit_array.GetBit( k ) != 0 ) == reference[k] );
+                count += reference[k];
+            }
+            check( bit_array.CountSet() == count );
+
+            const int from = rand() % ( size + 1 );
+
+            int first_clear = -1;
+            for ( int k = from; k < size; ++k )
+            {
+                if ( !reference[k] )
+                {
+                    first_clear = k;
+                    break;
+                }
+            }
+            check( bit_array.FindFirstClear( from ) == first_clear );
+
+            int next_set = -1;
+            for ( int k = from; k < size; ++k )
+            {
+                if ( reference[k] )
+                {
+                    next_set = k;
+                    break;
+                }
+            }
+            check( bit_array.FindNextSet( from ) == next_set );
+        }
+
+        for ( int j = 0; j < 32; ++j )
+        {
+            const int count = rand() % ( size + 2 );
+            bit_array.ShiftUp( count );
+            for ( int k = size - 1; k >= 0; --k )
+                reference[k] = ( k >= count ) ? reference[k-count] : false;
+            for ( int k = 0; k < size; ++k )
+                check( ( bit_array.GetBit( k ) != 0 ) == reference[k] );
+            if ( j % 4 == 0 )
+            {
+                bit_array.SetRange( 0, size );
+                for ( int k = 0; k < size; ++k )
+                    reference[k] = true;
+            }
+        }
+
+        delete [] reference;
+    }
+}
+
 void test_sequence_buffer()
 {
     printf( "test_sequence_buffer\n" );
@@ -671,6 +2466,357 @@ void test_generate_ack_bits()
     check( ack_bits == ( 1 | (1<<(11-9)) | (1<<(11-5)) | (1<<(11-1)) ) );
 }
 
+static void test_sequence_buffer_ack_bits_size( int size )
+{
+    protocol2::SequenceBuffer<TestPacketData> received_packets( size );
+
+    uint16_t sequence = 65000;                              // wraps the 16 bit sequence during the test
+
+    for ( int i = 0; i < 4096; ++i )
+    {
+        sequence += 1 + ( rand() % 3 );
+        if ( rand() % 4 )
+            received_packets.Insert( sequence );
+
+        if ( ( rand() % 8 ) == 0 )
+            received_packets.Remove( sequence - ( rand() % 32 ) );
+
+        const uint16_t ack = ( rand() % 4 ) ? received_packets.GetSequence() - 1 : sequence - ( rand() % 64 );
+
+        uint32_t expected_ack_bits = 0;
+        for ( int j = 0; j < 32; ++j )
+        {
+            if ( received_packets.Find( ack - j ) )
+                expected_ack_bits |= uint32_t(1) << j;
+        }
+
+        check( received_packets.GetAckBits( ack ) == expected_ack_bits );
+    }
+}
+
+void test_sequence_buffer_ack_bits()
+{
+    printf( "test_sequence_buffer_ack_bits\n" );
+
+    check( protocol2::reverse_bits( 1 ) == 0x80000000 );
+    check( protocol2::reverse_bits( 0x0000FFFF ) == 0xFFFF0000 );
+    check( protocol2::reverse_bits( 0x12345678 ) == 0x1E6A2C48 );
+
+    uint16_t sequences[32];
+    for ( int i = 0; i < 32; ++i )
+        sequences[i] = uint16_t( 65530 + i );
+    check( protocol2::sequence_match_mask( sequences, 65530 ) == 0xFFFFFFFF );
+    sequences[0] = 0;
+    sequences[17] = 0;
+    check( protocol2::sequence_match_mask( sequences, 65530 ) == ~( uint32_t(1) | ( uint32_t(1) << 17 ) ) );
+
+    test_sequence_buffer_ack_bits_size( 256 );
+    test_sequence_buffer_ack_bits_size( 64 );
+    test_sequence_buffer_ack_bits_size( 100 );              // not a power of two: takes the fallback path
+}
+
+template <int N> void test_sequence_buffer_fixed_size()
+{
+    // the fixed size buffer must behave exactly like the runtime sized buffer under the same operations
+
+    protocol2::SequenceBuffer<TestPacketData> reference( N );
+    protocol2::SequenceBuffer<TestPacketData, N> sequence_buffer;
+
+    check( sequence_buffer.GetSize() == N );
+
+    uint16_t sequence = 65000;
+
+    for ( int i = 0; i < 4096; ++i )
+    {
+        sequence += 1 + ( rand() % 3 );
+
+        const uint16_t insert_sequence = ( rand() % 8 ) ? sequence : uint16_t( sequence - ( rand() % ( N * 2 ) ) );
+        TestPacketData * reference_entry = reference.Insert( insert_sequence );
+        TestPacketData * entry = sequence_buffer.Insert( insert_sequence );
+        check( ( reference_entry != NULL ) == ( entry != NULL ) );
+        if ( entry )
+            entry->sequence = insert_sequence;
+
+        if ( ( rand() % 8 ) == 0 )
+        {
+            const uint16_t remove_sequence = sequence - ( rand() % 32 );
+            reference.Remove( remove_sequence );
+            sequence_buffer.Remove( remove_sequence );
+        }
+
+        check( sequence_buffer.GetSequence() == reference.GetSequence() );
+
+        const uint16_t ack = sequence_buffer.GetSequence() - 1 - ( rand() % 8 );
+        check( sequence_buffer.GetAckBits( ack ) == reference.GetAckBits( ack ) );
+
+        for ( int j = 0; j < 8; ++j )
+        {
+            const uint16_t find_sequence = sequence - ( rand() % ( N * 2 ) );
+            const TestPacketData * found = sequence_buffer.Find( find_sequence );
+            check( ( found != NULL ) == ( reference.Find( find_sequence ) != NULL ) );
+            check( !found || found->sequence == find_sequence );
+            check( sequence_buffer.IsAvailable( find_sequence ) == reference.IsAvailable( find_sequence ) );
+        }
+    }
+
+    sequence_buffer.Reset();
+
+    check( sequence_buffer.GetSequence() == 0 );
+
+    for ( int i = 0; i < N; ++i )
+        check( sequence_buffer.GetAtIndex( i ) == NULL );
+}
+
+void test_sequence_buffer_fixed()
+{
+    printf( "test_sequence_buffer_fixed\n" );
+
+    test_sequence_buffer_fixed_size<256>();
+    test_sequence_buffer_fixed_size<64>();
+    test_sequence_buffer_fixed_size<32>();                  // smaller than a word: GetAckBits takes the fallback path
+}
+
+template <typename Buffer> void test_sequence_buffer_eviction( Buffer & sequence_buffer )
+{
+    // after every insert, each entry in the buffer must be inside the window [sequence - size, sequence)
+
+    const int size = sequence_buffer.GetSize();
+
+    uint16_t sequence = 65000;
+
+    for ( int i = 0; i < 2048; ++i )
+    {
+        const int r = rand() % 16;
+        sequence += ( r == 0 ) ? ( rand() % ( size * 2 ) ) : ( r < 4 ) ? ( rand() % ( size / 2 ) ) : 1;
+
+        TestPacketData * entry = sequence_buffer.Insert( sequence );
+        check( entry );
+        entry->sequence = sequence;
+
+        const uint16_t oldest_sequence = sequence_buffer.GetSequence() - size;
+        int num_entries = 0;
+        for ( int j = 0; j < size; ++j )
+        {
+            TestPacketData * data = sequence_buffer.GetAtIndex( j );
+            if ( !data )
+                continue;
+            check( !protocol2::sequence_less_than( uint16_t( data->sequence ), oldest_sequence ) );
+            check( protocol2::sequence_less_than( uint16_t( data->sequence ), sequence_buffer.GetSequence() ) );
+            check( sequence_buffer.Find( data->sequence ) == data );
+            num_entries++;
+        }
+        check( num_entries > 0 );
+    }
+}
+
+static void test_sequence_buffer_wrap( int size )
+{
+    // inserts across the 65535 -> 0 wrap. sizes that don't divide 65536 have a jump in slot index there,
+    // so check that no sequence that has left the window can still be found after every insert
+
+    protocol2::SequenceBuffer<TestPacketData> sequence_buffer( size );
+
+    static bool inserted[65536];
+    memset( inserted, 0, sizeof( inserted ) );
+
+    const uint16_t first_sequence = uint16_t( 65536 - 3 * size );
+    uint16_t sequence = first_sequence;
+
+    for ( int advance = 0; advance < 6 * size; )
+    {
+        TestPacketData * entry = sequence_buffer.Insert( sequence );
+        check( entry );
+        entry->sequence = sequence;
+        inserted[sequence] = true;
+
+        const uint16_t oldest_sequence = uint16_t( sequence_buffer.GetSequence() - size );
+
+        if ( protocol2::sequence_less_than( first_sequence, oldest_sequence ) )
+        {
+            for ( uint16_t s = first_sequence; s != oldest_sequence; ++s )
+                check( sequence_buffer.Find( s ) == NULL );
+        }
+
+        for ( uint16_t s = oldest_sequence; s != sequence_buffer.GetSequence(); ++s )
+            check( ( sequence_buffer.Find( s ) != NULL ) == inserted[s] );
+
+        const int gap = ( rand() % 10 ) ? 1 + rand() % 4 : 1 + rand() % size;
+        sequence += uint16_t( gap );
+        advance += gap;
+    }
+}
+
+void test_sequence_buffer_remove_old_entries()
+{
+    printf( "test_sequence_buffer_remove_old_entries\n" );
+
+    {
+        protocol2::SequenceBuffer<TestPacketData> sequence_buffer( 256 );
+        test_sequence_buffer_eviction( sequence_buffer );
+    }
+
+    {
+        protocol2::SequenceBuffer<TestPacketData> sequence_buffer( 100 );
+        test_sequence_buffer_eviction( sequence_buffer );
+    }
+
+    {
+        protocol2::SequenceBuffer<TestPacketData,256> sequence_buffer;
+        test_sequence_buffer_eviction( sequence_buffer );
+    }
+
+    {
+        protocol2::SequenceBuffer<TestPacketData,32> sequence_buffer;
+        test_sequence_buffer_eviction( sequence_buffer );
+    }
+
+    test_sequence_buffer_wrap( 100 );
+    test_sequence_buffer_wrap( 1000 );
+    test_sequence_buffer_wrap( 256 );
+}
+
+void test_extended_ack_bits()
+{
+    printf( "test_extended_ack_bits\n" );
+
+    const int sizes[] = { 32, 64, 128, 256 };
+
+    for ( int i = 0; i < (int) ( sizeof( sizes ) / sizeof( int ) ); ++i )
+    {
+        const int size = sizes[i];
+
+        protocol2::SequenceBuffer<TestPacketData,256> received_packets;
+        protocol2::BitArray ack_bits( size );
+
+        // read into inline storage, the way connection packets hold their ack bits
+
+        uint64_t read_ack_words[4];
+        memset( read_ack_words, 0xFF, sizeof( read_ack_words ) );
+        protocol2::BitArray read_ack_bits( read_ack_words, size );
+        check( read_ack_bits.CountSet() == 0 );
+
+        uint16_t sequence = 65000;
+
+        for ( int j = 0; j < 1000; ++j )
+        {
+            // bursty loss: mostly received, sometimes runs of loss, sometimes heavy loss
+
+            const int loss = ( j % 200 ) < 150 ? 2 : 50;
+            sequence++;
+            if ( ( rand() % 100 ) >= loss )
+                received_packets.Insert( sequence );
+            if ( ( rand() % 100 ) == 0 )
+                sequence += rand() % 8;
+
+            uint16_t ack;
+            protocol2::GenerateAckBits( received_packets, ack, ack_bits );
+            check( ack == uint16_t( received_packets.GetSequence() - 1 ) );
+            for ( int k = 0; k < size; ++k )
+                check( ( ack_bits.GetBit( k ) != 0 ) == ( received_packets.Find( ack - k ) != NULL ) );
+
+            uint8_t buffer[64];
+
+            protocol2::WriteStream writeStream( buffer, sizeof( buffer ) );
+            check( protocol2::serialize_ack_bits_internal( writeStream, ack_bits ) );
+            writeStream.Flush();
+            check( writeStream.GetBitsProcessed() <= size + 1 );
+
+            protocol2::ReadStream readStream( buffer, sizeof( buffer ) );
+            read_ack_bits.ClearRange( 0, size );
+            check( protocol2::serialize_ack_bits_internal( readStream, read_ack_bits ) );
+            check( readStream.GetBitsProcessed() == writeStream.GetBitsProcessed() );
+
+            for ( int k = 0; k < read_ack_bits.GetNumWords(); ++k )
+            {
+                check( read_ack_bits.GetWord( k ) == ack_bits.GetWord( k ) );
+                check( read_ack_words[k] == ack_bits.GetWord( k ) );
+            }
+        }
+    }
+
+    // a full window with a single lost packet is a handful of bits, not the whole window
+
+    protocol2::BitArray ack_bits( 256 );
+    ack_bits.SetRange( 0, 256 );
+    ack_bits.ClearBit( 100 );
+
+    uint8_t buffer[64];
+    protocol2::WriteStream writeStream( buffer, sizeof( buffer ) );
+    check( protocol2::serialize_ack_bits_internal( writeStream, ack_bits ) );
+    check( writeStream.GetBitsProcessed() < 32 );
+}
+
+void test_classify_sequences()
+{
+    printf( "test_classify_sequences\n" );
+
+    const int MaxSequences = 100;
+
+    uint16_t sequences[MaxSequences];
+    uint8_t classes[MaxSequences];
+
+    const int window_sizes[] = { 1, 64, 256, 1000, 32768 };
+
+    for ( int iteration = 0; iteration < 1000; ++iteration )
+    {
+        const uint16_t window_start = uint16_t( rand() );
+        const int window_size = window_sizes[iteration % ( sizeof( window_sizes ) / sizeof( int ) )];
+        const uint16_t window_end = window_start + window_size - 1;
+        const int num_sequences = rand() % ( MaxSequences + 1 );
+
+        for ( int i = 0; i < num_sequences; ++i )
+        {
+            // mostly near the window edges, where the wrap and boundary cases are
+
+            switch ( rand() % 4 )
+            {
+                case 0: sequences[i] = uint16_t( rand() ); break;
+                case 1: sequences[i] = window_start + ( rand() % 64 ) - 32; break;
+                case 2: sequences[i] = window_end + ( rand() % 64 ) - 32; break;
+                default: sequences[i] = window_start + 32768 + ( rand() % 64 ) - 32; break;
+            }
+        }
+
+        protocol2::ClassifySequences( sequences, num_sequences, window_start, window_size, classes );
+
+        for ( int i = 0; i < num_sequences; ++i )
+        {
+            uint8_t expected = PROTOCOL2_SEQUENCE_IN_WINDOW;
+            if ( protocol2::sequence_less_than( sequences[i], window_start ) )
+                expected = PROTOCOL2_SEQUENCE_TOO_OLD;
+            else if ( protocol2::sequence_greater_than( sequences[i], window_end ) )
+                expected = PROTOCOL2_SEQUENCE_TOO_NEW;
+            check( classes[i] == expected );
+        }
+    }
+
+    // sequences already in the buffer are duplicates
+
+    protocol2::SequenceBuffer<TestPacketData,256> received_packets;
+
+    for ( int i = 0; i < 64; ++i )
+    {
+        sequences[i] = uint16_t( 65500 + i );
+        if ( i % 3 == 0 )
+            received_packets.Insert( sequences[i] );
+    }
+
+    protocol2::ClassifySequences( received_packets, sequences, 64, 65520, 32, classes );
+
+    for ( int i = 0; i < 64; ++i )
+    {
+        const uint16_t offset = sequences[i] - 65520;
+        if ( offset >= 32768 )
+            check( classes[i] == PROTOCOL2_SEQUENCE_TOO_OLD );
+        else if ( offset >= 32 )
+            check( classes[i] == PROTOCOL2_SEQUENCE_TOO_NEW );
+        else if ( i % 3 == 0 )
+            check( classes[i] == PROTOCOL2_SEQUENCE_DUPLICATE );
+        else
+            check( classes[i] == PROTOCOL2_SEQUENCE_IN_WINDOW );
+    }
+}
+
 void test_packet_sequence()
 {
     printf( "test_packet_sequence\n" );
@@ -713,16 +2859,117 @@ void test_packet_sequence()
     }
 }
 
+static void reference_compress_packet_sequence( uint64_t sequence, uint8_t & prefix_byte, int & num_sequence_bytes, uint8_t * sequence_bytes )
+{
+    prefix_byte = 0;
+    num_sequence_bytes = 0;
+    for ( int i = 7; i > 0; --i )
+    {
+        const uint8_t current_sequence_byte = uint8_t( sequence >> (i*8) );
+        if ( current_sequence_byte != 0 )
+        {
+            sequence_bytes[num_sequence_bytes++] = current_sequence_byte;
+            prefix_byte |= ( 1 << (i-1) );
+        }
+    }
+    sequence_bytes[num_sequence_bytes++] = (uint8_t) ( sequence & 0xFF );
+}
+
+void test_packet_sequence_batch()
+{
+    printf( "test_packet_sequence_batch\n" );
+
+    const int NumPackets = 256;
+
+    uint64_t sequences[NumPackets];
+    uint8_t prefix_bytes[NumPackets];
+    int num_sequence_bytes[NumPackets];
+    uint8_t buffers[NumPackets][8];
+    uint8_t * sequence_bytes[NumPackets];
+    const uint8_t * const_sequence_bytes[NumPackets];
+    uint64_t decoded_sequences[NumPackets];
+
+    for ( int iteration = 0; iteration < 64; ++iteration )
+    {
+        for ( int i = 0; i < NumPackets; ++i )
+        {
+            // random bytes, each zero half the time, so every prefix pattern shows up
+
+            uint64_t sequence = 0;
+            for ( int j = 0; j < 8; ++j )
+            {
+                if ( rand() % 2 )
+                    sequence |= uint64_t( 1 + rand() % 255 ) << ( j * 8 );
+            }
+            sequences[i] = sequence;
+            sequence_bytes[i] = buffers[i];
+            const_sequence_bytes[i] = buffers[i];
+        }
+
+        protocol2::CompressPacketSequences( NumPackets, sequences, prefix_bytes, num_sequence_bytes, sequence_bytes );
+
+        for ( int i = 0; i < NumPackets; ++i )
+        {
+            uint8_t expected_prefix_byte;
+            int expected_num_sequence_bytes;
+            uint8_t expected_sequence_bytes[8];
+            reference_compress_packet_sequence( sequences[i], expected_prefix_byte, expected_num_sequence_bytes, expected_sequence_bytes );
+
+            check( prefix_bytes[i] == expected_prefix_byte );
+            check( num_sequence_bytes[i] == expected_num_sequence_bytes );
+            check( memcmp( buffers[i], expected_sequence_bytes, expected_num_sequence_bytes ) == 0 );
+
+            // the high bit of the prefix byte is free for the caller (008 uses it as the encrypted flag)
+
+            check( protocol2::GetPacketSequenceBytes( prefix_bytes[i] ) == num_sequence_bytes[i] );
+            check( protocol2::GetPacketSequenceBytes( prefix_bytes[i] | 0x80 ) == num_sequence_bytes[i] );
+            check( protocol2::DecompressPacketSequence( prefix_bytes[i] | 0x80, buffers[i] ) == sequences[i] );
+        }
+
+        protocol2::DecompressPacketSequences( NumPackets, prefix_bytes, const_sequence_bytes, decoded_sequences );
+
+        for ( int i = 0; i < NumPackets; ++i )
+            check( decoded_sequences[i] == sequences[i] );
+    }
+}
+
 int main()
 {
     test_bitpacker();   
+    test_bitpacker64();
+    test_bitpacker_rollback();
+    test_bitpacker_bytes_view();
+    test_crc32();
     test_stream();
+    test_serialize_bits64();
     test_packets();
+    test_pooled_packet_factory();
+    test_read_packet_arena();
+    test_read_packet_max_bits();
+    test_read_packet_max_bits_underestimated();
+    test_packet_crc32_seed();
+    test_write_stream_checkpoint();
+    test_aggregate_packet();
     test_address_ipv4();
     test_address_ipv6();
+    test_socket_batch();
+    test_socket_segments();
+    test_socket_group();
+    test_io_uring_socket();
+    test_socket_poller();
+    test_resolved_address();
+    test_address_map();
+    test_simulator();
+    test_bit_array();
     test_sequence_buffer();
     test_generate_ack_bits();
+    test_sequence_buffer_ack_bits();
+    test_sequence_buffer_fixed();
+    test_sequence_buffer_remove_old_entries();
+    test_extended_ack_bits();
+    test_classify_sequences();
     test_packet_sequence();
+    test_packet_sequence_batch();
     
     return 0;
 }